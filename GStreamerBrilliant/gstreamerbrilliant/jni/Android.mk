@@ -2,9 +2,11 @@ LOCAL_PATH := $(call my-dir)
 
 include $(CLEAR_VARS)
 
+include $(LOCAL_PATH)/sources.mk
+
 LOCAL_MODULE    := gstreamer
-LOCAL_SRC_FILES := gstreamer_brilliant_android.c brilliant_rtsp_backend.c brilliant_custom_rtp_backend.c dummy.cpp
-LOCAL_C_INCLUDES := gstreamer_brilliant_android.h brilliant_rtsp_backend.h brilliant_custom_rtp_backend.h
+LOCAL_SRC_FILES := gstreamer_brilliant_android.c $(BRILLIANT_CORE_SRC_FILES) dummy.cpp
+LOCAL_C_INCLUDES := $(BRILLIANT_CORE_HEADERS)
 LOCAL_SHARED_LIBRARIES := gstreamer_android
 LOCAL_LDLIBS := -llog -landroid
 include $(BUILD_SHARED_LIBRARY)
@@ -29,7 +31,20 @@ endif
 
 GSTREAMER_NDK_BUILD_PATH  := $(GSTREAMER_ROOT)/share/gst-android/ndk-build/
 include $(GSTREAMER_NDK_BUILD_PATH)/plugins.mk
-GSTREAMER_PLUGINS         := $(GSTREAMER_PLUGINS_CORE) $(GSTREAMER_PLUGINS_PLAYBACK) $(GSTREAMER_PLUGINS_EFFECTS) $(GSTREAMER_PLUGINS_CODECS) $(GSTREAMER_PLUGINS_CODECS_RESTRICTED) $(GSTREAMER_PLUGINS_NET) $(GSTREAMER_PLUGINS_SYS)
+GSTREAMER_PLUGIN_SETS     := $(GSTREAMER_PLUGINS_CORE) $(GSTREAMER_PLUGINS_PLAYBACK) $(GSTREAMER_PLUGINS_EFFECTS) $(GSTREAMER_PLUGINS_CODECS) $(GSTREAMER_PLUGINS_CODECS_RESTRICTED) $(GSTREAMER_PLUGINS_NET) $(GSTREAMER_PLUGINS_SYS)
+# Every linked plugin is registered at library init, so only link the ones the rtsp and
+# custom_rtp pipelines use (see the factory lists in brilliant_plugins.c). Names the installed
+# GStreamer does not have are skipped. Build with BRILLIANT_ALL_PLUGINS=1 to link the full sets.
+BRILLIANT_PLUGINS         := coreelements typefindfunctions playback autodetect autoconvert \
+                             videoconvert videoconvertscale videoscale videofilter \
+                             audioconvert audioresample audiofx volume app udp rtp rtpmanager rtsp srtp \
+                             videoparsersbad audioparsers libav androidmedia opengl opensles \
+                             alaw mulaw opus
+ifeq ($(BRILLIANT_ALL_PLUGINS),1)
+GSTREAMER_PLUGINS         := $(GSTREAMER_PLUGIN_SETS)
+else
+GSTREAMER_PLUGINS         := $(filter $(BRILLIANT_PLUGINS),$(GSTREAMER_PLUGIN_SETS))
+endif
 G_IO_MODULES              := openssl
-GSTREAMER_EXTRA_DEPS      := gstreamer-video-1.0
+GSTREAMER_EXTRA_DEPS      := gstreamer-video-1.0 gstreamer-rtp-1.0
 include $(GSTREAMER_NDK_BUILD_PATH)/gstreamer-1.0.mk
@@ -0,0 +1,252 @@
+/*****************************************************************************
+ * GStreamerBrilliant: Android Library built with system's GStreamer Implementation. Intended for use in Brilliant Mobile App.
+ *****************************************************************************
+ * Copyright (C) 2022 Brilliant Home Technologies
+ *
+ * Authors: Brilliant iOS Team <android_developer # brilliant.tech>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+
+#include <string.h>
+#include "brilliant_alloc_tracker.h"
+
+GST_DEBUG_CATEGORY_STATIC (alloc_tracker_debug);
+#define GST_CAT_DEFAULT alloc_tracker_debug
+
+typedef struct _BrilliantAllocTracker
+{
+  GstTracer parent;
+} BrilliantAllocTracker;
+
+typedef struct _BrilliantAllocTrackerClass
+{
+  GstTracerClass parent_class;
+} BrilliantAllocTrackerClass;
+
+#define BRILLIANT_TYPE_ALLOC_TRACKER (brilliant_alloc_tracker_get_type ())
+G_DEFINE_TYPE (BrilliantAllocTracker, brilliant_alloc_tracker, GST_TYPE_TRACER);
+
+typedef struct _LiveEntry
+{
+  GType type;
+  guint64 sequence;             /* Creation order */
+  gboolean is_mini_object;
+} LiveEntry;
+
+/* Leftovers of one type, for describe */
+typedef struct _TypeTotal
+{
+  GType type;
+  gint64 count;
+  gint64 bytes;
+} TypeTotal;
+
+/* GStreamer has no way to remove tracer hooks, so a single tracer lives for the whole process */
+static BrilliantAllocTracker *tracker_instance;
+static gint tracker_enabled;
+static GMutex live_lock;
+static GHashTable *live_table;  /* object -> LiveEntry */
+static guint64 next_sequence = 1;
+
+static gint64
+entry_bytes (gpointer object, const LiveEntry *entry)
+{
+  /* Only read while the object is in the table, the destroyed hooks run before it is freed */
+  if (entry->is_mini_object && entry->type == GST_TYPE_MEMORY)
+    return ((GstMemory *) object)->maxsize;
+  return 0;
+}
+
+static void
+track (gpointer object, GType type, gboolean is_mini_object)
+{
+  if (!g_atomic_int_get (&tracker_enabled))
+    return;
+  LiveEntry *entry = g_new (LiveEntry, 1);
+  entry->type = type;
+  entry->is_mini_object = is_mini_object;
+  g_mutex_lock (&live_lock);
+  entry->sequence = next_sequence++;
+  g_hash_table_replace (live_table, object, entry);
+  g_mutex_unlock (&live_lock);
+}
+
+static void
+untrack (gpointer object)
+{
+  if (!g_atomic_int_get (&tracker_enabled))
+    return;
+  /* Objects created before accounting was enabled are not in the table */
+  g_mutex_lock (&live_lock);
+  g_hash_table_remove (live_table, object);
+  g_mutex_unlock (&live_lock);
+}
+
+static void
+object_created (GstTracer * self, GstClockTime ts, GstObject * object)
+{
+  track (object, G_OBJECT_TYPE (object), FALSE);
+}
+
+static void
+object_destroyed (GstTracer * self, GstClockTime ts, GstObject * object)
+{
+  untrack (object);
+}
+
+static void
+mini_object_created (GstTracer * self, GstClockTime ts, GstMiniObject * object)
+{
+  track (object, GST_MINI_OBJECT_TYPE (object), TRUE);
+}
+
+static void
+mini_object_destroyed (GstTracer * self, GstClockTime ts, GstMiniObject * object)
+{
+  untrack (object);
+}
+
+static void
+brilliant_alloc_tracker_class_init (BrilliantAllocTrackerClass * klass)
+{
+}
+
+static void
+brilliant_alloc_tracker_init (BrilliantAllocTracker * self)
+{
+  GstTracer *tracer = GST_TRACER (self);
+  gst_tracing_register_hook (tracer, "object-created", G_CALLBACK (object_created));
+  gst_tracing_register_hook (tracer, "object-destroyed", G_CALLBACK (object_destroyed));
+  gst_tracing_register_hook (tracer, "mini-object-created", G_CALLBACK (mini_object_created));
+  gst_tracing_register_hook (tracer, "mini-object-destroyed",
+      G_CALLBACK (mini_object_destroyed));
+}
+
+/* Start or stop accounting. Objects created while disabled are never reported. */
+void
+brilliant_alloc_tracker_set_enabled (gboolean enabled)
+{
+  g_mutex_lock (&live_lock);
+  if (!tracker_instance) {
+    GST_DEBUG_CATEGORY_INIT (alloc_tracker_debug, "brilliant-alloc-tracker", 0,
+        "Allocation accounting");
+    live_table = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+    tracker_instance = g_object_new (BRILLIANT_TYPE_ALLOC_TRACKER, NULL);
+  }
+  /* Destructions are not seen while disabled, so the table would go stale */
+  if (!enabled)
+    g_hash_table_remove_all (live_table);
+  g_atomic_int_set (&tracker_enabled, enabled);
+  g_mutex_unlock (&live_lock);
+  GST_INFO ("Allocation accounting %s", enabled ? "enabled" : "disabled");
+}
+
+gboolean
+brilliant_alloc_tracker_is_enabled (void)
+{
+  return g_atomic_int_get (&tracker_enabled);
+}
+
+/* Sequence number separating the objects created so far from the ones created afterwards */
+guint64
+brilliant_alloc_tracker_checkpoint (void)
+{
+  g_mutex_lock (&live_lock);
+  guint64 checkpoint = next_sequence - 1;
+  g_mutex_unlock (&live_lock);
+  return checkpoint;
+}
+
+/* Count the live objects created after the since checkpoint */
+void
+brilliant_alloc_tracker_get_counts (guint64 since, BrilliantAllocCounts *counts)
+{
+  memset (counts, 0, sizeof (*counts));
+  g_mutex_lock (&live_lock);
+  if (live_table) {
+    GHashTableIter iter;
+    gpointer object;
+    LiveEntry *entry;
+    g_hash_table_iter_init (&iter, live_table);
+    while (g_hash_table_iter_next (&iter, &object, (gpointer *) &entry)) {
+      if (entry->sequence <= since)
+        continue;
+      if (entry->is_mini_object)
+        counts->mini_objects++;
+      else
+        counts->objects++;
+      counts->bytes += entry_bytes (object, entry);
+    }
+  }
+  g_mutex_unlock (&live_lock);
+}
+
+static gint
+compare_type_totals (gconstpointer a, gconstpointer b)
+{
+  const TypeTotal *total_a = a;
+  const TypeTotal *total_b = b;
+  if (total_a->count != total_b->count)
+    return total_a->count > total_b->count ? -1 : 1;
+  return g_strcmp0 (g_type_name (total_a->type), g_type_name (total_b->type));
+}
+
+/* The live objects created after the since checkpoint, one "type count bytes" line per type,
+ * most frequent first. NULL if there are none. */
+gchar *
+brilliant_alloc_tracker_describe (guint64 since)
+{
+  GArray *totals = g_array_new (FALSE, FALSE, sizeof (TypeTotal));
+  g_mutex_lock (&live_lock);
+  if (live_table) {
+    GHashTableIter iter;
+    gpointer object;
+    LiveEntry *entry;
+    g_hash_table_iter_init (&iter, live_table);
+    while (g_hash_table_iter_next (&iter, &object, (gpointer *) &entry)) {
+      if (entry->sequence <= since)
+        continue;
+      TypeTotal *total = NULL;
+      for (guint i = 0; i < totals->len && !total; i++) {
+        if (g_array_index (totals, TypeTotal, i).type == entry->type)
+          total = &g_array_index (totals, TypeTotal, i);
+      }
+      if (!total) {
+        TypeTotal new_total = { entry->type, 0, 0 };
+        g_array_append_val (totals, new_total);
+        total = &g_array_index (totals, TypeTotal, totals->len - 1);
+      }
+      total->count++;
+      total->bytes += entry_bytes (object, entry);
+    }
+  }
+  g_mutex_unlock (&live_lock);
+
+  gchar *description = NULL;
+  if (totals->len > 0) {
+    g_array_sort (totals, compare_type_totals);
+    GString *text = g_string_new (NULL);
+    for (guint i = 0; i < totals->len; i++) {
+      const TypeTotal *total = &g_array_index (totals, TypeTotal, i);
+      g_string_append_printf (text, "%s %" G_GINT64_FORMAT " %" G_GINT64_FORMAT "\n",
+          g_type_name (total->type), total->count, total->bytes);
+    }
+    description = g_string_free (text, FALSE);
+  }
+  g_array_unref (totals);
+  return description;
+}
@@ -0,0 +1,53 @@
+/*****************************************************************************
+ * GStreamerBrilliant: Android Library built with system's GStreamer Implementation. Intended for use in Brilliant Mobile App.
+ *****************************************************************************
+ * Copyright (C) 2022 Brilliant Home Technologies
+ *
+ * Authors: Brilliant iOS Team <android_developer # brilliant.tech>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+
+#ifndef GSTREAMERBRILLIANT_BRILLIANT_ALLOC_TRACKER_H
+#define GSTREAMERBRILLIANT_BRILLIANT_ALLOC_TRACKER_H
+#include <gst/gst.h>
+
+/* Allocation accounting, to catch sessions that leave GStreamer objects behind.
+ *
+ * A GstTracer hooked on object and mini object creation and destruction keeps a table of every
+ * live GstObject and GstMiniObject, each stamped with a creation sequence number. A session
+ * takes a checkpoint when it is created; whatever was created after it and is still alive once
+ * the session is freed is reported, grouped by type. Bytes are the allocated size of the live
+ * GstMemory blocks.
+ *
+ * Accounting is process wide, so objects of sessions running concurrently show up in each
+ * other's counts, and the first session of the process also reports the singletons GStreamer
+ * creates lazily (system clock, default task pool). Off by default: every buffer goes through
+ * the table while enabled.
+ * */
+typedef struct _BrilliantAllocCounts
+{
+  gint64 objects;               /* Live GstObjects (elements, pads, clocks, ...) */
+  gint64 mini_objects;          /* Live GstMiniObjects (buffers, memory, caps, events, ...) */
+  gint64 bytes;                 /* Allocated size of the live GstMemory */
+} BrilliantAllocCounts;
+
+void brilliant_alloc_tracker_set_enabled (gboolean enabled);
+gboolean brilliant_alloc_tracker_is_enabled (void);
+guint64 brilliant_alloc_tracker_checkpoint (void);
+void brilliant_alloc_tracker_get_counts (guint64 since, BrilliantAllocCounts *counts);
+gchar *brilliant_alloc_tracker_describe (guint64 since);
+#endif //GSTREAMERBRILLIANT_BRILLIANT_ALLOC_TRACKER_H
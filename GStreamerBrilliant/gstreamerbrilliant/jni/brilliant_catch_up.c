@@ -0,0 +1,290 @@
+/*****************************************************************************
+ * GStreamerBrilliant: Android Library built with system's GStreamer Implementation. Intended for use in Brilliant Mobile App.
+ *****************************************************************************
+ * Copyright (C) 2022 Brilliant Home Technologies
+ *
+ * Authors: Brilliant iOS Team <android_developer # brilliant.tech>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+
+#include <string.h>
+#include "brilliant_catch_up.h"
+
+GST_DEBUG_CATEGORY_STATIC (catch_up_debug);
+#define GST_CAT_DEFAULT catch_up_debug
+
+/* Audio plays this much faster while catching up, about as fast as speech stays natural */
+#define CATCH_UP_AUDIO_RATE 1.2
+/* A track starts catching up past its target times this */
+#define CATCH_UP_ENGAGE_NUM 3
+#define CATCH_UP_ENGAGE_DEN 2
+
+typedef struct _CatchUpTrack
+{
+  GstElement *queue;            /* Its level is the buffered duration */
+  guint target_ms;
+  gboolean active;
+} CatchUpTrack;
+
+struct _BrilliantCatchUp
+{
+  GMutex lock;
+  gint64 values[BRILLIANT_CATCH_UP_STATS_FIELD_COUNT];
+  CatchUpTrack tracks[BRILLIANT_LATENCY_TRACK_COUNT];
+  /* Segment scaletempo last received, under the lock like the rest */
+  GstSegment audio_segment;
+  gboolean have_audio_segment;
+};
+
+static const BrilliantCatchUpStatsField episode_fields[BRILLIANT_LATENCY_TRACK_COUNT] = {
+  [BRILLIANT_LATENCY_TRACK_VIDEO] = BRILLIANT_CATCH_UP_STATS_VIDEO_EPISODES,
+  [BRILLIANT_LATENCY_TRACK_AUDIO] = BRILLIANT_CATCH_UP_STATS_AUDIO_EPISODES,
+};
+
+static guint
+default_target_ms (BrilliantLatencyTrack track)
+{
+  return track == BRILLIANT_LATENCY_TRACK_VIDEO ? BRILLIANT_CATCH_UP_DEFAULT_VIDEO_TARGET_MS :
+      BRILLIANT_CATCH_UP_DEFAULT_AUDIO_TARGET_MS;
+}
+
+BrilliantCatchUp *
+brilliant_catch_up_new (void)
+{
+  GST_DEBUG_CATEGORY_INIT (catch_up_debug, "brilliant-catch-up", 0,
+      "Brilliant catch-up playback");
+  BrilliantCatchUp *catch_up = g_new0 (BrilliantCatchUp, 1);
+  g_mutex_init (&catch_up->lock);
+  for (gint i = 0; i < BRILLIANT_LATENCY_TRACK_COUNT; i++)
+    catch_up->tracks[i].target_ms = default_target_ms (i);
+  gst_segment_init (&catch_up->audio_segment, GST_FORMAT_TIME);
+  return catch_up;
+}
+
+void
+brilliant_catch_up_free (BrilliantCatchUp *catch_up)
+{
+  if (!catch_up)
+    return;
+  for (gint i = 0; i < BRILLIANT_LATENCY_TRACK_COUNT; i++)
+    gst_clear_object (&catch_up->tracks[i].queue);
+  g_mutex_clear (&catch_up->lock);
+  g_free (catch_up);
+}
+
+/* Buffered duration a track drains back to, 0 for the default */
+void
+brilliant_catch_up_set_target (BrilliantCatchUp *catch_up, BrilliantLatencyTrack track,
+    guint target_ms)
+{
+  g_mutex_lock (&catch_up->lock);
+  catch_up->tracks[track].target_ms = target_ms ? target_ms : default_target_ms (track);
+  GST_DEBUG ("Track %d catch-up target %u ms", track, catch_up->tracks[track].target_ms);
+  g_mutex_unlock (&catch_up->lock);
+}
+
+/* Whether the track should be catching up, given how much its queue holds. Called with the lock
+ * held. */
+static gboolean
+update_track (BrilliantCatchUp * catch_up, BrilliantLatencyTrack track)
+{
+  CatchUpTrack *state = &catch_up->tracks[track];
+  guint64 level = 0;
+  g_object_get (state->queue, "current-level-time", &level, NULL);
+  guint64 target = state->target_ms * GST_MSECOND;
+  if (!state->active && level > target * CATCH_UP_ENGAGE_NUM / CATCH_UP_ENGAGE_DEN) {
+    state->active = TRUE;
+    catch_up->values[episode_fields[track]]++;
+    GST_INFO ("Track %d catching up, %" GST_TIME_FORMAT " buffered", track, GST_TIME_ARGS (level));
+  } else if (state->active && level <= target) {
+    state->active = FALSE;
+    GST_INFO ("Track %d back to %" GST_TIME_FORMAT " buffered", track, GST_TIME_ARGS (level));
+  }
+  return state->active;
+}
+
+/* Whether an H.264 access unit is not used as a reference by any other frame. All the slices of
+ * a picture share nal_ref_idc, so the first one tells. avc access units come from rtph264depay,
+ * which always writes 4 byte NAL lengths. */
+static gboolean
+is_non_reference (GstBuffer * buffer, gboolean avc)
+{
+  GstMapInfo map;
+  if (!gst_buffer_map (buffer, &map, GST_MAP_READ))
+    return FALSE;
+  gint nal_header = -1;
+  gsize offset = 0;
+  while (nal_header < 0 && offset + 4 <= map.size) {
+    gsize header_offset;
+    if (avc) {
+      header_offset = offset + 4;
+      offset = header_offset + GST_READ_UINT32_BE (map.data + offset);
+    } else if (map.data[offset] == 0 && map.data[offset + 1] == 0 && map.data[offset + 2] == 1) {
+      header_offset = offset + 3;
+      offset = header_offset;
+    } else {
+      offset++;
+      continue;
+    }
+    if (header_offset >= map.size)
+      break;
+    guint nal_type = map.data[header_offset] & 0x1f;
+    if (nal_type >= 1 && nal_type <= 5) /* Coded slice */
+      nal_header = map.data[header_offset];
+  }
+  gst_buffer_unmap (buffer, &map);
+  return nal_header >= 0 && (nal_header & 0x60) == 0;
+}
+
+static gboolean
+is_avc (GstPad * pad)
+{
+  GstCaps *caps = gst_pad_get_current_caps (pad);
+  if (!caps)
+    return FALSE;
+  const gchar *stream_format =
+      gst_structure_get_string (gst_caps_get_structure (caps, 0), "stream-format");
+  gboolean avc = g_strcmp0 (stream_format, "avc") == 0;
+  gst_caps_unref (caps);
+  return avc;
+}
+
+static GstPadProbeReturn
+video_output_probe (GstPad * pad, GstPadProbeInfo * info, BrilliantCatchUp * catch_up)
+{
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  g_mutex_lock (&catch_up->lock);
+  gboolean active = update_track (catch_up, BRILLIANT_LATENCY_TRACK_VIDEO);
+  g_mutex_unlock (&catch_up->lock);
+  if (!active || !GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT) ||
+      !is_non_reference (buffer, is_avc (pad)))
+    return GST_PAD_PROBE_OK;
+
+  g_mutex_lock (&catch_up->lock);
+  catch_up->values[BRILLIANT_CATCH_UP_STATS_VIDEO_FRAMES_DROPPED]++;
+  g_mutex_unlock (&catch_up->lock);
+  return GST_PAD_PROBE_DROP;
+}
+
+/* Every segment going into scaletempo, from upstream or from set_audio_rate. A new upstream
+ * segment is at rate 1, so catching up resumes on it with the next buffer if still needed. */
+static GstPadProbeReturn
+audio_segment_probe (GstPad * pad, GstPadProbeInfo * info, BrilliantCatchUp * catch_up)
+{
+  GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+  if (GST_EVENT_TYPE (event) == GST_EVENT_SEGMENT) {
+    const GstSegment *segment;
+    gst_event_parse_segment (event, &segment);
+    g_mutex_lock (&catch_up->lock);
+    gst_segment_copy_into (segment, &catch_up->audio_segment);
+    catch_up->have_audio_segment = segment->format == GST_FORMAT_TIME;
+    g_mutex_unlock (&catch_up->lock);
+  }
+  return GST_PAD_PROBE_OK;
+}
+
+/* Have scaletempo play from position on at rate, replacing current. The new segment starts at
+ * the running time position had in current, so the sink sees no gap and no overlap. Called
+ * without the lock, the segment probe takes it. Returns whether the segment was sent. */
+static gboolean
+set_audio_rate (GstPad * pad, const GstSegment * current, GstClockTime position, gdouble rate)
+{
+  GstSegment segment;
+  gst_segment_copy_into (current, &segment);
+  guint64 running_time = gst_segment_to_running_time (&segment, GST_FORMAT_TIME, position);
+  guint64 stream_time = gst_segment_to_stream_time (&segment, GST_FORMAT_TIME, position);
+  if (!GST_CLOCK_TIME_IS_VALID (running_time) || !GST_CLOCK_TIME_IS_VALID (stream_time))
+    return FALSE;
+  segment.rate = rate;
+  segment.start = position;
+  segment.position = position;
+  segment.time = stream_time;
+  segment.base = running_time;
+  segment.offset = 0;
+  GST_DEBUG ("Audio rate %.2f from %" GST_TIME_FORMAT, rate, GST_TIME_ARGS (position));
+  return gst_pad_send_event (pad, gst_event_new_segment (&segment));
+}
+
+static GstPadProbeReturn
+audio_input_probe (GstPad * pad, GstPadProbeInfo * info, BrilliantCatchUp * catch_up)
+{
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  GstSegment current;
+  g_mutex_lock (&catch_up->lock);
+  gboolean active = update_track (catch_up, BRILLIANT_LATENCY_TRACK_AUDIO);
+  gboolean have_segment = catch_up->have_audio_segment;
+  gst_segment_copy_into (&catch_up->audio_segment, &current);
+  g_mutex_unlock (&catch_up->lock);
+
+  gdouble rate = active ? CATCH_UP_AUDIO_RATE : 1.0;
+  gdouble playing_rate = current.rate;
+  if (have_segment && current.rate != rate && GST_BUFFER_PTS_IS_VALID (buffer) &&
+      set_audio_rate (pad, &current, GST_BUFFER_PTS (buffer), rate))
+    playing_rate = rate;
+
+  if (playing_rate > 1.0 && GST_BUFFER_DURATION_IS_VALID (buffer)) {
+    GstClockTime duration = GST_BUFFER_DURATION (buffer);
+    g_mutex_lock (&catch_up->lock);
+    catch_up->values[BRILLIANT_CATCH_UP_STATS_AUDIO_TIME_SAVED_US] +=
+        (duration - duration / playing_rate) / GST_USECOND;
+    g_mutex_unlock (&catch_up->lock);
+  }
+  return GST_PAD_PROBE_OK;
+}
+
+/* Catch up video by dropping frames as they leave queue, the one in front of the parser */
+void
+brilliant_catch_up_watch_video (BrilliantCatchUp *catch_up, GstElement *queue)
+{
+  g_mutex_lock (&catch_up->lock);
+  gst_object_replace ((GstObject **) & catch_up->tracks[BRILLIANT_LATENCY_TRACK_VIDEO].queue,
+      GST_OBJECT (queue));
+  g_mutex_unlock (&catch_up->lock);
+
+  GstPad *src_pad = gst_element_get_static_pad (queue, "src");
+  gst_pad_add_probe (src_pad, GST_PAD_PROBE_TYPE_BUFFER,
+      (GstPadProbeCallback) video_output_probe, catch_up, NULL);
+  gst_object_unref (src_pad);
+}
+
+/* Catch up audio through tempo, a scaletempo downstream of queue */
+void
+brilliant_catch_up_watch_audio (BrilliantCatchUp *catch_up, GstElement *queue, GstElement *tempo)
+{
+  g_mutex_lock (&catch_up->lock);
+  gst_object_replace ((GstObject **) & catch_up->tracks[BRILLIANT_LATENCY_TRACK_AUDIO].queue,
+      GST_OBJECT (queue));
+  g_mutex_unlock (&catch_up->lock);
+
+  GstPad *sink_pad = gst_element_get_static_pad (tempo, "sink");
+  gst_pad_add_probe (sink_pad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+      (GstPadProbeCallback) audio_segment_probe, catch_up, NULL);
+  gst_pad_add_probe (sink_pad, GST_PAD_PROBE_TYPE_BUFFER,
+      (GstPadProbeCallback) audio_input_probe, catch_up, NULL);
+  gst_object_unref (sink_pad);
+}
+
+/* Fill values with the BrilliantCatchUpStatsField values. Returns the number written. */
+gint
+brilliant_catch_up_get (BrilliantCatchUp *catch_up, gint64 *values, gint count)
+{
+  count = MIN (count, BRILLIANT_CATCH_UP_STATS_FIELD_COUNT);
+  g_mutex_lock (&catch_up->lock);
+  memcpy (values, catch_up->values, count * sizeof (gint64));
+  g_mutex_unlock (&catch_up->lock);
+  return count;
+}
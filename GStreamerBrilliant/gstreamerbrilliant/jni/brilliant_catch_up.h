@@ -0,0 +1,63 @@
+/*****************************************************************************
+ * GStreamerBrilliant: Android Library built with system's GStreamer Implementation. Intended for use in Brilliant Mobile App.
+ *****************************************************************************
+ * Copyright (C) 2022 Brilliant Home Technologies
+ *
+ * Authors: Brilliant iOS Team <android_developer # brilliant.tech>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef GSTREAMERBRILLIANT_BRILLIANT_CATCH_UP_H
+#define GSTREAMERBRILLIANT_BRILLIANT_CATCH_UP_H
+#include <gst/gst.h>
+#include "brilliant_latency_monitor.h"
+
+/* Drains media that piled up in the receive path (after a Wi-Fi stall, or when the app comes
+ * back to the foreground) without a flush, so that live view gets back to its target latency.
+ *
+ * The buffered duration of a track is the level of its queue. Once it exceeds one and a half
+ * times the track target, the track catches up until it is back to the target:
+ *   - Audio plays faster through scaletempo, which keeps the pitch. The segment scaletempo
+ *     receives is rewritten to a higher rate, keeping the running time continuous.
+ *   - Video drops the frames no other frame refers to (nal_ref_idc 0) before they are parsed
+ *     and decoded. Streams without such frames rely on the GOP drop of BrilliantQueueGuard.
+ *
+ * brilliant_catch_up_get fills BRILLIANT_CATCH_UP_STATS_FIELD_COUNT values indexed by
+ * BrilliantCatchUpStatsField, returned as is by nativeGetCatchUpStats.
+ * */
+#define BRILLIANT_CATCH_UP_DEFAULT_VIDEO_TARGET_MS 200
+#define BRILLIANT_CATCH_UP_DEFAULT_AUDIO_TARGET_MS 80
+
+typedef enum
+{
+  BRILLIANT_CATCH_UP_STATS_VIDEO_EPISODES = 0,  /* Times video started catching up */
+  BRILLIANT_CATCH_UP_STATS_VIDEO_FRAMES_DROPPED,
+  BRILLIANT_CATCH_UP_STATS_AUDIO_EPISODES,
+  BRILLIANT_CATCH_UP_STATS_AUDIO_TIME_SAVED_US, /* Media time played out faster than real time */
+  BRILLIANT_CATCH_UP_STATS_FIELD_COUNT
+} BrilliantCatchUpStatsField;
+
+typedef struct _BrilliantCatchUp BrilliantCatchUp;
+
+BrilliantCatchUp *brilliant_catch_up_new (void);
+void brilliant_catch_up_free (BrilliantCatchUp *catch_up);
+void brilliant_catch_up_set_target (BrilliantCatchUp *catch_up, BrilliantLatencyTrack track,
+    guint target_ms);
+void brilliant_catch_up_watch_video (BrilliantCatchUp *catch_up, GstElement *queue);
+void brilliant_catch_up_watch_audio (BrilliantCatchUp *catch_up, GstElement *queue,
+    GstElement *tempo);
+gint brilliant_catch_up_get (BrilliantCatchUp *catch_up, gint64 *values, gint count);
+#endif //GSTREAMERBRILLIANT_BRILLIANT_CATCH_UP_H
@@ -20,38 +20,29 @@
  * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
  *****************************************************************************/
 
-#include "gstreamer_brilliant_android.h"
+#include "brilliant_custom_rtp_backend.h"
+#include "brilliant_decoder_cache.h"
 #include <gst/gst.h>
 #include <gio/gio.h>
 #include <gst/audio/audio-channels.h>
 
-static void decode_bin_pad_added (GstElement *decode_bin, GstPad *pad, CustomData *data)
-{
-  gchar *pad_name = gst_pad_get_name(pad);
-  GST_DEBUG("decode_bin_pad_added, pad name: %s", pad_name);
-  gboolean success = gst_element_link(decode_bin, data->rtp_custom_data->video_data_pipe);
-  if (!success) {
-    gchar *message = g_strdup_printf("CustomRTPBackend is unable to link pad %s from decode_bin to video sink.", pad_name);
-    set_ui_message(message, data);
-    g_free(message);
-  }
-  g_free(pad_name);
-}
-
 static void rtp_bin_pad_added (GstElement *rtpBin, GstPad* pad, CustomData *data) {
   gchar *pad_name = gst_pad_get_name(pad);
   GST_DEBUG("rtp_bin_pad_added, pad name: %s", pad_name);
   if (strstr(pad_name, "send_rtp_src") != NULL) {
     GstPad *sink_pad = gst_element_get_static_pad(data->rtp_custom_data->out_audio_data_pipe, "sink");
     gst_pad_link(pad, sink_pad);
+    gst_object_unref(sink_pad);
   } else if (strstr(pad_name, "recv_rtp_src") != NULL) {
     GstCaps *caps = gst_pad_get_current_caps(pad);
     GstStructure *structure = gst_caps_get_structure(caps, 0);
     int isAudioPad =
         (gst_structure_has_field_typed(structure, "media", G_TYPE_STRING) &&
          g_strcmp0(g_value_get_string(gst_structure_get_value(structure, "media")), "audio") == 0);
+    gst_caps_unref(caps);
     GstPad *sink_pad = gst_element_get_static_pad(isAudioPad ? data->rtp_custom_data->audio_depay : data->rtp_custom_data->video_depay, "sink");
     gst_pad_link(pad, sink_pad);
+    gst_object_unref(sink_pad);
   }
   g_free(pad_name);
 }
@@ -96,12 +87,12 @@ static GstElement * get_srtp_decoder(
     g_object_set(src_element, "caps", srtp_caps, NULL);
     gst_caps_unref(srtp_caps);
     gst_element_link(src_element, srtp_dec);
-    if (!sink_element) {
+    if (sink_element) {
       gst_element_link(srtp_dec, sink_element);
     }
   } else {
     GST_WARNING("Couldn't construct srtpdec.");
-    if (!sink_element) {
+    if (sink_element) {
       gst_element_link_filtered(src_element, sink_element, link_caps);
     }
   }
@@ -132,6 +123,34 @@ static void add_srtp_encoder(
 }
 
 
+static GSocket * create_socket_on_port(CustomData *data, int port) {
+  GError *error = NULL;
+  GSocket *socket = g_socket_new(G_SOCKET_FAMILY_IPV4,
+                                 G_SOCKET_TYPE_DATAGRAM,
+                                 G_SOCKET_PROTOCOL_UDP,
+                                 &error);
+  if (!socket) {
+    GST_ERROR("Failed to create GSocket! Error: %s", error->message);
+    g_clear_error(&error);
+    return NULL;
+  }
+  GInetAddress *host_address = g_inet_address_new_from_string("0.0.0.0");
+  GST_DEBUG("Binding local socket on 0.0.0.0:%d", port);
+  GSocketAddress *bind_address = g_inet_socket_address_new(host_address, port);
+  gboolean bound = g_socket_bind(socket, bind_address, TRUE, &error);
+  g_object_unref(host_address);
+  g_object_unref(bind_address);
+  if (!bound) {
+    GST_ERROR("Failed to bind port %d. Error: %s", port, error ? error->message : "<unknown error>");
+    g_clear_error(&error);
+    g_socket_close(socket, NULL);
+    g_object_unref(socket);
+    return NULL;
+  }
+  brilliant_startup_timings_mark(&data->startup_timings, BRILLIANT_STARTUP_SOCKETS_BOUND);
+  return socket;
+}
+
 /*
  *  Video Pipeline Diagram:
  *
@@ -143,11 +162,18 @@ static void add_srtp_encoder(
  *                     #1  |      |
  *                         -------
  *                          |
- *                          V                              **
- *                   [rtph264depay]-->[queue]-->[decodebin]-->[identity]-->[autovideoconvert]-->[autovideosink]
+ *                          V                                                        **
+ *                   [rtph264depay]-->[queue]-->[h264parse]-->[funnel]-->[decoder]-->[identity]-->[autovideoconvert]-->[queue]-->[autovideosink]
+ *                                                                ^
+ *                                                  (*)[appsrc]---+
  *
- *  (**) denotes a link added in response to the pad-added signal being emitted.
+ *  (*) [appsrc] feeds the cached keyframe of the camera as a preview, see attach_keyframe_cache.
+ *  [decoder] is placed by the decoder cache: the decoder decodebin picked in an earlier
+ *  session, or decodebin itself the first time.
+ *  (**) denotes a link added in response to the pad-added signal being emitted, when
+ *  [decoder] is a decodebin.
  *  (#*) denotes a manual pad link
+ *  The [queue] in front of [autovideosink] holds one frame, see BrilliantRenderPacer.
  *
  *  We separate this setup into two functions, set_up_video_sink handles [identity] onwards
  *  so that we can expose a handle to the video sink as soon as possible.
@@ -162,19 +188,22 @@ static int set_up_video_sink(CustomData *data) {
   GST_DEBUG("Starting to set up video sink");
   rtp_custom_data->video_data_pipe = gst_element_factory_make("identity", NULL);
   // Use autovideoconvert ! autovideosink
-  GstElement *auto_video_convert = gst_element_factory_make("autovideoconvert", NULL);
-  GstElement *auto_video_sink = gst_element_factory_make("autovideosink", NULL);
+  GstElement *auto_video_convert = gst_element_factory_make("autovideoconvert", "video_convert");
+  GstElement *render_queue = gst_element_factory_make("queue", "render_queue");
+  GstElement *auto_video_sink = gst_element_factory_make("autovideosink", "video_output");
   if (!rtp_custom_data->video_data_pipe) {
   }
 
   gst_bin_add_many(GST_BIN(data->pipeline),
                    rtp_custom_data->video_data_pipe,
                    auto_video_convert,
+                   render_queue,
                    auto_video_sink,
                    NULL);
   gboolean linking_result = gst_element_link_many(
       rtp_custom_data->video_data_pipe,
       auto_video_convert,
+      render_queue,
       auto_video_sink,
       NULL
   );
@@ -182,10 +211,20 @@ static int set_up_video_sink(CustomData *data) {
     GST_ERROR("Failed to link video sink elements.");
     return FALSE;
   }
+  brilliant_startup_timings_watch_element(&data->startup_timings, auto_video_convert, "sink",
+                                          BRILLIANT_STARTUP_FIRST_DECODED_FRAME);
+  // Rendered once the push out of render_queue into the sink returns
+  brilliant_startup_timings_watch_element(&data->startup_timings, render_queue, "src",
+                                          BRILLIANT_STARTUP_FIRST_FRAME_RENDERED);
   GST_DEBUG("Finished set up video sink");
   return TRUE;
 }
 
+// rtpbin names its request pads after the session they belong to, e.g. recv_rtp_sink_1
+static guint rtp_bin_session_id(GstPad *rtp_bin_pad) {
+  return (guint) g_ascii_strtoull(strrchr(GST_PAD_NAME(rtp_bin_pad), '_') + 1, NULL, 10);
+}
+
 static int set_up_receive_video_pipeline(CustomData *data) {
   GST_DEBUG("Starting to set up receive video pipeline");
   RTPCustomData *rtp_custom_data = data->rtp_custom_data;
@@ -197,8 +236,17 @@ static int set_up_receive_video_pipeline(CustomData *data) {
     GST_WARNING("Video pipeline already set up.");
     return TRUE;
   }
+  // The Start Data handshake goes out from the socket video is received on, see start_track
+  rtp_custom_data->video_rtp_socket = create_socket_on_port(data, rtp_custom_data->local_rtp_video_udp_port);
+  if (!rtp_custom_data->video_rtp_socket) {
+    GST_WARNING("Failed to create video RTP socket.");
+    return FALSE;
+  }
   GstElement *rtp_video_udp_src = gst_element_factory_make("udpsrc", "rtp_video_udp_src");
-  g_object_set(rtp_video_udp_src, "port", rtp_custom_data->local_rtp_video_udp_port, NULL);
+  g_object_set(rtp_video_udp_src,
+               "socket", rtp_custom_data->video_rtp_socket,
+               "close-socket", FALSE,
+               NULL);
   GstElement *rtcp_video_udp_src = gst_element_factory_make("udpsrc", "rtcp_video_udp_src");
   g_object_set(rtcp_video_udp_src, "port", rtp_custom_data->local_rtcp_video_udp_port, NULL);
   GstElement *rtcp_video_udp_sink = gst_element_factory_make("udpsink", "rtcp_video_udp_sink");
@@ -212,16 +260,14 @@ static int set_up_receive_video_pipeline(CustomData *data) {
   rtp_custom_data->video_depay = gst_element_factory_make("rtph264depay", "video_depay");
   GstElement *queue = gst_element_factory_make("queue", "video_queue");
   GstElement *h264Parse = gst_element_factory_make("h264parse", "parser");
+  GstElement *preview_funnel = gst_element_factory_make("funnel", "preview_funnel");
+  // Bounded in time from the start, the queue guard then applies the configured limit
   g_object_set(queue,
                "max-size-buffers", 0,
                "max-size-bytes", 0,
-               "max-size-time", 0,
+               "max-size-time", (guint64) BRILLIANT_QUEUE_DEFAULT_VIDEO_LIMIT_MS *
+                                BRILLIANT_QUEUE_VIDEO_HARD_LIMIT_FACTOR * GST_MSECOND,
                NULL);
-  GstElement *decode_bin = gst_element_factory_make("decodebin", NULL);
-  g_signal_connect(G_OBJECT(decode_bin),
-                   "pad-added",
-                   G_CALLBACK(decode_bin_pad_added),
-                   data);
   gst_bin_add_many(GST_BIN(data->pipeline),
                    rtp_video_udp_src,
                    rtcp_video_udp_src,
@@ -229,15 +275,35 @@ static int set_up_receive_video_pipeline(CustomData *data) {
                    rtp_custom_data->video_depay,
                    queue,
                    h264Parse,
-                   decode_bin,
+                   preview_funnel,
                    NULL);
-  gst_element_link_many(rtp_custom_data->video_depay, queue, h264Parse, decode_bin, NULL);
+  gst_element_link_many(rtp_custom_data->video_depay, queue, h264Parse, preview_funnel, NULL);
+  brilliant_queue_guard_watch(data->queue_guard, BRILLIANT_LATENCY_TRACK_VIDEO, queue);
+  brilliant_catch_up_watch_video(data->catch_up, queue);
+  // Before the decoder is added, so that it is set up to request keyframes too
+  brilliant_keyframe_requester_watch(data->keyframe_requester, GST_BIN(data->pipeline),
+                                     rtp_custom_data->video_depay);
+  if (!brilliant_decoder_cache_add_decoder(GST_BIN(data->pipeline), preview_funnel, "video/x-h264",
+                                           rtp_custom_data->video_data_pipe)) {
+    GST_ERROR("Failed to set up the video decoder in RTP Custom video pipeline.");
+    return FALSE;
+  }
   GstCaps *video_caps = gst_caps_new_simple("application/x-srtp",
                                              "clock-rate", G_TYPE_INT, rtp_custom_data->incoming_video_sample_rate,
                                              "encoding-name", G_TYPE_STRING, "H264",
                                              "payload", G_TYPE_INT, rtp_custom_data->incoming_video_payload_type,
                                              "media", G_TYPE_STRING, "video",
+                                             // rtpbin sends keyframe requests as PLI, or FIR when they ask for all headers
+                                             "rtcp-fb-nack-pli", G_TYPE_BOOLEAN, TRUE,
+                                             "rtcp-fb-ccm-fir", G_TYPE_BOOLEAN, TRUE,
                                              NULL);
+  // Out of band SPS/PPS, rtph264depay hands them to h264parse ahead of the first keyframe
+  if (rtp_custom_data->incoming_video_sprop_parameter_sets) {
+    gst_caps_set_simple(video_caps,
+                        "sprop-parameter-sets", G_TYPE_STRING,
+                        rtp_custom_data->incoming_video_sprop_parameter_sets,
+                        NULL);
+  }
   // incomingVideoSsrc expected to be in [0, 4,294,967,295] as values can be up to 2^31
   GstElement *srtp_dec = get_srtp_decoder(
       rtp_custom_data->incoming_video_key,
@@ -247,14 +313,37 @@ static int set_up_receive_video_pipeline(CustomData *data) {
       GST_BIN(data->pipeline),
       video_caps
   );
+  gst_caps_unref(video_caps);
   if (srtp_dec == NULL) {
     GST_WARNING("Failed to set up srtpdec element in RTP Custom video pipeline.");
     return FALSE;
   }
+  brilliant_startup_timings_watch_element(&data->startup_timings, rtp_video_udp_src, "src",
+                                          BRILLIANT_STARTUP_FIRST_VIDEO_RTP);
+  brilliant_startup_timings_watch_element(&data->startup_timings, srtp_dec, "rtp_src",
+                                          BRILLIANT_STARTUP_FIRST_SRTP_DECRYPTED);
+  brilliant_startup_timings_watch_element(&data->startup_timings, rtp_custom_data->video_depay, "src",
+                                          BRILLIANT_STARTUP_FIRST_IDR);
+  GstElement *render_queue = gst_bin_get_by_name(GST_BIN(data->pipeline), "render_queue");
+  GstPad *video_render_pad = gst_element_get_static_pad(render_queue, "src");
+  brilliant_latency_monitor_watch_track(data->latency_monitor, BRILLIANT_LATENCY_TRACK_VIDEO,
+                                        rtp_custom_data->incoming_video_sample_rate,
+                                        rtp_custom_data->video_depay, rtcp_video_udp_src,
+                                        video_render_pad);
+  GstPad *decoder_input_pad = gst_element_get_static_pad(h264Parse, "src");
+  GstPad *decoder_output_pad = gst_element_get_static_pad(rtp_custom_data->video_data_pipe, "sink");
+  brilliant_frame_stats_watch(data->frame_stats, decoder_input_pad, decoder_output_pad,
+                              video_render_pad);
+  gst_object_unref(decoder_input_pad);
+  gst_object_unref(decoder_output_pad);
+  gst_object_unref(video_render_pad);
+  gst_object_unref(render_queue);
   // #1 Manually link srtpdec:rtp_src to rtpbin:recv_rtp_sink_0
   GstPad *srtp_dec_rtp_src = gst_element_get_static_pad(srtp_dec, "rtp_src");
   GstPad *rtp_bin_recv_rtp_sink = gst_element_request_pad_simple(rtp_custom_data->rtp_bin, "recv_rtp_sink_%u");
   gst_pad_link(srtp_dec_rtp_src, rtp_bin_recv_rtp_sink);
+  brilliant_jitter_controller_watch_track(data->jitter_controller, BRILLIANT_LATENCY_TRACK_VIDEO,
+                                          rtp_bin_session_id(rtp_bin_recv_rtp_sink), srtp_dec_rtp_src);
 
   // #2 Manually link rtcp udpsrc:src to rtpbin:recv_rtcp_sink_0
   GstPad *rtcp_udp_src = gst_element_get_static_pad(rtcp_video_udp_src, "src");
@@ -265,34 +354,17 @@ static int set_up_receive_video_pipeline(CustomData *data) {
   GstPad *rtp_bin_send_rtcp_src = gst_element_request_pad_simple(rtp_custom_data->rtp_bin, "send_rtcp_src_%u");
   GstPad *rtcp_udp_sink = gst_element_get_static_pad(rtcp_video_udp_sink, "sink");
   gst_pad_link(rtp_bin_send_rtcp_src, rtcp_udp_sink);
+  gst_object_unref(srtp_dec_rtp_src);
+  gst_object_unref(rtp_bin_recv_rtp_sink);
+  gst_object_unref(rtcp_udp_src);
+  gst_object_unref(rtp_bin_recv_rtcp_sink);
+  gst_object_unref(rtp_bin_send_rtcp_src);
+  gst_object_unref(rtcp_udp_sink);
+  attach_keyframe_cache(data);
   GST_DEBUG("Completed setup of receive video pipeline");
   return TRUE;
 }
 
-static GSocket * create_socket_on_port(int port) {
-  GError *error;
-  GSocket *socket = g_socket_new(G_SOCKET_FAMILY_IPV4,
-                                 G_SOCKET_TYPE_DATAGRAM,
-                                 G_SOCKET_PROTOCOL_UDP,
-                                 &error);
-  if (!socket) {
-    GST_ERROR("Failed to create GSocket! Error: %s", error->message);
-    return NULL;
-  }
-  GInetAddress *host_address = g_inet_address_new_from_string("0.0.0.0");
-  GST_DEBUG("Binding local socket on 0.0.0.0:%d", port);
-  GSocketAddress *bind_address = g_inet_socket_address_new(host_address, port);
-  if (!g_socket_bind(socket, bind_address, TRUE, &error)) {
-    GST_ERROR("Failed to bind port %d. Error: %s", port, error ? error->message : "<unknown error>");
-    g_socket_close(socket, NULL);
-    g_object_unref(socket);
-    g_object_unref(host_address);
-    g_object_unref(bind_address);
-    return NULL;
-  }
-  return socket;
-}
-
 /*
  *  Audio Pipeline Diagram:
  *
@@ -308,7 +380,9 @@ static GSocket * create_socket_on_port(int port) {
  *                            |
  *                    +-------+
  *                    V
- *             [rtpL16depay]-->[queue]-->[audioconvert]-->[volume]-->[autoaudiosink]
+ *             [rtpL16depay]-->[queue]-->[audioconvert]-->[scaletempo]*-->[audioconvert]*
+ *                                                                        |
+ *                                                 [autoaudiosink]<--[volume]
  *
  *  (*) denotes an optional element in the pipeline
  *  (#*) denotes a manual pad link
@@ -337,16 +411,24 @@ static int set_up_receive_audio_pipeline(CustomData *data, GSocket *socket) {
                NULL);
   rtp_custom_data->audio_depay = gst_element_factory_make("rtpL16depay", "audio_depay");
   GstElement *queue = gst_element_factory_make("queue", "audio_queue");
+  // Bounded in time from the start, the queue guard then applies the configured limit
   g_object_set(queue,
                "max-size-buffers", 0,
                "max-size-bytes", 0,
-               "max-size-time", 0,
+               "max-size-time", (guint64) BRILLIANT_QUEUE_DEFAULT_AUDIO_LIMIT_MS * GST_MSECOND,
+               "leaky", 2, // Downstream, drops the oldest buffers
                NULL);
 
   GstElement *audio_convert = gst_element_factory_make("audioconvert", NULL);
-  data->volume = gst_element_factory_make("volume", NULL);
+  // Catch-up playback speeds audio up through it, converting back to what the sink takes after
+  GstElement *tempo = gst_element_factory_make("scaletempo", "catch_up_tempo");
+  GstElement *tempo_convert = tempo ? gst_element_factory_make("audioconvert", NULL) : NULL;
+  if (!tempo)
+    GST_WARNING("scaletempo is missing, audio will not catch up");
+  // Owned like the volume the RTSP backend looks up, released when the session is freed
+  data->volume = gst_object_ref(gst_element_factory_make("volume", "vol"));
   g_object_set(data->volume, "mute", TRUE, NULL);
-  GstElement *auto_audio_sink = gst_element_factory_make("autoaudiosink", NULL);
+  GstElement *auto_audio_sink = gst_element_factory_make("autoaudiosink", "audio_output");
 
   gst_bin_add_many(GST_BIN(data->pipeline),
                    rtp_audio_udp_src,
@@ -362,10 +444,19 @@ static int set_up_receive_audio_pipeline(CustomData *data, GSocket *socket) {
     GST_WARNING("Failed to link audio_depay to audio_queue");
     return FALSE;
   }
-  if (!gst_element_link_many(queue, audio_convert, data->volume, auto_audio_sink, NULL)) {
+  if (tempo) {
+    gst_bin_add_many(GST_BIN(data->pipeline), tempo, tempo_convert, NULL);
+    if (!gst_element_link_many(queue, audio_convert, tempo, tempo_convert, data->volume,
+                               auto_audio_sink, NULL)) {
+      GST_WARNING("Failed to link audio_queue to rest of audio pipeline");
+      return FALSE;
+    }
+    brilliant_catch_up_watch_audio(data->catch_up, queue, tempo);
+  } else if (!gst_element_link_many(queue, audio_convert, data->volume, auto_audio_sink, NULL)) {
     GST_WARNING("Failed to link audio_queue to rest of audio pipeline");
     return FALSE;
   }
+  brilliant_queue_guard_watch(data->queue_guard, BRILLIANT_LATENCY_TRACK_AUDIO, queue);
   GstCaps *audio_caps = gst_caps_new_simple("application/x-srtp",
                                             "clock-rate", G_TYPE_INT, rtp_custom_data->incoming_audio_sample_rate,
                                             "encoding-name", G_TYPE_STRING, "L16",
@@ -383,16 +474,28 @@ static int set_up_receive_audio_pipeline(CustomData *data, GSocket *socket) {
       GST_BIN(data->pipeline),
       audio_caps
   );
-  //gst_object_unref(audio_caps);
+  gst_caps_unref(audio_caps);
   if (srtp_dec == NULL) {
     GST_WARNING("Failed to set up srtpdec element in CustomRTP audio pipeline");
     return FALSE;
   }
+  brilliant_startup_timings_watch_element(&data->startup_timings, rtp_audio_udp_src, "src",
+                                          BRILLIANT_STARTUP_FIRST_AUDIO_RTP);
+  brilliant_startup_timings_watch_element(&data->startup_timings, srtp_dec, "rtp_src",
+                                          BRILLIANT_STARTUP_FIRST_SRTP_DECRYPTED);
+  GstPad *audio_render_pad = gst_element_get_static_pad(data->volume, "src");
+  brilliant_latency_monitor_watch_track(data->latency_monitor, BRILLIANT_LATENCY_TRACK_AUDIO,
+                                        rtp_custom_data->incoming_audio_sample_rate,
+                                        rtp_custom_data->audio_depay, rtcp_audio_udp_src,
+                                        audio_render_pad);
+  gst_object_unref(audio_render_pad);
 
   // #1 Manually link srtpdec:rtp_src to rtpbin:recv_rtp_sink_1
   GstPad *srtp_dec_rtp_src = gst_element_get_static_pad(srtp_dec, "rtp_src");
   GstPad *rtp_bin_recv_rtp_sink = gst_element_request_pad_simple(rtp_custom_data->rtp_bin, "recv_rtp_sink_%u");
   gst_pad_link(srtp_dec_rtp_src, rtp_bin_recv_rtp_sink);
+  brilliant_jitter_controller_watch_track(data->jitter_controller, BRILLIANT_LATENCY_TRACK_AUDIO,
+                                          rtp_bin_session_id(rtp_bin_recv_rtp_sink), srtp_dec_rtp_src);
 
   // #2 Manually link rtcp udpsrc:src to rtpbin:recv_rtcp_sink_1
   GstPad *rtcp_udp_src = gst_element_get_static_pad(rtcp_audio_udp_src, "src");
@@ -403,6 +506,12 @@ static int set_up_receive_audio_pipeline(CustomData *data, GSocket *socket) {
   GstPad *rtp_bin_send_rtcp_src = gst_element_request_pad_simple(rtp_custom_data->rtp_bin, "send_rtcp_src_%u");
   GstPad *rtcp_udp_sink = gst_element_get_static_pad(rtcp_audio_udp_sink, "sink");
   gst_pad_link(rtp_bin_send_rtcp_src, rtcp_udp_sink);
+  gst_object_unref(srtp_dec_rtp_src);
+  gst_object_unref(rtp_bin_recv_rtp_sink);
+  gst_object_unref(rtcp_udp_src);
+  gst_object_unref(rtp_bin_recv_rtcp_sink);
+  gst_object_unref(rtp_bin_send_rtcp_src);
+  gst_object_unref(rtcp_udp_sink);
 
   GST_DEBUG("Completed setup of receive audio pipeline");
   return TRUE;
@@ -450,7 +559,7 @@ static int set_up_send_audio_pipeline(CustomData *data, GSocket *socket) {
                                           NULL);
   GstElement *outgoing_audio_caps = gst_element_factory_make("capsfilter", "outgoing_audio_rtp_caps");
   g_object_set(outgoing_audio_caps, "caps", src_caps, NULL);
-  // gst_object_unref(src_caps);
+  gst_caps_unref(src_caps);
 
   GstElement *rtp_l16_pay = gst_element_factory_make("rtpL16pay", NULL);
   g_object_set(rtp_l16_pay, "mtu", 332, "min_ptime", 20000000, NULL);
@@ -521,7 +630,6 @@ static int set_up_send_audio_pipeline(CustomData *data, GSocket *socket) {
                                             NULL);
   GstElement *rtp_caps_filter = gst_element_factory_make("capsfilter", "audio_rtp_caps");
   g_object_set(rtp_caps_filter, "caps", audio_caps, NULL);
-  gst_object_unref(audio_caps);
 
   gst_bin_add_many(GST_BIN(data->pipeline),
                    rtp_caps_filter,
@@ -538,6 +646,7 @@ static int set_up_send_audio_pipeline(CustomData *data, GSocket *socket) {
       GST_BIN(data->pipeline),
       audio_caps
   );
+  gst_caps_unref(audio_caps);
 
   // (#1) Manually link rtcp udpsrc:src to rtpbin:recv_rtcp_sink_2
   GstPad *rtcp_udp_src = gst_element_get_static_pad(rtcp_audio_udp_src, "src");
@@ -555,65 +664,126 @@ static int set_up_send_audio_pipeline(CustomData *data, GSocket *socket) {
   GstPad *rtp_bin_send_rtcp_src = gst_element_request_pad_simple(rtp_custom_data->rtp_bin, "send_rtcp_src_%u");
   GstPad *rtcp_udp_sink = gst_element_get_static_pad(rtcp_audio_udp_sink, "sink");
   gst_pad_link(rtp_bin_send_rtcp_src, rtcp_udp_sink);
+  gst_object_unref(rtcp_udp_src);
+  gst_object_unref(rtp_bin_recv_rtcp_sink);
+  gst_object_unref(rtp_pay_src);
+  gst_object_unref(rtp_bin_send_rtp_sink);
+  gst_object_unref(rtp_bin_send_rtcp_src);
+  gst_object_unref(rtcp_udp_sink);
 
   GST_DEBUG("Completed setup of send audio pipeline");
   return TRUE;
 }
 
-static int set_up_two_way_audio_pipeline(CustomData *data) {
+// The socket is shared for sending/receiving audio RTP packets because the server will
+// deliver audio to the port it sees packets coming from. Whichever audio track starts first binds it.
+static GSocket * get_audio_rtp_socket(CustomData *data) {
   RTPCustomData *rtp_custom_data = data->rtp_custom_data;
-  if (!rtp_custom_data) {
-    GST_ERROR("Missing RTPCustomData struct when constructing audio pipeline.");
+  if (!rtp_custom_data->audio_rtp_socket) {
+    GST_DEBUG("Binding shared audio socket on port %d", rtp_custom_data->local_rtp_audio_udp_port);
+    rtp_custom_data->audio_rtp_socket = create_socket_on_port(data, rtp_custom_data->local_rtp_audio_udp_port);
+  }
+  return rtp_custom_data->audio_rtp_socket;
+}
+
+/* Register the Start Data handshake of a track with the start sequencer. It is sent from the
+ * socket the track is received on, once its udpsrc is PLAYING. */
+static int start_track(CustomData *data, BrilliantStartTrack track, GSocket *socket,
+                       gchar *server, int port, const gchar *udp_src_name) {
+  GstElement *udp_src = gst_bin_get_by_name(GST_BIN(data->pipeline), udp_src_name);
+  if (!udp_src) {
+    GST_ERROR("Missing %s, cannot start track", udp_src_name);
     return FALSE;
   }
-  GST_DEBUG("Starting to set up two way audio pipeline on port %d", rtp_custom_data->local_rtp_audio_udp_port);
-  if (rtp_custom_data->audio_depay) {
-    // Assume audio pipeline has already been setup.
-    GST_WARNING("Audio pipeline was already set up.");
-    return TRUE;
+  GstPad *rtp_pad = gst_element_get_static_pad(udp_src, "src");
+  brilliant_start_sequencer_add_track(data->start_sequencer, track, socket, server, port, rtp_pad);
+  gst_object_unref(rtp_pad);
+  gst_object_unref(udp_src);
+  return TRUE;
+}
+
+static int activate_video_track(CustomData *data) {
+  RTPCustomData *rtp_custom_data = data->rtp_custom_data;
+  if (!set_up_receive_video_pipeline(data)) {
+    GST_WARNING("Failed to set up video pipeline.");
+    return FALSE;
   }
-  // The socket is shared for sending/receiving audio RTP packets because the server will
-  // deliver audio to the port it sees packets coming from
-  GSocket *audio_rtp_socket = create_socket_on_port(rtp_custom_data->local_rtp_audio_udp_port);
+  int start_video_result = start_track(
+      data,
+      BRILLIANT_START_TRACK_VIDEO,
+      rtp_custom_data->video_rtp_socket,
+      rtp_custom_data->incoming_video_server,
+      rtp_custom_data->incoming_video_port,
+      "rtp_video_udp_src"
+  );
+  if (!start_video_result) {
+    GST_WARNING("Failed to register the video start handshake.");
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static int activate_incoming_audio_track(CustomData *data) {
+  RTPCustomData *rtp_custom_data = data->rtp_custom_data;
+  GSocket *audio_rtp_socket = get_audio_rtp_socket(data);
   if (!audio_rtp_socket) {
     GST_WARNING("Failed to create audio RTP socket.");
     return FALSE;
   }
-  rtp_custom_data->audio_rtp_socket = audio_rtp_socket;
-  int set_up_receive_audio_result = set_up_receive_audio_pipeline(data, audio_rtp_socket);
-  if (!set_up_receive_audio_result) {
+  if (!set_up_receive_audio_pipeline(data, audio_rtp_socket)) {
     GST_WARNING("Failed to set up incoming audio pipeline.");
     return FALSE;
   }
-  int set_up_send_audio_result = set_up_send_audio_pipeline(data, audio_rtp_socket);
-  if (!set_up_send_audio_result) {
-    GST_WARNING("Failed to set up outgoing audio pipeline.");
+  int start_audio_result = start_track(
+      data,
+      BRILLIANT_START_TRACK_AUDIO,
+      audio_rtp_socket,
+      rtp_custom_data->incoming_audio_server,
+      rtp_custom_data->incoming_audio_port,
+      "rtp_audio_udp_src"
+  );
+  if (!start_audio_result) {
+    GST_WARNING("Failed to register the audio start handshake.");
     return FALSE;
   }
   return TRUE;
 }
 
-static int notify_custom_rtp_start_sending(CustomData *data, gchar *server, int port, int local_port) {
-  GSocket *socket = create_socket_on_port(local_port);
-  GError *error = NULL;
-  GInetAddress *host_address = g_inet_address_new_from_string(server);
-  GSocketAddress *dest_address = g_inet_socket_address_new(host_address, port);
-  GST_DEBUG("Sending datagram to %s:%d", server, port);
-  g_socket_send_to(socket, dest_address, "Start Data", 10, NULL, &error);
-  if (error != NULL) {
-    GST_ERROR ("Failed to notify server %s:%d to start. Error: %s", server, port, error->message);
-    g_error_free(error);
-    g_socket_close(socket, NULL);
-    g_object_unref(socket);
+static int activate_outgoing_audio_track(CustomData *data) {
+  GSocket *audio_rtp_socket = get_audio_rtp_socket(data);
+  if (!audio_rtp_socket) {
+    GST_WARNING("Failed to create audio RTP socket.");
+    return FALSE;
+  }
+  if (!set_up_send_audio_pipeline(data, audio_rtp_socket)) {
+    GST_WARNING("Failed to set up outgoing audio pipeline.");
     return FALSE;
   }
-  g_object_unref(host_address);
-  g_object_unref(dest_address);
-  g_socket_close(socket, NULL);
-  g_object_unref(socket);
   return TRUE;
 }
 
+/* Bring elements added to a running pipeline to its state, sinks first so sources never push
+ * into an element that is not running yet */
+static void sync_new_elements(CustomData *data) {
+  if (GST_STATE(data->pipeline) == GST_STATE_NULL)
+    return;
+  GstIterator *iterator = gst_bin_iterate_sorted(GST_BIN(data->pipeline));
+  GValue item = G_VALUE_INIT;
+  while (gst_iterator_next(iterator, &item) == GST_ITERATOR_OK) {
+    GstElement *element = g_value_get_object(&item);
+    if (GST_STATE(element) == GST_STATE_NULL && !gst_element_sync_state_with_parent(element)) {
+      GST_WARNING("Failed to sync state of %s", GST_OBJECT_NAME(element));
+    }
+    g_value_reset(&item);
+  }
+  g_value_unset(&item);
+  gst_iterator_free(iterator);
+}
+
+/* Build and start every track whose properties are set and that is not running yet. Each track
+ * stands on its own, so video can stream while audio is still being negotiated, and a session
+ * without audio never builds the audio graph. Safe to call again as properties arrive. Tracks
+ * only ever get added, a running one stays until the pipeline is freed. */
 int complete_custom_rtp_track_pipeline_setup(CustomData *data) {
   GST_DEBUG("Completing setup for custom rtp backend...");
   RTPCustomData *rtp_custom_data = data->rtp_custom_data;
@@ -621,48 +791,38 @@ int complete_custom_rtp_track_pipeline_setup(CustomData *data) {
     GST_ERROR("Missing RTPCustomData struct when completing custom rtp backend pipeline.");
     return FALSE;
   }
-  int track_info_present = rtp_custom_data->incoming_video_server &&
-      rtp_custom_data->incoming_video_key &&
-      rtp_custom_data->incoming_audio_server &&
-      rtp_custom_data->incoming_audio_key &&
-      rtp_custom_data->outgoing_audio_server &&
-      rtp_custom_data->outgoing_audio_key;
-  if (!track_info_present) {
-    GST_ERROR("Missing Track Info when completing custom rtp backend pipeline.");
-    return FALSE;
-  }
-  int video_setup_result = set_up_receive_video_pipeline(data);
-  if (!video_setup_result) {
-    GST_WARNING("Failed to set up video pipeline.");
-    return FALSE;
-  }
-  int notify_video_result = notify_custom_rtp_start_sending(
-      data,
-      rtp_custom_data->incoming_video_server,
-      rtp_custom_data->incoming_video_port,
-      rtp_custom_data->local_rtp_video_udp_port
-  );
-  if (notify_video_result != 1) {
-    GST_WARNING("Failed to notify Target to start video.");
-    return FALSE;
-  }
-  int audio_setup_result = set_up_two_way_audio_pipeline(data);
-  if (!audio_setup_result) {
-    GST_WARNING("Failed to set up audio pipeline.");
-    return FALSE;
+  if (!data->pipeline) {
+    GST_DEBUG("Pipeline not built yet, tracks will be started once it is.");
+    return TRUE;
   }
-  int notify_audio_result = notify_custom_rtp_start_sending(
-      data,
-      rtp_custom_data->incoming_audio_server,
-      rtp_custom_data->incoming_audio_port,
-      rtp_custom_data->local_rtp_audio_udp_port
-  );
-  if (!notify_audio_result) {
-    GST_WARNING("Failed to notify Target to start audio.");
-    return FALSE;
+  g_mutex_lock(&rtp_custom_data->lock);
+  if (!rtp_custom_data->local_ports_set) {
+    GST_DEBUG("Local ports not set yet, tracks will be started once they are.");
+    g_mutex_unlock(&rtp_custom_data->lock);
+    return TRUE;
   }
-  GST_DEBUG("Completed setup for custom rtp backend.");
-  return TRUE;
+  int result = TRUE;
+  if (rtp_custom_data->incoming_video_server && rtp_custom_data->incoming_video_key &&
+      !rtp_custom_data->video_depay) {
+    result &= activate_video_track(data);
+  }
+  if (rtp_custom_data->incoming_audio_server && rtp_custom_data->incoming_audio_key &&
+      !rtp_custom_data->audio_depay) {
+    result &= activate_incoming_audio_track(data);
+  }
+  if (rtp_custom_data->outgoing_audio_server && rtp_custom_data->outgoing_audio_key &&
+      !rtp_custom_data->out_audio_data_pipe) {
+    result &= activate_outgoing_audio_track(data);
+  }
+  GST_DEBUG("Completed setup for custom rtp backend: video %s, incoming audio %s, outgoing audio %s.",
+            rtp_custom_data->video_depay ? "on" : "off",
+            rtp_custom_data->audio_depay ? "on" : "off",
+            rtp_custom_data->out_audio_data_pipe ? "on" : "off");
+  g_mutex_unlock(&rtp_custom_data->lock);
+  // State changes can wait for streaming threads, which must never find the lock held by a thread
+  // waiting for them. Only the session thread activates tracks, nothing interleaves here.
+  sync_new_elements(data);
+  return result;
 }
 
 int build_custom_rtp_pipeline(CustomData *data)
@@ -677,14 +837,38 @@ int build_custom_rtp_pipeline(CustomData *data)
   rtp_custom_data->rtp_bin = gst_element_factory_make("rtpbin", "incoming_video_manager");
   g_object_set(
       rtp_custom_data->rtp_bin,
-      "latency", 500,
+      "latency", 500, // Starting point, then adapted by the jitter controller
       "autoremove", TRUE,
       "buffer-mode", 1, // RTP_JITTER_BUFFER_MODE_SLAVE
-      "rtcp-sync", 2, // GST_RTP_BIN_RTCP_SYNC_REP,
+      "rtp-profile", 4, // GST_RTP_PROFILE_SAVPF, sends keyframe requests without waiting for the RTCP interval
       NULL
   );
   g_signal_connect (G_OBJECT (rtp_custom_data->rtp_bin), "pad-added", (GCallback) rtp_bin_pad_added,
                     data);
+  data->rtp_stats = brilliant_rtp_stats_new(rtp_custom_data->rtp_bin);
+  data->jitter_controller = brilliant_jitter_controller_new(rtp_custom_data->rtp_bin, data->rtp_stats,
+                                                            data->context);
+  for (int track = 0; track < BRILLIANT_LATENCY_TRACK_COUNT; track++) {
+    if (data->jitter_latency_max_ms[track]) {
+      brilliant_jitter_controller_set_bounds(data->jitter_controller, track, data->jitter_latency_min_ms[track],
+                                             data->jitter_latency_max_ms[track]);
+    }
+  }
+  data->queue_guard = brilliant_queue_guard_new();
+  for (int track = 0; track < BRILLIANT_LATENCY_TRACK_COUNT; track++) {
+    if (data->queue_limit_ms[track]) {
+      brilliant_queue_guard_set_limit(data->queue_guard, track, data->queue_limit_ms[track]);
+    }
+  }
+  data->catch_up = brilliant_catch_up_new();
+  for (int track = 0; track < BRILLIANT_LATENCY_TRACK_COUNT; track++) {
+    if (data->catch_up_target_ms[track]) {
+      brilliant_catch_up_set_target(data->catch_up, track, data->catch_up_target_ms[track]);
+    }
+  }
+  apply_custom_rtp_sync_policy(data);
+  data->start_sequencer = brilliant_start_sequencer_new(data->context, &data->startup_timings);
+  data->keyframe_requester = brilliant_keyframe_requester_new();
   gst_bin_add(GST_BIN(data->pipeline), rtp_custom_data->rtp_bin);
   rtp_custom_data->mic_volume = gst_element_factory_make("volume", "mic_volume");
   g_object_set(rtp_custom_data->mic_volume, "mute", TRUE, NULL);
@@ -696,26 +880,85 @@ int build_custom_rtp_pipeline(CustomData *data)
   }
 
   if (!complete_custom_rtp_track_pipeline_setup(data)) {
-    GST_WARNING("Missing track info during initialization waiting until play to complete pipeline setup.");
+    GST_WARNING("Failed to start the tracks configured so far, retrying as properties arrive.");
   }
-  data->volume = gst_bin_get_by_name(GST_BIN (data->pipeline), "vol");
   return TRUE;
 }
 
+// How far ahead of the pipeline latency a sink may render: its own path latency, when it does not
+// wait for the slower tracks
+static void align_sink(CustomData *data, const gchar *sink_name, gboolean own_latency,
+                       GstClockTime pipeline_latency) {
+  GstElement *sink = gst_bin_get_by_name(GST_BIN(data->pipeline), sink_name);
+  if (!sink) {
+    return;
+  }
+  gint64 ts_offset = 0;
+  if (own_latency && GST_CLOCK_TIME_IS_VALID(pipeline_latency)) {
+    GstQuery *query = gst_query_new_latency();
+    if (gst_element_query(sink, query)) {
+      GstClockTime path_latency = 0;
+      gst_query_parse_latency(query, NULL, &path_latency, NULL);
+      if (path_latency < pipeline_latency) {
+        ts_offset = -(gint64) (pipeline_latency - path_latency);
+      }
+    }
+    gst_query_unref(query);
+  }
+  if (g_object_class_find_property(G_OBJECT_GET_CLASS(sink), "ts-offset")) {
+    GST_DEBUG("%s renders %" G_GINT64_FORMAT " ns ahead of the pipeline latency", sink_name, -ts_offset);
+    g_object_set(sink, "ts-offset", ts_offset, NULL);
+  }
+  gst_object_unref(sink);
+}
+
+/* Apply rtp_custom_data->sync_policy: how rtpbin aligns the tracks, whether their jitterbuffers
+ * share one latency, and which sinks render ahead of the pipeline latency at their own. The
+ * pipeline latency is the one of the slowest track, so a track that does not wait for the others
+ * needs a negative ts-offset. Called again whenever the pipeline latency changes. */
+void apply_custom_rtp_sync_policy(CustomData *data) {
+  RTPCustomData *rtp_custom_data = data->rtp_custom_data;
+  if (!rtp_custom_data || !data->pipeline || !rtp_custom_data->rtp_bin) {
+    return;
+  }
+  BrilliantSyncPolicy policy = rtp_custom_data->sync_policy;
+  g_object_set(rtp_custom_data->rtp_bin,
+               // GST_RTP_BIN_RTCP_SYNC_ALWAYS aligns on sender reports, RTP_INFO only on rtp-info we never have
+               "rtcp-sync", policy == BRILLIANT_SYNC_POLICY_LIP_SYNC ? 0 : 2,
+               NULL);
+  brilliant_jitter_controller_set_linked(data->jitter_controller, policy == BRILLIANT_SYNC_POLICY_LIP_SYNC);
+
+  GstClockTime pipeline_latency = GST_CLOCK_TIME_NONE;
+  if (policy != BRILLIANT_SYNC_POLICY_LIP_SYNC) {
+    GstQuery *query = gst_query_new_latency();
+    if (gst_element_query(data->pipeline, query)) {
+      gst_query_parse_latency(query, NULL, &pipeline_latency, NULL);
+    }
+    gst_query_unref(query);
+  }
+  align_sink(data, "audio_output", policy != BRILLIANT_SYNC_POLICY_LIP_SYNC, pipeline_latency);
+  align_sink(data, "video_output", policy == BRILLIANT_SYNC_POLICY_UNSYNCHRONIZED, pipeline_latency);
+}
+
 void cleanup_custom_rtp_data(RTPCustomData *rtp_custom_data)
 {
   if (rtp_custom_data == NULL) {
     return;
   }
-  free(rtp_custom_data->incoming_video_server);
-  free(rtp_custom_data->incoming_audio_server);
-  free(rtp_custom_data->outgoing_audio_server);
-  gst_buffer_unref(rtp_custom_data->incoming_video_key);
-  gst_buffer_unref(rtp_custom_data->incoming_audio_key);
-  gst_buffer_unref(rtp_custom_data->outgoing_audio_key);
+  g_free(rtp_custom_data->incoming_video_server);
+  g_free(rtp_custom_data->incoming_audio_server);
+  g_free(rtp_custom_data->outgoing_audio_server);
+  g_free(rtp_custom_data->incoming_video_sprop_parameter_sets);
+  if (rtp_custom_data->incoming_video_key)
+    gst_buffer_unref(rtp_custom_data->incoming_video_key);
+  if (rtp_custom_data->incoming_audio_key)
+    gst_buffer_unref(rtp_custom_data->incoming_audio_key);
+  if (rtp_custom_data->outgoing_audio_key)
+    gst_buffer_unref(rtp_custom_data->outgoing_audio_key);
   rtp_custom_data->incoming_video_server = NULL;
   rtp_custom_data->incoming_audio_server = NULL;
   rtp_custom_data->outgoing_audio_server = NULL;
+  rtp_custom_data->incoming_video_sprop_parameter_sets = NULL;
   rtp_custom_data->incoming_video_key = NULL;
   rtp_custom_data->incoming_audio_key = NULL;
   rtp_custom_data->outgoing_audio_key = NULL;
@@ -22,10 +22,11 @@
 
 #ifndef GSTREAMERBRILLIANT_BRILLIANT_CUSTOM_RTP_BACKEND_H
 #define GSTREAMERBRILLIANT_BRILLIANT_CUSTOM_RTP_BACKEND_H
-#include "gstreamer_brilliant_android.h"
+#include "brilliant_session.h"
 
 int build_custom_rtp_pipeline(CustomData *data);
 int complete_custom_rtp_track_pipeline_setup(CustomData *data);
 void cleanup_custom_rtp_data(RTPCustomData *rtp_custom_data);
+void apply_custom_rtp_sync_policy(CustomData *data);
 
 #endif //GSTREAMERBRILLIANT_BRILLIANT_CUSTOM_RTP_BACKEND_H
@@ -0,0 +1,292 @@
+/*****************************************************************************
+ * GStreamerBrilliant: Android Library built with system's GStreamer Implementation. Intended for use in Brilliant Mobile App.
+ *****************************************************************************
+ * Copyright (C) 2022 Brilliant Home Technologies
+ *
+ * Authors: Brilliant iOS Team <android_developer # brilliant.tech>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+
+#include <string.h>
+#include "brilliant_decoder_cache.h"
+
+GST_DEBUG_CATEGORY_STATIC (decoder_cache_debug);
+#define GST_CAT_DEFAULT decoder_cache_debug
+
+typedef struct _CachedDecoder
+{
+  gchar *factory;               /* Element factory decodebin picked */
+  gchar *caps;                  /* Input format it negotiated, media type and format fields only */
+} CachedDecoder;
+
+static GMutex cache_lock;
+static GHashTable *cache;       /* Media type -> CachedDecoder */
+static gchar *cache_path;       /* Key file the cache is saved to, NULL to keep it in memory */
+static GQuark autoplug_quark;   /* Media type a decodebin placed by us decodes */
+static GQuark cached_quark;     /* Media type a decoder placed from the cache decodes */
+
+static void
+free_cached_decoder (CachedDecoder *entry)
+{
+  g_free (entry->factory);
+  g_free (entry->caps);
+  g_free (entry);
+}
+
+/* Called with cache_lock held */
+static void
+ensure_cache (void)
+{
+  if (cache)
+    return;
+  GST_DEBUG_CATEGORY_INIT (decoder_cache_debug, "brilliant-decoder-cache", 0,
+      "Decoder selection cache");
+  cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      (GDestroyNotify) free_cached_decoder);
+  autoplug_quark = g_quark_from_static_string ("brilliant-decoder-cache-autoplug");
+  cached_quark = g_quark_from_static_string ("brilliant-decoder-cache-cached");
+}
+
+/* Called with cache_lock held */
+static void
+save_cache (void)
+{
+  if (!cache_path)
+    return;
+  GKeyFile *key_file = g_key_file_new ();
+  GHashTableIter iter;
+  const gchar *media_type;
+  CachedDecoder *entry;
+  g_hash_table_iter_init (&iter, cache);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &media_type, (gpointer *) &entry)) {
+    g_key_file_set_string (key_file, media_type, "decoder", entry->factory);
+    g_key_file_set_string (key_file, media_type, "caps", entry->caps);
+  }
+  GError *error = NULL;
+  if (!g_key_file_save_to_file (key_file, cache_path, &error)) {
+    GST_WARNING ("Could not save the decoder cache: %s", error->message);
+    g_clear_error (&error);
+  }
+  g_key_file_free (key_file);
+}
+
+static void
+forget_decoder (const gchar *media_type)
+{
+  g_mutex_lock (&cache_lock);
+  if (g_hash_table_remove (cache, media_type))
+    save_cache ();
+  g_mutex_unlock (&cache_lock);
+}
+
+/* Load the decoders recorded by earlier launches from path, and save new ones there */
+void
+brilliant_decoder_cache_load (const gchar *path)
+{
+  g_mutex_lock (&cache_lock);
+  ensure_cache ();
+  g_free (cache_path);
+  cache_path = g_strdup (path);
+  GKeyFile *key_file = g_key_file_new ();
+  if (g_key_file_load_from_file (key_file, path, G_KEY_FILE_NONE, NULL)) {
+    gchar **media_types = g_key_file_get_groups (key_file, NULL);
+    for (gint i = 0; media_types[i]; i++) {
+      gchar *factory = g_key_file_get_string (key_file, media_types[i], "decoder", NULL);
+      gchar *caps = g_key_file_get_string (key_file, media_types[i], "caps", NULL);
+      if (factory && caps) {
+        CachedDecoder *entry = g_new (CachedDecoder, 1);
+        entry->factory = factory;
+        entry->caps = caps;
+        g_hash_table_replace (cache, g_strdup (media_types[i]), entry);
+        GST_INFO ("Cached decoder for %s: %s, %s", media_types[i], factory, caps);
+      } else {
+        g_free (factory);
+        g_free (caps);
+      }
+    }
+    g_strfreev (media_types);
+  }
+  g_key_file_free (key_file);
+  g_mutex_unlock (&cache_lock);
+}
+
+static gboolean
+keep_format_field (GQuark field, GValue *value, gpointer user_data)
+{
+  const gchar *name = g_quark_to_string (field);
+  return strcmp (name, "stream-format") == 0 || strcmp (name, "alignment") == 0;
+}
+
+/* The first decoder in bin, going by factory classification */
+static GstElement *
+find_decoder (GstBin *bin)
+{
+  GstElement *decoder = NULL;
+  GValue item = G_VALUE_INIT;
+  GstIterator *iterator = gst_bin_iterate_recurse (bin);
+  while (!decoder && gst_iterator_next (iterator, &item) == GST_ITERATOR_OK) {
+    GstElement *element = g_value_get_object (&item);
+    GstElementFactory *factory = gst_element_get_factory (element);
+    const gchar *klass = factory ?
+        gst_element_factory_get_metadata (factory, GST_ELEMENT_METADATA_KLASS) : NULL;
+    if (klass && strstr (klass, "Decoder"))
+      decoder = gst_object_ref (element);
+    g_value_reset (&item);
+  }
+  g_value_unset (&item);
+  gst_iterator_free (iterator);
+  return decoder;
+}
+
+/* Record the decoder decodebin settled on, with the format of its input */
+static void
+record_decoder (GstElement *decodebin)
+{
+  const gchar *media_type = g_object_get_qdata (G_OBJECT (decodebin), autoplug_quark);
+  GstElement *decoder = find_decoder (GST_BIN (decodebin));
+  if (!decoder) {
+    GST_DEBUG ("No decoder in %s, nothing to record", GST_OBJECT_NAME (decodebin));
+    return;
+  }
+  GstPad *decoder_sink = gst_element_get_static_pad (decoder, "sink");
+  GstCaps *caps = decoder_sink ? gst_pad_get_current_caps (decoder_sink) : NULL;
+  if (caps && gst_caps_get_size (caps) > 0) {
+    GstStructure *format = gst_structure_copy (gst_caps_get_structure (caps, 0));
+    gst_structure_filter_and_map_in_place (format, keep_format_field, NULL);
+    GstCaps *format_caps = gst_caps_new_full (format, NULL);
+    CachedDecoder *entry = g_new (CachedDecoder, 1);
+    entry->factory = g_strdup (GST_OBJECT_NAME (gst_element_get_factory (decoder)));
+    entry->caps = gst_caps_to_string (format_caps);
+    gst_caps_unref (format_caps);
+    GST_INFO ("Recording decoder for %s: %s, %s", media_type, entry->factory, entry->caps);
+    g_mutex_lock (&cache_lock);
+    g_hash_table_replace (cache, g_strdup (media_type), entry);
+    save_cache ();
+    g_mutex_unlock (&cache_lock);
+  }
+  if (caps)
+    gst_caps_unref (caps);
+  if (decoder_sink)
+    gst_object_unref (decoder_sink);
+  gst_object_unref (decoder);
+}
+
+static void
+decodebin_pad_added (GstElement *decodebin, GstPad *pad, GstElement *downstream)
+{
+  GstPad *sink_pad = gst_element_get_static_pad (downstream, "sink");
+  if (gst_pad_is_linked (sink_pad)) {
+    GST_DEBUG ("%s already linked, ignoring %s:%s", GST_OBJECT_NAME (downstream),
+        GST_DEBUG_PAD_NAME (pad));
+  } else if (GST_PAD_LINK_FAILED (gst_pad_link (pad, sink_pad))) {
+    GST_ERROR ("Unable to link %s:%s to %s", GST_DEBUG_PAD_NAME (pad),
+        GST_OBJECT_NAME (downstream));
+  } else {
+    record_decoder (decodebin);
+  }
+  gst_object_unref (sink_pad);
+}
+
+/* upstream ! capsfilter ! decoder ! downstream, NULL if any of it fails */
+static GstElement *
+add_cached_decoder (GstBin *bin, GstElement *upstream, const gchar *media_type,
+    const gchar *factory, const gchar *caps_string, GstElement *downstream)
+{
+  GstCaps *caps = gst_caps_from_string (caps_string);
+  GstElement *decoder = gst_element_factory_make (factory, NULL);
+  GstElement *capsfilter = gst_element_factory_make ("capsfilter", NULL);
+  if (!caps || !decoder || !capsfilter) {
+    GST_WARNING ("Cannot create cached decoder %s for %s", factory, media_type);
+    if (caps)
+      gst_caps_unref (caps);
+    if (decoder)
+      gst_object_unref (gst_object_ref_sink (decoder));
+    if (capsfilter)
+      gst_object_unref (gst_object_ref_sink (capsfilter));
+    return NULL;
+  }
+  g_object_set (capsfilter, "caps", caps, NULL);
+  gst_caps_unref (caps);
+  gst_bin_add_many (bin, capsfilter, decoder, NULL);
+  if (!gst_element_link_many (upstream, capsfilter, decoder, downstream, NULL)) {
+    GST_WARNING ("Cannot link cached decoder %s for %s", factory, media_type);
+    /* Removing the elements unlinks whatever did get linked */
+    gst_bin_remove_many (bin, capsfilter, decoder, NULL);
+    return NULL;
+  }
+  g_object_set_qdata_full (G_OBJECT (decoder), cached_quark, g_strdup (media_type), g_free);
+  GST_DEBUG ("Using cached decoder %s for %s", factory, media_type);
+  return decoder;
+}
+
+/* Decode media_type between upstream and downstream, both already in bin. Returns the decoder
+ * or decodebin placed, NULL if neither could be. */
+GstElement *
+brilliant_decoder_cache_add_decoder (GstBin *bin, GstElement *upstream,
+    const gchar *media_type, GstElement *downstream)
+{
+  g_mutex_lock (&cache_lock);
+  ensure_cache ();
+  CachedDecoder *entry = g_hash_table_lookup (cache, media_type);
+  gchar *factory = entry ? g_strdup (entry->factory) : NULL;
+  gchar *caps = entry ? g_strdup (entry->caps) : NULL;
+  g_mutex_unlock (&cache_lock);
+
+  if (factory) {
+    GstElement *decoder =
+        add_cached_decoder (bin, upstream, media_type, factory, caps, downstream);
+    g_free (factory);
+    g_free (caps);
+    if (decoder)
+      return decoder;
+    forget_decoder (media_type);
+  }
+
+  GstElement *decodebin = gst_element_factory_make ("decodebin", NULL);
+  if (!decodebin) {
+    GST_ERROR ("Cannot create decodebin for %s", media_type);
+    return NULL;
+  }
+  g_object_set_qdata_full (G_OBJECT (decodebin), autoplug_quark, g_strdup (media_type), g_free);
+  g_signal_connect_object (decodebin, "pad-added", G_CALLBACK (decodebin_pad_added),
+      downstream, 0);
+  gst_bin_add (bin, decodebin);
+  if (!gst_element_link (upstream, decodebin)) {
+    GST_ERROR ("Cannot link %s to decodebin", GST_OBJECT_NAME (upstream));
+    gst_bin_remove (bin, decodebin);
+    return NULL;
+  }
+  return decodebin;
+}
+
+/* Forget the cached decoder an error message comes from, so the next session autoplugs */
+void
+brilliant_decoder_cache_handle_error (GstMessage *message)
+{
+  if (!cached_quark)
+    return;
+  for (GstObject *object = GST_MESSAGE_SRC (message); object;
+      object = GST_OBJECT_PARENT (object)) {
+    const gchar *media_type = g_object_get_qdata (G_OBJECT (object), cached_quark);
+    if (media_type) {
+      GST_WARNING ("Cached decoder %s failed, autoplugging %s from now on",
+          GST_OBJECT_NAME (object), media_type);
+      forget_decoder (media_type);
+      return;
+    }
+  }
+}
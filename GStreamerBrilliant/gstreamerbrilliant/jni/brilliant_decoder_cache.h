@@ -0,0 +1,45 @@
+/*****************************************************************************
+ * GStreamerBrilliant: Android Library built with system's GStreamer Implementation. Intended for use in Brilliant Mobile App.
+ *****************************************************************************
+ * Copyright (C) 2022 Brilliant Home Technologies
+ *
+ * Authors: Brilliant iOS Team <android_developer # brilliant.tech>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+
+#ifndef GSTREAMERBRILLIANT_BRILLIANT_DECODER_CACHE_H
+#define GSTREAMERBRILLIANT_BRILLIANT_DECODER_CACHE_H
+#include <gst/gst.h>
+
+/* Remembers which decoder decodebin picked for a media type, so later sessions can skip
+ * autoplugging.
+ *
+ * brilliant_decoder_cache_add_decoder places a decoder between two elements. The first time a
+ * media type is seen it places a decodebin and, once that has exposed its source pad, records
+ * the decoder it chose and the stream-format/alignment it negotiated. From then on it places
+ * that decoder directly, behind a capsfilter with the recorded format, and falls back to
+ * decodebin if the decoder cannot be created or linked. An error posted by a cached decoder
+ * drops its entry, so the next session autoplugs again.
+ *
+ * The cache is process wide and, once brilliant_decoder_cache_load was given a file, persisted
+ * there across launches.
+ * */
+void brilliant_decoder_cache_load (const gchar *path);
+GstElement *brilliant_decoder_cache_add_decoder (GstBin *bin, GstElement *upstream,
+    const gchar *media_type, GstElement *downstream);
+void brilliant_decoder_cache_handle_error (GstMessage *message);
+#endif //GSTREAMERBRILLIANT_BRILLIANT_DECODER_CACHE_H
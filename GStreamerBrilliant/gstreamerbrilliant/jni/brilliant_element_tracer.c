@@ -0,0 +1,226 @@
+/*****************************************************************************
+ * GStreamerBrilliant: Android Library built with system's GStreamer Implementation. Intended for use in Brilliant Mobile App.
+ *****************************************************************************
+ * Copyright (C) 2022 Brilliant Home Technologies
+ *
+ * Authors: Brilliant iOS Team <android_developer # brilliant.tech>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+
+#include <string.h>
+#include "brilliant_element_tracer.h"
+#include "brilliant_histogram.h"
+
+/* Percentiles cover this much recent streaming */
+#define ELEMENT_TRACER_WINDOW_US (30 * G_USEC_PER_SEC)
+
+GST_DEBUG_CATEGORY_STATIC (element_tracer_debug);
+#define GST_CAT_DEFAULT element_tracer_debug
+
+typedef struct _BrilliantElementTracer
+{
+  GstTracer parent;
+} BrilliantElementTracer;
+
+typedef struct _BrilliantElementTracerClass
+{
+  GstTracerClass parent_class;
+} BrilliantElementTracerClass;
+
+#define BRILLIANT_TYPE_ELEMENT_TRACER (brilliant_element_tracer_get_type ())
+G_DEFINE_TYPE (BrilliantElementTracer, brilliant_element_tracer, GST_TYPE_TRACER);
+
+typedef struct _ElementSlot
+{
+  gchar name[48];
+  BrilliantHistogram *histogram;
+} ElementSlot;
+
+/* A push in progress on the current thread */
+typedef struct _PushFrame
+{
+  gint slot;                    /* Element receiving the buffer, -1 if not traced */
+  GstClockTime start;
+  GstClockTime child_time;      /* Spent in pushes made by that element */
+} PushFrame;
+
+/* GStreamer has no way to remove tracer hooks, so a single tracer lives for the whole process */
+static BrilliantElementTracer *tracer_instance;
+static gint tracer_enabled;
+static GMutex slots_lock;
+static ElementSlot slots[BRILLIANT_ELEMENT_TRACER_MAX_ELEMENTS];
+static gint slot_count;
+static GQuark slot_quark;
+static GPrivate push_stack = G_PRIVATE_INIT ((GDestroyNotify) g_array_unref);
+
+/* Element name without its instance number: avdec_h264-2 -> avdec_h264, queue12 -> queue */
+static void
+copy_base_name (gchar *dest, gsize dest_size, const gchar *name)
+{
+  gsize length = strlen (name);
+  while (length > 1 && g_ascii_isdigit (name[length - 1]))
+    length--;
+  if (length > 1 && name[length - 1] == '-' && length < strlen (name))
+    length--;
+  g_strlcpy (dest, name, MIN (dest_size, length + 1));
+}
+
+/* Slot of a traced element, cached on the element itself after the first lookup */
+static gint
+slot_for_element (GstElement * element)
+{
+  gpointer cached = g_object_get_qdata (G_OBJECT (element), slot_quark);
+  if (cached)
+    return GPOINTER_TO_INT (cached) - 1;
+
+  gchar base_name[sizeof (slots[0].name)];
+  gchar *name = gst_object_get_name (GST_OBJECT (element));
+  copy_base_name (base_name, sizeof (base_name), name ? name : "unnamed");
+  g_free (name);
+
+  gint slot = -1;
+  g_mutex_lock (&slots_lock);
+  for (gint i = 0; i < slot_count && slot < 0; i++) {
+    if (strcmp (slots[i].name, base_name) == 0)
+      slot = i;
+  }
+  if (slot < 0 && slot_count < BRILLIANT_ELEMENT_TRACER_MAX_ELEMENTS) {
+    slot = slot_count++;
+    g_strlcpy (slots[slot].name, base_name, sizeof (slots[slot].name));
+    slots[slot].histogram = brilliant_histogram_new (ELEMENT_TRACER_WINDOW_US);
+  }
+  g_mutex_unlock (&slots_lock);
+  if (slot < 0) {
+    GST_WARNING ("Element table full, not tracing %s", base_name);
+    return -1;
+  }
+  g_object_set_qdata (G_OBJECT (element), slot_quark, GINT_TO_POINTER (slot + 1));
+  return slot;
+}
+
+/* Element a push on pad runs into. Pushes into a bin go through its ghost pad first and only
+ * reach the child with a second, nested push, so bins themselves are not traced. */
+static gint
+slot_for_push (GstPad * pad)
+{
+  GstPad *peer = GST_PAD_PEER (pad);
+  GstObject *parent = peer ? GST_OBJECT_PARENT (peer) : NULL;
+  if (!parent || !GST_IS_ELEMENT (parent) || GST_IS_BIN (parent))
+    return -1;
+  return slot_for_element (GST_ELEMENT (parent));
+}
+
+static GArray *
+get_push_stack (void)
+{
+  GArray *stack = g_private_get (&push_stack);
+  if (!stack) {
+    stack = g_array_new (FALSE, FALSE, sizeof (PushFrame));
+    g_private_set (&push_stack, stack);
+  }
+  return stack;
+}
+
+/* pad-push-pre and pad-push-list-pre */
+static void
+push_pre (GstTracer * self, GstClockTime ts, GstPad * pad, gpointer buffer)
+{
+  if (!g_atomic_int_get (&tracer_enabled))
+    return;
+  PushFrame frame = { slot_for_push (pad), ts, 0 };
+  g_array_append_val (get_push_stack (), frame);
+}
+
+/* pad-push-post and pad-push-list-post */
+static void
+push_post (GstTracer * self, GstClockTime ts, GstPad * pad, GstFlowReturn result)
+{
+  if (!g_atomic_int_get (&tracer_enabled))
+    return;
+  /* Empty if tracing was enabled while this push was in progress */
+  GArray *stack = get_push_stack ();
+  if (stack->len == 0)
+    return;
+  PushFrame frame = g_array_index (stack, PushFrame, stack->len - 1);
+  g_array_set_size (stack, stack->len - 1);
+
+  GstClockTime total = ts - frame.start;
+  if (stack->len > 0)
+    g_array_index (stack, PushFrame, stack->len - 1).child_time += total;
+  if (frame.slot >= 0) {
+    brilliant_histogram_add (slots[frame.slot].histogram,
+        total - MIN (frame.child_time, total));
+  }
+}
+
+static void
+brilliant_element_tracer_class_init (BrilliantElementTracerClass * klass)
+{
+  slot_quark = g_quark_from_static_string ("brilliant-element-tracer-slot");
+}
+
+static void
+brilliant_element_tracer_init (BrilliantElementTracer * self)
+{
+  GstTracer *tracer = GST_TRACER (self);
+  gst_tracing_register_hook (tracer, "pad-push-pre", G_CALLBACK (push_pre));
+  gst_tracing_register_hook (tracer, "pad-push-post", G_CALLBACK (push_post));
+  gst_tracing_register_hook (tracer, "pad-push-list-pre", G_CALLBACK (push_pre));
+  gst_tracing_register_hook (tracer, "pad-push-list-post", G_CALLBACK (push_post));
+}
+
+/* Start or stop tracing. Starting again forgets the previous measurements. */
+void
+brilliant_element_tracer_set_enabled (gboolean enabled)
+{
+  g_mutex_lock (&slots_lock);
+  if (!tracer_instance) {
+    GST_DEBUG_CATEGORY_INIT (element_tracer_debug, "brilliant-element-tracer", 0,
+        "Per element processing time");
+    tracer_instance = g_object_new (BRILLIANT_TYPE_ELEMENT_TRACER, NULL);
+  }
+  if (enabled && !g_atomic_int_get (&tracer_enabled)) {
+    for (gint i = 0; i < slot_count; i++)
+      brilliant_histogram_reset (slots[i].histogram);
+  }
+  g_atomic_int_set (&tracer_enabled, enabled);
+  g_mutex_unlock (&slots_lock);
+  GST_INFO ("Element tracing %s", enabled ? "enabled" : "disabled");
+}
+
+/* Copy the processing time percentiles of up to count elements, returns how many were written */
+gint
+brilliant_element_tracer_get_latencies (BrilliantElementLatency *latencies, gint count)
+{
+  g_mutex_lock (&slots_lock);
+  gint written = 0;
+  for (gint i = 0; i < slot_count && written < count; i++) {
+    BrilliantHistogramSnapshot snapshot;
+    brilliant_histogram_get_snapshot (slots[i].histogram, &snapshot);
+    if (!snapshot.count)
+      continue;
+    BrilliantElementLatency *latency = &latencies[written++];
+    g_strlcpy (latency->name, slots[i].name, sizeof (latency->name));
+    latency->count = snapshot.count;
+    latency->p50_ns = snapshot.p50;
+    latency->p95_ns = brilliant_histogram_get_percentile (slots[i].histogram, 95);
+    latency->p99_ns = snapshot.p99;
+    latency->max_ns = snapshot.max;
+  }
+  g_mutex_unlock (&slots_lock);
+  return written;
+}
@@ -0,0 +1,53 @@
+/*****************************************************************************
+ * GStreamerBrilliant: Android Library built with system's GStreamer Implementation. Intended for use in Brilliant Mobile App.
+ *****************************************************************************
+ * Copyright (C) 2022 Brilliant Home Technologies
+ *
+ * Authors: Brilliant iOS Team <android_developer # brilliant.tech>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+
+#ifndef GSTREAMERBRILLIANT_BRILLIANT_ELEMENT_TRACER_H
+#define GSTREAMERBRILLIANT_BRILLIANT_ELEMENT_TRACER_H
+#include <gst/gst.h>
+
+/* Time spent in each element of the process' pipelines, for field diagnostics.
+ *
+ * A GstTracer hooked on buffer pushes: the time a push spends in the downstream element, minus
+ * the time spent in the pushes it makes itself, is that element's processing time for the
+ * buffer. Bins only forward to their children through ghost pads, so rtpbin and decodebin show
+ * up as their children (rtpsession, rtpjitterbuffer, avdec_h264, ...).
+ *
+ * Memory is fixed: up to BRILLIANT_ELEMENT_TRACER_MAX_ELEMENTS element names, each with a rolling
+ * histogram of nanoseconds. Instance numbers are stripped from names (srtpdec3 counts as srtpdec),
+ * so sessions coming and going do not use up the slots. Tracing is process wide and costs nothing but a flag check once disabled.
+ * */
+#define BRILLIANT_ELEMENT_TRACER_MAX_ELEMENTS 64
+
+typedef struct _BrilliantElementLatency
+{
+  gchar name[48];
+  gint64 count;
+  gint64 p50_ns;
+  gint64 p95_ns;
+  gint64 p99_ns;
+  gint64 max_ns;
+} BrilliantElementLatency;
+
+void brilliant_element_tracer_set_enabled (gboolean enabled);
+gint brilliant_element_tracer_get_latencies (BrilliantElementLatency *latencies, gint count);
+#endif //GSTREAMERBRILLIANT_BRILLIANT_ELEMENT_TRACER_H
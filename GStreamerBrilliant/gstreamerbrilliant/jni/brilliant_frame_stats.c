@@ -0,0 +1,326 @@
+/*****************************************************************************
+ * GStreamerBrilliant: Android Library built with system's GStreamer Implementation. Intended for use in Brilliant Mobile App.
+ *****************************************************************************
+ * Copyright (C) 2022 Brilliant Home Technologies
+ *
+ * Authors: Brilliant iOS Team <android_developer # brilliant.tech>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+
+#include <string.h>
+#include "brilliant_frame_stats.h"
+
+/* Percentiles cover this much recent streaming */
+#define FRAME_STATS_WINDOW_US (30 * G_USEC_PER_SEC)
+/* A decoder never holds this many frames, anything beyond was dropped inside it */
+#define MAX_PENDING_FRAMES 64
+/* PTS gaps larger than this are stream discontinuities, not render jitter */
+#define MAX_FRAME_INTERVAL GST_SECOND
+
+typedef struct _PendingFrame
+{
+  GstClockTime pts;
+  gint64 entered_us;
+} PendingFrame;
+
+struct _BrilliantFrameStats
+{
+  GMutex lock;
+  gint64 counters[BRILLIANT_FRAME_COUNTER_COUNT];
+  GHashTable *qos_dropped;            /* Element name -> dropped count of its last QoS message */
+  GstElement *video_sink;             /* The sink render_pad feeds, autovideosink included */
+  GQueue pending_frames;              /* PendingFrame inside the decoder, in decoding order */
+  GstClockTime pipeline_latency;      /* From the LATENCY event sent upstream by the sink */
+  BrilliantRenderPacer *render_pacer; /* Not owned, NULL if the sink always syncs */
+  GstClockTime last_render_time;      /* Clock time the previous frame was presented */
+  GstClockTime last_render_pts;
+  BrilliantHistogram *histograms[BRILLIANT_FRAME_HISTOGRAM_COUNT];
+};
+
+/* Parsed access unit about to enter the decoder */
+static GstPadProbeReturn
+decoder_input_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  BrilliantFrameStats *stats = user_data;
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  if (!GST_BUFFER_PTS_IS_VALID (buffer))
+    return GST_PAD_PROBE_OK;
+
+  PendingFrame *frame = g_new (PendingFrame, 1);
+  frame->pts = GST_BUFFER_PTS (buffer);
+  frame->entered_us = g_get_monotonic_time ();
+  g_mutex_lock (&stats->lock);
+  g_queue_push_tail (&stats->pending_frames, frame);
+  if (stats->pending_frames.length > MAX_PENDING_FRAMES)
+    g_free (g_queue_pop_head (&stats->pending_frames));
+  guint depth = stats->pending_frames.length;
+  stats->counters[BRILLIANT_FRAME_COUNTER_DECODER_QUEUE_DEPTH] = depth;
+  g_mutex_unlock (&stats->lock);
+
+  brilliant_histogram_add (stats->histograms[BRILLIANT_FRAME_HISTOGRAM_DECODER_QUEUE_DEPTH], depth);
+  return GST_PAD_PROBE_OK;
+}
+
+/* Decoded frame leaving the decoder. Frames queued before it with no output were dropped. */
+static GstPadProbeReturn
+decoder_output_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  BrilliantFrameStats *stats = user_data;
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  gint64 decode_time = -1;
+
+  g_mutex_lock (&stats->lock);
+  stats->counters[BRILLIANT_FRAME_COUNTER_DECODED]++;
+  GList *link = stats->pending_frames.head;
+  while (link && ((PendingFrame *) link->data)->pts != GST_BUFFER_PTS (buffer))
+    link = link->next;
+  if (link) {
+    PendingFrame *frame;
+    do {
+      frame = g_queue_pop_head (&stats->pending_frames);
+      if (frame->pts == GST_BUFFER_PTS (buffer))
+        decode_time = g_get_monotonic_time () - frame->entered_us;
+      g_free (frame);
+    } while (decode_time < 0);
+  }
+  stats->counters[BRILLIANT_FRAME_COUNTER_DECODER_QUEUE_DEPTH] = stats->pending_frames.length;
+  g_mutex_unlock (&stats->lock);
+
+  if (decode_time >= 0)
+    brilliant_histogram_add (stats->histograms[BRILLIANT_FRAME_HISTOGRAM_DECODE_TIME], decode_time);
+  return GST_PAD_PROBE_OK;
+}
+
+/* Clock time the sink will present the buffer: when it is due, or now if it is already late or
+ * the sink does not sync to the clock */
+static GstClockTime
+render_time (BrilliantFrameStats *stats, GstPad * pad, GstBuffer * buffer)
+{
+  GstClockTime result = GST_CLOCK_TIME_NONE;
+  GstElement *element = gst_pad_get_parent_element (pad);
+  GstClock *clock = element ? gst_element_get_clock (element) : NULL;
+  GstEvent *segment_event = gst_pad_get_sticky_event (pad, GST_EVENT_SEGMENT, 0);
+
+  if (clock && segment_event) {
+    const GstSegment *segment;
+    gst_event_parse_segment (segment_event, &segment);
+    GstClockTime running_time = gst_segment_to_running_time (segment, GST_FORMAT_TIME,
+        GST_BUFFER_PTS (buffer));
+    result = gst_clock_get_time (clock);
+    g_mutex_lock (&stats->lock);
+    gboolean synced = !stats->render_pacer ||
+        brilliant_render_pacer_get_mode (stats->render_pacer) != BRILLIANT_RENDER_MODE_IMMEDIATE;
+    GstClockTime latency = stats->pipeline_latency;
+    g_mutex_unlock (&stats->lock);
+    if (synced && GST_CLOCK_TIME_IS_VALID (running_time))
+      result = MAX (result, running_time + gst_element_get_base_time (element) + latency);
+  }
+  if (segment_event)
+    gst_event_unref (segment_event);
+  if (clock)
+    gst_object_unref (clock);
+  if (element)
+    gst_object_unref (element);
+  return result;
+}
+
+/* Input of the sink: the frame is about to be presented */
+static GstPadProbeReturn
+render_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  BrilliantFrameStats *stats = user_data;
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  GstClockTime pts = GST_BUFFER_PTS (buffer);
+  GstClockTime now = GST_BUFFER_PTS_IS_VALID (buffer) ? render_time (stats, pad, buffer)
+      : GST_CLOCK_TIME_NONE;
+  gint64 jitter = -1;
+
+  g_mutex_lock (&stats->lock);
+  stats->counters[BRILLIANT_FRAME_COUNTER_RENDERED]++;
+  if (GST_CLOCK_TIME_IS_VALID (now) && GST_CLOCK_TIME_IS_VALID (stats->last_render_time)
+      && pts > stats->last_render_pts && pts - stats->last_render_pts < MAX_FRAME_INTERVAL) {
+    GstClockTimeDiff render_interval = GST_CLOCK_DIFF (stats->last_render_time, now);
+    GstClockTimeDiff pts_interval = GST_CLOCK_DIFF (stats->last_render_pts, pts);
+    jitter = ABS (render_interval - pts_interval) / GST_USECOND;
+  }
+  stats->last_render_time = now;
+  stats->last_render_pts = pts;
+  g_mutex_unlock (&stats->lock);
+
+  if (jitter >= 0)
+    brilliant_histogram_add (stats->histograms[BRILLIANT_FRAME_HISTOGRAM_RENDER_JITTER], jitter);
+  return GST_PAD_PROBE_OK;
+}
+
+/* Events the sink sends upstream: the pipeline latency, and a QoS event for every frame */
+static GstPadProbeReturn
+render_event_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  BrilliantFrameStats *stats = user_data;
+  GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+  if (GST_EVENT_TYPE (event) == GST_EVENT_LATENCY) {
+    GstClockTime latency;
+    gst_event_parse_latency (event, &latency);
+    g_mutex_lock (&stats->lock);
+    stats->pipeline_latency = latency;
+    g_mutex_unlock (&stats->lock);
+  } else if (GST_EVENT_TYPE (event) == GST_EVENT_QOS) {
+    GstClockTimeDiff diff;
+    gst_event_parse_qos (event, NULL, NULL, &diff, NULL);
+    if (diff > 0) {
+      g_mutex_lock (&stats->lock);
+      stats->counters[BRILLIANT_FRAME_COUNTER_LATE]++;
+      g_mutex_unlock (&stats->lock);
+      brilliant_histogram_add (stats->histograms[BRILLIANT_FRAME_HISTOGRAM_LATENESS],
+          diff / GST_USECOND);
+    }
+  }
+  return GST_PAD_PROBE_OK;
+}
+
+BrilliantFrameStats *
+brilliant_frame_stats_new (void)
+{
+  BrilliantFrameStats *stats = g_new0 (BrilliantFrameStats, 1);
+  g_mutex_init (&stats->lock);
+  g_queue_init (&stats->pending_frames);
+  stats->qos_dropped = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  stats->last_render_time = GST_CLOCK_TIME_NONE;
+  stats->last_render_pts = GST_CLOCK_TIME_NONE;
+  for (gint i = 0; i < BRILLIANT_FRAME_HISTOGRAM_COUNT; i++)
+    stats->histograms[i] = brilliant_histogram_new (FRAME_STATS_WINDOW_US);
+  return stats;
+}
+
+void
+brilliant_frame_stats_free (BrilliantFrameStats *stats)
+{
+  if (!stats)
+    return;
+  g_queue_clear_full (&stats->pending_frames, g_free);
+  g_hash_table_destroy (stats->qos_dropped);
+  gst_clear_object (&stats->video_sink);
+  for (gint i = 0; i < BRILLIANT_FRAME_HISTOGRAM_COUNT; i++)
+    brilliant_histogram_free (stats->histograms[i]);
+  g_mutex_clear (&stats->lock);
+  g_free (stats);
+}
+
+/* Start measuring: decoder_input_pad feeds parsed access units to the decoder,
+ * decoder_output_pad receives its decoded frames and render_pad is the pad feeding the sink. */
+void
+brilliant_frame_stats_watch (BrilliantFrameStats *stats, GstPad *decoder_input_pad,
+    GstPad *decoder_output_pad, GstPad *render_pad)
+{
+  if (!decoder_input_pad || !decoder_output_pad || !render_pad) {
+    GST_WARNING ("Cannot measure frame statistics, missing pads");
+    return;
+  }
+  gst_pad_add_probe (decoder_input_pad, GST_PAD_PROBE_TYPE_BUFFER, decoder_input_probe, stats,
+      NULL);
+  gst_pad_add_probe (decoder_output_pad, GST_PAD_PROBE_TYPE_BUFFER, decoder_output_probe, stats,
+      NULL);
+  gst_pad_add_probe (render_pad, GST_PAD_PROBE_TYPE_BUFFER, render_probe, stats, NULL);
+  gst_pad_add_probe (render_pad, GST_PAD_PROBE_TYPE_EVENT_UPSTREAM, render_event_probe, stats,
+      NULL);
+
+  GstPad *sink_pad = gst_pad_get_peer (render_pad);
+  g_mutex_lock (&stats->lock);
+  gst_clear_object (&stats->video_sink);
+  stats->video_sink = sink_pad ? gst_pad_get_parent_element (sink_pad) : NULL;
+  g_mutex_unlock (&stats->lock);
+  if (sink_pad)
+    gst_object_unref (sink_pad);
+}
+
+/* Called with the lock held. Whether element is the video sink, or the sink autovideosink
+ * picked inside it. */
+static gboolean
+is_video_sink (BrilliantFrameStats *stats, GstObject *element)
+{
+  return stats->video_sink && (element == GST_OBJECT (stats->video_sink) ||
+      gst_object_has_as_ancestor (element, GST_OBJECT (stats->video_sink)));
+}
+
+static gboolean
+is_video_decoder (GstObject *element)
+{
+  if (!GST_IS_ELEMENT (element))
+    return FALSE;
+  const gchar *klass = gst_element_get_metadata (GST_ELEMENT (element),
+      GST_ELEMENT_METADATA_KLASS);
+  return klass && strstr (klass, "Decoder") && strstr (klass, "Video");
+}
+
+/* pacer decides whether the sink syncs to the clock, it must outlive the watched pads */
+void
+brilliant_frame_stats_set_render_pacer (BrilliantFrameStats *stats, BrilliantRenderPacer *pacer)
+{
+  g_mutex_lock (&stats->lock);
+  stats->render_pacer = pacer;
+  g_mutex_unlock (&stats->lock);
+}
+
+/* QoS messages carry the running total of buffers the posting element dropped. Only those of
+ * the video sink and video decoders count, the audio path posts them too. */
+void
+brilliant_frame_stats_handle_qos_message (BrilliantFrameStats *stats, GstMessage *message)
+{
+  guint64 dropped = 0;
+  GstFormat format;
+  gst_message_parse_qos_stats (message, &format, NULL, &dropped);
+  if (format != GST_FORMAT_BUFFERS && format != GST_FORMAT_DEFAULT)
+    return;
+
+  g_mutex_lock (&stats->lock);
+  gboolean is_sink = is_video_sink (stats, GST_MESSAGE_SRC (message));
+  if (!is_sink && !is_video_decoder (GST_MESSAGE_SRC (message))) {
+    g_mutex_unlock (&stats->lock);
+    return;
+  }
+  gchar *name = gst_object_get_name (GST_MESSAGE_SRC (message));
+  gint64 previous = GPOINTER_TO_SIZE (g_hash_table_lookup (stats->qos_dropped, name));
+  g_hash_table_replace (stats->qos_dropped, name, GSIZE_TO_POINTER (dropped));
+  if ((gint64) dropped > previous) {
+    stats->counters[is_sink ? BRILLIANT_FRAME_COUNTER_SINK_QOS_DROPPED
+        : BRILLIANT_FRAME_COUNTER_DECODER_QOS_DROPPED] += dropped - previous;
+  }
+  g_mutex_unlock (&stats->lock);
+}
+
+/* Fill values with the counters then the histogram snapshots. Returns the number of values written. */
+gint
+brilliant_frame_stats_get (BrilliantFrameStats *stats, gint64 *values, gint count)
+{
+  gint64 all[BRILLIANT_FRAME_STATS_FIELDS];
+  g_mutex_lock (&stats->lock);
+  memcpy (all, stats->counters, sizeof (stats->counters));
+  g_mutex_unlock (&stats->lock);
+  for (gint i = 0; i < BRILLIANT_FRAME_HISTOGRAM_COUNT; i++) {
+    BrilliantHistogramSnapshot snapshot;
+    brilliant_histogram_get_snapshot (stats->histograms[i], &snapshot);
+    gint64 *fields = all + BRILLIANT_FRAME_COUNTER_COUNT + i * BRILLIANT_HISTOGRAM_SNAPSHOT_FIELDS;
+    fields[0] = snapshot.count;
+    fields[1] = snapshot.p50;
+    fields[2] = snapshot.p90;
+    fields[3] = snapshot.p99;
+    fields[4] = snapshot.max;
+  }
+  count = MIN (count, BRILLIANT_FRAME_STATS_FIELDS);
+  memcpy (values, all, count * sizeof (gint64));
+  return count;
+}
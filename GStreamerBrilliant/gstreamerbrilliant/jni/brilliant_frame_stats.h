@@ -0,0 +1,74 @@
+/*****************************************************************************
+ * GStreamerBrilliant: Android Library built with system's GStreamer Implementation. Intended for use in Brilliant Mobile App.
+ *****************************************************************************
+ * Copyright (C) 2022 Brilliant Home Technologies
+ *
+ * Authors: Brilliant iOS Team <android_developer # brilliant.tech>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+
+#ifndef GSTREAMERBRILLIANT_BRILLIANT_FRAME_STATS_H
+#define GSTREAMERBRILLIANT_BRILLIANT_FRAME_STATS_H
+#include <gst/gst.h>
+#include "brilliant_histogram.h"
+#include "brilliant_render_pacer.h"
+
+/* Frame level statistics of the video path between the depayloader and the sink, to tell
+ * whether stutter comes from the network, the decoder or rendering.
+ *
+ * Decode time is measured from the parsed access unit entering the decoder to the decoded frame
+ * with the same PTS leaving it. Late frames and their lateness come from the QoS events the sink
+ * sends upstream, QoS drops from the QoS messages the video decoder and sink post. Render
+ * jitter is how far the interval between two presentations strays from their PTS interval.
+ *
+ * brilliant_frame_stats_get fills BRILLIANT_FRAME_STATS_FIELDS values: the counters, then one
+ * BrilliantHistogramSnapshot per histogram. The layout is returned as is by nativeGetFrameStats.
+ * */
+typedef enum
+{
+  BRILLIANT_FRAME_COUNTER_DECODED = 0,
+  BRILLIANT_FRAME_COUNTER_RENDERED,
+  BRILLIANT_FRAME_COUNTER_DECODER_QOS_DROPPED,
+  BRILLIANT_FRAME_COUNTER_SINK_QOS_DROPPED,
+  BRILLIANT_FRAME_COUNTER_LATE,
+  BRILLIANT_FRAME_COUNTER_DECODER_QUEUE_DEPTH,  /* Frames currently inside the decoder */
+  BRILLIANT_FRAME_COUNTER_COUNT
+} BrilliantFrameCounter;
+
+typedef enum
+{
+  BRILLIANT_FRAME_HISTOGRAM_DECODE_TIME = 0,        /* us */
+  BRILLIANT_FRAME_HISTOGRAM_RENDER_JITTER,          /* us */
+  BRILLIANT_FRAME_HISTOGRAM_LATENESS,               /* us, late frames only */
+  BRILLIANT_FRAME_HISTOGRAM_DECODER_QUEUE_DEPTH,    /* Frames, sampled as each one enters */
+  BRILLIANT_FRAME_HISTOGRAM_COUNT
+} BrilliantFrameHistogram;
+
+#define BRILLIANT_FRAME_STATS_FIELDS \
+    (BRILLIANT_FRAME_COUNTER_COUNT + BRILLIANT_FRAME_HISTOGRAM_COUNT * BRILLIANT_HISTOGRAM_SNAPSHOT_FIELDS)
+
+typedef struct _BrilliantFrameStats BrilliantFrameStats;
+
+BrilliantFrameStats *brilliant_frame_stats_new (void);
+void brilliant_frame_stats_free (BrilliantFrameStats *stats);
+void brilliant_frame_stats_watch (BrilliantFrameStats *stats, GstPad *decoder_input_pad,
+    GstPad *decoder_output_pad, GstPad *render_pad);
+void brilliant_frame_stats_set_render_pacer (BrilliantFrameStats *stats,
+    BrilliantRenderPacer *pacer);
+void brilliant_frame_stats_handle_qos_message (BrilliantFrameStats *stats, GstMessage *message);
+gint brilliant_frame_stats_get (BrilliantFrameStats *stats, gint64 *values, gint count);
+#endif //GSTREAMERBRILLIANT_BRILLIANT_FRAME_STATS_H
@@ -0,0 +1,180 @@
+/*****************************************************************************
+ * GStreamerBrilliant: Android Library built with system's GStreamer Implementation. Intended for use in Brilliant Mobile App.
+ *****************************************************************************
+ * Copyright (C) 2022 Brilliant Home Technologies
+ *
+ * Authors: Brilliant iOS Team <android_developer # brilliant.tech>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+
+#include <string.h>
+#include "brilliant_histogram.h"
+
+#define SUB_BUCKET_BITS 4
+#define SUB_BUCKETS (1 << SUB_BUCKET_BITS)
+/* Enough buckets for any non-negative gint64 */
+#define BUCKET_COUNT ((64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS)
+
+typedef struct _HistogramGeneration
+{
+  guint32 buckets[BUCKET_COUNT];
+  gint64 count;
+  gint64 max;
+} HistogramGeneration;
+
+struct _BrilliantHistogram
+{
+  GMutex lock;
+  gint64 window_us;
+  gint64 generation_start;      /* Monotonic time the current generation started */
+  HistogramGeneration generations[2];
+  guint current;
+};
+
+static guint
+bucket_for_value (guint64 value)
+{
+  if (value < SUB_BUCKETS)
+    return (guint) value;
+  guint shift = 63 - __builtin_clzll (value) - SUB_BUCKET_BITS;
+  return (shift + 1) * SUB_BUCKETS + (guint) ((value >> shift) - SUB_BUCKETS);
+}
+
+/* Middle of the range of values falling into the bucket */
+static gint64
+value_for_bucket (guint bucket)
+{
+  if (bucket < SUB_BUCKETS)
+    return bucket;
+  guint shift = bucket / SUB_BUCKETS - 1;
+  guint64 lower = (guint64) (SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+  return (gint64) (lower + ((1ULL << shift) >> 1));
+}
+
+/* Retire generations that fell out of the window. Called with the lock held. */
+static void
+rotate (BrilliantHistogram *histogram, gint64 now)
+{
+  gint64 half_window = histogram->window_us / 2;
+  if (now - histogram->generation_start < half_window)
+    return;
+  if (now - histogram->generation_start >= histogram->window_us) {
+    memset (histogram->generations, 0, sizeof (histogram->generations));
+  } else {
+    histogram->current ^= 1;
+    memset (&histogram->generations[histogram->current], 0, sizeof (HistogramGeneration));
+  }
+  histogram->generation_start = now;
+}
+
+BrilliantHistogram *
+brilliant_histogram_new (gint64 window_us)
+{
+  BrilliantHistogram *histogram = g_new0 (BrilliantHistogram, 1);
+  g_mutex_init (&histogram->lock);
+  histogram->window_us = window_us;
+  histogram->generation_start = g_get_monotonic_time ();
+  return histogram;
+}
+
+void
+brilliant_histogram_free (BrilliantHistogram *histogram)
+{
+  if (!histogram)
+    return;
+  g_mutex_clear (&histogram->lock);
+  g_free (histogram);
+}
+
+void
+brilliant_histogram_add (BrilliantHistogram *histogram, gint64 value)
+{
+  value = MAX (value, 0);
+  g_mutex_lock (&histogram->lock);
+  rotate (histogram, g_get_monotonic_time ());
+  HistogramGeneration *generation = &histogram->generations[histogram->current];
+  generation->buckets[bucket_for_value (value)]++;
+  generation->count++;
+  generation->max = MAX (generation->max, value);
+  g_mutex_unlock (&histogram->lock);
+}
+
+void
+brilliant_histogram_reset (BrilliantHistogram *histogram)
+{
+  g_mutex_lock (&histogram->lock);
+  memset (histogram->generations, 0, sizeof (histogram->generations));
+  histogram->generation_start = g_get_monotonic_time ();
+  g_mutex_unlock (&histogram->lock);
+}
+
+void
+brilliant_histogram_get_snapshot (BrilliantHistogram *histogram,
+    BrilliantHistogramSnapshot *snapshot)
+{
+  memset (snapshot, 0, sizeof (*snapshot));
+  g_mutex_lock (&histogram->lock);
+  rotate (histogram, g_get_monotonic_time ());
+  HistogramGeneration *a = &histogram->generations[0];
+  HistogramGeneration *b = &histogram->generations[1];
+  snapshot->count = a->count + b->count;
+  snapshot->max = MAX (a->max, b->max);
+  if (snapshot->count > 0) {
+    /* Ranks of the percentiles, rounded up so p99 of a handful of samples is their maximum */
+    gint64 p50_rank = (snapshot->count * 50 + 99) / 100;
+    gint64 p90_rank = (snapshot->count * 90 + 99) / 100;
+    gint64 p99_rank = (snapshot->count * 99 + 99) / 100;
+    gint64 seen = 0;
+    for (guint i = 0; i < BUCKET_COUNT && seen < p99_rank; i++) {
+      guint32 in_bucket = a->buckets[i] + b->buckets[i];
+      if (!in_bucket)
+        continue;
+      gint64 value = MIN (value_for_bucket (i), snapshot->max);
+      if (seen < p50_rank && seen + in_bucket >= p50_rank)
+        snapshot->p50 = value;
+      if (seen < p90_rank && seen + in_bucket >= p90_rank)
+        snapshot->p90 = value;
+      if (seen + in_bucket >= p99_rank)
+        snapshot->p99 = value;
+      seen += in_bucket;
+    }
+  }
+  g_mutex_unlock (&histogram->lock);
+}
+
+/* Value at or below which percent of the samples in the window fall, 0 if there are none */
+gint64
+brilliant_histogram_get_percentile (BrilliantHistogram *histogram, guint percent)
+{
+  gint64 result = 0;
+  g_mutex_lock (&histogram->lock);
+  rotate (histogram, g_get_monotonic_time ());
+  HistogramGeneration *a = &histogram->generations[0];
+  HistogramGeneration *b = &histogram->generations[1];
+  gint64 count = a->count + b->count;
+  gint64 rank = MAX ((count * MIN (percent, 100) + 99) / 100, 1);
+  gint64 seen = 0;
+  for (guint i = 0; i < BUCKET_COUNT && count > 0; i++) {
+    seen += a->buckets[i] + b->buckets[i];
+    if (seen >= rank) {
+      result = MIN (value_for_bucket (i), MAX (a->max, b->max));
+      break;
+    }
+  }
+  g_mutex_unlock (&histogram->lock);
+  return result;
+}
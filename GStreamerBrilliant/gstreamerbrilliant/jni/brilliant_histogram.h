@@ -0,0 +1,57 @@
+/*****************************************************************************
+ * GStreamerBrilliant: Android Library built with system's GStreamer Implementation. Intended for use in Brilliant Mobile App.
+ *****************************************************************************
+ * Copyright (C) 2022 Brilliant Home Technologies
+ *
+ * Authors: Brilliant iOS Team <android_developer # brilliant.tech>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+
+#ifndef GSTREAMERBRILLIANT_BRILLIANT_HISTOGRAM_H
+#define GSTREAMERBRILLIANT_BRILLIANT_HISTOGRAM_H
+#include <glib.h>
+
+/* Rolling histogram of non-negative integer samples (typically microseconds).
+ *
+ * Buckets are log-linear: exact below 16, then 16 buckets per power of two, so percentiles are
+ * within ~6% of the true value whatever the range. Samples older than the window are forgotten:
+ * the histogram keeps two generations of half a window each and drops the older one as time
+ * moves on. All functions are thread safe.
+ * */
+typedef struct _BrilliantHistogram BrilliantHistogram;
+
+/* Summary of the samples currently in the window. The field order matches the long[] the JNI
+ * stats queries return for each histogram. */
+typedef struct _BrilliantHistogramSnapshot
+{
+  gint64 count;
+  gint64 p50;
+  gint64 p90;
+  gint64 p99;
+  gint64 max;
+} BrilliantHistogramSnapshot;
+
+#define BRILLIANT_HISTOGRAM_SNAPSHOT_FIELDS 5
+
+BrilliantHistogram *brilliant_histogram_new (gint64 window_us);
+void brilliant_histogram_free (BrilliantHistogram *histogram);
+void brilliant_histogram_add (BrilliantHistogram *histogram, gint64 value);
+void brilliant_histogram_reset (BrilliantHistogram *histogram);
+void brilliant_histogram_get_snapshot (BrilliantHistogram *histogram,
+    BrilliantHistogramSnapshot *snapshot);
+gint64 brilliant_histogram_get_percentile (BrilliantHistogram *histogram, guint percent);
+#endif //GSTREAMERBRILLIANT_BRILLIANT_HISTOGRAM_H
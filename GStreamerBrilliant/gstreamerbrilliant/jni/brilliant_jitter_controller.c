@@ -0,0 +1,355 @@
+/*****************************************************************************
+ * GStreamerBrilliant: Android Library built with system's GStreamer Implementation. Intended for use in Brilliant Mobile App.
+ *****************************************************************************
+ * Copyright (C) 2022 Brilliant Home Technologies
+ *
+ * Authors: Brilliant iOS Team <android_developer # brilliant.tech>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+
+#include <string.h>
+#include <gst/rtp/gstrtpbuffer.h>
+#include "brilliant_jitter_controller.h"
+
+GST_DEBUG_CATEGORY_STATIC (jitter_controller_debug);
+#define GST_CAT_DEFAULT jitter_controller_debug
+
+#define TICK_MS 1000
+/* Interarrival jitter is a mean deviation, this many times it covers nearly all packets */
+#define JITTER_HEADROOM 4
+/* Scheduling and decoding slack on top of what the network needs */
+#define LATENCY_MARGIN_MS 20
+/* Reordering is rare, remember its worst case for this many ticks */
+#define REORDER_HISTORY_TICKS 10
+/* Sequence numbers tracked per pad to time reordered packets */
+#define REORDER_WINDOW 64
+/* Largest change per tick. Late drops are already glitches, so they may raise it further. */
+#define MAX_STEP_UP_MS 60
+#define MAX_STEP_DOWN_MS 20
+#define LATE_STEP_UP_MS 100
+/* Quiet ticks needed before lowering the latency */
+#define CALM_TICKS 5
+/* Differences below this are noise, not worth a change */
+#define MIN_CHANGE_MS 10
+
+typedef struct _TrackState
+{
+  gboolean watched;
+  guint session_id;                   /* rtpbin session the track was set up in */
+  GstElement *jitterbuffer;           /* NULL until rtpbin made one for the track's SSRC */
+  guint min_ms;
+  guint max_ms;
+  guint latency_ms;
+  gint64 tick_reorder_us;             /* Worst reordering delay since the last tick */
+
+  /* Session thread only */
+  gint64 reorder_history_us[REORDER_HISTORY_TICKS];
+  guint calm_ticks;
+} TrackState;
+
+struct _BrilliantJitterController
+{
+  GstElement *rtp_bin;
+  gulong new_jitterbuffer_id;
+  BrilliantRtpStats *rtp_stats;
+  GSource *tick_source;
+
+  GMutex lock;
+  TrackState tracks[BRILLIANT_LATENCY_TRACK_COUNT];
+  gboolean linked;
+
+  /* Session thread only */
+  guint tick_count;
+  GHashTable *late_counts;            /* SSRC -> jitterbuffer num-late at the last tick */
+};
+
+typedef struct _ReorderTracker
+{
+  BrilliantJitterController *controller;
+  TrackState *track;
+  gboolean started;
+  guint16 highest_seq;
+  gint64 arrivals[REORDER_WINDOW];    /* Monotonic arrival time by seq % REORDER_WINDOW, 0 if missing */
+} ReorderTracker;
+
+/* Called with the lock held */
+static BrilliantLatencyTrack
+track_of_session (BrilliantJitterController * controller, guint session_id)
+{
+  for (gint i = 0; i < BRILLIANT_LATENCY_TRACK_COUNT; i++) {
+    if (controller->tracks[i].watched && controller->tracks[i].session_id == session_id)
+      return i;
+  }
+  return BRILLIANT_LATENCY_TRACK_COUNT;
+}
+
+/* Streaming thread: rtpbin made the jitterbuffer of a new SSRC, start it at its track's latency */
+static void
+new_jitterbuffer_cb (GstElement * rtp_bin, GstElement * jitterbuffer, guint session, guint ssrc,
+    BrilliantJitterController * controller)
+{
+  g_mutex_lock (&controller->lock);
+  BrilliantLatencyTrack index = track_of_session (controller, session);
+  guint latency_ms = 0;
+  if (index < BRILLIANT_LATENCY_TRACK_COUNT) {
+    TrackState *track = &controller->tracks[index];
+    gst_object_replace ((GstObject **) & track->jitterbuffer, GST_OBJECT (jitterbuffer));
+    latency_ms = track->latency_ms;
+  }
+  g_mutex_unlock (&controller->lock);
+  if (latency_ms)
+    g_object_set (jitterbuffer, "latency", latency_ms, NULL);
+}
+
+/* Streaming thread: time how long a reordered packet arrived after the first of its successors */
+static GstPadProbeReturn
+reorder_probe (GstPad * pad, GstPadProbeInfo * info, ReorderTracker * tracker)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  if (!gst_rtp_buffer_map (GST_PAD_PROBE_INFO_BUFFER (info), GST_MAP_READ, &rtp))
+    return GST_PAD_PROBE_OK;
+  guint16 seq = gst_rtp_buffer_get_seq (&rtp);
+  gst_rtp_buffer_unmap (&rtp);
+  gint64 now = g_get_monotonic_time ();
+
+  gint diff = tracker->started ? gst_rtp_buffer_compare_seqnum (tracker->highest_seq, seq) : 0;
+  if (!tracker->started || diff >= REORDER_WINDOW || diff <= -REORDER_WINDOW) {
+    memset (tracker->arrivals, 0, sizeof (tracker->arrivals));
+    tracker->started = TRUE;
+    tracker->highest_seq = seq;
+  } else if (diff > 0) {
+    for (guint16 missing = tracker->highest_seq + 1; missing != seq; missing++)
+      tracker->arrivals[missing % REORDER_WINDOW] = 0;
+    tracker->highest_seq = seq;
+  } else if (diff < 0) {
+    gint64 first_successor = now;
+    for (guint16 later = seq + 1; later != (guint16) (tracker->highest_seq + 1); later++) {
+      gint64 arrival = tracker->arrivals[later % REORDER_WINDOW];
+      if (arrival)
+        first_successor = MIN (first_successor, arrival);
+    }
+    g_mutex_lock (&tracker->controller->lock);
+    tracker->track->tick_reorder_us = MAX (tracker->track->tick_reorder_us, now - first_successor);
+    g_mutex_unlock (&tracker->controller->lock);
+  }
+  tracker->arrivals[seq % REORDER_WINDOW] = now;
+  return GST_PAD_PROBE_OK;
+}
+
+/* Packets dropped as late by the jitterbuffer of ssrc since the last tick */
+static gint64
+late_since_last_tick (BrilliantJitterController * controller, guint ssrc, gint64 late)
+{
+  gpointer key = GUINT_TO_POINTER (ssrc);
+  gint64 *last = g_hash_table_lookup (controller->late_counts, key);
+  if (!last) {
+    last = g_new0 (gint64, 1);
+    g_hash_table_insert (controller->late_counts, key, last);
+  }
+  gint64 delta = MAX (late - *last, 0);
+  *last = late;
+  return delta;
+}
+
+/* Called with the lock held. The latency the track should move to this tick, within its bounds. */
+static guint
+next_latency (BrilliantJitterController * controller, TrackState * track, gint64 jitter_us,
+    gint64 late, gboolean receiving)
+{
+  track->reorder_history_us[controller->tick_count % REORDER_HISTORY_TICKS] =
+      track->tick_reorder_us;
+  track->tick_reorder_us = 0;
+  gint64 reorder_us = 0;
+  for (guint i = 0; i < REORDER_HISTORY_TICKS; i++)
+    reorder_us = MAX (reorder_us, track->reorder_history_us[i]);
+
+  guint current = track->latency_ms;
+  gint64 wanted = (JITTER_HEADROOM * jitter_us + reorder_us) / 1000 + LATENCY_MARGIN_MS;
+  guint target = current;
+  if (late > 0) {
+    track->calm_ticks = 0;
+    target = MAX (wanted, current + LATE_STEP_UP_MS);
+  } else if (wanted > current) {
+    track->calm_ticks = 0;
+    target = MIN (wanted, current + MAX_STEP_UP_MS);
+  } else if (receiving && ++track->calm_ticks >= CALM_TICKS) {
+    target = MAX (wanted, (gint64) current - MAX_STEP_DOWN_MS);
+  }
+  GST_LOG ("Session %u wants %" G_GINT64_FORMAT " ms: jitter %" G_GINT64_FORMAT
+      " us, reordering %" G_GINT64_FORMAT " us, %" G_GINT64_FORMAT " late packets",
+      track->session_id, wanted, jitter_us, reorder_us, late);
+  return CLAMP (target, track->min_ms, track->max_ms);
+}
+
+static gboolean
+tick (BrilliantJitterController * controller)
+{
+  gint64 jitter_us[BRILLIANT_LATENCY_TRACK_COUNT] = { 0 };
+  gint64 late[BRILLIANT_LATENCY_TRACK_COUNT] = { 0 };
+  gboolean receiving[BRILLIANT_LATENCY_TRACK_COUNT] = { FALSE };
+  GArray *snapshot = brilliant_rtp_stats_collect (controller->rtp_stats);
+  g_mutex_lock (&controller->lock);
+  for (guint i = 0; i + BRILLIANT_RTP_STATS_FIELD_COUNT <= snapshot->len;
+      i += BRILLIANT_RTP_STATS_FIELD_COUNT) {
+    const gint64 *values = &g_array_index (snapshot, gint64, i);
+    BrilliantLatencyTrack index = track_of_session (controller, values[BRILLIANT_RTP_STATS_SESSION]);
+    if (index == BRILLIANT_LATENCY_TRACK_COUNT)
+      continue;
+    receiving[index] = TRUE;
+    jitter_us[index] = MAX (jitter_us[index], values[BRILLIANT_RTP_STATS_JITTER_US]);
+    late[index] += late_since_last_tick (controller, values[BRILLIANT_RTP_STATS_SSRC],
+        values[BRILLIANT_RTP_STATS_JB_LATE]);
+  }
+  g_array_free (snapshot, TRUE);
+
+  guint targets[BRILLIANT_LATENCY_TRACK_COUNT] = { 0 };
+  guint shared = 0;
+  guint shared_current = 0;
+  for (gint i = 0; i < BRILLIANT_LATENCY_TRACK_COUNT; i++) {
+    if (!controller->tracks[i].watched)
+      continue;
+    targets[i] = next_latency (controller, &controller->tracks[i], jitter_us[i], late[i],
+        receiving[i]);
+    shared = MAX (shared, targets[i]);
+    shared_current = MAX (shared_current, controller->tracks[i].latency_ms);
+  }
+  controller->tick_count++;
+
+  GstElement *changed[BRILLIANT_LATENCY_TRACK_COUNT] = { NULL };
+  for (gint i = 0; i < BRILLIANT_LATENCY_TRACK_COUNT; i++) {
+    TrackState *track = &controller->tracks[i];
+    if (!track->watched)
+      continue;
+    guint current = track->latency_ms;
+    if (controller->linked)
+      targets[i] = CLAMP (shared, track->min_ms, track->max_ms);
+    /* Small moves are noise, unless the bounds or lip sync leave no choice */
+    gboolean forced = current < track->min_ms || current > track->max_ms ||
+        (controller->linked && current != shared_current);
+    if (targets[i] == current ||
+        (ABS ((gint) targets[i] - (gint) current) < MIN_CHANGE_MS && !forced))
+      continue;
+    GST_INFO ("Session %u latency %u -> %u ms", track->session_id, current, targets[i]);
+    track->latency_ms = targets[i];
+    if (track->jitterbuffer)
+      changed[i] = gst_object_ref (track->jitterbuffer);
+  }
+  g_mutex_unlock (&controller->lock);
+
+  /* The jitterbuffers post a LATENCY message, the session recalculates the pipeline latency */
+  for (gint i = 0; i < BRILLIANT_LATENCY_TRACK_COUNT; i++) {
+    if (!changed[i])
+      continue;
+    g_object_set (changed[i], "latency", targets[i], NULL);
+    gst_object_unref (changed[i]);
+  }
+  return G_SOURCE_CONTINUE;
+}
+
+/* Every track starts from the latency rtp_bin was configured with */
+BrilliantJitterController *
+brilliant_jitter_controller_new (GstElement *rtp_bin, BrilliantRtpStats *rtp_stats,
+    GMainContext *context)
+{
+  GST_DEBUG_CATEGORY_INIT (jitter_controller_debug, "brilliant-jitter-controller", 0,
+      "Brilliant adaptive jitterbuffer latency");
+  BrilliantJitterController *controller = g_new0 (BrilliantJitterController, 1);
+  g_mutex_init (&controller->lock);
+  controller->rtp_bin = gst_object_ref (rtp_bin);
+  controller->rtp_stats = rtp_stats;
+  guint latency_ms = 0;
+  g_object_get (rtp_bin, "latency", &latency_ms, NULL);
+  for (gint i = 0; i < BRILLIANT_LATENCY_TRACK_COUNT; i++) {
+    controller->tracks[i].min_ms = BRILLIANT_JITTER_LATENCY_DEFAULT_MIN_MS;
+    controller->tracks[i].max_ms = BRILLIANT_JITTER_LATENCY_DEFAULT_MAX_MS;
+    controller->tracks[i].latency_ms = latency_ms;
+  }
+  controller->late_counts = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+  controller->new_jitterbuffer_id = g_signal_connect (rtp_bin, "new-jitterbuffer",
+      G_CALLBACK (new_jitterbuffer_cb), controller);
+  controller->tick_source = g_timeout_source_new (TICK_MS);
+  g_source_set_callback (controller->tick_source, (GSourceFunc) tick, controller, NULL);
+  g_source_attach (controller->tick_source, context);
+  return controller;
+}
+
+void
+brilliant_jitter_controller_free (BrilliantJitterController *controller)
+{
+  if (!controller)
+    return;
+  g_source_destroy (controller->tick_source);
+  g_source_unref (controller->tick_source);
+  g_signal_handler_disconnect (controller->rtp_bin, controller->new_jitterbuffer_id);
+  gst_object_unref (controller->rtp_bin);
+  for (gint i = 0; i < BRILLIANT_LATENCY_TRACK_COUNT; i++)
+    gst_clear_object (&controller->tracks[i].jitterbuffer);
+  g_hash_table_destroy (controller->late_counts);
+  g_mutex_clear (&controller->lock);
+  g_free (controller);
+}
+
+/* Keep the latency of track within [min_ms, max_ms], applied on the next tick */
+void
+brilliant_jitter_controller_set_bounds (BrilliantJitterController *controller,
+    BrilliantLatencyTrack track, guint min_ms, guint max_ms)
+{
+  g_mutex_lock (&controller->lock);
+  controller->tracks[track].min_ms = MIN (min_ms, max_ms);
+  controller->tracks[track].max_ms = MAX (min_ms, max_ms);
+  g_mutex_unlock (&controller->lock);
+  GST_DEBUG ("Track %d latency bounds [%u, %u] ms", track, MIN (min_ms, max_ms),
+      MAX (min_ms, max_ms));
+}
+
+/* Give every track the largest latency any of them needs, from the next tick on */
+void
+brilliant_jitter_controller_set_linked (BrilliantJitterController *controller, gboolean linked)
+{
+  g_mutex_lock (&controller->lock);
+  controller->linked = linked;
+  g_mutex_unlock (&controller->lock);
+}
+
+/* Adapt the jitterbuffer of track, received in rtpbin session session_id, and measure
+ * reordering on rtp_pad, where its RTP packets enter the rtpbin */
+void
+brilliant_jitter_controller_watch_track (BrilliantJitterController *controller,
+    BrilliantLatencyTrack track, guint session_id, GstPad *rtp_pad)
+{
+  g_mutex_lock (&controller->lock);
+  controller->tracks[track].watched = TRUE;
+  controller->tracks[track].session_id = session_id;
+  g_mutex_unlock (&controller->lock);
+
+  ReorderTracker *tracker = g_new0 (ReorderTracker, 1);
+  tracker->controller = controller;
+  tracker->track = &controller->tracks[track];
+  gst_pad_add_probe (rtp_pad, GST_PAD_PROBE_TYPE_BUFFER, (GstPadProbeCallback) reorder_probe,
+      tracker, g_free);
+}
+
+/* Latency currently asked of the jitterbuffer of track, in milliseconds */
+guint
+brilliant_jitter_controller_get_latency (BrilliantJitterController *controller,
+    BrilliantLatencyTrack track)
+{
+  g_mutex_lock (&controller->lock);
+  guint latency_ms = controller->tracks[track].latency_ms;
+  g_mutex_unlock (&controller->lock);
+  return latency_ms;
+}
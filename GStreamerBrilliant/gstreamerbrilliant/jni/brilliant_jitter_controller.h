@@ -0,0 +1,63 @@
+/*****************************************************************************
+ * GStreamerBrilliant: Android Library built with system's GStreamer Implementation. Intended for use in Brilliant Mobile App.
+ *****************************************************************************
+ * Copyright (C) 2022 Brilliant Home Technologies
+ *
+ * Authors: Brilliant iOS Team <android_developer # brilliant.tech>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+
+#ifndef GSTREAMERBRILLIANT_BRILLIANT_JITTER_CONTROLLER_H
+#define GSTREAMERBRILLIANT_BRILLIANT_JITTER_CONTROLLER_H
+#include <gst/gst.h>
+#include "brilliant_rtp_stats.h"
+#include "brilliant_latency_monitor.h"
+
+/* Adapts the jitterbuffer latency of each track of an rtpbin to the network instead of a fixed
+ * worst case.
+ *
+ * Once a second the controller looks at what the jitterbuffer of each track went through and
+ * picks the latency that would have absorbed it:
+ *   - the RFC 3550 interarrival jitter of the track's remote SSRCs, with headroom for its tail,
+ *   - how long out of order packets arrived after their successors, over the last few seconds,
+ *     as measured on the RTP pad handed to brilliant_jitter_controller_watch_track,
+ *   - packets the jitterbuffer dropped for arriving too late, which push the latency up at once
+ *     and hold it there for a while.
+ * Raising the latency pauses playout and lowering it skips ahead by the difference, so changes
+ * go in small steps: up quickly, down slowly and only once the network has been calm for a
+ * while. Each track has its own bounds, equal bounds fix its latency. Linked tracks all get the
+ * largest latency any of them needs, as lip sync wants.
+ *
+ * All changes happen on the main context the controller was created with.
+ * */
+#define BRILLIANT_JITTER_LATENCY_DEFAULT_MIN_MS 40
+#define BRILLIANT_JITTER_LATENCY_DEFAULT_MAX_MS 1000
+
+typedef struct _BrilliantJitterController BrilliantJitterController;
+
+BrilliantJitterController *brilliant_jitter_controller_new (GstElement *rtp_bin,
+    BrilliantRtpStats *rtp_stats, GMainContext *context);
+void brilliant_jitter_controller_free (BrilliantJitterController *controller);
+void brilliant_jitter_controller_set_bounds (BrilliantJitterController *controller,
+    BrilliantLatencyTrack track, guint min_ms, guint max_ms);
+void brilliant_jitter_controller_set_linked (BrilliantJitterController *controller,
+    gboolean linked);
+void brilliant_jitter_controller_watch_track (BrilliantJitterController *controller,
+    BrilliantLatencyTrack track, guint session_id, GstPad *rtp_pad);
+guint brilliant_jitter_controller_get_latency (BrilliantJitterController *controller,
+    BrilliantLatencyTrack track);
+#endif //GSTREAMERBRILLIANT_BRILLIANT_JITTER_CONTROLLER_H
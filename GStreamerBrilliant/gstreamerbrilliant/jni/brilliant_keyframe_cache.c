@@ -0,0 +1,270 @@
+/*****************************************************************************
+ * GStreamerBrilliant: Android Library built with system's GStreamer Implementation. Intended for use in Brilliant Mobile App.
+ *****************************************************************************
+ * Copyright (C) 2022 Brilliant Home Technologies
+ *
+ * Authors: Brilliant iOS Team <android_developer # brilliant.tech>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+
+#include "brilliant_keyframe_cache.h"
+
+GST_DEBUG_CATEGORY_STATIC (keyframe_cache_debug);
+#define GST_CAT_DEFAULT keyframe_cache_debug
+
+#define KEYFRAME_GROUP "keyframe"
+
+typedef struct _CachedKeyframe
+{
+  GstCaps *caps;                /* Caps the keyframe left the parser with */
+  GstBuffer *buffer;            /* Deep copy of the access unit, SPS/PPS included */
+} CachedKeyframe;
+
+static GMutex cache_lock;
+static GHashTable *keyframes;   /* Camera id -> CachedKeyframe */
+static gchar *cache_directory;  /* Where keyframes are saved, NULL to keep them in memory only */
+
+static void
+free_cached_keyframe (CachedKeyframe *keyframe)
+{
+  gst_caps_unref (keyframe->caps);
+  gst_buffer_unref (keyframe->buffer);
+  g_free (keyframe);
+}
+
+/* Called with cache_lock held */
+static void
+ensure_cache (void)
+{
+  if (keyframes)
+    return;
+  GST_DEBUG_CATEGORY_INIT (keyframe_cache_debug, "brilliant-keyframe-cache", 0,
+      "Last keyframe of each camera");
+  keyframes = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      (GDestroyNotify) free_cached_keyframe);
+}
+
+/* Called with cache_lock held */
+static gchar *
+keyframe_path (const gchar *camera_id)
+{
+  if (!cache_directory)
+    return NULL;
+  gchar *escaped_id = g_uri_escape_string (camera_id, NULL, FALSE);
+  gchar *file_name = g_strconcat (escaped_id, ".keyframe", NULL);
+  gchar *path = g_build_filename (cache_directory, file_name, NULL);
+  g_free (file_name);
+  g_free (escaped_id);
+  return path;
+}
+
+/* Also keep the keyframes in directory, across launches */
+void
+brilliant_keyframe_cache_set_directory (const gchar *directory)
+{
+  g_mutex_lock (&cache_lock);
+  ensure_cache ();
+  g_free (cache_directory);
+  cache_directory = g_strdup (directory);
+  g_mutex_unlock (&cache_lock);
+}
+
+/* Streaming thread, remember each keyframe the parser pushes */
+static GstPadProbeReturn
+keyframe_probe (GstPad *pad, GstPadProbeInfo *info, const gchar *camera_id)
+{
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT)
+      || gst_buffer_get_size (buffer) == 0)
+    return GST_PAD_PROBE_OK;
+  GstCaps *caps = gst_pad_get_current_caps (pad);
+  if (!caps)
+    return GST_PAD_PROBE_OK;
+  CachedKeyframe *keyframe = g_new (CachedKeyframe, 1);
+  keyframe->caps = caps;
+  keyframe->buffer = gst_buffer_copy_deep (buffer);
+  g_mutex_lock (&cache_lock);
+  g_hash_table_replace (keyframes, g_strdup (camera_id), keyframe);
+  g_mutex_unlock (&cache_lock);
+  GST_LOG ("Cached %" G_GSIZE_FORMAT " byte keyframe of %s", gst_buffer_get_size (buffer),
+      camera_id);
+  return GST_PAD_PROBE_OK;
+}
+
+/* Cache the keyframes of camera_id leaving parser, an h264parse */
+void
+brilliant_keyframe_cache_watch (const gchar *camera_id, GstElement *parser)
+{
+  g_mutex_lock (&cache_lock);
+  ensure_cache ();
+  g_mutex_unlock (&cache_lock);
+  /* Every IDR carries its SPS/PPS, so a cached keyframe decodes on its own */
+  g_object_set (parser, "config-interval", -1, NULL);
+  GstPad *pad = gst_element_get_static_pad (parser, "src");
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, (GstPadProbeCallback) keyframe_probe,
+      g_strdup (camera_id), g_free);
+  gst_object_unref (pad);
+}
+
+/* Called with cache_lock held */
+static CachedKeyframe *
+load_keyframe (const gchar *camera_id)
+{
+  gchar *path = keyframe_path (camera_id);
+  if (!path)
+    return NULL;
+  CachedKeyframe *keyframe = NULL;
+  GKeyFile *key_file = g_key_file_new ();
+  if (g_key_file_load_from_file (key_file, path, G_KEY_FILE_NONE, NULL)) {
+    gchar *caps = g_key_file_get_string (key_file, KEYFRAME_GROUP, "caps", NULL);
+    gchar *data = g_key_file_get_string (key_file, KEYFRAME_GROUP, "data", NULL);
+    GstCaps *parsed_caps = caps ? gst_caps_from_string (caps) : NULL;
+    if (parsed_caps && data) {
+      gsize size;
+      guchar *bytes = g_base64_decode (data, &size);
+      keyframe = g_new (CachedKeyframe, 1);
+      keyframe->caps = parsed_caps;
+      keyframe->buffer = gst_buffer_new_wrapped (bytes, size);
+      g_hash_table_replace (keyframes, g_strdup (camera_id), keyframe);
+      GST_DEBUG ("Loaded %" G_GSIZE_FORMAT " byte keyframe of %s from %s", size, camera_id,
+          path);
+    } else if (parsed_caps) {
+      gst_caps_unref (parsed_caps);
+    }
+    g_free (caps);
+    g_free (data);
+  }
+  g_key_file_free (key_file);
+  g_free (path);
+  return keyframe;
+}
+
+/* Once the decoder took the cached keyframe as its reference, live delta units would be decoded
+ * against it. They are dropped until the live stream reaches a keyframe of its own. */
+static GstPadProbeReturn
+live_delta_probe (GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+  if (GST_BUFFER_FLAG_IS_SET (GST_PAD_PROBE_INFO_BUFFER (info), GST_BUFFER_FLAG_DELTA_UNIT))
+    return GST_PAD_PROBE_DROP;
+  GST_DEBUG ("Live stream resumed at a keyframe after the preview");
+  return GST_PAD_PROBE_REMOVE;
+}
+
+/* Hold back live delta units on every sink pad of funnel but the preview's */
+static void
+wait_for_live_keyframe (GstElement *funnel, GstPad *preview_pad)
+{
+  GstIterator *it = gst_element_iterate_sink_pads (funnel);
+  GValue item = G_VALUE_INIT;
+  while (gst_iterator_next (it, &item) == GST_ITERATOR_OK) {
+    GstPad *pad = g_value_get_object (&item);
+    if (pad != preview_pad)
+      gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, live_delta_probe, NULL, NULL);
+    g_value_reset (&item);
+  }
+  g_value_unset (&item);
+  gst_iterator_free (it);
+}
+
+/* Show the cached keyframe of camera_id through a new sink pad of funnel, which must sit between
+ * the parser and the decoder, the live stream resuming at its next keyframe. FALSE if the camera
+ * has no cached keyframe. */
+gboolean
+brilliant_keyframe_cache_add_preview (const gchar *camera_id, GstBin *bin, GstElement *funnel)
+{
+  g_mutex_lock (&cache_lock);
+  ensure_cache ();
+  CachedKeyframe *keyframe = g_hash_table_lookup (keyframes, camera_id);
+  if (!keyframe)
+    keyframe = load_keyframe (camera_id);
+  GstCaps *caps = keyframe ? gst_caps_ref (keyframe->caps) : NULL;
+  GstBuffer *buffer = keyframe ? gst_buffer_copy (keyframe->buffer) : NULL;
+  g_mutex_unlock (&cache_lock);
+  if (!keyframe) {
+    GST_DEBUG ("No cached keyframe of %s", camera_id);
+    return FALSE;
+  }
+
+  GstElement *preview_src = gst_element_factory_make ("appsrc", "preview_src");
+  if (!preview_src) {
+    GST_WARNING ("Cannot create appsrc, no preview for %s", camera_id);
+    gst_caps_unref (caps);
+    gst_buffer_unref (buffer);
+    return FALSE;
+  }
+  g_object_set (preview_src, "caps", caps, "format", GST_FORMAT_TIME, NULL);
+  gst_caps_unref (caps);
+  gst_bin_add (bin, preview_src);
+  if (!gst_element_link (preview_src, funnel)) {
+    GST_WARNING ("Cannot link the preview of %s", camera_id);
+    gst_bin_remove (bin, preview_src);
+    gst_buffer_unref (buffer);
+    return FALSE;
+  }
+  gst_element_sync_state_with_parent (preview_src);
+  GstPad *src_pad = gst_element_get_static_pad (preview_src, "src");
+  GstPad *preview_pad = gst_pad_get_peer (src_pad);
+  wait_for_live_keyframe (funnel, preview_pad);
+  gst_object_unref (preview_pad);
+  gst_object_unref (src_pad);
+
+  /* Untimestamped, so the sink shows it as soon as it is decoded whatever the live clock says */
+  GST_BUFFER_PTS (buffer) = GST_CLOCK_TIME_NONE;
+  GST_BUFFER_DTS (buffer) = GST_CLOCK_TIME_NONE;
+  GstFlowReturn flow_return;
+  g_signal_emit_by_name (preview_src, "push-buffer", buffer, &flow_return);
+  g_signal_emit_by_name (preview_src, "end-of-stream", &flow_return);
+  gst_buffer_unref (buffer);
+  GST_DEBUG ("Showing the cached keyframe of %s", camera_id);
+  return TRUE;
+}
+
+/* Write the cached keyframe of camera_id to the cache directory, if there is one */
+void
+brilliant_keyframe_cache_save (const gchar *camera_id)
+{
+  g_mutex_lock (&cache_lock);
+  ensure_cache ();
+  gchar *path = keyframe_path (camera_id);
+  CachedKeyframe *keyframe = g_hash_table_lookup (keyframes, camera_id);
+  gchar *caps = keyframe && path ? gst_caps_to_string (keyframe->caps) : NULL;
+  GstBuffer *buffer = keyframe && path ? gst_buffer_ref (keyframe->buffer) : NULL;
+  g_mutex_unlock (&cache_lock);
+  if (!caps) {
+    g_free (path);
+    return;
+  }
+
+  GstMapInfo map;
+  if (gst_buffer_map (buffer, &map, GST_MAP_READ)) {
+    gchar *data = g_base64_encode (map.data, map.size);
+    gst_buffer_unmap (buffer, &map);
+    GKeyFile *key_file = g_key_file_new ();
+    g_key_file_set_string (key_file, KEYFRAME_GROUP, "caps", caps);
+    g_key_file_set_string (key_file, KEYFRAME_GROUP, "data", data);
+    GError *error = NULL;
+    if (!g_key_file_save_to_file (key_file, path, &error)) {
+      GST_WARNING ("Could not save the keyframe of %s: %s", camera_id, error->message);
+      g_clear_error (&error);
+    }
+    g_key_file_free (key_file);
+    g_free (data);
+  }
+  gst_buffer_unref (buffer);
+  g_free (caps);
+  g_free (path);
+}
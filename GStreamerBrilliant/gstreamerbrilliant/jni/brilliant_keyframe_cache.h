@@ -0,0 +1,45 @@
+/*****************************************************************************
+ * GStreamerBrilliant: Android Library built with system's GStreamer Implementation. Intended for use in Brilliant Mobile App.
+ *****************************************************************************
+ * Copyright (C) 2022 Brilliant Home Technologies
+ *
+ * Authors: Brilliant iOS Team <android_developer # brilliant.tech>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+
+#ifndef GSTREAMERBRILLIANT_BRILLIANT_KEYFRAME_CACHE_H
+#define GSTREAMERBRILLIANT_BRILLIANT_KEYFRAME_CACHE_H
+#include <gst/gst.h>
+
+/* Keeps the last H.264 keyframe of each camera, to show it while a new session connects.
+ *
+ * brilliant_keyframe_cache_watch copies every keyframe leaving h264parse, with the caps it went
+ * out with. The parser is told to repeat SPS/PPS in front of each IDR, so a keyframe decodes on its
+ * own. brilliant_keyframe_cache_add_preview feeds the camera's cached keyframe to the decoder
+ * through an appsrc on another sink pad of the funnel between parser and decoder, ahead of the
+ * live stream. Nothing is decoded to fill the cache.
+ *
+ * The cache is process wide and held in memory. Once brilliant_keyframe_cache_set_directory was
+ * given a directory, brilliant_keyframe_cache_save also writes a camera's keyframe there and
+ * previews fall back to it, so they survive the process.
+ * */
+void brilliant_keyframe_cache_set_directory (const gchar *directory);
+void brilliant_keyframe_cache_watch (const gchar *camera_id, GstElement *parser);
+gboolean brilliant_keyframe_cache_add_preview (const gchar *camera_id, GstBin *bin,
+    GstElement *funnel);
+void brilliant_keyframe_cache_save (const gchar *camera_id);
+#endif //GSTREAMERBRILLIANT_BRILLIANT_KEYFRAME_CACHE_H
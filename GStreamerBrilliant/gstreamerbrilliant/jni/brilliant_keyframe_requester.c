@@ -0,0 +1,167 @@
+/*****************************************************************************
+ * GStreamerBrilliant: Android Library built with system's GStreamer Implementation. Intended for use in Brilliant Mobile App.
+ *****************************************************************************
+ * Copyright (C) 2022 Brilliant Home Technologies
+ *
+ * Authors: Brilliant iOS Team <android_developer # brilliant.tech>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+
+#include <string.h>
+#include <gst/video/video.h>
+#include "brilliant_keyframe_requester.h"
+
+GST_DEBUG_CATEGORY_STATIC (keyframe_requester_debug);
+#define GST_CAT_DEFAULT keyframe_requester_debug
+
+/* A keyframe takes about a round trip plus one frame to arrive, requests within this interval of
+ * the previous one would only make the camera send another */
+#define MIN_REQUEST_INTERVAL_US (G_USEC_PER_SEC / 2)
+
+struct _BrilliantKeyframeRequester
+{
+  GMutex lock;
+  gint64 values[BRILLIANT_KEYFRAME_REQUEST_FIELD_COUNT];
+  gint64 last_request_us;       /* Monotonic time of the last request forwarded, 0 for none */
+  gint64 outage_start_us;       /* First request not answered by a keyframe yet, 0 for none */
+  gboolean first_frame_seen;
+};
+
+BrilliantKeyframeRequester *
+brilliant_keyframe_requester_new (void)
+{
+  GST_DEBUG_CATEGORY_INIT (keyframe_requester_debug, "brilliant-keyframe-requester", 0,
+      "Brilliant RTCP keyframe requests");
+  BrilliantKeyframeRequester *requester = g_new0 (BrilliantKeyframeRequester, 1);
+  g_mutex_init (&requester->lock);
+  return requester;
+}
+
+void
+brilliant_keyframe_requester_free (BrilliantKeyframeRequester *requester)
+{
+  if (!requester)
+    return;
+  g_mutex_clear (&requester->lock);
+  g_free (requester);
+}
+
+/* Rate limit every keyframe request leaving the depayloader, whoever sent it */
+static GstPadProbeReturn
+request_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  BrilliantKeyframeRequester *requester = user_data;
+  GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+  if (!gst_video_event_is_force_key_unit (event))
+    return GST_PAD_PROBE_OK;
+
+  gint64 now = g_get_monotonic_time ();
+  g_mutex_lock (&requester->lock);
+  if (requester->last_request_us && now - requester->last_request_us < MIN_REQUEST_INTERVAL_US) {
+    requester->values[BRILLIANT_KEYFRAME_REQUEST_SUPPRESSED]++;
+    g_mutex_unlock (&requester->lock);
+    return GST_PAD_PROBE_DROP;
+  }
+  requester->last_request_us = now;
+  if (!requester->outage_start_us)
+    requester->outage_start_us = now;
+  gint64 sent = ++requester->values[BRILLIANT_KEYFRAME_REQUEST_SENT];
+  g_mutex_unlock (&requester->lock);
+  GST_DEBUG ("Requesting keyframe, request %" G_GINT64_FORMAT, sent);
+  return GST_PAD_PROBE_OK;
+}
+
+/* Request a keyframe if the stream starts mid GOP, and time the recovery of every request */
+static GstPadProbeReturn
+frame_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  BrilliantKeyframeRequester *requester = user_data;
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  gboolean keyframe = !GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+  gboolean join_mid_gop = FALSE;
+
+  g_mutex_lock (&requester->lock);
+  if (!requester->first_frame_seen) {
+    requester->first_frame_seen = TRUE;
+    join_mid_gop = !keyframe;
+  }
+  if (keyframe && requester->outage_start_us) {
+    gint64 recovery = g_get_monotonic_time () - requester->outage_start_us;
+    requester->outage_start_us = 0;
+    requester->values[BRILLIANT_KEYFRAME_REQUEST_RECOVERIES]++;
+    requester->values[BRILLIANT_KEYFRAME_REQUEST_LAST_RECOVERY_US] = recovery;
+    requester->values[BRILLIANT_KEYFRAME_REQUEST_MAX_RECOVERY_US] =
+        MAX (requester->values[BRILLIANT_KEYFRAME_REQUEST_MAX_RECOVERY_US], recovery);
+    GST_DEBUG ("Keyframe arrived %" G_GINT64_FORMAT " us after the first request", recovery);
+  }
+  g_mutex_unlock (&requester->lock);
+
+  if (join_mid_gop) {
+    GstElement *depay = gst_pad_get_parent_element (pad);
+    GstPad *sink_pad = gst_element_get_static_pad (depay, "sink");
+    GST_INFO ("Stream starts mid GOP, requesting a keyframe");
+    /* Pushed from the sink pad so it goes through request_probe like any other request */
+    gst_pad_push_event (sink_pad, gst_video_event_new_upstream_force_key_unit (
+            GST_CLOCK_TIME_NONE, TRUE, 0));
+    gst_object_unref (sink_pad);
+    gst_object_unref (depay);
+  }
+  return GST_PAD_PROBE_OK;
+}
+
+/* Decoders request a keyframe themselves when a frame misses its reference */
+static void
+deep_element_added (GstBin * bin, GstBin * sub_bin, GstElement * element, gpointer user_data)
+{
+  if (g_object_class_find_property (G_OBJECT_GET_CLASS (element),
+          "automatic-request-sync-points")) {
+    GST_DEBUG ("%s requests keyframes on decoding errors", GST_OBJECT_NAME (element));
+    g_object_set (element, "automatic-request-sync-points", TRUE, NULL);
+  }
+}
+
+/* Watch the H.264 depayloader of the video track. Decoders are picked up as they are added to
+ * bin, or to any bin inside it. */
+void
+brilliant_keyframe_requester_watch (BrilliantKeyframeRequester *requester, GstBin *bin,
+    GstElement *depay)
+{
+  if (g_object_class_find_property (G_OBJECT_GET_CLASS (depay), "request-keyframe"))
+    g_object_set (depay, "request-keyframe", TRUE, NULL);
+  else
+    GST_WARNING ("%s cannot request keyframes on packet loss", GST_OBJECT_NAME (depay));
+  g_signal_connect (bin, "deep-element-added", G_CALLBACK (deep_element_added), NULL);
+
+  GstPad *sink_pad = gst_element_get_static_pad (depay, "sink");
+  gst_pad_add_probe (sink_pad, GST_PAD_PROBE_TYPE_EVENT_UPSTREAM, request_probe, requester, NULL);
+  gst_object_unref (sink_pad);
+  GstPad *src_pad = gst_element_get_static_pad (depay, "src");
+  gst_pad_add_probe (src_pad, GST_PAD_PROBE_TYPE_BUFFER, frame_probe, requester, NULL);
+  gst_object_unref (src_pad);
+}
+
+/* Fill values with the BrilliantKeyframeRequestField values. Returns the number written. */
+gint
+brilliant_keyframe_requester_get (BrilliantKeyframeRequester *requester, gint64 *values,
+    gint count)
+{
+  count = MIN (count, BRILLIANT_KEYFRAME_REQUEST_FIELD_COUNT);
+  g_mutex_lock (&requester->lock);
+  memcpy (values, requester->values, count * sizeof (gint64));
+  g_mutex_unlock (&requester->lock);
+  return count;
+}
@@ -0,0 +1,61 @@
+/*****************************************************************************
+ * GStreamerBrilliant: Android Library built with system's GStreamer Implementation. Intended for use in Brilliant Mobile App.
+ *****************************************************************************
+ * Copyright (C) 2022 Brilliant Home Technologies
+ *
+ * Authors: Brilliant iOS Team <android_developer # brilliant.tech>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+
+#ifndef GSTREAMERBRILLIANT_BRILLIANT_KEYFRAME_REQUESTER_H
+#define GSTREAMERBRILLIANT_BRILLIANT_KEYFRAME_REQUESTER_H
+#include <gst/gst.h>
+
+/* Asks the camera for a keyframe over RTCP instead of waiting for its next periodic IDR.
+ *
+ * Keyframe requests are GstForceKeyUnit events travelling upstream from the depayloader. rtpbin
+ * turns them into a PLI, or a FIR when the event asks for all headers, for the SSRC they came
+ * from, as allowed by the rtcp-fb-* fields of the track caps. They are sent:
+ *   - when the stream starts on a delta frame, i.e. the session joined mid GOP,
+ *   - by rtph264depay when it detects a missing packet,
+ *   - by decoders that fail to decode a frame for lack of a reference.
+ * Requests closer together than the minimum interval are dropped, a keyframe already on its way
+ * answers them. Recovery time runs from the first request of an outage to the next keyframe out
+ * of the depayloader.
+ *
+ * brilliant_keyframe_requester_get fills BRILLIANT_KEYFRAME_REQUEST_FIELD_COUNT values indexed by
+ * BrilliantKeyframeRequestField, returned as is by nativeGetKeyframeRequests.
+ * */
+typedef enum
+{
+  BRILLIANT_KEYFRAME_REQUEST_SENT = 0,           /* Requests forwarded to rtpbin */
+  BRILLIANT_KEYFRAME_REQUEST_SUPPRESSED,         /* Requests dropped by the rate limit */
+  BRILLIANT_KEYFRAME_REQUEST_RECOVERIES,         /* Keyframes that answered an outstanding request */
+  BRILLIANT_KEYFRAME_REQUEST_LAST_RECOVERY_US,
+  BRILLIANT_KEYFRAME_REQUEST_MAX_RECOVERY_US,
+  BRILLIANT_KEYFRAME_REQUEST_FIELD_COUNT
+} BrilliantKeyframeRequestField;
+
+typedef struct _BrilliantKeyframeRequester BrilliantKeyframeRequester;
+
+BrilliantKeyframeRequester *brilliant_keyframe_requester_new (void);
+void brilliant_keyframe_requester_free (BrilliantKeyframeRequester *requester);
+void brilliant_keyframe_requester_watch (BrilliantKeyframeRequester *requester, GstBin *bin,
+    GstElement *depay);
+gint brilliant_keyframe_requester_get (BrilliantKeyframeRequester *requester, gint64 *values,
+    gint count);
+#endif //GSTREAMERBRILLIANT_BRILLIANT_KEYFRAME_REQUESTER_H
@@ -0,0 +1,328 @@
+/*****************************************************************************
+ * GStreamerBrilliant: Android Library built with system's GStreamer Implementation. Intended for use in Brilliant Mobile App.
+ *****************************************************************************
+ * Copyright (C) 2022 Brilliant Home Technologies
+ *
+ * Authors: Brilliant iOS Team <android_developer # brilliant.tech>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+
+#include <gst/rtp/rtp.h>
+#include "brilliant_latency_monitor.h"
+
+/* Percentiles cover this much recent streaming */
+#define LATENCY_WINDOW_US (30 * G_USEC_PER_SEC)
+/* Frames depayloaded but never rendered (dropped downstream) are forgotten beyond this */
+#define MAX_PENDING_FRAMES 512
+/* Seconds between the NTP (1900) and Unix (1970) epochs */
+#define NTP_UNIX_EPOCH_OFFSET G_GUINT64_CONSTANT (2208988800)
+
+typedef struct _LatencyTrack
+{
+  BrilliantLatencyMonitor *monitor;
+  gint clock_rate;
+  gboolean have_reference;
+  gboolean reference_from_extension;  /* Extension references win over RTCP sender reports */
+  gint64 reference_capture_us;        /* Wall clock capture time of reference_rtp_time */
+  guint32 reference_rtp_time;
+  GstClockTime pipeline_latency;      /* From the LATENCY event sent upstream by the sink */
+  BrilliantRenderPacer *render_pacer; /* Video only, not owned, NULL if the sink always syncs */
+  GHashTable *capture_times;          /* Buffer PTS -> wall clock capture time, us */
+  BrilliantHistogram *histogram;
+} LatencyTrack;
+
+struct _BrilliantLatencyMonitor
+{
+  GMutex lock;
+  guint extension_id;
+  LatencyTrack tracks[BRILLIANT_LATENCY_TRACK_COUNT];
+};
+
+static gint64
+ntp_to_unix_us (guint64 ntp_time)
+{
+  guint64 seconds = ntp_time >> 32;
+  guint64 fraction = ntp_time & G_GUINT64_CONSTANT (0xffffffff);
+  return (gint64) (seconds - NTP_UNIX_EPOCH_OFFSET) * G_USEC_PER_SEC +
+      (gint64) ((fraction * G_USEC_PER_SEC) >> 32);
+}
+
+static gint64
+capture_time_for (LatencyTrack *track, guint32 rtp_time)
+{
+  gint32 rtp_delta = (gint32) (rtp_time - track->reference_rtp_time);
+  return track->reference_capture_us + (gint64) rtp_delta * G_USEC_PER_SEC / track->clock_rate;
+}
+
+static gboolean
+read_capture_time_extension (GstRTPBuffer * rtp, guint id, guint64 * capture_ntp_time)
+{
+  gpointer data;
+  guint size;
+  guint8 appbits;
+
+  if (!id)
+    return FALSE;
+  if (!gst_rtp_buffer_get_extension_onebyte_header (rtp, id, 0, &data, &size) &&
+      !gst_rtp_buffer_get_extension_twobytes_header (rtp, &appbits, id, 0, &data, &size))
+    return FALSE;
+  if (size < 8)
+    return FALSE;
+  *capture_ntp_time = GST_READ_UINT64_BE (data);
+  return TRUE;
+}
+
+/* Depayloader input: remember when the frame each RTP packet belongs to was captured */
+static GstPadProbeReturn
+depay_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  LatencyTrack *track = user_data;
+  BrilliantLatencyMonitor *monitor = track->monitor;
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  guint64 capture_ntp_time;
+
+  if (!GST_BUFFER_PTS_IS_VALID (buffer) || !gst_rtp_buffer_map (buffer, GST_MAP_READ, &rtp))
+    return GST_PAD_PROBE_OK;
+  guint32 rtp_time = gst_rtp_buffer_get_timestamp (&rtp);
+  g_mutex_lock (&monitor->lock);
+  gboolean have_extension = read_capture_time_extension (&rtp, monitor->extension_id,
+      &capture_ntp_time);
+  gst_rtp_buffer_unmap (&rtp);
+
+  if (have_extension) {
+    track->have_reference = TRUE;
+    track->reference_from_extension = TRUE;
+    track->reference_capture_us = ntp_to_unix_us (capture_ntp_time);
+    track->reference_rtp_time = rtp_time;
+  }
+  if (track->have_reference) {
+    GstClockTime pts = GST_BUFFER_PTS (buffer);
+    if (g_hash_table_size (track->capture_times) >= MAX_PENDING_FRAMES)
+      g_hash_table_remove_all (track->capture_times);
+    if (!g_hash_table_contains (track->capture_times, &pts)) {
+      gint64 capture_us = capture_time_for (track, rtp_time);
+      g_hash_table_insert (track->capture_times, g_memdup (&pts, sizeof (pts)),
+          g_memdup (&capture_us, sizeof (capture_us)));
+    }
+  }
+  g_mutex_unlock (&monitor->lock);
+  return GST_PAD_PROBE_OK;
+}
+
+/* Incoming RTCP: use sender reports as the capture time reference until an extension shows up */
+static GstPadProbeReturn
+rtcp_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  LatencyTrack *track = user_data;
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  GstRTCPBuffer rtcp = GST_RTCP_BUFFER_INIT;
+  GstRTCPPacket packet;
+
+  if (!gst_rtcp_buffer_validate (buffer) || !gst_rtcp_buffer_map (buffer, GST_MAP_READ, &rtcp))
+    return GST_PAD_PROBE_OK;
+  gboolean more = gst_rtcp_buffer_get_first_packet (&rtcp, &packet);
+  while (more) {
+    if (gst_rtcp_packet_get_type (&packet) == GST_RTCP_TYPE_SR) {
+      guint32 ssrc, rtp_time, packet_count, octet_count;
+      guint64 ntp_time;
+      gst_rtcp_packet_sr_get_sender_info (&packet, &ssrc, &ntp_time, &rtp_time,
+          &packet_count, &octet_count);
+      g_mutex_lock (&track->monitor->lock);
+      if (!track->reference_from_extension) {
+        track->have_reference = TRUE;
+        track->reference_capture_us = ntp_to_unix_us (ntp_time);
+        track->reference_rtp_time = rtp_time;
+      }
+      g_mutex_unlock (&track->monitor->lock);
+    }
+    more = gst_rtcp_packet_move_to_next (&packet);
+  }
+  gst_rtcp_buffer_unmap (&rtcp);
+  return GST_PAD_PROBE_OK;
+}
+
+/* The sink announces the pipeline latency it will add to every buffer's running time */
+static GstPadProbeReturn
+latency_event_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  LatencyTrack *track = user_data;
+  GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+  if (GST_EVENT_TYPE (event) == GST_EVENT_LATENCY) {
+    GstClockTime latency;
+    gst_event_parse_latency (event, &latency);
+    g_mutex_lock (&track->monitor->lock);
+    track->pipeline_latency = latency;
+    g_mutex_unlock (&track->monitor->lock);
+  }
+  return GST_PAD_PROBE_OK;
+}
+
+/* ts-offset of the sink render_pad feeds, which the sync policy sets to render ahead of or
+ * behind the pipeline latency. 0 for sinks without one. */
+static gint64
+sink_ts_offset (GstPad * render_pad)
+{
+  gint64 ts_offset = 0;
+  GstPad *peer = gst_pad_get_peer (render_pad);
+  GstElement *sink = peer ? gst_pad_get_parent_element (peer) : NULL;
+  if (sink && g_object_class_find_property (G_OBJECT_GET_CLASS (sink), "ts-offset"))
+    g_object_get (sink, "ts-offset", &ts_offset, NULL);
+  if (sink)
+    gst_object_unref (sink);
+  if (peer)
+    gst_object_unref (peer);
+  return ts_offset;
+}
+
+/* Wall clock time the sink will present the buffer, in us. Now if it does not sync to the
+ * clock. */
+static gint64
+presentation_time (LatencyTrack *track, GstPad * pad, GstBuffer * buffer)
+{
+  gint64 now_us = g_get_real_time ();
+  g_mutex_lock (&track->monitor->lock);
+  BrilliantRenderPacer *pacer = track->render_pacer;
+  g_mutex_unlock (&track->monitor->lock);
+  if (pacer && brilliant_render_pacer_get_mode (pacer) == BRILLIANT_RENDER_MODE_IMMEDIATE)
+    return now_us;
+  GstElement *element = gst_pad_get_parent_element (pad);
+  GstClock *clock = element ? gst_element_get_clock (element) : NULL;
+  GstEvent *segment_event = gst_pad_get_sticky_event (pad, GST_EVENT_SEGMENT, 0);
+
+  if (clock && segment_event) {
+    const GstSegment *segment;
+    gst_event_parse_segment (segment_event, &segment);
+    GstClockTime running_time = gst_segment_to_running_time (segment, GST_FORMAT_TIME,
+        GST_BUFFER_PTS (buffer));
+    if (GST_CLOCK_TIME_IS_VALID (running_time)) {
+      GstClockTimeDiff due = (GstClockTimeDiff) (running_time +
+          gst_element_get_base_time (element) + track->pipeline_latency) +
+          sink_ts_offset (pad);
+      GstClockTimeDiff clock_now = (GstClockTimeDiff) gst_clock_get_time (clock);
+      if (due > clock_now)
+        now_us += (due - clock_now) / GST_USECOND;
+    }
+  }
+  if (segment_event)
+    gst_event_unref (segment_event);
+  if (clock)
+    gst_object_unref (clock);
+  if (element)
+    gst_object_unref (element);
+  return now_us;
+}
+
+/* Input of the sink: the frame is about to be presented */
+static GstPadProbeReturn
+render_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  LatencyTrack *track = user_data;
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  GstClockTime pts = GST_BUFFER_PTS (buffer);
+
+  if (!GST_BUFFER_PTS_IS_VALID (buffer))
+    return GST_PAD_PROBE_OK;
+  g_mutex_lock (&track->monitor->lock);
+  gint64 *capture_us = g_hash_table_lookup (track->capture_times, &pts);
+  gint64 capture = capture_us ? *capture_us : 0;
+  if (capture_us)
+    g_hash_table_remove (track->capture_times, &pts);
+  g_mutex_unlock (&track->monitor->lock);
+
+  if (capture)
+    brilliant_histogram_add (track->histogram, presentation_time (track, pad, buffer) - capture);
+  return GST_PAD_PROBE_OK;
+}
+
+BrilliantLatencyMonitor *
+brilliant_latency_monitor_new (void)
+{
+  BrilliantLatencyMonitor *monitor = g_new0 (BrilliantLatencyMonitor, 1);
+  g_mutex_init (&monitor->lock);
+  for (gint i = 0; i < BRILLIANT_LATENCY_TRACK_COUNT; i++) {
+    LatencyTrack *track = &monitor->tracks[i];
+    track->monitor = monitor;
+    track->capture_times = g_hash_table_new_full (g_int64_hash, g_int64_equal, g_free, g_free);
+    track->histogram = brilliant_histogram_new (LATENCY_WINDOW_US);
+  }
+  return monitor;
+}
+
+void
+brilliant_latency_monitor_free (BrilliantLatencyMonitor *monitor)
+{
+  if (!monitor)
+    return;
+  for (gint i = 0; i < BRILLIANT_LATENCY_TRACK_COUNT; i++) {
+    g_hash_table_destroy (monitor->tracks[i].capture_times);
+    brilliant_histogram_free (monitor->tracks[i].histogram);
+  }
+  g_mutex_clear (&monitor->lock);
+  g_free (monitor);
+}
+
+/* Id the device uses for the absolute capture time extension, 0 to rely on RTCP only */
+void
+brilliant_latency_monitor_set_extension_id (BrilliantLatencyMonitor *monitor, guint id)
+{
+  g_mutex_lock (&monitor->lock);
+  monitor->extension_id = id;
+  g_mutex_unlock (&monitor->lock);
+}
+
+/* pacer decides whether the video sink syncs to the clock, it must outlive the watched pads */
+void
+brilliant_latency_monitor_set_render_pacer (BrilliantLatencyMonitor *monitor,
+    BrilliantRenderPacer *pacer)
+{
+  g_mutex_lock (&monitor->lock);
+  monitor->tracks[BRILLIANT_LATENCY_TRACK_VIDEO].render_pacer = pacer;
+  g_mutex_unlock (&monitor->lock);
+}
+
+/* Start measuring a track: depay receives its RTP after the jitterbuffer, rtcp_src its RTCP and
+ * render_pad is the pad feeding its sink. */
+void
+brilliant_latency_monitor_watch_track (BrilliantLatencyMonitor *monitor,
+    BrilliantLatencyTrack track_id, gint clock_rate, GstElement *depay, GstElement *rtcp_src,
+    GstPad *render_pad)
+{
+  LatencyTrack *track = &monitor->tracks[track_id];
+  if (clock_rate <= 0 || !depay || !rtcp_src || !render_pad) {
+    GST_WARNING ("Cannot measure latency of track %d", track_id);
+    return;
+  }
+  track->clock_rate = clock_rate;
+
+  GstPad *depay_sink = gst_element_get_static_pad (depay, "sink");
+  gst_pad_add_probe (depay_sink, GST_PAD_PROBE_TYPE_BUFFER, depay_probe, track, NULL);
+  gst_object_unref (depay_sink);
+  GstPad *rtcp_src_pad = gst_element_get_static_pad (rtcp_src, "src");
+  gst_pad_add_probe (rtcp_src_pad, GST_PAD_PROBE_TYPE_BUFFER, rtcp_probe, track, NULL);
+  gst_object_unref (rtcp_src_pad);
+  gst_pad_add_probe (render_pad, GST_PAD_PROBE_TYPE_BUFFER, render_probe, track, NULL);
+  gst_pad_add_probe (render_pad, GST_PAD_PROBE_TYPE_EVENT_UPSTREAM, latency_event_probe, track,
+      NULL);
+}
+
+void
+brilliant_latency_monitor_get_snapshot (BrilliantLatencyMonitor *monitor,
+    BrilliantLatencyTrack track, BrilliantHistogramSnapshot *snapshot)
+{
+  brilliant_histogram_get_snapshot (monitor->tracks[track].histogram, snapshot);
+}
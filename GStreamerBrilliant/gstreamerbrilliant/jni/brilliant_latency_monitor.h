@@ -0,0 +1,58 @@
+/*****************************************************************************
+ * GStreamerBrilliant: Android Library built with system's GStreamer Implementation. Intended for use in Brilliant Mobile App.
+ *****************************************************************************
+ * Copyright (C) 2022 Brilliant Home Technologies
+ *
+ * Authors: Brilliant iOS Team <android_developer # brilliant.tech>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+
+#ifndef GSTREAMERBRILLIANT_BRILLIANT_LATENCY_MONITOR_H
+#define GSTREAMERBRILLIANT_BRILLIANT_LATENCY_MONITOR_H
+#include <gst/gst.h>
+#include "brilliant_histogram.h"
+#include "brilliant_render_pacer.h"
+
+/* Steady state glass to glass latency of the custom RTP receive path.
+ *
+ * The capture time of each frame comes from the absolute capture time RTP header extension
+ * (http://www.webrtc.org/experiments/rtp-hdrext/abs-capture-time) when the device sends it and
+ * its id is configured, otherwise from the NTP/RTP timestamp mapping of the device's RTCP sender
+ * reports. It is compared with the wall clock time the frame is due at the sink: the running
+ * time of the buffer plus the pipeline latency, so sinks waiting on the clock are accounted for.
+ * Both sides are wall clock times, results assume the device and phone clocks are NTP synced.
+ * */
+typedef enum
+{
+  BRILLIANT_LATENCY_TRACK_VIDEO = 0,
+  BRILLIANT_LATENCY_TRACK_AUDIO,
+  BRILLIANT_LATENCY_TRACK_COUNT
+} BrilliantLatencyTrack;
+
+typedef struct _BrilliantLatencyMonitor BrilliantLatencyMonitor;
+
+BrilliantLatencyMonitor *brilliant_latency_monitor_new (void);
+void brilliant_latency_monitor_free (BrilliantLatencyMonitor *monitor);
+void brilliant_latency_monitor_set_extension_id (BrilliantLatencyMonitor *monitor, guint id);
+void brilliant_latency_monitor_set_render_pacer (BrilliantLatencyMonitor *monitor,
+    BrilliantRenderPacer *pacer);
+void brilliant_latency_monitor_watch_track (BrilliantLatencyMonitor *monitor,
+    BrilliantLatencyTrack track, gint clock_rate, GstElement *depay, GstElement *rtcp_src,
+    GstPad *render_pad);
+void brilliant_latency_monitor_get_snapshot (BrilliantLatencyMonitor *monitor,
+    BrilliantLatencyTrack track, BrilliantHistogramSnapshot *snapshot);
+#endif //GSTREAMERBRILLIANT_BRILLIANT_LATENCY_MONITOR_H
@@ -0,0 +1,313 @@
+/*****************************************************************************
+ * GStreamerBrilliant: Android Library built with system's GStreamer Implementation. Intended for use in Brilliant Mobile App.
+ *****************************************************************************
+ * Copyright (C) 2022 Brilliant Home Technologies
+ *
+ * Authors: Brilliant iOS Team <android_developer # brilliant.tech>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "brilliant_log_ring.h"
+
+#define LOG_RING_CAPACITY 2048  /* Records per ring, a power of two */
+#define LOG_MAX_SESSION_RINGS 8
+#define LOG_OBJECT_SIZE 32
+#define LOG_MESSAGE_SIZE 160
+
+GST_DEBUG_CATEGORY_STATIC (log_ring_debug);
+#define GST_CAT_DEFAULT log_ring_debug
+
+typedef struct _LogRecord
+{
+  guint sequence;               /* Index of the record + 1 once written, 0 while being written */
+  guint8 level;
+  guint32 tid;
+  GstClockTime ts;
+  GstDebugCategory *category;   /* Categories, file and function names are never freed */
+  const gchar *file;
+  const gchar *function;
+  gint line;
+  gchar object[LOG_OBJECT_SIZE];
+  gchar message[LOG_MESSAGE_SIZE];
+} LogRecord;
+
+struct _BrilliantLogRing
+{
+  LogRecord *records;
+  guint head;                   /* Index of the next record */
+  GstElement *pipeline;         /* Pipeline whose objects log here, NULL for the process ring */
+};
+
+static GMutex control_lock;     /* Serializes installation and ring registration, never taken by writers */
+static gboolean installed;
+static gchar *dump_directory;
+static BrilliantLogRing *process_ring;
+static BrilliantLogRing *session_rings[LOG_MAX_SESSION_RINGS];
+static gint writers;            /* Threads currently looking up or writing into a ring */
+static GPrivate thread_id = G_PRIVATE_INIT (NULL);
+
+static guint32
+current_tid (void)
+{
+  gpointer tid = g_private_get (&thread_id);
+  if (!tid) {
+    tid = GUINT_TO_POINTER ((guint) syscall (SYS_gettid));
+    g_private_set (&thread_id, tid);
+  }
+  return GPOINTER_TO_UINT (tid);
+}
+
+static BrilliantLogRing *
+ring_new (GstElement *pipeline)
+{
+  BrilliantLogRing *ring = g_new0 (BrilliantLogRing, 1);
+  ring->pipeline = pipeline;
+  /* Touch every page now rather than faulting them in from the streaming threads */
+  ring->records = g_malloc (LOG_RING_CAPACITY * sizeof (LogRecord));
+  memset (ring->records, 0, LOG_RING_CAPACITY * sizeof (LogRecord));
+  return ring;
+}
+
+/* Ring of the session owning the pipeline object belongs to, the process ring if there is none */
+static BrilliantLogRing *
+ring_for_object (GObject *object)
+{
+  if (!object || !GST_IS_OBJECT (object))
+    return process_ring;
+  GstObject *root = GST_OBJECT_CAST (object);
+  while (GST_OBJECT_PARENT (root))
+    root = GST_OBJECT_PARENT (root);
+  for (gint i = 0; i < LOG_MAX_SESSION_RINGS; i++) {
+    BrilliantLogRing *ring = g_atomic_pointer_get (&session_rings[i]);
+    if (ring && (GstObject *) ring->pipeline == root)
+      return ring;
+  }
+  return process_ring;
+}
+
+static void
+describe_object (gchar *dest, GObject *object)
+{
+  if (!object) {
+    dest[0] = '\0';
+  } else if (GST_IS_PAD (object) && GST_OBJECT_PARENT (object)) {
+    g_snprintf (dest, LOG_OBJECT_SIZE, "%s:%s", GST_DEBUG_PAD_NAME (object));
+  } else if (GST_IS_OBJECT (object)) {
+    g_strlcpy (dest, GST_STR_NULL (GST_OBJECT_NAME (object)), LOG_OBJECT_SIZE);
+  } else {
+    g_strlcpy (dest, G_OBJECT_TYPE_NAME (object), LOG_OBJECT_SIZE);
+  }
+}
+
+/* Installed in place of GStreamer's own log functions, runs on the thread that logs */
+static void
+log_function (GstDebugCategory * category, GstDebugLevel level, const gchar * file,
+    const gchar * function, gint line, GObject * object, GstDebugMessage * message,
+    gpointer user_data)
+{
+  /* Writers announce themselves before looking up a ring, so that detach can wait for them */
+  g_atomic_int_inc (&writers);
+  BrilliantLogRing *ring = ring_for_object (object);
+  guint index = (guint) g_atomic_int_add ((gint *) &ring->head, 1);
+  LogRecord *record = &ring->records[index & (LOG_RING_CAPACITY - 1)];
+  g_atomic_int_set ((gint *) &record->sequence, 0);
+  record->level = level;
+  record->tid = current_tid ();
+  record->ts = gst_util_get_timestamp ();
+  record->category = category;
+  record->file = file;
+  record->function = function;
+  record->line = line;
+  describe_object (record->object, object);
+  g_strlcpy (record->message, GST_STR_NULL (gst_debug_message_get (message)),
+      sizeof (record->message));
+  g_atomic_int_set ((gint *) &record->sequence, index + 1);
+  g_atomic_int_add (&writers, -1);
+}
+
+/* Copy the complete records of ring, skipping the ones being overwritten meanwhile */
+static void
+collect_records (BrilliantLogRing *ring, GArray *records)
+{
+  guint head = (guint) g_atomic_int_get ((gint *) &ring->head);
+  guint first = head > LOG_RING_CAPACITY ? head - LOG_RING_CAPACITY : 0;
+  for (guint index = first; index != head; index++) {
+    LogRecord *record = &ring->records[index & (LOG_RING_CAPACITY - 1)];
+    if ((guint) g_atomic_int_get ((gint *) &record->sequence) != index + 1)
+      continue;
+    LogRecord copy = *record;
+    if ((guint) g_atomic_int_get ((gint *) &record->sequence) != index + 1)
+      continue;
+    g_array_append_val (records, copy);
+  }
+}
+
+static gint
+compare_record_time (gconstpointer a, gconstpointer b)
+{
+  const LogRecord *record_a = a;
+  const LogRecord *record_b = b;
+  if (record_a->ts != record_b->ts)
+    return record_a->ts < record_b->ts ? -1 : 1;
+  return 0;
+}
+
+static void
+write_record (FILE *file, const LogRecord *record)
+{
+  const gchar *source = strrchr (record->file, '/');
+  fprintf (file, "%" GST_TIME_FORMAT " %5u %-7s %20s %s:%d:%s:<%s> %s\n",
+      GST_TIME_ARGS (record->ts), record->tid,
+      gst_debug_level_get_name ((GstDebugLevel) record->level),
+      gst_debug_category_get_name (record->category), source ? source + 1 : record->file,
+      record->line, record->function, record->object, record->message);
+}
+
+/* Start recording the GStreamer debug log into rings instead of logcat, for the rest of the
+ * process' life. thresholds is a GST_DEBUG style string ("*:2,rtpjitterbuffer:5"), NULL keeps
+ * the current ones. Rings are written to dump_dir when a session's pipeline fails, unless it is
+ * NULL. Sessions created afterwards get their own ring. */
+void
+brilliant_log_ring_install (const gchar *thresholds, const gchar *dump_dir)
+{
+  g_mutex_lock (&control_lock);
+  if (!installed) {
+    GST_DEBUG_CATEGORY_INIT (log_ring_debug, "brilliant-log-ring", 0, "In memory debug log");
+    process_ring = ring_new (NULL);
+    /* GStreamer's default output and the logcat one are both added without user data */
+    gst_debug_remove_log_function_by_data (NULL);
+    gst_debug_add_log_function (log_function, process_ring, NULL);
+    installed = TRUE;
+  }
+  g_free (dump_directory);
+  dump_directory = g_strdup (dump_dir);
+  g_mutex_unlock (&control_lock);
+
+  gst_debug_set_active (TRUE);
+  if (thresholds)
+    gst_debug_set_threshold_from_string (thresholds, TRUE);
+  GST_INFO ("Debug log recorded in memory, thresholds %s", GST_STR_NULL (thresholds));
+}
+
+/* Ring of the session running pipeline. NULL if the log ring is not installed or too many
+ * sessions have one, their records then go to the process ring. */
+BrilliantLogRing *
+brilliant_log_ring_new (GstElement *pipeline)
+{
+  g_mutex_lock (&control_lock);
+  BrilliantLogRing *ring = NULL;
+  for (gint i = 0; installed && !ring && i < LOG_MAX_SESSION_RINGS; i++) {
+    if (!session_rings[i]) {
+      ring = ring_new (pipeline);
+      g_atomic_pointer_set (&session_rings[i], ring);
+    }
+  }
+  g_mutex_unlock (&control_lock);
+  if (installed && !ring)
+    GST_WARNING ("No free session log ring, %s logs into the process ring",
+        GST_OBJECT_NAME (pipeline));
+  return ring;
+}
+
+/* Stop routing records to ring, before its pipeline is freed. The records stay available to
+ * brilliant_log_ring_dump. */
+void
+brilliant_log_ring_detach (BrilliantLogRing *ring)
+{
+  if (!ring)
+    return;
+  g_mutex_lock (&control_lock);
+  for (gint i = 0; i < LOG_MAX_SESSION_RINGS; i++) {
+    if (session_rings[i] == ring)
+      g_atomic_pointer_set (&session_rings[i], NULL);
+  }
+  while (g_atomic_int_get (&writers) > 0)
+    g_thread_yield ();
+  ring->pipeline = NULL;
+  g_mutex_unlock (&control_lock);
+}
+
+void
+brilliant_log_ring_free (BrilliantLogRing *ring)
+{
+  if (!ring)
+    return;
+  brilliant_log_ring_detach (ring);
+  g_free (ring->records);
+  g_free (ring);
+}
+
+/* Write the records of ring and of the process ring to path as text, oldest first. A NULL ring
+ * writes the process ring alone. */
+gboolean
+brilliant_log_ring_dump (BrilliantLogRing *ring, const gchar *path, GError **error)
+{
+  if (!g_atomic_int_get (&installed)) {
+    g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED, "The log ring is not installed");
+    return FALSE;
+  }
+  GArray *records = g_array_new (FALSE, FALSE, sizeof (LogRecord));
+  if (ring)
+    collect_records (ring, records);
+  collect_records (process_ring, records);
+  g_array_sort (records, compare_record_time);
+
+  FILE *file = fopen (path, "w");
+  if (!file) {
+    int saved_errno = errno;
+    g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (saved_errno),
+        "Cannot open %s: %s", path, g_strerror (saved_errno));
+    g_array_unref (records);
+    return FALSE;
+  }
+  for (guint i = 0; i < records->len; i++)
+    write_record (file, &g_array_index (records, LogRecord, i));
+  guint written = records->len;
+  g_array_unref (records);
+  if (fclose (file) != 0) {
+    int saved_errno = errno;
+    g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (saved_errno),
+        "Cannot write %s: %s", path, g_strerror (saved_errno));
+    return FALSE;
+  }
+  GST_INFO ("Wrote %u log records to %s", written, path);
+  return TRUE;
+}
+
+/* Write ring to a new file of the dump directory, if one was given at installation */
+void
+brilliant_log_ring_dump_on_error (BrilliantLogRing *ring, const gchar *reason)
+{
+  g_mutex_lock (&control_lock);
+  gchar *path = dump_directory ? g_strdup_printf ("%s/gstreamer-brilliant-%" G_GINT64_FORMAT
+      ".log", dump_directory, g_get_real_time () / G_USEC_PER_SEC) : NULL;
+  g_mutex_unlock (&control_lock);
+  if (!path)
+    return;
+  GError *error = NULL;
+  GST_WARNING ("Dumping the debug log to %s: %s", path, reason);
+  if (!brilliant_log_ring_dump (ring, path, &error)) {
+    GST_ERROR ("Failed to dump the debug log: %s", error->message);
+    g_clear_error (&error);
+  }
+  g_free (path);
+}
@@ -0,0 +1,46 @@
+/*****************************************************************************
+ * GStreamerBrilliant: Android Library built with system's GStreamer Implementation. Intended for use in Brilliant Mobile App.
+ *****************************************************************************
+ * Copyright (C) 2022 Brilliant Home Technologies
+ *
+ * Authors: Brilliant iOS Team <android_developer # brilliant.tech>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+
+#ifndef GSTREAMERBRILLIANT_BRILLIANT_LOG_RING_H
+#define GSTREAMERBRILLIANT_BRILLIANT_LOG_RING_H
+#include <gst/gst.h>
+
+/* In memory GStreamer debug log, so diagnostics can stay enabled in field builds.
+ *
+ * Once installed, the GStreamer debug log no longer goes to logcat: a GstLogFunction copies each
+ * record (time, thread, level, category, source location, object name and message) into a
+ * fixed size ring, the ring of the session whose pipeline the logging object belongs to, or a
+ * process wide ring for everything else. Recording takes a couple of atomic operations and a
+ * copy of the message; the record header is only turned into text when a ring is dumped, on
+ * demand or when the session's pipeline posts an error. The usual per category thresholds apply
+ * before any of this, so messages below them cost a single level comparison.
+ * */
+typedef struct _BrilliantLogRing BrilliantLogRing;
+
+void brilliant_log_ring_install (const gchar *thresholds, const gchar *dump_dir);
+BrilliantLogRing *brilliant_log_ring_new (GstElement *pipeline);
+void brilliant_log_ring_detach (BrilliantLogRing *ring);
+void brilliant_log_ring_free (BrilliantLogRing *ring);
+gboolean brilliant_log_ring_dump (BrilliantLogRing *ring, const gchar *path, GError **error);
+void brilliant_log_ring_dump_on_error (BrilliantLogRing *ring, const gchar *reason);
+#endif //GSTREAMERBRILLIANT_BRILLIANT_LOG_RING_H
@@ -0,0 +1,100 @@
+/*****************************************************************************
+ * GStreamerBrilliant: Android Library built with system's GStreamer Implementation. Intended for use in Brilliant Mobile App.
+ *****************************************************************************
+ * Copyright (C) 2022 Brilliant Home Technologies
+ *
+ * Authors: Brilliant iOS Team <android_developer # brilliant.tech>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+
+#include <string.h>
+#include "brilliant_plugins.h"
+#include "brilliant_session.h"
+
+GST_DEBUG_CATEGORY_STATIC (plugins_debug);
+#define GST_CAT_DEFAULT plugins_debug
+
+/* What build_rtsp_pipeline and build_custom_rtp_pipeline create, directly or through the auto
+ * elements and decodebin */
+static const gchar *rtsp_factories[] = {
+  "rtspsrc", "rtpbin", "udpsrc", "rtph264depay", "h264parse", "decodebin", "typefind",
+  "queue", "autovideoconvert", "autovideosink", "audioconvert", "scaletempo", "volume",
+  "autoaudiosink", NULL
+};
+
+static const gchar *custom_rtp_factories[] = {
+  "rtpbin", "udpsrc", "udpsink", "srtpdec", "srtpenc", "capsfilter", "identity", "queue",
+  "rtph264depay", "h264parse", "decodebin", "typefind", "autovideoconvert", "autovideosink",
+  "rtpL16depay", "rtpL16pay", "audioconvert", "audioresample", "scaletempo", "volume",
+  "autoaudiosink",
+  "autoaudiosrc", NULL
+};
+
+static GMutex warm_up_lock;
+static GHashTable *warmed_up;   /* Factory lists warmed up or being warmed up */
+
+static gpointer
+warm_up_thread (gpointer user_data)
+{
+  const gchar **factories = user_data;
+  gint64 start = g_get_monotonic_time ();
+  for (gint i = 0; factories[i]; i++) {
+    GstElementFactory *factory = gst_element_factory_find (factories[i]);
+    if (!factory) {
+      GST_WARNING ("Element factory %s is missing from this build", factories[i]);
+      continue;
+    }
+    GstPluginFeature *loaded = gst_plugin_feature_load (GST_PLUGIN_FEATURE (factory));
+    if (loaded) {
+      /* Class initialization is what creating the first instance costs the most */
+      GType type = gst_element_factory_get_element_type (GST_ELEMENT_FACTORY (loaded));
+      if (type)
+        g_type_class_unref (g_type_class_ref (type));
+      gst_object_unref (loaded);
+    } else {
+      GST_WARNING ("Could not load element factory %s", factories[i]);
+    }
+    gst_object_unref (factory);
+  }
+  GST_INFO ("Warmed up %u element factories in %" G_GINT64_FORMAT " us",
+      g_strv_length ((gchar **) factories), g_get_monotonic_time () - start);
+  return NULL;
+}
+
+/* Load the element factories of backend_type in the background, once per process */
+void
+brilliant_plugins_warm_up (const gchar *backend_type)
+{
+  const gchar **factories = NULL;
+  if (strcmp (backend_type, backend_type_rtsp) == 0)
+    factories = rtsp_factories;
+  else if (strcmp (backend_type, backend_type_custom_rtp) == 0)
+    factories = custom_rtp_factories;
+  if (!factories)
+    return;
+
+  g_mutex_lock (&warm_up_lock);
+  if (!warmed_up) {
+    GST_DEBUG_CATEGORY_INIT (plugins_debug, "brilliant-plugins", 0, "Plugin warm up");
+    warmed_up = g_hash_table_new (g_direct_hash, g_direct_equal);
+  }
+  gboolean started = g_hash_table_contains (warmed_up, factories);
+  g_hash_table_add (warmed_up, factories);
+  g_mutex_unlock (&warm_up_lock);
+  if (!started)
+    g_thread_unref (g_thread_new ("plugin-warm-up", warm_up_thread, factories));
+}
@@ -0,0 +1,36 @@
+/*****************************************************************************
+ * GStreamerBrilliant: Android Library built with system's GStreamer Implementation. Intended for use in Brilliant Mobile App.
+ *****************************************************************************
+ * Copyright (C) 2022 Brilliant Home Technologies
+ *
+ * Authors: Brilliant iOS Team <android_developer # brilliant.tech>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+
+#ifndef GSTREAMERBRILLIANT_BRILLIANT_PLUGINS_H
+#define GSTREAMERBRILLIANT_BRILLIANT_PLUGINS_H
+#include <gst/gst.h>
+
+/* Plugin loading off the cold start path.
+ *
+ * brilliant_plugins_warm_up loads, on a background thread, the element factories a backend
+ * type builds its pipeline from, and initializes their classes (pad templates, codec tables),
+ * so that the first session of that type does not pay for it. Factories of the other backend
+ * are left alone and get loaded on first lookup, as GStreamer normally does.
+ * */
+void brilliant_plugins_warm_up (const gchar *backend_type);
+#endif //GSTREAMERBRILLIANT_BRILLIANT_PLUGINS_H
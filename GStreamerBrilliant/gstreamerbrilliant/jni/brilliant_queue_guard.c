@@ -0,0 +1,242 @@
+/*****************************************************************************
+ * GStreamerBrilliant: Android Library built with system's GStreamer Implementation. Intended for use in Brilliant Mobile App.
+ *****************************************************************************
+ * Copyright (C) 2022 Brilliant Home Technologies
+ *
+ * Authors: Brilliant iOS Team <android_developer # brilliant.tech>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+
+#include <string.h>
+#include <gst/video/video.h>
+#include "brilliant_queue_guard.h"
+
+GST_DEBUG_CATEGORY_STATIC (queue_guard_debug);
+#define GST_CAT_DEFAULT queue_guard_debug
+
+typedef struct _GuardedQueue
+{
+  GstElement *queue;
+  guint limit_ms;
+  guint64 buffers_in;
+  guint64 buffers_out;
+  guint64 dropped;              /* Counted up to the last flush */
+} GuardedQueue;
+
+struct _BrilliantQueueGuard
+{
+  GMutex lock;
+  gint64 values[BRILLIANT_QUEUE_STATS_FIELD_COUNT];
+  GuardedQueue queues[BRILLIANT_LATENCY_TRACK_COUNT];
+  gboolean dropping_gop;
+};
+
+static const BrilliantQueueStatsField max_level_fields[BRILLIANT_LATENCY_TRACK_COUNT] = {
+  [BRILLIANT_LATENCY_TRACK_VIDEO] = BRILLIANT_QUEUE_STATS_VIDEO_MAX_LEVEL_US,
+  [BRILLIANT_LATENCY_TRACK_AUDIO] = BRILLIANT_QUEUE_STATS_AUDIO_MAX_LEVEL_US,
+};
+
+BrilliantQueueGuard *
+brilliant_queue_guard_new (void)
+{
+  GST_DEBUG_CATEGORY_INIT (queue_guard_debug, "brilliant-queue-guard", 0,
+      "Brilliant bounded queues");
+  BrilliantQueueGuard *guard = g_new0 (BrilliantQueueGuard, 1);
+  g_mutex_init (&guard->lock);
+  guard->queues[BRILLIANT_LATENCY_TRACK_VIDEO].limit_ms = BRILLIANT_QUEUE_DEFAULT_VIDEO_LIMIT_MS;
+  guard->queues[BRILLIANT_LATENCY_TRACK_AUDIO].limit_ms = BRILLIANT_QUEUE_DEFAULT_AUDIO_LIMIT_MS;
+  return guard;
+}
+
+void
+brilliant_queue_guard_free (BrilliantQueueGuard *guard)
+{
+  if (!guard)
+    return;
+  for (gint i = 0; i < BRILLIANT_LATENCY_TRACK_COUNT; i++)
+    gst_clear_object (&guard->queues[i].queue);
+  g_mutex_clear (&guard->lock);
+  g_free (guard);
+}
+
+/* Called with the lock held */
+static void
+configure_queue (GuardedQueue * guarded, BrilliantLatencyTrack track)
+{
+  if (!guarded->queue)
+    return;
+  guint64 limit = (guint64) guarded->limit_ms * GST_MSECOND;
+  if (track == BRILLIANT_LATENCY_TRACK_VIDEO) {
+    g_object_set (guarded->queue, "max-size-time", limit * BRILLIANT_QUEUE_VIDEO_HARD_LIMIT_FACTOR, NULL);
+  } else {
+    g_object_set (guarded->queue, "max-size-time", limit,
+        "leaky", 2,             /* Downstream, drops the oldest buffers */
+        NULL);
+  }
+}
+
+/* Time a queue can hold before dropping, 0 for the default */
+void
+brilliant_queue_guard_set_limit (BrilliantQueueGuard *guard, BrilliantLatencyTrack track,
+    guint limit_ms)
+{
+  g_mutex_lock (&guard->lock);
+  guard->queues[track].limit_ms = limit_ms ? limit_ms :
+      track == BRILLIANT_LATENCY_TRACK_VIDEO ? BRILLIANT_QUEUE_DEFAULT_VIDEO_LIMIT_MS :
+      BRILLIANT_QUEUE_DEFAULT_AUDIO_LIMIT_MS;
+  configure_queue (&guard->queues[track], track);
+  g_mutex_unlock (&guard->lock);
+  GST_DEBUG ("Track %d queue limit %u ms", track, guard->queues[track].limit_ms);
+}
+
+/* Called with the lock held */
+static guint64
+record_level (BrilliantQueueGuard * guard, BrilliantLatencyTrack track)
+{
+  guint64 level = 0;
+  g_object_get (guard->queues[track].queue, "current-level-time", &level, NULL);
+  gint64 *max_level = &guard->values[max_level_fields[track]];
+  *max_level = MAX (*max_level, (gint64) (level / GST_USECOND));
+  return level;
+}
+
+static GstPadProbeReturn
+video_input_probe (GstPad * pad, GstPadProbeInfo * info, BrilliantQueueGuard * guard)
+{
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  gboolean keyframe = !GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+  gboolean request_keyframe = FALSE;
+
+  g_mutex_lock (&guard->lock);
+  guint64 level = record_level (guard, BRILLIANT_LATENCY_TRACK_VIDEO);
+  if (guard->dropping_gop && keyframe) {
+    guard->dropping_gop = FALSE;
+    GST_INFO ("Resuming at keyframe, %" GST_TIME_FORMAT " queued", GST_TIME_ARGS (level));
+  } else if (!guard->dropping_gop && !keyframe &&
+      level > guard->queues[BRILLIANT_LATENCY_TRACK_VIDEO].limit_ms * GST_MSECOND) {
+    guard->dropping_gop = TRUE;
+    guard->values[BRILLIANT_QUEUE_STATS_VIDEO_GOPS_DROPPED]++;
+    request_keyframe = TRUE;
+    GST_INFO ("Decoder %" GST_TIME_FORMAT " behind, dropping the rest of the GOP",
+        GST_TIME_ARGS (level));
+  }
+  gboolean drop = guard->dropping_gop;
+  if (drop)
+    guard->values[BRILLIANT_QUEUE_STATS_VIDEO_FRAMES_DROPPED]++;
+  g_mutex_unlock (&guard->lock);
+
+  /* Upstream of the queue, so the keyframe requester rate limits it like any other */
+  if (request_keyframe) {
+    gst_pad_push_event (pad, gst_video_event_new_upstream_force_key_unit (GST_CLOCK_TIME_NONE,
+            TRUE, 0));
+  }
+  return drop ? GST_PAD_PROBE_DROP : GST_PAD_PROBE_OK;
+}
+
+/* Buffers the leaky audio queue dropped since the last flush are those that went in and
+ * neither came out nor are still queued. Called with the lock held. */
+static guint64
+audio_drops_since_flush (GuardedQueue * audio)
+{
+  guint queued = 0;
+  g_object_get (audio->queue, "current-level-buffers", &queued, NULL);
+  gint64 dropped = (gint64) (audio->buffers_in - audio->buffers_out) - queued;
+  return MAX (dropped, 0);
+}
+
+static GstPadProbeReturn
+audio_input_probe (GstPad * pad, GstPadProbeInfo * info, BrilliantQueueGuard * guard)
+{
+  g_mutex_lock (&guard->lock);
+  guard->queues[BRILLIANT_LATENCY_TRACK_AUDIO].buffers_in++;
+  record_level (guard, BRILLIANT_LATENCY_TRACK_AUDIO);
+  g_mutex_unlock (&guard->lock);
+  return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn
+audio_output_probe (GstPad * pad, GstPadProbeInfo * info, BrilliantQueueGuard * guard)
+{
+  g_mutex_lock (&guard->lock);
+  guard->queues[BRILLIANT_LATENCY_TRACK_AUDIO].buffers_out++;
+  g_mutex_unlock (&guard->lock);
+  return GST_PAD_PROBE_OK;
+}
+
+/* A flush empties the queue without the buffers coming out, so the drops are counted before
+ * the queue sees FLUSH_START and the counts start over once it is empty at FLUSH_STOP */
+static GstPadProbeReturn
+audio_flush_probe (GstPad * pad, GstPadProbeInfo * info, BrilliantQueueGuard * guard)
+{
+  GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+  GuardedQueue *audio = &guard->queues[BRILLIANT_LATENCY_TRACK_AUDIO];
+
+  g_mutex_lock (&guard->lock);
+  if (GST_EVENT_TYPE (event) == GST_EVENT_FLUSH_START) {
+    audio->dropped += audio_drops_since_flush (audio);
+    audio->buffers_in = audio->buffers_out;
+  } else if (GST_EVENT_TYPE (event) == GST_EVENT_FLUSH_STOP) {
+    audio->buffers_in = audio->buffers_out = 0;
+  }
+  g_mutex_unlock (&guard->lock);
+  return GST_PAD_PROBE_OK;
+}
+
+/* Bound queue, the one in front of the decoder for video, the one in front of the sink for
+ * audio */
+void
+brilliant_queue_guard_watch (BrilliantQueueGuard *guard, BrilliantLatencyTrack track,
+    GstElement *queue)
+{
+  g_mutex_lock (&guard->lock);
+  gst_object_replace ((GstObject **) & guard->queues[track].queue, GST_OBJECT (queue));
+  configure_queue (&guard->queues[track], track);
+  g_mutex_unlock (&guard->lock);
+
+  GstPad *sink_pad = gst_element_get_static_pad (queue, "sink");
+  if (track == BRILLIANT_LATENCY_TRACK_VIDEO) {
+    gst_pad_add_probe (sink_pad, GST_PAD_PROBE_TYPE_BUFFER,
+        (GstPadProbeCallback) video_input_probe, guard, NULL);
+  } else {
+    gst_pad_add_probe (sink_pad, GST_PAD_PROBE_TYPE_BUFFER,
+        (GstPadProbeCallback) audio_input_probe, guard, NULL);
+    gst_pad_add_probe (sink_pad, GST_PAD_PROBE_TYPE_EVENT_FLUSH,
+        (GstPadProbeCallback) audio_flush_probe, guard, NULL);
+    GstPad *src_pad = gst_element_get_static_pad (queue, "src");
+    gst_pad_add_probe (src_pad, GST_PAD_PROBE_TYPE_BUFFER,
+        (GstPadProbeCallback) audio_output_probe, guard, NULL);
+    gst_object_unref (src_pad);
+  }
+  gst_object_unref (sink_pad);
+}
+
+/* Fill values with the BrilliantQueueStatsField values. Returns the number written. */
+gint
+brilliant_queue_guard_get (BrilliantQueueGuard *guard, gint64 *values, gint count)
+{
+  count = MIN (count, BRILLIANT_QUEUE_STATS_FIELD_COUNT);
+  g_mutex_lock (&guard->lock);
+  GuardedQueue *audio = &guard->queues[BRILLIANT_LATENCY_TRACK_AUDIO];
+  if (audio->queue) {
+    gint64 dropped = audio->dropped + audio_drops_since_flush (audio);
+    guard->values[BRILLIANT_QUEUE_STATS_AUDIO_BUFFERS_DROPPED] =
+        MAX (guard->values[BRILLIANT_QUEUE_STATS_AUDIO_BUFFERS_DROPPED], dropped);
+  }
+  memcpy (values, guard->values, count * sizeof (gint64));
+  g_mutex_unlock (&guard->lock);
+  return count;
+}
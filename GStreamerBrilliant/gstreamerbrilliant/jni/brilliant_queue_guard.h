@@ -0,0 +1,66 @@
+/*****************************************************************************
+ * GStreamerBrilliant: Android Library built with system's GStreamer Implementation. Intended for use in Brilliant Mobile App.
+ *****************************************************************************
+ * Copyright (C) 2022 Brilliant Home Technologies
+ *
+ * Authors: Brilliant iOS Team <android_developer # brilliant.tech>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+
+#ifndef GSTREAMERBRILLIANT_BRILLIANT_QUEUE_GUARD_H
+#define GSTREAMERBRILLIANT_BRILLIANT_QUEUE_GUARD_H
+#include <gst/gst.h>
+#include "brilliant_latency_monitor.h"
+
+/* Keeps the queues in front of the video decoder and the audio sink from growing without bound
+ * when the phone falls behind, so that live view catches up instead of drifting behind reality.
+ *
+ * Each queue is bounded in time:
+ *   - Video: once the queue holds more than its limit, the rest of the GOP is dropped as it
+ *     arrives and a keyframe is requested upstream. Decoding resumes cleanly at the next
+ *     keyframe while the decoder works through what is queued. The queue itself holds at most
+ *     twice the limit, in case the next keyframe is long to come.
+ *   - Audio: the queue leaks its oldest buffers.
+ *
+ * brilliant_queue_guard_get fills BRILLIANT_QUEUE_STATS_FIELD_COUNT values indexed by
+ * BrilliantQueueStatsField, returned as is by nativeGetQueueDrops.
+ * */
+#define BRILLIANT_QUEUE_DEFAULT_VIDEO_LIMIT_MS 500
+#define BRILLIANT_QUEUE_DEFAULT_AUDIO_LIMIT_MS 200
+/* The video queue holds this many times its limit before blocking upstream */
+#define BRILLIANT_QUEUE_VIDEO_HARD_LIMIT_FACTOR 2
+
+typedef enum
+{
+  BRILLIANT_QUEUE_STATS_VIDEO_FRAMES_DROPPED = 0,
+  BRILLIANT_QUEUE_STATS_VIDEO_GOPS_DROPPED,     /* Times the rest of a GOP was dropped */
+  BRILLIANT_QUEUE_STATS_AUDIO_BUFFERS_DROPPED,
+  BRILLIANT_QUEUE_STATS_VIDEO_MAX_LEVEL_US,     /* Most the video queue held */
+  BRILLIANT_QUEUE_STATS_AUDIO_MAX_LEVEL_US,
+  BRILLIANT_QUEUE_STATS_FIELD_COUNT
+} BrilliantQueueStatsField;
+
+typedef struct _BrilliantQueueGuard BrilliantQueueGuard;
+
+BrilliantQueueGuard *brilliant_queue_guard_new (void);
+void brilliant_queue_guard_free (BrilliantQueueGuard *guard);
+void brilliant_queue_guard_set_limit (BrilliantQueueGuard *guard, BrilliantLatencyTrack track,
+    guint limit_ms);
+void brilliant_queue_guard_watch (BrilliantQueueGuard *guard, BrilliantLatencyTrack track,
+    GstElement *queue);
+gint brilliant_queue_guard_get (BrilliantQueueGuard *guard, gint64 *values, gint count);
+#endif //GSTREAMERBRILLIANT_BRILLIANT_QUEUE_GUARD_H
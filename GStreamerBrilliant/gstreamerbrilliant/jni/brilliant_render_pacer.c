@@ -0,0 +1,275 @@
+/*****************************************************************************
+ * GStreamerBrilliant: Android Library built with system's GStreamer Implementation. Intended for use in Brilliant Mobile App.
+ *****************************************************************************
+ * Copyright (C) 2022 Brilliant Home Technologies
+ *
+ * Authors: Brilliant iOS Team <android_developer # brilliant.tech>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+
+#include <string.h>
+#include "brilliant_render_pacer.h"
+
+GST_DEBUG_CATEGORY_STATIC (render_pacer_debug);
+#define GST_CAT_DEFAULT render_pacer_debug
+
+struct _BrilliantRenderPacer
+{
+  GMutex lock;
+  BrilliantRenderMode mode;
+  GstPipeline *pipeline;        /* Not owned, outlives the pacer's probes */
+  GstElement *queue;
+  GstElement *sink;
+  GstClockTime latency;         /* Distributed to the sinks, NONE until known */
+  guint64 frames_in;
+  guint64 frames_out;
+  gint64 values[BRILLIANT_RENDER_STATS_FIELD_COUNT];
+};
+
+BrilliantRenderPacer *
+brilliant_render_pacer_new (BrilliantRenderMode mode)
+{
+  GST_DEBUG_CATEGORY_INIT (render_pacer_debug, "brilliant-render-pacer", 0,
+      "Brilliant video render mode");
+  BrilliantRenderPacer *pacer = g_new0 (BrilliantRenderPacer, 1);
+  g_mutex_init (&pacer->lock);
+  pacer->mode = mode;
+  pacer->latency = GST_CLOCK_TIME_NONE;
+  return pacer;
+}
+
+void
+brilliant_render_pacer_free (BrilliantRenderPacer *pacer)
+{
+  if (!pacer)
+    return;
+  gst_clear_object (&pacer->queue);
+  gst_clear_object (&pacer->sink);
+  g_mutex_clear (&pacer->lock);
+  g_free (pacer);
+}
+
+/* autovideosink forwards sync to the sink it picked since GStreamer 1.20, before that the sink
+ * is set directly */
+static void
+set_sync (GstElement * sink, gboolean sync)
+{
+  if (g_object_class_find_property (G_OBJECT_GET_CLASS (sink), "sync")) {
+    g_object_set (sink, "sync", sync, NULL);
+    return;
+  }
+  if (!GST_IS_BIN (sink))
+    return;
+  GstIterator *it = gst_bin_iterate_sinks (GST_BIN (sink));
+  GValue item = G_VALUE_INIT;
+  while (gst_iterator_next (it, &item) == GST_ITERATOR_OK) {
+    GstElement *child = g_value_get_object (&item);
+    if (g_object_class_find_property (G_OBJECT_GET_CLASS (child), "sync"))
+      g_object_set (child, "sync", sync, NULL);
+    g_value_reset (&item);
+  }
+  g_value_unset (&item);
+  gst_iterator_free (it);
+}
+
+/* Called with the lock held */
+static void
+configure (BrilliantRenderPacer * pacer)
+{
+  gboolean immediate = pacer->mode == BRILLIANT_RENDER_MODE_IMMEDIATE;
+  if (pacer->queue) {
+    g_object_set (pacer->queue,
+        "max-size-buffers", 1,
+        "max-size-bytes", 0,
+        "max-size-time", (guint64) 0,
+        "leaky", immediate ? 2 : 0,     /* Downstream, drops the oldest */
+        NULL);
+  }
+  if (pacer->sink)
+    set_sync (pacer->sink, !immediate);
+}
+
+void
+brilliant_render_pacer_set_mode (BrilliantRenderPacer *pacer, BrilliantRenderMode mode)
+{
+  g_mutex_lock (&pacer->lock);
+  pacer->mode = mode;
+  configure (pacer);
+  g_mutex_unlock (&pacer->lock);
+  GST_INFO ("Render mode %d", mode);
+}
+
+/* The metrics of the video sink ask, frames are presented on arrival in immediate mode */
+BrilliantRenderMode
+brilliant_render_pacer_get_mode (BrilliantRenderPacer *pacer)
+{
+  g_mutex_lock (&pacer->lock);
+  BrilliantRenderMode mode = pacer->mode;
+  g_mutex_unlock (&pacer->lock);
+  return mode;
+}
+
+static GstPadProbeReturn
+queue_input_probe (GstPad * pad, GstPadProbeInfo * info, BrilliantRenderPacer * pacer)
+{
+  g_mutex_lock (&pacer->lock);
+  pacer->frames_in++;
+  g_mutex_unlock (&pacer->lock);
+  return GST_PAD_PROBE_OK;
+}
+
+/* How long before its clock time the sink gets buffer, 0 if not early or unknown */
+static GstClockTimeDiff
+time_to_clock_time (BrilliantRenderPacer * pacer, GstPad * pad, GstBuffer * buffer,
+    GstClockTime latency, gint64 ts_offset)
+{
+  GstClockTimeDiff early = 0;
+  if (!GST_CLOCK_TIME_IS_VALID (latency))
+    return 0;
+  GstClock *clock = gst_element_get_clock (GST_ELEMENT (pacer->pipeline));
+  GstEvent *event = gst_pad_get_sticky_event (pad, GST_EVENT_SEGMENT, 0);
+  if (clock && event && GST_BUFFER_PTS_IS_VALID (buffer)) {
+    const GstSegment *segment;
+    gst_event_parse_segment (event, &segment);
+    guint64 running_time = gst_segment_to_running_time (segment, GST_FORMAT_TIME,
+        GST_BUFFER_PTS (buffer));
+    if (GST_CLOCK_TIME_IS_VALID (running_time)) {
+      GstClockTime now = gst_clock_get_time (clock) -
+          gst_element_get_base_time (GST_ELEMENT (pacer->pipeline));
+      GstClockTimeDiff due = (GstClockTimeDiff) (running_time + latency) + ts_offset;
+      early = MAX (due - (GstClockTimeDiff) now, 0);
+    }
+  }
+  if (event)
+    gst_event_unref (event);
+  if (clock)
+    gst_object_unref (clock);
+  return early;
+}
+
+static GstPadProbeReturn
+queue_output_probe (GstPad * pad, GstPadProbeInfo * info, BrilliantRenderPacer * pacer)
+{
+  g_mutex_lock (&pacer->lock);
+  pacer->frames_out++;
+  gboolean immediate = pacer->mode == BRILLIANT_RENDER_MODE_IMMEDIATE;
+  GstClockTime latency = pacer->latency;
+  g_mutex_unlock (&pacer->lock);
+  if (!immediate)
+    return GST_PAD_PROBE_OK;
+
+  gint64 ts_offset = 0;
+  if (g_object_class_find_property (G_OBJECT_GET_CLASS (pacer->sink), "ts-offset"))
+    g_object_get (pacer->sink, "ts-offset", &ts_offset, NULL);
+  GstClockTimeDiff early = time_to_clock_time (pacer, pad, GST_PAD_PROBE_INFO_BUFFER (info),
+      latency, ts_offset);
+  if (early > 0) {
+    gint64 early_us = early / GST_USECOND;
+    g_mutex_lock (&pacer->lock);
+    pacer->values[BRILLIANT_RENDER_STATS_FRAMES_EARLY]++;
+    pacer->values[BRILLIANT_RENDER_STATS_DELAY_REMOVED_US] += early_us;
+    pacer->values[BRILLIANT_RENDER_STATS_MAX_DELAY_REMOVED_US] =
+        MAX (pacer->values[BRILLIANT_RENDER_STATS_MAX_DELAY_REMOVED_US], early_us);
+    g_mutex_unlock (&pacer->lock);
+  }
+  return GST_PAD_PROBE_OK;
+}
+
+/* Apply the mode to render_queue and video_output in pipeline, once autovideosink picked its
+ * sink. Pipelines without them keep their default rendering. */
+void
+brilliant_render_pacer_watch (BrilliantRenderPacer *pacer, GstPipeline *pipeline)
+{
+  GstElement *queue = gst_bin_get_by_name (GST_BIN (pipeline), "render_queue");
+  GstElement *sink = gst_bin_get_by_name (GST_BIN (pipeline), "video_output");
+  if (!queue || !sink) {
+    GST_DEBUG ("No render queue, rendering is always paced");
+    if (queue)
+      gst_object_unref (queue);
+    if (sink)
+      gst_object_unref (sink);
+    return;
+  }
+
+  g_mutex_lock (&pacer->lock);
+  pacer->pipeline = pipeline;
+  gst_object_replace ((GstObject **) & pacer->queue, GST_OBJECT (queue));
+  gst_object_replace ((GstObject **) & pacer->sink, GST_OBJECT (sink));
+  configure (pacer);
+  g_mutex_unlock (&pacer->lock);
+
+  GstPad *sink_pad = gst_element_get_static_pad (queue, "sink");
+  gst_pad_add_probe (sink_pad, GST_PAD_PROBE_TYPE_BUFFER,
+      (GstPadProbeCallback) queue_input_probe, pacer, NULL);
+  gst_object_unref (sink_pad);
+  GstPad *src_pad = gst_element_get_static_pad (queue, "src");
+  gst_pad_add_probe (src_pad, GST_PAD_PROBE_TYPE_BUFFER,
+      (GstPadProbeCallback) queue_output_probe, pacer, NULL);
+  gst_object_unref (src_pad);
+  gst_object_unref (queue);
+  gst_object_unref (sink);
+}
+
+/* Latency the pipeline gave its sinks, for the clock time of each frame. Call once it is
+ * PLAYING and whenever the latency is recalculated. The pipeline's own latency property is
+ * only set when overridden, otherwise the sinks get the minimum a latency query reports. */
+void
+brilliant_render_pacer_update_latency (BrilliantRenderPacer *pacer)
+{
+  g_mutex_lock (&pacer->lock);
+  GstPipeline *pipeline = pacer->pipeline;
+  g_mutex_unlock (&pacer->lock);
+  if (!pipeline)
+    return;
+
+  GstClockTime latency = gst_pipeline_get_latency (pipeline);
+  if (!GST_CLOCK_TIME_IS_VALID (latency)) {
+    GstQuery *query = gst_query_new_latency ();
+    if (gst_element_query (GST_ELEMENT (pipeline), query)) {
+      gboolean live;
+      GstClockTime min_latency;
+      gst_query_parse_latency (query, &live, &min_latency, NULL);
+      /* Non live pipelines do not wait for latency, no frame is early because of it */
+      latency = live ? min_latency : 0;
+    }
+    gst_query_unref (query);
+  }
+
+  g_mutex_lock (&pacer->lock);
+  pacer->latency = latency;
+  g_mutex_unlock (&pacer->lock);
+  GST_DEBUG ("Pipeline latency %" GST_TIME_FORMAT, GST_TIME_ARGS (latency));
+}
+
+/* Fill values with the BrilliantRenderStatsField values. Returns the number written. */
+gint
+brilliant_render_pacer_get (BrilliantRenderPacer *pacer, gint64 *values, gint count)
+{
+  count = MIN (count, BRILLIANT_RENDER_STATS_FIELD_COUNT);
+  g_mutex_lock (&pacer->lock);
+  /* Frames the leaky queue dropped went in and neither came out nor are still queued */
+  if (pacer->queue) {
+    guint queued = 0;
+    g_object_get (pacer->queue, "current-level-buffers", &queued, NULL);
+    gint64 superseded = (gint64) (pacer->frames_in - pacer->frames_out) - queued;
+    pacer->values[BRILLIANT_RENDER_STATS_FRAMES_SUPERSEDED] =
+        MAX (pacer->values[BRILLIANT_RENDER_STATS_FRAMES_SUPERSEDED], superseded);
+  }
+  memcpy (values, pacer->values, count * sizeof (gint64));
+  g_mutex_unlock (&pacer->lock);
+  return count;
+}
@@ -0,0 +1,66 @@
+/*****************************************************************************
+ * GStreamerBrilliant: Android Library built with system's GStreamer Implementation. Intended for use in Brilliant Mobile App.
+ *****************************************************************************
+ * Copyright (C) 2022 Brilliant Home Technologies
+ *
+ * Authors: Brilliant iOS Team <android_developer # brilliant.tech>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef GSTREAMERBRILLIANT_BRILLIANT_RENDER_PACER_H
+#define GSTREAMERBRILLIANT_BRILLIANT_RENDER_PACER_H
+#include <gst/gst.h>
+
+/* How the video sink presents decoded frames.
+ *
+ * Both backends put a one frame queue, render_queue, between video_convert and the video sink,
+ * video_output:
+ *   - Paced, the default: the sink waits for each frame's clock time, and the queue blocks.
+ *   - Immediate: the sink presents frames as soon as they arrive, without clock sync and so
+ *     without QoS, and the queue leaks. A frame the sink has not taken before the next one is
+ *     decoded is superseded and dropped.
+ * In immediate mode, each frame presented ahead of its clock time counts how much earlier it is
+ * shown than paced mode would have.
+ *
+ * brilliant_render_pacer_get fills BRILLIANT_RENDER_STATS_FIELD_COUNT values indexed by
+ * BrilliantRenderStatsField, returned as is by nativeGetRenderStats.
+ * */
+typedef enum
+{
+  BRILLIANT_RENDER_MODE_PACED = 0,
+  BRILLIANT_RENDER_MODE_IMMEDIATE,
+  BRILLIANT_RENDER_MODE_COUNT
+} BrilliantRenderMode;
+
+typedef enum
+{
+  BRILLIANT_RENDER_STATS_FRAMES_EARLY = 0,      /* Presented before their clock time */
+  BRILLIANT_RENDER_STATS_FRAMES_SUPERSEDED,     /* Dropped for a newer frame */
+  BRILLIANT_RENDER_STATS_DELAY_REMOVED_US,      /* Sum over the early frames */
+  BRILLIANT_RENDER_STATS_MAX_DELAY_REMOVED_US,
+  BRILLIANT_RENDER_STATS_FIELD_COUNT
+} BrilliantRenderStatsField;
+
+typedef struct _BrilliantRenderPacer BrilliantRenderPacer;
+
+BrilliantRenderPacer *brilliant_render_pacer_new (BrilliantRenderMode mode);
+void brilliant_render_pacer_free (BrilliantRenderPacer *pacer);
+void brilliant_render_pacer_watch (BrilliantRenderPacer *pacer, GstPipeline *pipeline);
+void brilliant_render_pacer_set_mode (BrilliantRenderPacer *pacer, BrilliantRenderMode mode);
+BrilliantRenderMode brilliant_render_pacer_get_mode (BrilliantRenderPacer *pacer);
+void brilliant_render_pacer_update_latency (BrilliantRenderPacer *pacer);
+gint brilliant_render_pacer_get (BrilliantRenderPacer *pacer, gint64 *values, gint count);
+#endif //GSTREAMERBRILLIANT_BRILLIANT_RENDER_PACER_H
@@ -0,0 +1,171 @@
+/*****************************************************************************
+ * GStreamerBrilliant: Android Library built with system's GStreamer Implementation. Intended for use in Brilliant Mobile App.
+ *****************************************************************************
+ * Copyright (C) 2022 Brilliant Home Technologies
+ *
+ * Authors: Brilliant iOS Team <android_developer # brilliant.tech>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+
+#include "brilliant_rtp_stats.h"
+
+/* rtpbin creates sessions on demand, the custom RTP backend uses three */
+#define MAX_SESSIONS 8
+
+struct _BrilliantRtpStats
+{
+  GstElement *rtp_bin;
+  gulong new_jitterbuffer_id;
+  GMutex lock;
+  GHashTable *jitterbuffers;    /* SSRC -> rtpjitterbuffer */
+};
+
+/* Streaming thread: rtpbin made a jitterbuffer for a new SSRC */
+static void
+new_jitterbuffer_cb (GstElement * rtp_bin, GstElement * jitterbuffer, guint session,
+    guint ssrc, BrilliantRtpStats * stats)
+{
+  g_mutex_lock (&stats->lock);
+  g_hash_table_replace (stats->jitterbuffers, GUINT_TO_POINTER (ssrc),
+      gst_object_ref (jitterbuffer));
+  g_mutex_unlock (&stats->lock);
+}
+
+static gint64
+structure_get_int64 (const GstStructure * structure, const gchar * field)
+{
+  const GValue *value = gst_structure_get_value (structure, field);
+  if (!value)
+    return 0;
+  if (G_VALUE_HOLDS_UINT64 (value))
+    return (gint64) g_value_get_uint64 (value);
+  if (G_VALUE_HOLDS_INT64 (value))
+    return g_value_get_int64 (value);
+  if (G_VALUE_HOLDS_UINT (value))
+    return g_value_get_uint (value);
+  if (G_VALUE_HOLDS_INT (value))
+    return g_value_get_int (value);
+  return 0;
+}
+
+static void
+add_jitterbuffer_stats (BrilliantRtpStats * stats, guint ssrc, gint64 * values)
+{
+  g_mutex_lock (&stats->lock);
+  GstElement *jitterbuffer = g_hash_table_lookup (stats->jitterbuffers, GUINT_TO_POINTER (ssrc));
+  if (jitterbuffer)
+    gst_object_ref (jitterbuffer);
+  g_mutex_unlock (&stats->lock);
+  if (!jitterbuffer)
+    return;
+
+  GstStructure *jb_stats = NULL;
+  g_object_get (jitterbuffer, "stats", &jb_stats, NULL);
+  if (jb_stats) {
+    values[BRILLIANT_RTP_STATS_JB_PUSHED] = structure_get_int64 (jb_stats, "num-pushed");
+    values[BRILLIANT_RTP_STATS_JB_LOST] = structure_get_int64 (jb_stats, "num-lost");
+    values[BRILLIANT_RTP_STATS_JB_LATE] = structure_get_int64 (jb_stats, "num-late");
+    values[BRILLIANT_RTP_STATS_JB_DUPLICATES] = structure_get_int64 (jb_stats, "num-duplicates");
+    values[BRILLIANT_RTP_STATS_JB_AVG_JITTER_US] =
+        structure_get_int64 (jb_stats, "avg-jitter") / GST_USECOND;
+    gst_structure_free (jb_stats);
+  }
+  gst_object_unref (jitterbuffer);
+}
+
+/* Append one entry per remote source of the session */
+static void
+add_session_stats (BrilliantRtpStats * stats, guint session_id, GObject * session, GArray * snapshot)
+{
+  GstStructure *session_stats = NULL;
+  g_object_get (session, "stats", &session_stats, NULL);
+  if (!session_stats)
+    return;
+
+  G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+  const GValue *sources_value = gst_structure_get_value (session_stats, "source-stats");
+  GValueArray *sources = sources_value ? g_value_get_boxed (sources_value) : NULL;
+  for (guint i = 0; sources && i < sources->n_values; i++) {
+    const GstStructure *source = g_value_get_boxed (g_value_array_get_nth (sources, i));
+    gboolean internal = FALSE;
+    guint ssrc = 0;
+    gint clock_rate = 0;
+    gst_structure_get_boolean (source, "internal", &internal);
+    if (internal || !gst_structure_get_uint (source, "ssrc", &ssrc))
+      continue;
+    gst_structure_get_int (source, "clock-rate", &clock_rate);
+
+    gint64 values[BRILLIANT_RTP_STATS_FIELD_COUNT] = { 0 };
+    values[BRILLIANT_RTP_STATS_SESSION] = session_id;
+    values[BRILLIANT_RTP_STATS_SSRC] = ssrc;
+    values[BRILLIANT_RTP_STATS_PACKETS_RECEIVED] = structure_get_int64 (source, "packets-received");
+    values[BRILLIANT_RTP_STATS_BYTES_RECEIVED] = structure_get_int64 (source, "octets-received");
+    values[BRILLIANT_RTP_STATS_PACKETS_LOST] = structure_get_int64 (source, "packets-lost");
+    if (clock_rate > 0) {
+      values[BRILLIANT_RTP_STATS_JITTER_US] =
+          structure_get_int64 (source, "jitter") * G_USEC_PER_SEC / clock_rate;
+    }
+    /* Round trip is in 1/65536 seconds */
+    values[BRILLIANT_RTP_STATS_RTT_US] =
+        structure_get_int64 (source, "rb-round-trip") * G_USEC_PER_SEC / 65536;
+    add_jitterbuffer_stats (stats, ssrc, values);
+    g_array_append_vals (snapshot, values, BRILLIANT_RTP_STATS_FIELD_COUNT);
+  }
+  G_GNUC_END_IGNORE_DEPRECATIONS
+  gst_structure_free (session_stats);
+}
+
+BrilliantRtpStats *
+brilliant_rtp_stats_new (GstElement *rtp_bin)
+{
+  BrilliantRtpStats *stats = g_new0 (BrilliantRtpStats, 1);
+  g_mutex_init (&stats->lock);
+  stats->jitterbuffers = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+      gst_object_unref);
+  stats->rtp_bin = gst_object_ref (rtp_bin);
+  stats->new_jitterbuffer_id = g_signal_connect (rtp_bin, "new-jitterbuffer",
+      G_CALLBACK (new_jitterbuffer_cb), stats);
+  return stats;
+}
+
+void
+brilliant_rtp_stats_free (BrilliantRtpStats *stats)
+{
+  if (!stats)
+    return;
+  g_signal_handler_disconnect (stats->rtp_bin, stats->new_jitterbuffer_id);
+  gst_object_unref (stats->rtp_bin);
+  g_hash_table_destroy (stats->jitterbuffers);
+  g_mutex_clear (&stats->lock);
+  g_free (stats);
+}
+
+/* Take a snapshot of all remote SSRCs. The caller owns the returned array of gint64. */
+GArray *
+brilliant_rtp_stats_collect (BrilliantRtpStats *stats)
+{
+  GArray *snapshot = g_array_new (FALSE, FALSE, sizeof (gint64));
+  for (guint session_id = 0; session_id < MAX_SESSIONS; session_id++) {
+    GObject *session = NULL;
+    g_signal_emit_by_name (stats->rtp_bin, "get-internal-session", session_id, &session);
+    if (!session)
+      continue;
+    add_session_stats (stats, session_id, session, snapshot);
+    g_object_unref (session);
+  }
+  return snapshot;
+}
@@ -0,0 +1,57 @@
+/*****************************************************************************
+ * GStreamerBrilliant: Android Library built with system's GStreamer Implementation. Intended for use in Brilliant Mobile App.
+ *****************************************************************************
+ * Copyright (C) 2022 Brilliant Home Technologies
+ *
+ * Authors: Brilliant iOS Team <android_developer # brilliant.tech>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+
+#ifndef GSTREAMERBRILLIANT_BRILLIANT_RTP_STATS_H
+#define GSTREAMERBRILLIANT_BRILLIANT_RTP_STATS_H
+#include <gst/gst.h>
+
+/* Per SSRC receive statistics of an rtpbin: RTCP derived numbers from its sessions plus the
+ * counters of the jitterbuffer handling that SSRC.
+ *
+ * A snapshot is a flat array of gint64 with BRILLIANT_RTP_STATS_FIELD_COUNT values per remote
+ * SSRC, indexed by the fields below. The layout is part of the Java interface (nativeGetRtpStats
+ * and onRtpStats), so only append new fields.
+ * */
+typedef enum
+{
+  BRILLIANT_RTP_STATS_SESSION = 0,        /* rtpbin session id, in the order the tracks were set up */
+  BRILLIANT_RTP_STATS_SSRC,
+  BRILLIANT_RTP_STATS_PACKETS_RECEIVED,
+  BRILLIANT_RTP_STATS_BYTES_RECEIVED,
+  BRILLIANT_RTP_STATS_PACKETS_LOST,       /* Expected minus received, as in RTCP receiver reports */
+  BRILLIANT_RTP_STATS_JITTER_US,          /* RFC 3550 interarrival jitter */
+  BRILLIANT_RTP_STATS_RTT_US,             /* From the last report block the SSRC sent, 0 if none */
+  BRILLIANT_RTP_STATS_JB_PUSHED,          /* Jitterbuffer: packets pushed downstream */
+  BRILLIANT_RTP_STATS_JB_LOST,            /* Jitterbuffer: packets given up on */
+  BRILLIANT_RTP_STATS_JB_LATE,            /* Jitterbuffer: packets dropped for arriving too late */
+  BRILLIANT_RTP_STATS_JB_DUPLICATES,
+  BRILLIANT_RTP_STATS_JB_AVG_JITTER_US,
+  BRILLIANT_RTP_STATS_FIELD_COUNT
+} BrilliantRtpStatsField;
+
+typedef struct _BrilliantRtpStats BrilliantRtpStats;
+
+BrilliantRtpStats *brilliant_rtp_stats_new (GstElement *rtp_bin);
+void brilliant_rtp_stats_free (BrilliantRtpStats *stats);
+GArray *brilliant_rtp_stats_collect (BrilliantRtpStats *stats);
+#endif //GSTREAMERBRILLIANT_BRILLIANT_RTP_STATS_H
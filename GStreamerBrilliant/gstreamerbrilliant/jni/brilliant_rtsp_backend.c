@@ -20,7 +20,8 @@
  * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
  *****************************************************************************/
 
-#include "gstreamer_brilliant_android.h"
+#include "brilliant_session.h"
+#include "brilliant_decoder_cache.h"
 #include <gst/gst.h>
 
 int build_rtsp_pipeline(CustomData *data)
@@ -31,14 +32,27 @@ int build_rtsp_pipeline(CustomData *data)
     return FALSE;
   }
   GError *error = NULL;
-  /* Build pipeline */
-  char *parseLaunchString = "rtspsrc debug=true name=rtspsrc rtspsrc. ! "
-                            "rtph264depay ! h264parse ! decodebin ! "
-                            "autovideoconvert ! autovideosink "
-                            "rtspsrc. ! decodebin ! audioconvert ! "
-                            "volume name=vol ! autoaudiosink";
+  /* Build pipeline, the video decoder between preview_funnel and video_convert is placed below.
+   * The funnel lets attach_keyframe_cache show a cached keyframe while rtspsrc connects.
+   * Catch-up playback measures the queues and speeds audio up through scaletempo when audiofx
+   * is there, the render queue and video_output are set up by BrilliantRenderPacer. */
+  GstElementFactory *tempo_factory = gst_element_factory_find("scaletempo");
+  gboolean have_tempo = tempo_factory != NULL;
+  if (have_tempo)
+    gst_object_unref(tempo_factory);
+  else
+    GST_WARNING("scaletempo is missing, audio will not catch up");
+  gchar *parseLaunchString = g_strdup_printf("rtspsrc name=rtspsrc rtspsrc. ! "
+                            "rtph264depay name=video_depay ! queue name=video_queue ! "
+                            "h264parse name=parser ! funnel name=preview_funnel "
+                            "autovideoconvert name=video_convert ! queue name=render_queue ! "
+                            "autovideosink name=video_output "
+                            "rtspsrc. ! decodebin ! queue name=audio_queue ! audioconvert ! "
+                            "%svolume name=vol ! autoaudiosink",
+                            have_tempo ? "scaletempo name=catch_up_tempo ! audioconvert ! " : "");
 
   data->pipeline = gst_parse_launch (parseLaunchString, &error);
+  g_free (parseLaunchString);
   if (error) {
       gchar *message =
               g_strdup_printf ("Unable to build pipeline: %s", error->message);
@@ -59,6 +73,78 @@ int build_rtsp_pipeline(CustomData *data)
       g_object_set(data->volume, "mute", FALSE, NULL);
   }
 
+  GstElement *video_depay = gst_bin_get_by_name(GST_BIN (data->pipeline), "video_depay");
+  brilliant_startup_timings_watch_element(&data->startup_timings, video_depay, "src",
+                                          BRILLIANT_STARTUP_FIRST_IDR);
+  GstElement *video_convert = gst_bin_get_by_name(GST_BIN (data->pipeline), "video_convert");
+  brilliant_startup_timings_watch_element(&data->startup_timings, video_convert, "sink",
+                                          BRILLIANT_STARTUP_FIRST_DECODED_FRAME);
+  GstElement *render_queue = gst_bin_get_by_name(GST_BIN (data->pipeline), "render_queue");
+  brilliant_startup_timings_watch_element(&data->startup_timings, render_queue, "src",
+                                          BRILLIANT_STARTUP_FIRST_FRAME_RENDERED);
+  GstElement *parser = gst_bin_get_by_name(GST_BIN (data->pipeline), "parser");
+  GstElement *preview_funnel = gst_bin_get_by_name(GST_BIN (data->pipeline), "preview_funnel");
+  gboolean decoder_placed = preview_funnel && video_convert &&
+      brilliant_decoder_cache_add_decoder(GST_BIN (data->pipeline), preview_funnel,
+                                          "video/x-h264", video_convert) != NULL;
+  if (preview_funnel)
+    gst_object_unref(preview_funnel);
+  if (parser && video_convert && render_queue) {
+    GstPad *decoder_input_pad = gst_element_get_static_pad(parser, "src");
+    GstPad *decoder_output_pad = gst_element_get_static_pad(video_convert, "sink");
+    GstPad *render_pad = gst_element_get_static_pad(render_queue, "src");
+    brilliant_frame_stats_watch(data->frame_stats, decoder_input_pad, decoder_output_pad, render_pad);
+    gst_object_unref(decoder_input_pad);
+    gst_object_unref(decoder_output_pad);
+    gst_object_unref(render_pad);
+  }
+  if (parser)
+    gst_object_unref(parser);
+  if (video_depay)
+    gst_object_unref(video_depay);
+  if (video_convert)
+    gst_object_unref(video_convert);
+  if (render_queue)
+    gst_object_unref(render_queue);
+  if (!decoder_placed) {
+    GST_ERROR("Could not set up the video decoder");
+    return FALSE;
+  }
+
+  data->catch_up = brilliant_catch_up_new();
+  for (int track = 0; track < BRILLIANT_LATENCY_TRACK_COUNT; track++) {
+    if (data->catch_up_target_ms[track]) {
+      brilliant_catch_up_set_target(data->catch_up, track, data->catch_up_target_ms[track]);
+    }
+  }
+  GstElement *video_queue = gst_bin_get_by_name(GST_BIN (data->pipeline), "video_queue");
+  GstElement *audio_queue = gst_bin_get_by_name(GST_BIN (data->pipeline), "audio_queue");
+  GstElement *tempo = gst_bin_get_by_name(GST_BIN (data->pipeline), "catch_up_tempo");
+  // Same time bounds as the custom RTP queues, without the queue guard on top
+  if (video_queue) {
+    g_object_set(video_queue,
+                 "max-size-buffers", 0,
+                 "max-size-bytes", 0,
+                 "max-size-time", (guint64) BRILLIANT_QUEUE_DEFAULT_VIDEO_LIMIT_MS *
+                                  BRILLIANT_QUEUE_VIDEO_HARD_LIMIT_FACTOR * GST_MSECOND,
+                 NULL);
+    brilliant_catch_up_watch_video(data->catch_up, video_queue);
+    gst_object_unref(video_queue);
+  }
+  if (audio_queue) {
+    g_object_set(audio_queue,
+                 "max-size-buffers", 0,
+                 "max-size-bytes", 0,
+                 "max-size-time", (guint64) BRILLIANT_QUEUE_DEFAULT_AUDIO_LIMIT_MS * GST_MSECOND,
+                 "leaky", 2, // Downstream, drops the oldest buffers
+                 NULL);
+    if (tempo)
+      brilliant_catch_up_watch_audio(data->catch_up, audio_queue, tempo);
+    gst_object_unref(audio_queue);
+  }
+  if (tempo)
+    gst_object_unref(tempo);
+
   g_object_set(rtsp_data->rtsp_src, "protocols", 0x4, NULL);
   g_object_set(rtsp_data->rtsp_src, "tcp-timeout",(guint64)1000000*15, NULL); // In microseconds
   return TRUE;
@@ -22,7 +22,7 @@
 
 #ifndef GSTREAMERBRILLIANT_BRILLIANT_RTSP_BACKEND_H
 #define GSTREAMERBRILLIANT_BRILLIANT_RTSP_BACKEND_H
-#include "gstreamer_brilliant_android.h"
+#include "brilliant_session.h"
 
 int build_rtsp_pipeline(CustomData *data);
 #endif //GSTREAMERBRILLIANT_BRILLIANT_RTSP_BACKEND_H
@@ -0,0 +1,1627 @@
+/*****************************************************************************
+ * GStreamerBrilliant: Android Library built with system's GStreamer Implementation. Intended for use in Brilliant Mobile App.
+ *****************************************************************************
+ * Copyright (C) 2022 Brilliant Home Technologies
+ *
+ * Authors: Brilliant iOS Team <android_developer # brilliant.tech>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#include <gst/video/video.h>
+#include <gst/video/videooverlay.h>
+#include <pthread.h>
+#include "brilliant_session.h"
+#include "brilliant_rtsp_backend.h"
+#include "brilliant_custom_rtp_backend.h"
+#include "inttypes.h"
+#include <gio/gio.h>
+
+GST_DEBUG_CATEGORY_STATIC (debug_category);
+#define GST_CAT_DEFAULT debug_category
+
+/* Do not allow seeks to be performed closer than this distance. It is visually useless, and will probably
+ * confuse some demuxers. */
+#define SEEK_MIN_DELAY (500 * GST_MSECOND)
+
+/* These global constants are used to evaluate against backend_type strings */
+const char backend_type_rtsp[] = "rtsp";
+const char backend_type_custom_rtp[] = "custom_rtp";
+
+/* Sessions built ahead of use by brilliant_session_prewarm and not handed out yet */
+#define SESSION_POOL_SIZE 2
+static GMutex session_pool_lock;
+static GQueue session_pool = G_QUEUE_INIT;
+
+/* Leftovers of the last session freed while allocation accounting was enabled */
+static GMutex allocation_report_lock;
+static gchar *allocation_report;
+
+/*
+ * Private methods
+ */
+static GstBuffer * byte_array_to_buffer(const guint8 *data, gsize data_len) {
+  gpointer buffer_data = g_memdup(data, data_len);
+  // Takes ownership of allocated memory
+  GstBuffer *buffer = gst_buffer_new_wrapped(buffer_data, data_len);
+  return buffer;
+}
+
+/* Change the content of the UI's TextView */
+void set_ui_message (const gchar * message, CustomData * data)
+{
+  GST_DEBUG ("Setting message to: %s", message);
+  if (data->callbacks.set_message)
+    data->callbacks.set_message (message, data->user_data);
+}
+
+/* Tell the application what is the current position and clip duration */
+static void
+set_current_ui_position (gint position, gint duration, CustomData * data)
+{
+  if (data->callbacks.set_current_position)
+    data->callbacks.set_current_position (position, duration, data->user_data);
+}
+
+/* If we have pipeline and it is running, query the current position and clip duration and inform
+ * the application */
+static gboolean
+refresh_ui (CustomData * data)
+{
+  gint64 position;
+
+  /* We do not want to update anything unless we have a working pipeline in the PAUSED or PLAYING state */
+  if (!data || !data->pipeline || data->state < GST_STATE_PAUSED)
+    return TRUE;
+
+  /* If we didn't know it yet, query the stream duration */
+  if (!GST_CLOCK_TIME_IS_VALID (data->duration)) {
+    if (!gst_element_query_duration (data->pipeline, GST_FORMAT_TIME,
+            &data->duration)) {
+//      GST_WARNING
+//          ("Could not query current duration (normal for still pictures)");
+      data->duration = 0;
+    }
+  }
+
+  if (!gst_element_query_position (data->pipeline, GST_FORMAT_TIME, &position)) {
+    GST_WARNING
+        ("Could not query current position (normal for still pictures)");
+    position = 0;
+  }
+
+  /* Java expects these values in milliseconds, and GStreamer provides nanoseconds */
+  set_current_ui_position (position / GST_MSECOND, data->duration / GST_MSECOND,
+      data);
+  return TRUE;
+}
+
+/* Forward declaration for the delayed seek callback */
+static gboolean delayed_seek_cb (CustomData * data);
+
+/* Perform seek, if we are not too close to the previous seek. Otherwise, schedule the seek for
+ * some time in the future. */
+static void
+execute_seek (gint64 desired_position, CustomData * data)
+{
+  gint64 diff;
+
+  if (desired_position == GST_CLOCK_TIME_NONE)
+    return;
+
+  diff = gst_util_get_timestamp () - data->last_seek_time;
+
+  if (GST_CLOCK_TIME_IS_VALID (data->last_seek_time) && diff < SEEK_MIN_DELAY) {
+    /* The previous seek was too close, delay this one */
+    GSource *timeout_source;
+
+    if (data->desired_position == GST_CLOCK_TIME_NONE) {
+      /* There was no previous seek scheduled. Setup a timer for some time in the future */
+      timeout_source =
+          g_timeout_source_new ((SEEK_MIN_DELAY - diff) / GST_MSECOND);
+      g_source_set_callback (timeout_source, (GSourceFunc) delayed_seek_cb,
+          data, NULL);
+      g_source_attach (timeout_source, data->context);
+      g_source_unref (timeout_source);
+    }
+    /* Update the desired seek position. If multiple petitions are received before it is time
+     * to perform a seek, only the last one is remembered. */
+    data->desired_position = desired_position;
+    GST_DEBUG ("Throttling seek to %" GST_TIME_FORMAT ", will be in %"
+        GST_TIME_FORMAT, GST_TIME_ARGS (desired_position),
+        GST_TIME_ARGS (SEEK_MIN_DELAY - diff));
+  } else {
+    /* Perform the seek now */
+    GST_DEBUG ("Seeking to %" GST_TIME_FORMAT,
+        GST_TIME_ARGS (desired_position));
+    data->last_seek_time = gst_util_get_timestamp ();
+    gst_element_seek_simple (data->pipeline, GST_FORMAT_TIME,
+        GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT, desired_position);
+    data->desired_position = GST_CLOCK_TIME_NONE;
+  }
+}
+
+/* Delayed seek callback. This gets called by the timer setup in the above function. */
+static gboolean
+delayed_seek_cb (CustomData * data)
+{
+  GST_DEBUG ("Doing delayed seek to %" GST_TIME_FORMAT,
+      GST_TIME_ARGS (data->desired_position));
+  execute_seek (data->desired_position, data);
+  return FALSE;
+}
+
+/* Retrieve errors from the bus and show them on the UI */
+static void
+error_cb (GstBus * bus, GstMessage * msg, CustomData * data)
+{
+  GError *err;
+  gchar *debug_info;
+  gchar *message_string;
+
+  brilliant_decoder_cache_handle_error (msg);
+  gst_message_parse_error (msg, &err, &debug_info);
+  message_string =
+      g_strdup_printf ("Error received from element %s: %s",
+      GST_OBJECT_NAME (msg->src), err->message);
+  g_clear_error (&err);
+  g_free (debug_info);
+  set_ui_message (message_string, data);
+  brilliant_log_ring_dump_on_error (data->log_ring, message_string);
+  g_free (message_string);
+  data->target_state = GST_STATE_NULL;
+  gst_element_set_state (data->pipeline, GST_STATE_NULL);
+}
+
+/* Called when the End Of the Stream is reached. Just move to the beginning of the media and pause. */
+static void
+eos_cb (GstBus * bus, GstMessage * msg, CustomData * data)
+{
+  data->target_state = GST_STATE_PAUSED;
+  data->is_live |=
+      (gst_element_set_state (data->pipeline,
+          GST_STATE_PAUSED) == GST_STATE_CHANGE_NO_PREROLL);
+  execute_seek (0, data);
+}
+
+/* Called when the duration of the media changes. Just mark it as unknown, so we re-query it in the next UI refresh. */
+static void
+duration_cb (GstBus * bus, GstMessage * msg, CustomData * data)
+{
+  data->duration = GST_CLOCK_TIME_NONE;
+}
+
+/* Called when buffering messages are received. We inform the UI about the current buffering level and
+ * keep the pipeline paused until 100% buffering is reached. At that point, set the desired state. */
+static void
+buffering_cb (GstBus * bus, GstMessage * msg, CustomData * data)
+{
+  gint percent;
+
+  if (data->is_live)
+    return;
+
+  gst_message_parse_buffering (msg, &percent);
+  if (percent < 100 && data->target_state >= GST_STATE_PAUSED) {
+    gchar *message_string = g_strdup_printf ("Buffering %d%%", percent);
+    gst_element_set_state (data->pipeline, GST_STATE_PAUSED);
+    set_ui_message (message_string, data);
+    g_free (message_string);
+  } else if (data->target_state >= GST_STATE_PLAYING) {
+    gst_element_set_state (data->pipeline, GST_STATE_PLAYING);
+  } else if (data->target_state >= GST_STATE_PAUSED) {
+    set_ui_message ("Buffering complete", data);
+  }
+}
+
+/* Decoders and sinks post QoS messages when they drop late frames */
+static void
+qos_cb (GstBus * bus, GstMessage * msg, CustomData * data)
+{
+  brilliant_frame_stats_handle_qos_message (data->frame_stats, msg);
+}
+
+/* Jitterbuffers post LATENCY when their latency changes, the sinks have to follow. Tracks that
+ * do not wait for the others are realigned on the new pipeline latency. */
+static void
+latency_cb (GstBus * bus, GstMessage * msg, CustomData * data)
+{
+  gst_bin_recalculate_latency (GST_BIN (data->pipeline));
+  brilliant_render_pacer_update_latency (data->render_pacer);
+  if (data->rtp_custom_data)
+    apply_custom_rtp_sync_policy (data);
+}
+
+/* Called when the clock is lost */
+static void
+clock_lost_cb (GstBus * bus, GstMessage * msg, CustomData * data)
+{
+  if (data->target_state >= GST_STATE_PLAYING) {
+    gst_element_set_state (data->pipeline, GST_STATE_PAUSED);
+    gst_element_set_state (data->pipeline, GST_STATE_PLAYING);
+  }
+}
+
+/* Retrieve the video sink's Caps and tell the application about the media size */
+static void
+check_media_size (CustomData * data)
+{
+  GstPad *video_sink_pad;
+  GstCaps *caps;
+  GstVideoInfo info;
+
+  /* Retrieve the Caps at the entrance of the video sink */
+  video_sink_pad = gst_element_get_static_pad (data->video_sink, "sink");
+  caps = gst_pad_get_current_caps (video_sink_pad);
+
+  if (gst_video_info_from_caps (&info, caps)) {
+    info.width = info.width * info.par_n / info.par_d;
+    GST_DEBUG ("Media size is %dx%d, notifying application", info.width,
+        info.height);
+
+    if (data->callbacks.on_media_size_changed)
+      data->callbacks.on_media_size_changed (info.width, info.height, data->user_data);
+  }
+
+  gst_caps_unref (caps);
+  gst_object_unref (video_sink_pad);
+}
+
+/* Keep the keyframes of the camera and show the last one while the stream connects, once both
+ * the camera id and the video path (parser and preview_funnel) are known */
+void
+attach_keyframe_cache (CustomData * data)
+{
+  if (!data->camera_id || !data->pipeline)
+    return;
+  GstElement *parser = gst_bin_get_by_name (GST_BIN (data->pipeline), "parser");
+  GstElement *funnel = gst_bin_get_by_name (GST_BIN (data->pipeline), "preview_funnel");
+  if (parser && funnel
+      && g_atomic_int_compare_and_exchange (&data->keyframe_cache_attached, FALSE, TRUE)) {
+    brilliant_keyframe_cache_watch (data->camera_id, parser);
+    if (brilliant_keyframe_cache_add_preview (data->camera_id, GST_BIN (data->pipeline), funnel)) {
+      GstElement *render_queue = gst_bin_get_by_name (GST_BIN (data->pipeline), "render_queue");
+      brilliant_startup_timings_watch_element (&data->startup_timings, render_queue, "src",
+          BRILLIANT_STARTUP_PREVIEW_RENDERED);
+      if (render_queue)
+        gst_object_unref (render_queue);
+    }
+  }
+  if (parser)
+    gst_object_unref (parser);
+  if (funnel)
+    gst_object_unref (funnel);
+}
+
+/* Notify UI about pipeline state changes */
+static void
+state_changed_cb (GstBus * bus, GstMessage * msg, CustomData * data)
+{
+  GstState old_state, new_state, pending_state;
+  gst_message_parse_state_changed (msg, &old_state, &new_state, &pending_state);
+  /* A udpsrc may be receiving now, ask the device for its media. Not waiting for the pipeline,
+   * which only gets to PLAYING once the video sink prerolled. */
+  if (new_state == GST_STATE_PLAYING)
+    brilliant_start_sequencer_arm (data->start_sequencer);
+  /* Only pay attention to messages coming from the pipeline, not its children */
+  if (GST_MESSAGE_SRC (msg) == GST_OBJECT (data->pipeline)) {
+    data->state = new_state;
+    gchar *message = g_strdup_printf ("State changed to %s",
+        gst_element_state_get_name (new_state));
+    set_ui_message (message, data);
+    g_free (message);
+
+    if (new_state == GST_STATE_NULL || new_state == GST_STATE_READY)
+      data->is_live = FALSE;
+
+    /* The sinks got their latency on the way to PLAYING */
+    if (new_state == GST_STATE_PLAYING)
+      brilliant_render_pacer_update_latency (data->render_pacer);
+
+    /* The Ready to Paused state change is particularly interesting: */
+    if (old_state == GST_STATE_READY && new_state == GST_STATE_PAUSED) {
+      /* By now the sink already knows the media size */
+      check_media_size (data);
+
+      /* If there was a scheduled seek, perform it now that we have moved to the Paused state */
+      if (GST_CLOCK_TIME_IS_VALID (data->desired_position))
+        execute_seek (data->desired_position, data);
+    }
+  }
+}
+
+/* Streaming thread, decoded frames only go on to the video sink while it has a window */
+static GstPadProbeReturn
+video_gate_probe (GstPad * pad, GstPadProbeInfo * info, CustomData * data)
+{
+  return g_atomic_int_get (&data->video_gate_open) ? GST_PAD_PROBE_OK : GST_PAD_PROBE_DROP;
+}
+
+/* Open or close the gate in front of sink. While it is closed the sink never gets a frame to
+ * preroll with, so it changes state without waiting for one (async off) and the pipeline still
+ * reaches PLAYING and distributes its latency. */
+static void
+set_video_gate (CustomData * data, GstElement * sink, gboolean open)
+{
+  g_atomic_int_set (&data->video_gate_open, open);
+  if (sink && g_object_class_find_property (G_OBJECT_GET_CLASS (sink), "async"))
+    g_object_set (sink, "async", open, NULL);
+}
+
+/* Let the pipeline play, receive and decode before there is a window, dropping frames at the
+ * entry of video_convert until one arrives, so they are not converted for nothing. The gate is
+ * checked again on the sink pad of the overlay sink, for the frame render_queue may hold when it
+ * closes, see brilliant_session_release_window. Sinks that render without a window
+ * (fakevideosink on desktop) are not gated. Call once the pipeline is READY and autovideosink
+ * picked its sink. */
+static void
+install_video_gate (CustomData * data)
+{
+  GstElement *overlay = gst_bin_get_by_interface (GST_BIN (data->pipeline),
+      GST_TYPE_VIDEO_OVERLAY);
+  GstElement *video_convert = gst_bin_get_by_name (GST_BIN (data->pipeline), "video_convert");
+  if (!overlay || !video_convert) {
+    GST_DEBUG ("Video does not wait for a window");
+    g_atomic_int_set (&data->video_gate_open, TRUE);
+  } else {
+    GstPad *pads[] = {
+      gst_element_get_static_pad (video_convert, "sink"),
+      gst_element_get_static_pad (overlay, "sink"),
+    };
+    for (guint i = 0; i < G_N_ELEMENTS (pads); i++) {
+      if (!pads[i])
+        continue;
+      gst_pad_add_probe (pads[i], GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+          (GstPadProbeCallback) video_gate_probe, data, NULL);
+      gst_object_unref (pads[i]);
+    }
+    /* Opened already if the owner lets the sink use a window of its own */
+    set_video_gate (data, overlay, g_atomic_int_get (&data->video_gate_open));
+  }
+  if (overlay)
+    gst_object_unref (overlay);
+  if (video_convert)
+    gst_object_unref (video_convert);
+}
+
+/* Hand the current window to the video sink and let frames through, no state change needed */
+static void
+attach_window (CustomData * data)
+{
+  if (!data->video_sink || !data->window_handle)
+    return;
+  GST_DEBUG ("Attaching window handle %p", (gpointer) data->window_handle);
+  gst_video_overlay_set_window_handle (GST_VIDEO_OVERLAY (data->video_sink),
+      data->window_handle);
+  set_video_gate (data, data->video_sink, TRUE);
+}
+
+/* Check if all conditions are met to report GStreamer as initialized.
+ * The window is not one of them: the pipeline can play without one, see install_video_gate.
+ * Session thread only, it is the one thread that replaces video_sink. */
+static void
+check_initialization_complete (CustomData * data)
+{
+  if (!data->initialized && data->main_loop) {
+    GST_DEBUG
+        ("Initialization complete, notifying application. window_handle:%p main_loop:%p",
+        (gpointer) data->window_handle, data->main_loop);
+    /* autovideosink only picks a new sink after going through NULL */
+    GstElement *video_sink = gst_bin_get_by_interface (GST_BIN (data->pipeline),
+        GST_TYPE_VIDEO_OVERLAY);
+    if (video_sink == data->video_sink) {
+      gst_clear_object (&video_sink);
+    } else {
+      gst_clear_object (&data->video_sink);
+      data->video_sink = video_sink;
+    }
+    if (!data->video_sink) {
+      GST_ERROR("Could not retrieve video sink");
+    } else {
+      GST_DEBUG("RETRIEVED VIDEO SINK");
+    }
+
+    /* The main loop is running, inform the sink about the window if we received one already */
+    attach_window (data);
+    if (data->callbacks.on_initialized)
+      data->callbacks.on_initialized (data->backend_type, data->user_data);
+    data->initialized = TRUE;
+  }
+}
+
+static gboolean
+check_initialization_on_session_thread (CustomData * data)
+{
+  check_initialization_complete (data);
+  return G_SOURCE_REMOVE;
+}
+
+/* Log the time to first frame breakdown and hand it to the application. Runs on the session thread. */
+static gboolean
+report_startup_timings (CustomData * data)
+{
+  gint64 timings_us[BRILLIANT_STARTUP_MILESTONE_COUNT];
+  gint count = brilliant_startup_timings_get (&data->startup_timings, timings_us,
+      BRILLIANT_STARTUP_MILESTONE_COUNT);
+  GString *summary = g_string_new (NULL);
+  for (gint i = 0; i < count; i++) {
+    g_string_append_printf (summary, " %s=%" G_GINT64_FORMAT,
+        brilliant_startup_milestone_get_name (i), timings_us[i]);
+  }
+  GST_INFO ("Startup timings (us):%s", summary->str);
+  g_string_free (summary, TRUE);
+
+  if (data->callbacks.on_startup_timings)
+    data->callbacks.on_startup_timings (timings_us, count, data->user_data);
+  return G_SOURCE_REMOVE;
+}
+
+/* Called from the video streaming thread once the first frame was rendered */
+static void
+startup_complete_cb (gpointer user_data)
+{
+  CustomData *data = (CustomData *) user_data;
+  g_main_context_invoke (data->context, (GSourceFunc) report_startup_timings, data);
+}
+
+/* Hand the current RTP statistics to the application. Runs on the session thread. */
+static gboolean
+report_rtp_stats (CustomData * data)
+{
+  if (!data->rtp_stats || !data->callbacks.on_rtp_stats)
+    return G_SOURCE_CONTINUE;
+  GArray *stats = brilliant_rtp_stats_collect (data->rtp_stats);
+  data->callbacks.on_rtp_stats ((const gint64 *) stats->data,
+      stats->len / BRILLIANT_RTP_STATS_FIELD_COUNT, data->user_data);
+  g_array_free (stats, TRUE);
+  return G_SOURCE_CONTINUE;
+}
+
+/* (Re)start the RTP statistics timer with the current interval. Runs on the session thread. */
+static gboolean
+restart_rtp_stats_timer (CustomData * data)
+{
+  if (data->rtp_stats_source) {
+    g_source_destroy (data->rtp_stats_source);
+    g_source_unref (data->rtp_stats_source);
+    data->rtp_stats_source = NULL;
+  }
+  if (!data->rtp_stats_interval_ms)
+    return G_SOURCE_REMOVE;
+  data->rtp_stats_source = g_timeout_source_new (data->rtp_stats_interval_ms);
+  g_source_set_callback (data->rtp_stats_source, (GSourceFunc) report_rtp_stats, data, NULL);
+  g_source_attach (data->rtp_stats_source, data->context);
+  return G_SOURCE_REMOVE;
+}
+
+/* Close one of the sockets the custom RTP backend hands to its udpsrc elements */
+static void
+close_rtp_socket (CustomData * data, GSocket ** socket, int port)
+{
+  if (!*socket)
+    return;
+  GError *error = NULL;
+  GST_DEBUG ("Closing socket 0.0.0.0:%d", port);
+  g_socket_close (*socket, &error);
+  if (error) {
+    gchar *message =
+        g_strdup_printf ("Failed to close socket on cleanup: %s", error->message);
+    g_clear_error (&error);
+    set_ui_message (message, data);
+    g_free (message);
+  }
+  gst_object_unref (*socket);
+  *socket = NULL;
+}
+
+/* Main method for the native code. This is executed on its own thread. */
+static void *
+app_function (void *userdata)
+{
+  GstBus *bus;
+  CustomData *data = (CustomData *) userdata;
+  GSource *timeout_source;
+  GSource *bus_source;
+
+  GST_DEBUG ("Creating pipeline in CustomData at %p", data);
+
+  /* Create our own GLib Main Context and make it the default one */
+  data->context = g_main_context_new ();
+  g_main_context_push_thread_default (data->context);
+  brilliant_trace_recorder_watch_context (data->context);
+
+  int result = FALSE;
+  if (strcmp(data->backend_type, backend_type_rtsp) == 0) {
+    result = build_rtsp_pipeline(data);
+  } else if (strcmp(data->backend_type, backend_type_custom_rtp) == 0) {
+    result = build_custom_rtp_pipeline(data);
+  } else {
+    GST_ERROR("Unrecognized backend type %s, aborting pipeline creation.", data->backend_type);
+  }
+  if (!result) {
+    return NULL;
+  }
+  brilliant_startup_timings_mark (&data->startup_timings, BRILLIANT_STARTUP_PIPELINE_BUILT);
+  data->log_ring = brilliant_log_ring_new (data->pipeline);
+
+  /* Set the pipeline to READY, so it can already accept a window handle, if we have one */
+  data->target_state = GST_STATE_READY;
+  gst_element_set_state (data->pipeline, GST_STATE_READY);
+  install_video_gate (data);
+  data->render_pacer = brilliant_render_pacer_new (data->render_mode);
+  brilliant_render_pacer_watch (data->render_pacer, GST_PIPELINE (data->pipeline));
+  brilliant_frame_stats_set_render_pacer (data->frame_stats, data->render_pacer);
+  if (data->latency_monitor)
+    brilliant_latency_monitor_set_render_pacer (data->latency_monitor, data->render_pacer);
+
+  /* Instruct the bus to emit signals for each received message, and connect to the interesting signals */
+  bus = gst_element_get_bus (data->pipeline);
+  bus_source = gst_bus_create_watch (bus);
+  g_source_set_callback (bus_source, (GSourceFunc) gst_bus_async_signal_func,
+      NULL, NULL);
+  g_source_attach (bus_source, data->context);
+  g_source_unref (bus_source);
+  g_signal_connect (G_OBJECT (bus), "message::error", (GCallback) error_cb,
+      data);
+  g_signal_connect (G_OBJECT (bus), "message::eos", (GCallback) eos_cb, data);
+  g_signal_connect (G_OBJECT (bus), "message::state-changed",
+      (GCallback) state_changed_cb, data);
+  g_signal_connect (G_OBJECT (bus), "message::duration",
+      (GCallback) duration_cb, data);
+  g_signal_connect (G_OBJECT (bus), "message::buffering",
+      (GCallback) buffering_cb, data);
+  g_signal_connect (G_OBJECT (bus), "message::qos", (GCallback) qos_cb, data);
+  g_signal_connect (G_OBJECT (bus), "message::clock-lost",
+      (GCallback) clock_lost_cb, data);
+  g_signal_connect (G_OBJECT (bus), "message::latency",
+      (GCallback) latency_cb, data);
+  gst_object_unref (bus);
+
+  /* Register a function that GLib will call 4 times per second */
+  timeout_source = g_timeout_source_new (250);
+  g_source_set_callback (timeout_source, (GSourceFunc) refresh_ui, data, NULL);
+  g_source_attach (timeout_source, data->context);
+  g_source_unref (timeout_source);
+  restart_rtp_stats_timer (data);
+
+  /* Create a GLib Main Loop and set it to run */
+  GST_DEBUG ("Entering main loop... (CustomData:%p)", data);
+  data->main_loop = g_main_loop_new (data->context, FALSE);
+  g_mutex_lock (&data->loop_lock);
+  gboolean quit = data->quit_requested;
+  g_atomic_int_set (&data->main_loop_running, !quit);
+  g_mutex_unlock (&data->loop_lock);
+  if (!quit) {
+    if (data->callbacks.on_pipeline_ready)
+      data->callbacks.on_pipeline_ready (data->pipeline, data->user_data);
+    check_initialization_complete (data);
+    g_main_loop_run (data->main_loop);
+  }
+  GST_DEBUG ("Exited main loop");
+  g_main_loop_unref (data->main_loop);
+  data->main_loop = NULL;
+
+  /* Free resources */
+  if (data->rtp_stats_source) {
+    g_source_destroy (data->rtp_stats_source);
+    g_source_unref (data->rtp_stats_source);
+    data->rtp_stats_source = NULL;
+  }
+  g_main_context_pop_thread_default (data->context);
+  g_main_context_unref (data->context);
+  data->target_state = GST_STATE_NULL;
+  gst_element_set_state (data->pipeline, GST_STATE_NULL);
+  if (data->camera_id)
+    brilliant_keyframe_cache_save (data->camera_id);
+  brilliant_log_ring_detach (data->log_ring);
+  gst_object_unref (data->pipeline);
+  g_free(data->backend_type);
+
+  /* Drop the references taken when these elements were looked up in the bin */
+  if (data->rtsp_data) {
+    gst_clear_object (&data->rtsp_data->rtsp_src);
+    GST_DEBUG ("Cleaned up rtsp_data pipeline elements");
+  }
+  gst_clear_object (&data->video_sink);
+  gst_clear_object (&data->volume);
+  if (data->rtp_custom_data) {
+    close_rtp_socket (data, &data->rtp_custom_data->audio_rtp_socket,
+        data->rtp_custom_data->local_rtp_audio_udp_port);
+    close_rtp_socket (data, &data->rtp_custom_data->video_rtp_socket,
+        data->rtp_custom_data->local_rtp_video_udp_port);
+    data->rtp_custom_data->out_audio_data_pipe = NULL;
+    data->rtp_custom_data->rtp_bin = NULL;
+    data->rtp_custom_data->video_depay = NULL;
+    data->rtp_custom_data->video_data_pipe = NULL;
+    data->rtp_custom_data->audio_depay = NULL;
+    data->rtp_custom_data->mic_volume = NULL;
+    GST_DEBUG ("Cleaned up rtp_custom_data pipeline elements");
+  }
+  GST_DEBUG("Exiting gstreamer pipeline app_function.");
+  return NULL;
+}
+
+/* Log and keep the objects a freed session left behind, see brilliant_session_get_allocation_report */
+static void
+report_leftover_allocations (guint64 checkpoint)
+{
+  gchar *report = brilliant_alloc_tracker_describe (checkpoint);
+  if (report)
+    GST_WARNING ("Objects left over by the session (type count bytes):\n%s", report);
+  else
+    GST_DEBUG ("Session left no objects behind");
+  g_mutex_lock (&allocation_report_lock);
+  g_free (allocation_report);
+  allocation_report = report;
+  g_mutex_unlock (&allocation_report_lock);
+}
+
+/*
+ * Session API
+ */
+
+/* Handing a pooled session to its owner, done on the session thread so that callbacks are never
+ * seen half updated */
+typedef struct _SessionAdoption
+{
+  CustomData *data;
+  BrilliantSessionCallbacks callbacks;
+  gpointer user_data;
+  GMutex lock;
+  GCond cond;
+  gboolean done;
+} SessionAdoption;
+
+static gboolean
+adopt_session (SessionAdoption * adoption)
+{
+  CustomData *data = adoption->data;
+  data->callbacks = adoption->callbacks;
+  data->user_data = adoption->user_data;
+  /* Time to first frame is measured from the owner's request, the pipeline is already built */
+  brilliant_startup_timings_restart (&data->startup_timings);
+  brilliant_startup_timings_mark (&data->startup_timings, BRILLIANT_STARTUP_PIPELINE_BUILT);
+  if (data->callbacks.on_pipeline_ready)
+    data->callbacks.on_pipeline_ready (data->pipeline, data->user_data);
+  /* The pool already completed initialization without an owner to tell, tell this one */
+  data->initialized = FALSE;
+  check_initialization_complete (data);
+
+  g_mutex_lock (&adoption->lock);
+  adoption->done = TRUE;
+  g_cond_signal (&adoption->cond);
+  g_mutex_unlock (&adoption->lock);
+  return G_SOURCE_REMOVE;
+}
+
+/* A pooled session of backend_type whose pipeline is READY, now owned by the caller. NULL if
+ * there is none. */
+static CustomData *
+take_pooled_session (const gchar *backend_type,
+    const BrilliantSessionCallbacks *callbacks, gpointer user_data)
+{
+  CustomData *data = NULL;
+  g_mutex_lock (&session_pool_lock);
+  for (GList *link = session_pool.head; link; link = link->next) {
+    CustomData *candidate = link->data;
+    if (strcmp (candidate->backend_type, backend_type) == 0
+        && g_atomic_int_get (&candidate->main_loop_running)) {
+      data = candidate;
+      g_queue_delete_link (&session_pool, link);
+      break;
+    }
+  }
+  g_mutex_unlock (&session_pool_lock);
+  if (!data)
+    return NULL;
+
+  SessionAdoption adoption = { data };
+  if (callbacks)
+    adoption.callbacks = *callbacks;
+  adoption.user_data = user_data;
+  g_mutex_init (&adoption.lock);
+  g_cond_init (&adoption.cond);
+  g_main_context_invoke (data->context, (GSourceFunc) adopt_session, &adoption);
+  g_mutex_lock (&adoption.lock);
+  while (!adoption.done)
+    g_cond_wait (&adoption.cond, &adoption.lock);
+  g_mutex_unlock (&adoption.lock);
+  g_mutex_clear (&adoption.lock);
+  g_cond_clear (&adoption.cond);
+  GST_DEBUG ("Took pooled %s session at %p", backend_type, data);
+  return data;
+}
+
+/* Create a session from scratch */
+static CustomData *
+create_session (const gchar *backend_type,
+    const BrilliantSessionCallbacks *callbacks, gpointer user_data)
+{
+  CustomData *data = g_new0 (CustomData, 1);
+  data->alloc_checkpoint = brilliant_alloc_tracker_checkpoint ();
+  brilliant_startup_timings_init (&data->startup_timings, startup_complete_cb, data);
+  data->frame_stats = brilliant_frame_stats_new ();
+  data->rtp_custom_data = NULL;
+  data->desired_position = GST_CLOCK_TIME_NONE;
+  data->last_seek_time = GST_CLOCK_TIME_NONE;
+  g_mutex_init (&data->loop_lock);
+  GST_DEBUG_CATEGORY_INIT (debug_category, "gstreamer-brilliant", 0,
+      "GStreamer Brilliant");
+  if (callbacks)
+    data->callbacks = *callbacks;
+  data->user_data = user_data;
+  data->backend_type = g_strdup (backend_type);
+  GST_DEBUG ("Created CustomData for backendType %s at %p", data->backend_type, data);
+  if (strcmp(data->backend_type, backend_type_custom_rtp) == 0) {
+    data->rtp_custom_data = g_new0 (RTPCustomData, 1);
+    g_mutex_init (&data->rtp_custom_data->lock);
+    data->rtsp_data = NULL;
+    data->latency_monitor = brilliant_latency_monitor_new ();
+  } else if (strcmp(data->backend_type, backend_type_rtsp) == 0) {
+    data->rtsp_data = g_new0 (RTSPData, 1);
+    data->rtp_custom_data = NULL;
+  }
+  pthread_create (&data->app_thread, NULL, &app_function, data);
+  return data;
+}
+
+/* Create the session's internal data structure, pipeline and thread. A session prepared by
+ * brilliant_session_prewarm is used instead when one is ready. */
+CustomData *
+brilliant_session_new (const gchar *backend_type,
+    const BrilliantSessionCallbacks *callbacks, gpointer user_data)
+{
+  CustomData *data = take_pooled_session (backend_type, callbacks, user_data);
+  if (!data)
+    data = create_session (backend_type, callbacks, user_data);
+  return data;
+}
+
+/* Build a session of backend_type up to READY in the background, for the next
+ * brilliant_session_new to take over. FALSE if the pool is full or the type unknown. */
+gboolean
+brilliant_session_prewarm (const gchar *backend_type)
+{
+  GST_DEBUG_CATEGORY_INIT (debug_category, "gstreamer-brilliant", 0,
+      "GStreamer Brilliant");
+  if (strcmp (backend_type, backend_type_custom_rtp) != 0
+      && strcmp (backend_type, backend_type_rtsp) != 0) {
+    GST_ERROR ("Cannot prewarm unknown backend type %s", backend_type);
+    return FALSE;
+  }
+  g_mutex_lock (&session_pool_lock);
+  gboolean full = session_pool.length >= SESSION_POOL_SIZE;
+  if (!full)
+    g_queue_push_tail (&session_pool, create_session (backend_type, NULL, NULL));
+  g_mutex_unlock (&session_pool_lock);
+  if (full)
+    GST_DEBUG ("Session pool full, not prewarming %s", backend_type);
+  return !full;
+}
+
+/* Free the sessions nobody took, e.g. when leaving the device list */
+void
+brilliant_session_drain_pool (void)
+{
+  g_mutex_lock (&session_pool_lock);
+  GQueue pooled = session_pool;
+  g_queue_init (&session_pool);
+  g_mutex_unlock (&session_pool_lock);
+  g_queue_clear_full (&pooled, (GDestroyNotify) brilliant_session_free);
+}
+
+/* Dispatched by the main loop once it runs, a quit before g_main_loop_run would be lost */
+static gboolean
+quit_main_loop (CustomData * data)
+{
+  g_main_loop_quit (data->main_loop);
+  return G_SOURCE_REMOVE;
+}
+
+/* Quit the main loop, remove the native thread and free resources. The session thread may not
+ * have reached its main loop yet, e.g. for a session still warming up in the pool: it then skips
+ * the loop. */
+void
+brilliant_session_free (CustomData *data)
+{
+  if (!data)
+    return;
+  GST_DEBUG ("Quitting main loop...");
+  g_mutex_lock (&data->loop_lock);
+  data->quit_requested = TRUE;
+  if (g_atomic_int_get (&data->main_loop_running)) {
+    /* The context lives until the loop quits */
+    GSource *quit_source = g_idle_source_new ();
+    g_source_set_callback (quit_source, (GSourceFunc) quit_main_loop, data, NULL);
+    g_source_attach (quit_source, data->context);
+    g_source_unref (quit_source);
+  }
+  g_mutex_unlock (&data->loop_lock);
+  GST_DEBUG ("Waiting for thread to finish...");
+  pthread_join (data->app_thread, NULL);
+  g_mutex_clear (&data->loop_lock);
+  if (data->rtp_custom_data) {
+    GST_DEBUG ("Freeing RtpCustomData at %p", data->rtp_custom_data);
+    cleanup_custom_rtp_data(data->rtp_custom_data);
+    g_mutex_clear (&data->rtp_custom_data->lock);
+    g_free(data->rtp_custom_data);
+    data->rtp_custom_data = NULL;
+  }
+  if (data->rtsp_data) {
+    GST_DEBUG ("Freeing RtspData at %p", data->rtsp_data);
+    g_free(data->rtsp_data);
+    data->rtsp_data = NULL;
+  }
+  brilliant_latency_monitor_free (data->latency_monitor);
+  data->latency_monitor = NULL;
+  brilliant_start_sequencer_free (data->start_sequencer);
+  data->start_sequencer = NULL;
+  brilliant_keyframe_requester_free (data->keyframe_requester);
+  data->keyframe_requester = NULL;
+  g_free (data->camera_id);
+  data->camera_id = NULL;
+  brilliant_jitter_controller_free (data->jitter_controller);
+  data->jitter_controller = NULL;
+  brilliant_queue_guard_free (data->queue_guard);
+  data->queue_guard = NULL;
+  brilliant_catch_up_free (data->catch_up);
+  data->catch_up = NULL;
+  brilliant_render_pacer_free (data->render_pacer);
+  data->render_pacer = NULL;
+  brilliant_rtp_stats_free (data->rtp_stats);
+  data->rtp_stats = NULL;
+  brilliant_frame_stats_free (data->frame_stats);
+  data->frame_stats = NULL;
+  brilliant_log_ring_free (data->log_ring);
+  data->log_ring = NULL;
+  brilliant_startup_timings_clear (&data->startup_timings);
+  if (brilliant_alloc_tracker_is_enabled ())
+    report_leftover_allocations (data->alloc_checkpoint);
+  GST_DEBUG ("Freeing CustomData at %p", data);
+  g_free (data);
+  GST_DEBUG ("Done finalizing");
+}
+
+/* Set rtspsrc's URI */
+void
+brilliant_session_set_uri (CustomData *data, const gchar *uri)
+{
+  if (!data || !data->pipeline) {
+    GST_DEBUG ("Missing Pipeline or data, aborting set URI");
+    return;
+  }
+  if (strcmp(data->backend_type, backend_type_rtsp) != 0) {
+    GST_ERROR("Set URI called on backend type %s", data->backend_type);
+    return;
+  }
+  GST_DEBUG ("Setting rtspsrc URI to %s", uri);
+  if (data->target_state >= GST_STATE_READY)
+    gst_element_set_state (data->pipeline, GST_STATE_READY);
+  g_object_set (data->rtsp_data->rtsp_src, "location", uri, NULL);
+  data->duration = GST_CLOCK_TIME_NONE;
+  data->is_live |=
+      (gst_element_set_state (data->pipeline,
+          data->target_state) == GST_STATE_CHANGE_NO_PREROLL);
+}
+
+/* Runs on the session thread, so track activation never races the pipeline build */
+static gboolean
+activate_rtp_tracks (CustomData *data)
+{
+  if (!complete_custom_rtp_track_pipeline_setup (data))
+    GST_ERROR ("Failed to start a custom RTP track");
+  return G_SOURCE_REMOVE;
+}
+
+/* Set the properties of one custom RTP track. The track is built and started as soon as its
+ * properties and the local ports are known, independently of the other tracks. A running track
+ * keeps its properties until the session is freed: tracks are not torn down one by one, changing
+ * or removing one takes a new session. */
+void
+brilliant_session_set_rtp_track_properties (CustomData *data, const gchar *track_name,
+    const gchar *server, int track_port, const guint8 *track_key, gsize track_key_len,
+    uint32_t track_ssrc, int sample_rate, int payload_type, int channels)
+{
+  if (strcmp(data->backend_type, backend_type_custom_rtp) != 0) {
+    GST_ERROR("Native set rtp track properties called on pipeline with type %s.",
+              data->backend_type);
+    return;
+  }
+
+  g_mutex_lock (&data->rtp_custom_data->lock);
+  if (strncmp(track_name, "incoming_video", strlen(track_name)) == 0) {
+    if (data->rtp_custom_data->video_depay) {
+      GST_WARNING ("Incoming video track already running, ignoring new properties");
+      g_mutex_unlock (&data->rtp_custom_data->lock);
+      return;
+    }
+    // Copy allocated types
+    g_free (data->rtp_custom_data->incoming_video_server);
+    gst_clear_buffer (&data->rtp_custom_data->incoming_video_key);
+    data->rtp_custom_data->incoming_video_server = g_strdup(server);
+    data->rtp_custom_data->incoming_video_key = byte_array_to_buffer(track_key, track_key_len);
+    GST_DEBUG ("Incoming Video Track uri to %s", data->rtp_custom_data->incoming_video_server);
+
+    // Assign primitive types
+    data->rtp_custom_data->incoming_video_ssrc = track_ssrc;
+    data->rtp_custom_data->incoming_video_port = track_port;
+    data->rtp_custom_data->incoming_video_sample_rate = sample_rate;
+    data->rtp_custom_data->incoming_video_payload_type = payload_type;
+    GST_DEBUG ("Incoming Video Track ssrc %" PRIu32 " port %d sample rate %d payload type %d",
+               data->rtp_custom_data->incoming_video_ssrc,
+               track_port,
+               sample_rate,
+               payload_type
+    );
+
+  } else if (strncmp(track_name, "incoming_audio", strlen(track_name)) == 0) {
+    if (data->rtp_custom_data->audio_depay) {
+      GST_WARNING ("Incoming audio track already running, ignoring new properties");
+      g_mutex_unlock (&data->rtp_custom_data->lock);
+      return;
+    }
+    // Copy allocated types
+    g_free (data->rtp_custom_data->incoming_audio_server);
+    gst_clear_buffer (&data->rtp_custom_data->incoming_audio_key);
+    data->rtp_custom_data->incoming_audio_server = g_strdup(server);
+    data->rtp_custom_data->incoming_audio_key = byte_array_to_buffer(track_key, track_key_len);
+    GST_DEBUG ("Incoming Audio Track uri to %s", data->rtp_custom_data->incoming_audio_server);
+
+    // Assign primitive types
+    data->rtp_custom_data->incoming_audio_ssrc = track_ssrc;
+    data->rtp_custom_data->incoming_audio_port = track_port;
+    data->rtp_custom_data->incoming_audio_sample_rate = sample_rate;
+    data->rtp_custom_data->incoming_audio_payload_type = payload_type;
+    data->rtp_custom_data->incoming_audio_channels = channels;
+    GST_DEBUG ("Incoming Audio Track ssrc %" PRIu32 " port %d sample rate %d payload type %d channels %d",
+               data->rtp_custom_data->incoming_audio_ssrc,
+               track_port,
+               sample_rate,
+               payload_type,
+               channels
+    );
+  } else if (strncmp(track_name, "outgoing_audio", strlen(track_name)) == 0) {
+    if (data->rtp_custom_data->out_audio_data_pipe) {
+      GST_WARNING ("Outgoing audio track already running, ignoring new properties");
+      g_mutex_unlock (&data->rtp_custom_data->lock);
+      return;
+    }
+    // Copy allocated types
+    g_free (data->rtp_custom_data->outgoing_audio_server);
+    gst_clear_buffer (&data->rtp_custom_data->outgoing_audio_key);
+    data->rtp_custom_data->outgoing_audio_server = g_strdup(server);
+    data->rtp_custom_data->outgoing_audio_key = byte_array_to_buffer(track_key, track_key_len);
+    GST_DEBUG ("Outgoing Audio Track uri to %s", data->rtp_custom_data->outgoing_audio_server);
+    // Assign primitive types
+    data->rtp_custom_data->outgoing_audio_ssrc = track_ssrc;
+    data->rtp_custom_data->outgoing_audio_port = track_port;
+    data->rtp_custom_data->outgoing_audio_sample_rate = sample_rate;
+    data->rtp_custom_data->outgoing_audio_payload_type = payload_type;
+    data->rtp_custom_data->audio_channels = channels;
+    GST_DEBUG ("Outgoing Audio Track ssrc %" PRIu32 " port %d sample rate %d payload type %d channels %d",
+               data->rtp_custom_data->outgoing_audio_ssrc,
+               track_port,
+               sample_rate,
+               payload_type,
+               channels
+    );
+  } else {
+    GST_ERROR ("Unknown rtp track %s", track_name);
+    g_mutex_unlock (&data->rtp_custom_data->lock);
+    return;
+  }
+  g_mutex_unlock (&data->rtp_custom_data->lock);
+  /* Without a context yet the pipeline build picks the track up itself */
+  if (data->context)
+    g_main_context_invoke (data->context, (GSourceFunc) activate_rtp_tracks, data);
+}
+
+/* Only SPS (7) and PPS (8) NAL units belong in sprop-parameter-sets */
+static gboolean
+is_parameter_set (const gchar *base64_nal)
+{
+  gsize len = 0;
+  guchar *nal = g_base64_decode (base64_nal, &len);
+  gboolean valid = len > 0 && ((nal[0] & 0x1f) == 7 || (nal[0] & 0x1f) == 8);
+  g_free (nal);
+  return valid;
+}
+
+/* Set the H.264 parameter sets of the incoming video track, as the comma separated base64
+ * sprop-parameter-sets of its SDP, so the decoder is configured by the first packet instead of
+ * the first in-band SPS/PPS. Set before playing, NULL clears them. FALSE if they do not parse. */
+gboolean
+brilliant_session_set_rtp_video_parameter_sets (CustomData *data,
+    const gchar *sprop_parameter_sets)
+{
+  if (!data || !data->rtp_custom_data) {
+    GST_ERROR ("Video parameter sets are only supported by the custom RTP backend");
+    return FALSE;
+  }
+  if (sprop_parameter_sets) {
+    gchar **nals = g_strsplit (sprop_parameter_sets, ",", -1);
+    gboolean valid = nals[0] != NULL;
+    for (gint i = 0; valid && nals[i]; i++)
+      valid = is_parameter_set (nals[i]);
+    g_strfreev (nals);
+    if (!valid) {
+      GST_ERROR ("Ignoring invalid sprop-parameter-sets %s", sprop_parameter_sets);
+      return FALSE;
+    }
+  }
+  g_mutex_lock (&data->rtp_custom_data->lock);
+  g_free (data->rtp_custom_data->incoming_video_sprop_parameter_sets);
+  data->rtp_custom_data->incoming_video_sprop_parameter_sets = g_strdup (sprop_parameter_sets);
+  g_mutex_unlock (&data->rtp_custom_data->lock);
+  GST_DEBUG ("Incoming Video Track sprop-parameter-sets %s",
+      sprop_parameter_sets ? sprop_parameter_sets : "(none)");
+  return TRUE;
+}
+
+/* Set the local ports the custom RTP tracks receive on. Tracks wait for them, or for play, before
+ * binding their sockets, so they can be set before or after the track properties. */
+void
+brilliant_session_set_rtp_local_ports (CustomData *data,
+    int local_rtp_video_udp_port, int local_rtcp_video_udp_port,
+    int local_rtp_audio_udp_port, int local_rtcp_audio_udp_port)
+{
+  if (strcmp(data->backend_type, backend_type_custom_rtp) != 0) {
+    GST_ERROR("Native set rtp local ports called on pipeline with type %s.",
+              data->backend_type);
+    return;
+  }
+  RTPCustomData *rtp_custom_data = data->rtp_custom_data;
+  g_mutex_lock (&rtp_custom_data->lock);
+  /* Sockets are bound when a track activates, a running track keeps the ports it bound */
+  if (rtp_custom_data->video_rtp_socket) {
+    if (local_rtp_video_udp_port != rtp_custom_data->local_rtp_video_udp_port)
+      GST_WARNING ("Video track already running, keeping its local ports");
+  } else {
+    rtp_custom_data->local_rtp_video_udp_port = local_rtp_video_udp_port;
+    rtp_custom_data->local_rtcp_video_udp_port = local_rtcp_video_udp_port;
+  }
+  if (rtp_custom_data->audio_rtp_socket) {
+    if (local_rtp_audio_udp_port != rtp_custom_data->local_rtp_audio_udp_port)
+      GST_WARNING ("Audio tracks already running, keeping their local ports");
+  } else {
+    rtp_custom_data->local_rtp_audio_udp_port = local_rtp_audio_udp_port;
+    rtp_custom_data->local_rtcp_audio_udp_port = local_rtcp_audio_udp_port;
+  }
+  rtp_custom_data->local_ports_set = TRUE;
+  g_mutex_unlock (&rtp_custom_data->lock);
+  /* Tracks whose properties came first start now */
+  if (data->context)
+    g_main_context_invoke (data->context, (GSourceFunc) activate_rtp_tracks, data);
+}
+
+/* Set volume's mute property */
+void
+brilliant_session_set_mute (CustomData *data, gboolean mute)
+{
+  if (!data || !data->pipeline) {
+    GST_DEBUG ("Missing Pipeline or data, aborting set URI");
+    return;
+  }
+  if (data->volume == NULL) {
+    GST_ERROR("Missing volume when setting mute");
+  } else {
+    g_object_set(data->volume, "mute", mute, NULL);
+  }
+}
+
+/* Set mic volume's mute property */
+void
+brilliant_session_set_mic_mute (CustomData *data, gboolean mute)
+{
+  if (!data || !data->pipeline) {
+    GST_DEBUG ("Missing Pipeline or data, aborting set mic mute");
+    return;
+  }
+  if (strcmp(data->backend_type, backend_type_custom_rtp) != 0 || data->rtp_custom_data == NULL) {
+    GST_ERROR("Called mic mute on inapplicable backend type %s", data->backend_type);
+    return;
+  }
+  if (data->rtp_custom_data->mic_volume == NULL) {
+    GST_ERROR("Missing mic volume when setting mute");
+  } else {
+    g_object_set(data->rtp_custom_data->mic_volume, "mute", mute, NULL);
+  }
+}
+
+/* Set mic volume's volume property */
+void
+brilliant_session_set_mic_volume (CustomData *data, gfloat volume)
+{
+  if (!data || !data->pipeline) {
+    GST_DEBUG ("Missing Pipeline or data, aborting set mic volume");
+    return;
+  }
+  if (strcmp(data->backend_type, backend_type_custom_rtp) != 0 || data->rtp_custom_data == NULL) {
+    GST_ERROR("Called mic volume on inapplicable backend type %s", data->backend_type);
+    return;
+  }
+  if (data->rtp_custom_data->mic_volume == NULL) {
+    GST_ERROR("Missing mic volume when setting volume");
+  } else {
+    g_object_set(data->rtp_custom_data->mic_volume, "volume", (gdouble) volume, NULL);
+  }
+}
+
+/* Enable GST_DEBUG Logging
+ * Example String: 4,rtspsrc:6
+ * Setting it to empty string will disable
+ * */
+void
+brilliant_session_set_debug_logging (const gchar *gst_debug_string)
+{
+    // Note: When using this make sure to adjust the default level in
+    // <GstreamerAndroidRoot>/<platform>/share/gst-android/ndk-build/gstreamer_android-1.0.c.in
+    // and recompile first.
+    setenv("GST_DEBUG", gst_debug_string, 1);
+    gst_debug_set_threshold_from_string(gst_debug_string, TRUE);
+}
+
+/* Record the debug log of all sessions in memory instead of logcat, see brilliant_log_ring.h */
+void
+brilliant_session_set_log_ring (const gchar *thresholds, const gchar *dump_dir)
+{
+  brilliant_log_ring_install (thresholds, dump_dir);
+}
+
+/* Write the session's recent debug log, and the process wide one, to path */
+gboolean
+brilliant_session_dump_log (CustomData *data, const gchar *path)
+{
+  GError *error = NULL;
+  if (!brilliant_log_ring_dump (data ? data->log_ring : NULL, path, &error)) {
+    GST_ERROR ("Failed to dump the debug log: %s", error->message);
+    g_clear_error (&error);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/* Load what sessions of backend_type need in the background, ahead of the first one */
+void
+brilliant_session_warm_up (const gchar *backend_type)
+{
+  brilliant_plugins_warm_up (backend_type);
+}
+
+/* Remember the decoders decodebin picks in cache_path, and skip autoplugging once known */
+void
+brilliant_session_set_decoder_cache (const gchar *cache_path)
+{
+  brilliant_decoder_cache_load (cache_path);
+}
+
+/* Also keep the last keyframe of each camera in directory, for previews across launches */
+void
+brilliant_session_set_keyframe_cache (const gchar *directory)
+{
+  brilliant_keyframe_cache_set_directory (directory);
+}
+
+/* Name the camera this session shows. Its last keyframe is cached and, when one is known, shown
+ * until the live stream starts. Set once, before playing. */
+void
+brilliant_session_set_camera_id (CustomData *data, const gchar *camera_id)
+{
+  if (!data)
+    return;
+  if (data->camera_id) {
+    GST_WARNING ("Camera id already set to %s, ignoring %s", data->camera_id, camera_id);
+    return;
+  }
+  data->camera_id = g_strdup (camera_id);
+  attach_keyframe_cache (data);
+}
+
+/* Measure the processing time of every element, in all sessions of the process */
+void
+brilliant_session_set_element_tracing (gboolean enabled)
+{
+  brilliant_element_tracer_set_enabled (enabled);
+}
+
+/* Processing time percentiles of the elements traced so far, see BrilliantElementLatency */
+gint
+brilliant_session_get_element_latencies (BrilliantElementLatency *latencies, gint count)
+{
+  return brilliant_element_tracer_get_latencies (latencies, count);
+}
+
+/* Record pipeline activity of all sessions, capacity events at most (0 for the default) */
+gboolean
+brilliant_session_start_trace (guint capacity)
+{
+  return brilliant_trace_recorder_start (capacity);
+}
+
+/* Stop recording and write the trace as Chrome trace event JSON to path */
+gboolean
+brilliant_session_stop_trace (const gchar *path)
+{
+  GError *error = NULL;
+  if (!brilliant_trace_recorder_stop (path, &error)) {
+    GST_ERROR ("Failed to save trace: %s", error->message);
+    g_clear_error (&error);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/* Copy the startup milestones reached so far, as offsets from session creation in
+ * microseconds (-1 if not reached). Returns the number of entries written. */
+gint
+brilliant_session_get_startup_timings (CustomData *data, gint64 *timings_us, gint count)
+{
+  if (!data)
+    return 0;
+  return brilliant_startup_timings_get (&data->startup_timings, timings_us, count);
+}
+
+/* Fill attempts with the Start Data handshakes sent per BrilliantStartTrack, custom RTP only */
+gint
+brilliant_session_get_start_attempts (CustomData *data, gint *attempts, gint count)
+{
+  if (!data || !data->start_sequencer)
+    return 0;
+  return brilliant_start_sequencer_get_attempts (data->start_sequencer, attempts, count);
+}
+
+/* Id of the absolute capture time RTP header extension the device sends, as negotiated out of
+ * band. 0 (the default) measures latency from RTCP sender reports only. Set before playing. */
+void
+brilliant_session_set_capture_time_extension_id (CustomData *data, guint id)
+{
+  if (!data || !data->latency_monitor) {
+    GST_ERROR ("Capture time extension is only supported by the custom RTP backend");
+    return;
+  }
+  brilliant_latency_monitor_set_extension_id (data->latency_monitor, id);
+}
+
+/* Glass to glass latency of the given track over the last 30 seconds, in microseconds */
+gboolean
+brilliant_session_get_latency_stats (CustomData *data, BrilliantLatencyTrack track,
+    BrilliantHistogramSnapshot *snapshot)
+{
+  if (!data || !data->latency_monitor || track >= BRILLIANT_LATENCY_TRACK_COUNT)
+    return FALSE;
+  brilliant_latency_monitor_get_snapshot (data->latency_monitor, track, snapshot);
+  return TRUE;
+}
+
+/* Report RTP statistics through the on_rtp_stats callback every interval_ms, 0 to stop */
+void
+brilliant_session_set_rtp_stats_interval (CustomData *data, guint interval_ms)
+{
+  if (!data)
+    return;
+  data->rtp_stats_interval_ms = interval_ms;
+  /* Before the main loop exists app_function starts the timer itself */
+  if (data->context)
+    g_main_context_invoke (data->context, (GSourceFunc) restart_rtp_stats_timer, data);
+}
+
+/* Bounds of the jitterbuffer latency of a custom RTP track, which adapts to the network in
+ * between. Equal bounds fix the latency. */
+void
+brilliant_session_set_jitter_latency_bounds (CustomData *data, BrilliantLatencyTrack track,
+    guint min_ms, guint max_ms)
+{
+  if (!data || (guint) track >= BRILLIANT_LATENCY_TRACK_COUNT)
+    return;
+  data->jitter_latency_min_ms[track] = min_ms;
+  data->jitter_latency_max_ms[track] = max_ms;
+  /* Before the pipeline is built, the backend applies them itself */
+  if (data->jitter_controller)
+    brilliant_jitter_controller_set_bounds (data->jitter_controller, track, min_ms, max_ms);
+}
+
+/* Current jitterbuffer latency of a custom RTP track in milliseconds, 0 for other backends */
+guint
+brilliant_session_get_jitter_latency (CustomData *data, BrilliantLatencyTrack track)
+{
+  if (!data || !data->jitter_controller || (guint) track >= BRILLIANT_LATENCY_TRACK_COUNT)
+    return 0;
+  return brilliant_jitter_controller_get_latency (data->jitter_controller, track);
+}
+
+static gboolean
+apply_sync_policy (CustomData *data)
+{
+  apply_custom_rtp_sync_policy (data);
+  return G_SOURCE_REMOVE;
+}
+
+/* Choose between lip sync and the lowest latency for the custom RTP backend, see
+ * BrilliantSyncPolicy. Can be changed while playing. */
+void
+brilliant_session_set_sync_policy (CustomData *data, BrilliantSyncPolicy policy)
+{
+  if (!data || !data->rtp_custom_data || (guint) policy >= BRILLIANT_SYNC_POLICY_COUNT)
+    return;
+  data->rtp_custom_data->sync_policy = policy;
+  /* Before the main loop exists the backend applies it while building the pipeline */
+  if (data->context)
+    g_main_context_invoke (data->context, (GSourceFunc) apply_sync_policy, data);
+}
+
+/* Time the queue in front of the video decoder or the audio sink may hold before it drops,
+ * 0 for the default, see BrilliantQueueGuard */
+void
+brilliant_session_set_queue_limit (CustomData *data, BrilliantLatencyTrack track, guint limit_ms)
+{
+  if (!data || (guint) track >= BRILLIANT_LATENCY_TRACK_COUNT)
+    return;
+  data->queue_limit_ms[track] = limit_ms;
+  /* Before the pipeline is built, the backend applies it itself */
+  if (data->queue_guard)
+    brilliant_queue_guard_set_limit (data->queue_guard, track, limit_ms);
+}
+
+/* What the bounded queues dropped, indexed by BrilliantQueueStatsField. Returns the number of
+ * values written, 0 if the backend does not bound its queues. */
+gint
+brilliant_session_get_queue_drops (CustomData *data, gint64 *values, gint count)
+{
+  if (!data || !data->queue_guard)
+    return 0;
+  return brilliant_queue_guard_get (data->queue_guard, values, count);
+}
+
+/* Buffered duration catch-up playback drains a track back to, 0 for the default, see
+ * BrilliantCatchUp */
+void
+brilliant_session_set_catch_up_target (CustomData *data, BrilliantLatencyTrack track,
+    guint target_ms)
+{
+  if (!data || (guint) track >= BRILLIANT_LATENCY_TRACK_COUNT)
+    return;
+  data->catch_up_target_ms[track] = target_ms;
+  /* Before the pipeline is built, the backend applies it itself */
+  if (data->catch_up)
+    brilliant_catch_up_set_target (data->catch_up, track, target_ms);
+}
+
+/* How much catching up took place, indexed by BrilliantCatchUpStatsField. Returns the number of
+ * values written, 0 if the backend does not catch up. */
+gint
+brilliant_session_get_catch_up_stats (CustomData *data, gint64 *values, gint count)
+{
+  if (!data || !data->catch_up)
+    return 0;
+  return brilliant_catch_up_get (data->catch_up, values, count);
+}
+
+/* Whether the video sink waits for each frame's clock time or presents it right away, see
+ * BrilliantRenderPacer */
+void
+brilliant_session_set_render_mode (CustomData *data, BrilliantRenderMode mode)
+{
+  if (!data || (guint) mode >= BRILLIANT_RENDER_MODE_COUNT)
+    return;
+  data->render_mode = mode;
+  /* Before the pipeline is READY, it is applied once autovideosink picked its sink */
+  if (data->render_pacer)
+    brilliant_render_pacer_set_mode (data->render_pacer, mode);
+}
+
+/* Frames presented early or superseded, indexed by BrilliantRenderStatsField. Returns the number
+ * of values written, 0 before the pipeline is built. */
+gint
+brilliant_session_get_render_stats (CustomData *data, gint64 *values, gint count)
+{
+  if (!data || !data->render_pacer)
+    return 0;
+  return brilliant_render_pacer_get (data->render_pacer, values, count);
+}
+
+/* Snapshot of the RTCP and jitterbuffer statistics of every remote SSRC, see BrilliantRtpStatsField.
+ * Returns NULL if the backend has no rtpbin, otherwise the caller frees the array. */
+GArray *
+brilliant_session_get_rtp_stats (CustomData *data)
+{
+  if (!data || !data->rtp_stats)
+    return NULL;
+  return brilliant_rtp_stats_collect (data->rtp_stats);
+}
+
+/* Decode and render statistics of the video path, see BrilliantFrameCounter and
+ * BrilliantFrameHistogram for the layout. Returns the number of values written. */
+gint
+brilliant_session_get_frame_stats (CustomData *data, gint64 *values, gint count)
+{
+  if (!data)
+    return 0;
+  return brilliant_frame_stats_get (data->frame_stats, values, count);
+}
+
+/* RTCP keyframe requests of the video path, indexed by BrilliantKeyframeRequestField. Returns
+ * the number of values written, 0 if the backend does not request keyframes. */
+gint
+brilliant_session_get_keyframe_requests (CustomData *data, gint64 *values, gint count)
+{
+  if (!data || !data->keyframe_requester)
+    return 0;
+  return brilliant_keyframe_requester_get (data->keyframe_requester, values, count);
+}
+
+/* Set pipeline to PLAYING state */
+void
+brilliant_session_play (CustomData *data)
+{
+  if (!data)
+    return;
+
+  /* Custom RTP tracks start as their properties arrive, tracks not configured yet join later.
+   * Playing without local ports lets the system pick them, as it always did. */
+  if (data->rtp_custom_data) {
+    g_mutex_lock (&data->rtp_custom_data->lock);
+    gboolean ports_were_set = data->rtp_custom_data->local_ports_set;
+    data->rtp_custom_data->local_ports_set = TRUE;
+    g_mutex_unlock (&data->rtp_custom_data->lock);
+    if (!ports_were_set && data->context)
+      g_main_context_invoke (data->context, (GSourceFunc) activate_rtp_tracks, data);
+  }
+  GST_DEBUG ("Setting state to PLAYING");
+  data->target_state = GST_STATE_PLAYING;
+  data->is_live |=
+      (gst_element_set_state (data->pipeline,
+          GST_STATE_PLAYING) == GST_STATE_CHANGE_NO_PREROLL);
+  /* Tracks whose udpsrc was PLAYING already get no state change to start them */
+  brilliant_start_sequencer_arm (data->start_sequencer);
+}
+
+/* Set pipeline to PAUSED state */
+void
+brilliant_session_pause (CustomData *data)
+{
+  if (!data)
+    return;
+  GST_DEBUG ("Setting state to PAUSED");
+  data->target_state = GST_STATE_PAUSED;
+  data->is_live |=
+      (gst_element_set_state (data->pipeline,
+          GST_STATE_PAUSED) == GST_STATE_CHANGE_NO_PREROLL);
+}
+
+/* Instruct the pipeline to seek to a different position */
+void
+brilliant_session_set_position (CustomData *data, int milliseconds)
+{
+  if (!data)
+    return;
+  gint64 desired_position = (gint64) (milliseconds * GST_MSECOND);
+  if (data->state >= GST_STATE_PAUSED) {
+    execute_seek (desired_position, data);
+  } else {
+    GST_DEBUG ("Scheduling seek to %" GST_TIME_FORMAT " for later",
+        GST_TIME_ARGS (desired_position));
+    data->desired_position = desired_position;
+  }
+}
+
+/* Hand a native window to the session. Passing the handle the session already has only
+ * re-exposes the current frame. */
+void
+brilliant_session_set_window_handle (CustomData *data, guintptr window_handle)
+{
+  if (!data)
+    return;
+  GST_DEBUG ("Received window handle %p", (gpointer) window_handle);
+
+  if (data->window_handle == window_handle) {
+    GST_DEBUG ("New window handle is the same as the previous one %p",
+        (gpointer) data->window_handle);
+    if (data->video_sink) {
+      gst_video_overlay_expose (GST_VIDEO_OVERLAY (data->video_sink));
+    }
+    return;
+  }
+  if (data->window_handle)
+    GST_DEBUG ("Replacing previous window handle %p", (gpointer) data->window_handle);
+  data->window_handle = window_handle;
+
+  /* Once initialized the pipeline may already be playing, the sink just switches windows.
+   * Otherwise the session thread completes initialization, or does when its main loop starts.
+   * Attached rather than invoked, so it never runs on this thread. */
+  if (data->initialized) {
+    attach_window (data);
+  } else if (g_atomic_int_get (&data->main_loop_running)) {
+    GSource *source = g_idle_source_new ();
+    g_source_set_callback (source, (GSourceFunc) check_initialization_on_session_thread, data,
+        NULL);
+    g_source_attach (source, data->context);
+    g_source_unref (source);
+  }
+}
+
+/* Let the video sink render to a window of its own instead of waiting for one, as desktop tools
+ * showing video do */
+void
+brilliant_session_use_own_window (CustomData *data)
+{
+  if (data)
+    set_video_gate (data, data->video_sink, TRUE);
+}
+
+/* Detach the current native window from the video sink. The caller stays responsible for
+ * releasing the window itself. The pipeline keeps receiving and decoding, frames are dropped
+ * until the next window. */
+void
+brilliant_session_release_window (CustomData *data)
+{
+  if (!data)
+    return;
+  GST_DEBUG ("Releasing window handle %p", (gpointer) data->window_handle);
+
+  /* Keep playing and decoding without a window, frames are dropped until the next one */
+  set_video_gate (data, data->video_sink, FALSE);
+  if (data->video_sink) {
+    GstState state, pending;
+    gst_element_get_state (data->pipeline, &state, &pending, 0);
+    /* Frames render under the stream lock of the sink's own pad, behind render_queue */
+    GstPad *pad = gst_element_get_static_pad (data->video_sink, "sink");
+    if (pad && state == GST_STATE_PLAYING && pending == GST_STATE_VOID_PENDING) {
+      /* Wait for a frame that passed the gate already to be rendered, the caller frees the
+       * window once we return. Frames still in render_queue meet the closed gate again on this
+       * pad. A PLAYING sink does not block in preroll holding this lock. */
+      GST_PAD_STREAM_LOCK (pad);
+      gst_video_overlay_set_window_handle (GST_VIDEO_OVERLAY (data->video_sink),
+          (guintptr) NULL);
+      GST_PAD_STREAM_UNLOCK (pad);
+    } else {
+      /* The sink may be holding a frame in preroll, only stopping the stream releases it */
+      gst_video_overlay_set_window_handle (GST_VIDEO_OVERLAY (data->video_sink),
+          (guintptr) NULL);
+      gst_element_set_state (data->pipeline, GST_STATE_READY);
+      /* Report initialization again with the next window, so the application plays again */
+      data->initialized = FALSE;
+    }
+    if (pad)
+      gst_object_unref (pad);
+  }
+  data->window_handle = 0;
+}
+
+/* Count the GstObjects, GstMiniObjects and bytes of every backend, in all sessions of the process */
+void
+brilliant_session_set_allocation_accounting (gboolean enabled)
+{
+  brilliant_alloc_tracker_set_enabled (enabled);
+}
+
+/* Live objects created since the session was, FALSE if accounting is disabled */
+gboolean
+brilliant_session_get_allocation_counts (CustomData *data, BrilliantAllocCounts *counts)
+{
+  if (!data || !brilliant_alloc_tracker_is_enabled ())
+    return FALSE;
+  brilliant_alloc_tracker_get_counts (data->alloc_checkpoint, counts);
+  return TRUE;
+}
+
+/* Objects the last freed session left behind, one "type count bytes" line per type. NULL if it
+ * left none. Free with g_free. */
+gchar *
+brilliant_session_get_allocation_report (void)
+{
+  g_mutex_lock (&allocation_report_lock);
+  gchar *report = g_strdup (allocation_report);
+  g_mutex_unlock (&allocation_report_lock);
+  return report;
+}
@@ -0,0 +1,254 @@
+/*****************************************************************************
+ * GStreamerBrilliant: Android Library built with system's GStreamer Implementation. Intended for use in Brilliant Mobile App.
+ *****************************************************************************
+ * Copyright (C) 2022 Brilliant Home Technologies
+ *
+ * Authors: Brilliant iOS Team <android_developer # brilliant.tech>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef GSTREAMERBRILLIANT_BRILLIANT_SESSION_H
+#define GSTREAMERBRILLIANT_BRILLIANT_SESSION_H
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <gst/gst.h>
+#include <gio/gio.h>
+#include "brilliant_startup_timings.h"
+#include "brilliant_latency_monitor.h"
+#include "brilliant_rtp_stats.h"
+#include "brilliant_frame_stats.h"
+#include "brilliant_element_tracer.h"
+#include "brilliant_trace_recorder.h"
+#include "brilliant_alloc_tracker.h"
+#include "brilliant_log_ring.h"
+#include "brilliant_plugins.h"
+#include "brilliant_decoder_cache.h"
+#include "brilliant_start_sequencer.h"
+#include "brilliant_keyframe_cache.h"
+#include "brilliant_keyframe_requester.h"
+#include "brilliant_jitter_controller.h"
+#include "brilliant_queue_guard.h"
+#include "brilliant_catch_up.h"
+#include "brilliant_render_pacer.h"
+
+/* These constants are used to evaluate against backend_type strings */
+extern const char backend_type_rtsp[];
+extern const char backend_type_custom_rtp[];
+
+/* How the custom RTP backend trades lip sync for latency */
+typedef enum
+{
+  BRILLIANT_SYNC_POLICY_LIP_SYNC = 0,     /* Tracks aligned with RTCP, all at the latency of the slowest */
+  BRILLIANT_SYNC_POLICY_AUDIO_PRIORITY,   /* Audio plays at its own latency, video trails it */
+  BRILLIANT_SYNC_POLICY_UNSYNCHRONIZED,   /* Every track plays at its own latency */
+  BRILLIANT_SYNC_POLICY_COUNT
+} BrilliantSyncPolicy;
+
+/* Structure to contain all our Custom RTP Backend information,
+ * when applicable.
+ * We will also store and additional element and pipeline handles specific to this
+ * pipeline type here.
+ * */
+typedef struct _RTPCustomData
+{
+  GstElement *out_audio_data_pipe;    /* The running outgoing pipeline */
+  GstElement *audio_depay;            /* The audio depay element we will link the rtp src pad to */
+  GstElement *video_depay;            /* The video depay element we will link the rtp src pad to */
+  GstElement *mic_volume;             /* Volume element for muting and adjusting stream volume */
+  GstElement *rtp_bin;                /* RTP Bin element */
+  GstElement *video_data_pipe;        /* Incoming video data pipe */
+  GSocket *audio_rtp_socket;          /* Shared audio RTP Socket */
+  GSocket *video_rtp_socket;          /* Video RTP Socket, also sends the video Start Data */
+  /* Guards everything below and which tracks are running: the owner sets the properties from its
+   * own thread, the session thread reads them as it activates tracks */
+  GMutex lock;
+
+  int local_rtp_video_udp_port;
+  int local_rtcp_video_udp_port;
+  int local_rtp_audio_udp_port;
+  int local_rtcp_audio_udp_port;
+  gboolean local_ports_set;           /* Tracks bind their sockets only once this is set */
+  gchar *incoming_video_server;
+  gchar *incoming_audio_server;
+  gchar *outgoing_audio_server;
+  int incoming_video_sample_rate;
+  int incoming_audio_sample_rate;
+  int outgoing_audio_sample_rate;
+  int incoming_video_payload_type;
+  int incoming_audio_payload_type;
+  int outgoing_audio_payload_type;
+  GstBuffer *incoming_video_key;
+  GstBuffer *incoming_audio_key;
+  GstBuffer *outgoing_audio_key;
+  gchar *incoming_video_sprop_parameter_sets; /* Base64 SPS/PPS as in SDP, NULL when only in-band */
+  uint32_t incoming_video_ssrc;
+  uint32_t incoming_audio_ssrc;
+  uint32_t outgoing_audio_ssrc;
+  int incoming_video_port;
+  int incoming_audio_port;
+  int outgoing_audio_port;
+  int incoming_audio_channels;
+  int audio_channels;
+  BrilliantSyncPolicy sync_policy;
+} RTPCustomData;
+
+/* Structure to contain all our RTSP Backend information,
+ * when applicable.
+ * We will also store and additional element and pipeline handles specific to this
+ * pipeline type here.
+ * */
+typedef struct _RTSPData {
+  GstElement *rtsp_src;           /* The rtspsrc element */
+} RTSPData;
+
+/* Callbacks through which a session reports to its owner (the JNI glue on Android, or a desktop
+ * harness on Linux). All of them are optional and are invoked from the session's own thread.
+ * */
+typedef struct _BrilliantSessionCallbacks
+{
+  void (*set_message) (const gchar *message, gpointer user_data);
+  void (*set_current_position) (gint position, gint duration, gpointer user_data);
+  void (*on_initialized) (const gchar *backend_type, gpointer user_data);
+  void (*on_media_size_changed) (gint width, gint height, gpointer user_data);
+  /* The backend pipeline is built and its main loop is about to run. Lets desktop tools attach
+   * probes or look up elements by name before media starts flowing. */
+  void (*on_pipeline_ready) (GstElement *pipeline, gpointer user_data);
+  /* The first frame was rendered. timings_us holds BRILLIANT_STARTUP_MILESTONE_COUNT offsets from
+   * session creation, -1 for milestones that were never reached. Reported once per session. */
+  void (*on_startup_timings) (const gint64 *timings_us, gint count, gpointer user_data);
+  /* Periodic RTP receive statistics, see brilliant_session_set_rtp_stats_interval. stats holds
+   * BRILLIANT_RTP_STATS_FIELD_COUNT values for each of the source_count remote SSRCs. */
+  void (*on_rtp_stats) (const gint64 *stats, gint source_count, gpointer user_data);
+} BrilliantSessionCallbacks;
+
+/* Structure to contain all our information common to all backend types,
+ * so we can pass it to callbacks
+ * */
+typedef struct _CustomData
+{
+    BrilliantSessionCallbacks callbacks; /* Owner callbacks, see above */
+    gpointer user_data;             /* Passed back to every callback (the Java app GlobalRef on Android) */
+    gchar *backend_type;            /* String constant identifying the backend pipeline */
+    pthread_t app_thread;           /* Thread running app_function and the main loop */
+    GstElement *pipeline;           /* The running pipeline */
+    GstElement *video_sink;         /* The video sink element which receives XOverlay commands */
+    GstElement *volume;             /* The volume element */
+    GMainContext *context;          /* GLib context used to run the main loop */
+    GMainLoop *main_loop;           /* GLib main loop */
+    RTPCustomData *rtp_custom_data; /* Data used by Custom RTP pipeline */
+    RTSPData *rtsp_data;            /* Data used by RTSP pipeline */
+    gboolean initialized;           /* To avoid informing the UI multiple times about the initialization */
+    guintptr window_handle;         /* The native window where video will be rendered (ANativeWindow on Android) */
+    GstState state;                 /* Current pipeline state */
+    GstState target_state;          /* Desired pipeline state, to be set once buffering is complete */
+    gint64 duration;                /* Cached clip duration */
+    gint64 desired_position;        /* Position to seek to, once the pipeline is running */
+    GstClockTime last_seek_time;    /* For seeking overflow prevention (throttling) */
+    gboolean is_live;               /* Live streams do not use buffering */
+    BrilliantStartupTimings startup_timings; /* Time to first frame breakdown */
+    BrilliantLatencyMonitor *latency_monitor; /* Steady state latency, custom RTP backend only */
+    BrilliantRtpStats *rtp_stats;   /* RTCP and jitterbuffer statistics, custom RTP backend only */
+    guint rtp_stats_interval_ms;    /* Period of on_rtp_stats reports, 0 when disabled */
+    GSource *rtp_stats_source;      /* Timer reporting on_rtp_stats, owned by the session thread */
+    BrilliantFrameStats *frame_stats; /* Decode and render statistics of the video path */
+    guint64 alloc_checkpoint;       /* Allocation accounting checkpoint taken when the session was created */
+    BrilliantLogRing *log_ring;     /* Debug log of the pipeline, NULL unless the log ring is installed */
+    gint main_loop_running;         /* Set by the session thread once the pipeline is built and READY */
+    GMutex loop_lock;               /* Orders main_loop_running against quit_requested */
+    gboolean quit_requested;        /* brilliant_session_free was called, the main loop must not run */
+    BrilliantStartSequencer *start_sequencer; /* Start Data handshake, custom RTP backend only */
+    gchar *camera_id;               /* Identifies the camera in the keyframe cache, NULL if unknown */
+    gint keyframe_cache_attached;   /* The video path is cached and previewed already */
+    gint video_gate_open;           /* Decoded frames reach the video sink, only while there is a window */
+    BrilliantKeyframeRequester *keyframe_requester; /* RTCP keyframe requests, custom RTP backend only */
+    BrilliantJitterController *jitter_controller; /* Adaptive jitterbuffer latency, custom RTP backend only */
+    guint jitter_latency_min_ms[BRILLIANT_LATENCY_TRACK_COUNT]; /* Bounds of the adaptive latency, */
+    guint jitter_latency_max_ms[BRILLIANT_LATENCY_TRACK_COUNT]; /* 0 for the controller defaults */
+    BrilliantQueueGuard *queue_guard; /* Bounded decoder and audio sink queues, custom RTP backend only */
+    guint queue_limit_ms[BRILLIANT_LATENCY_TRACK_COUNT]; /* Queue time limits, 0 for the defaults */
+    BrilliantCatchUp *catch_up;     /* Drains excess buffered media, custom RTP and RTSP backends */
+    guint catch_up_target_ms[BRILLIANT_LATENCY_TRACK_COUNT]; /* 0 for the defaults */
+    BrilliantRenderPacer *render_pacer; /* When the video sink presents frames */
+    BrilliantRenderMode render_mode;
+} CustomData;
+
+void set_ui_message (const gchar * message, CustomData * data);
+void attach_keyframe_cache (CustomData * data);
+
+/*
+ * Session API. A session owns one pipeline of the given backend type and the thread running its
+ * main loop. These functions are safe to call from the owner's thread.
+ */
+CustomData *brilliant_session_new (const gchar *backend_type,
+    const BrilliantSessionCallbacks *callbacks, gpointer user_data);
+void brilliant_session_free (CustomData *data);
+gboolean brilliant_session_prewarm (const gchar *backend_type);
+void brilliant_session_drain_pool (void);
+void brilliant_session_set_uri (CustomData *data, const gchar *uri);
+void brilliant_session_set_rtp_track_properties (CustomData *data, const gchar *track_name,
+    const gchar *server, int track_port, const guint8 *track_key, gsize track_key_len,
+    uint32_t track_ssrc, int sample_rate, int payload_type, int channels);
+gboolean brilliant_session_set_rtp_video_parameter_sets (CustomData *data,
+    const gchar *sprop_parameter_sets);
+void brilliant_session_set_rtp_local_ports (CustomData *data,
+    int local_rtp_video_udp_port, int local_rtcp_video_udp_port,
+    int local_rtp_audio_udp_port, int local_rtcp_audio_udp_port);
+void brilliant_session_set_mute (CustomData *data, gboolean mute);
+void brilliant_session_set_mic_mute (CustomData *data, gboolean mute);
+void brilliant_session_set_mic_volume (CustomData *data, gfloat volume);
+void brilliant_session_play (CustomData *data);
+void brilliant_session_pause (CustomData *data);
+void brilliant_session_set_position (CustomData *data, int milliseconds);
+void brilliant_session_set_window_handle (CustomData *data, guintptr window_handle);
+void brilliant_session_release_window (CustomData *data);
+void brilliant_session_use_own_window (CustomData *data);
+void brilliant_session_set_debug_logging (const gchar *gst_debug_string);
+void brilliant_session_set_log_ring (const gchar *thresholds, const gchar *dump_dir);
+gboolean brilliant_session_dump_log (CustomData *data, const gchar *path);
+void brilliant_session_warm_up (const gchar *backend_type);
+void brilliant_session_set_decoder_cache (const gchar *cache_path);
+void brilliant_session_set_keyframe_cache (const gchar *directory);
+void brilliant_session_set_camera_id (CustomData *data, const gchar *camera_id);
+void brilliant_session_set_element_tracing (gboolean enabled);
+gint brilliant_session_get_element_latencies (BrilliantElementLatency *latencies, gint count);
+gboolean brilliant_session_start_trace (guint capacity);
+gboolean brilliant_session_stop_trace (const gchar *path);
+gint brilliant_session_get_startup_timings (CustomData *data, gint64 *timings_us, gint count);
+gint brilliant_session_get_start_attempts (CustomData *data, gint *attempts, gint count);
+void brilliant_session_set_capture_time_extension_id (CustomData *data, guint id);
+gboolean brilliant_session_get_latency_stats (CustomData *data, BrilliantLatencyTrack track,
+    BrilliantHistogramSnapshot *snapshot);
+void brilliant_session_set_rtp_stats_interval (CustomData *data, guint interval_ms);
+void brilliant_session_set_jitter_latency_bounds (CustomData *data, BrilliantLatencyTrack track,
+    guint min_ms, guint max_ms);
+guint brilliant_session_get_jitter_latency (CustomData *data, BrilliantLatencyTrack track);
+void brilliant_session_set_sync_policy (CustomData *data, BrilliantSyncPolicy policy);
+void brilliant_session_set_queue_limit (CustomData *data, BrilliantLatencyTrack track,
+    guint limit_ms);
+gint brilliant_session_get_queue_drops (CustomData *data, gint64 *values, gint count);
+void brilliant_session_set_catch_up_target (CustomData *data, BrilliantLatencyTrack track,
+    guint target_ms);
+gint brilliant_session_get_catch_up_stats (CustomData *data, gint64 *values, gint count);
+void brilliant_session_set_render_mode (CustomData *data, BrilliantRenderMode mode);
+gint brilliant_session_get_render_stats (CustomData *data, gint64 *values, gint count);
+GArray *brilliant_session_get_rtp_stats (CustomData *data);
+gint brilliant_session_get_frame_stats (CustomData *data, gint64 *values, gint count);
+gint brilliant_session_get_keyframe_requests (CustomData *data, gint64 *values, gint count);
+void brilliant_session_set_allocation_accounting (gboolean enabled);
+gboolean brilliant_session_get_allocation_counts (CustomData *data, BrilliantAllocCounts *counts);
+gchar *brilliant_session_get_allocation_report (void);
+#endif //GSTREAMERBRILLIANT_BRILLIANT_SESSION_H
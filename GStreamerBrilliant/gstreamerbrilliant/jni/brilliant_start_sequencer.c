@@ -0,0 +1,259 @@
+/*****************************************************************************
+ * GStreamerBrilliant: Android Library built with system's GStreamer Implementation. Intended for use in Brilliant Mobile App.
+ *****************************************************************************
+ * Copyright (C) 2022 Brilliant Home Technologies
+ *
+ * Authors: Brilliant iOS Team <android_developer # brilliant.tech>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+
+#include <string.h>
+#include "brilliant_start_sequencer.h"
+
+GST_DEBUG_CATEGORY_STATIC (start_sequencer_debug);
+#define GST_CAT_DEFAULT start_sequencer_debug
+
+#define START_MESSAGE "Start Data"
+/* Backoff between handshakes of a track, doubling from the first to the last value */
+#define START_RETRY_INITIAL_MS 250
+#define START_RETRY_MAX_MS 2000
+/* Handshakes sent per arm before giving up on a track, until the next arm */
+#define START_MAX_ATTEMPTS 10
+
+typedef struct _StartTrack
+{
+  BrilliantStartSequencer *sequencer;
+  BrilliantStartTrack track;
+  GSocket *socket;
+  GSocketAddress *destination;
+  GstPad *rtp_pad;
+  GstElement *udp_src;          /* Owner of rtp_pad, the handshake waits for it to be PLAYING */
+  gulong probe_id;
+  gint media_seen;              /* Atomic, set from the streaming thread */
+  gint attempts;                /* Handshakes sent in total */
+  gint round_attempts;          /* Handshakes sent since the last arm */
+  guint retry_interval_ms;
+  GSource *retry_source;
+} StartTrack;
+
+struct _BrilliantStartSequencer
+{
+  GMainContext *context;
+  BrilliantStartupTimings *timings;
+  GMutex lock;
+  StartTrack *tracks[BRILLIANT_START_TRACK_COUNT];
+};
+
+static const gchar *track_names[BRILLIANT_START_TRACK_COUNT] = { "video", "audio" };
+static const BrilliantStartupMilestone sent_milestones[BRILLIANT_START_TRACK_COUNT] = {
+  BRILLIANT_STARTUP_VIDEO_START_DATA_SENT,
+  BRILLIANT_STARTUP_AUDIO_START_DATA_SENT,
+};
+
+BrilliantStartSequencer *
+brilliant_start_sequencer_new (GMainContext *context, BrilliantStartupTimings *timings)
+{
+  GST_DEBUG_CATEGORY_INIT (start_sequencer_debug, "brilliant-start-sequencer", 0,
+      "Custom RTP start handshake");
+  BrilliantStartSequencer *sequencer = g_new0 (BrilliantStartSequencer, 1);
+  sequencer->context = g_main_context_ref (context);
+  sequencer->timings = timings;
+  g_mutex_init (&sequencer->lock);
+  return sequencer;
+}
+
+/* Called with the sequencer lock held */
+static void
+stop_retries (StartTrack *track)
+{
+  if (track->retry_source) {
+    g_source_destroy (track->retry_source);
+    g_source_unref (track->retry_source);
+    track->retry_source = NULL;
+  }
+}
+
+static void
+free_track (StartTrack *track)
+{
+  g_mutex_lock (&track->sequencer->lock);
+  stop_retries (track);
+  gulong probe_id = track->probe_id;
+  track->probe_id = 0;
+  g_mutex_unlock (&track->sequencer->lock);
+  if (track->rtp_pad) {
+    if (probe_id)
+      gst_pad_remove_probe (track->rtp_pad, probe_id);
+    gst_object_unref (track->rtp_pad);
+  }
+  if (track->udp_src)
+    gst_object_unref (track->udp_src);
+  g_object_unref (track->socket);
+  g_object_unref (track->destination);
+  g_free (track);
+}
+
+void
+brilliant_start_sequencer_free (BrilliantStartSequencer *sequencer)
+{
+  if (!sequencer)
+    return;
+  for (gint i = 0; i < BRILLIANT_START_TRACK_COUNT; i++) {
+    if (sequencer->tracks[i])
+      free_track (sequencer->tracks[i]);
+  }
+  g_mutex_clear (&sequencer->lock);
+  g_main_context_unref (sequencer->context);
+  g_free (sequencer);
+}
+
+/* Streaming thread, the first RTP packet of the track left its udpsrc. The lock is held while
+ * the probe is added, so probe_id is set by the time it is cleared here. */
+static GstPadProbeReturn
+first_packet_probe (GstPad *pad, GstPadProbeInfo *info, StartTrack *track)
+{
+  g_atomic_int_set (&track->media_seen, TRUE);
+  g_mutex_lock (&track->sequencer->lock);
+  track->probe_id = 0;
+  g_mutex_unlock (&track->sequencer->lock);
+  return GST_PAD_PROBE_REMOVE;
+}
+
+/* Register the handshake of a track, sent from socket to server:port. Does nothing if the track
+ * was already registered. */
+void
+brilliant_start_sequencer_add_track (BrilliantStartSequencer *sequencer,
+    BrilliantStartTrack track, GSocket *socket, const gchar *server, int port, GstPad *rtp_pad)
+{
+  g_mutex_lock (&sequencer->lock);
+  if (sequencer->tracks[track]) {
+    g_mutex_unlock (&sequencer->lock);
+    return;
+  }
+  StartTrack *start_track = g_new0 (StartTrack, 1);
+  start_track->sequencer = sequencer;
+  start_track->track = track;
+  start_track->socket = g_object_ref (socket);
+  GInetAddress *host_address = g_inet_address_new_from_string (server);
+  start_track->destination = g_inet_socket_address_new (host_address, port);
+  g_object_unref (host_address);
+  start_track->rtp_pad = gst_object_ref (rtp_pad);
+  start_track->udp_src = gst_pad_get_parent_element (rtp_pad);
+  start_track->probe_id = gst_pad_add_probe (rtp_pad,
+      GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+      (GstPadProbeCallback) first_packet_probe, start_track, NULL);
+  sequencer->tracks[track] = start_track;
+  g_mutex_unlock (&sequencer->lock);
+  GST_DEBUG ("Registered %s handshake to %s:%d", track_names[track], server, port);
+}
+
+/* Called with the sequencer lock held */
+static void
+send_handshake (StartTrack *track)
+{
+  GError *error = NULL;
+  g_socket_send_to (track->socket, track->destination, START_MESSAGE, strlen (START_MESSAGE),
+      NULL, &error);
+  track->attempts++;
+  track->round_attempts++;
+  if (error) {
+    GST_WARNING ("Failed to send %s handshake, attempt %d: %s", track_names[track->track],
+        track->attempts, error->message);
+    g_clear_error (&error);
+    return;
+  }
+  GST_DEBUG ("Sent %s handshake, attempt %d", track_names[track->track], track->attempts);
+  if (track->attempts == 1)
+    brilliant_startup_timings_mark (track->sequencer->timings, sent_milestones[track->track]);
+}
+
+static gboolean retry_handshake (StartTrack *track);
+
+/* Called with the sequencer lock held */
+static void
+schedule_retry (StartTrack *track)
+{
+  stop_retries (track);
+  track->retry_source = g_timeout_source_new (track->retry_interval_ms);
+  g_source_set_callback (track->retry_source, (GSourceFunc) retry_handshake, track, NULL);
+  g_source_attach (track->retry_source, track->sequencer->context);
+  track->retry_interval_ms = MIN (track->retry_interval_ms * 2, START_RETRY_MAX_MS);
+}
+
+static gboolean
+retry_handshake (StartTrack *track)
+{
+  BrilliantStartSequencer *sequencer = track->sequencer;
+  g_mutex_lock (&sequencer->lock);
+  g_source_unref (track->retry_source);
+  track->retry_source = NULL;
+  if (g_atomic_int_get (&track->media_seen)) {
+    GST_INFO ("%s media arrived after %d handshakes", track_names[track->track],
+        track->attempts);
+  } else if (track->round_attempts >= START_MAX_ATTEMPTS) {
+    GST_WARNING ("No %s media after %d handshakes, giving up", track_names[track->track],
+        track->attempts);
+  } else {
+    send_handshake (track);
+    schedule_retry (track);
+  }
+  g_mutex_unlock (&sequencer->lock);
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+arm_tracks (BrilliantStartSequencer *sequencer)
+{
+  g_mutex_lock (&sequencer->lock);
+  for (gint i = 0; i < BRILLIANT_START_TRACK_COUNT; i++) {
+    StartTrack *track = sequencer->tracks[i];
+    if (!track || track->retry_source || g_atomic_int_get (&track->media_seen))
+      continue;
+    if (!track->udp_src || GST_STATE (track->udp_src) != GST_STATE_PLAYING)
+      continue;
+    track->round_attempts = 0;
+    track->retry_interval_ms = START_RETRY_INITIAL_MS;
+    send_handshake (track);
+    schedule_retry (track);
+  }
+  g_mutex_unlock (&sequencer->lock);
+  return G_SOURCE_REMOVE;
+}
+
+/* Start the handshake of every registered track still waiting for media whose udpsrc is PLAYING.
+ * Call whenever elements reach PLAYING, from any thread. */
+void
+brilliant_start_sequencer_arm (BrilliantStartSequencer *sequencer)
+{
+  if (!sequencer)
+    return;
+  g_main_context_invoke (sequencer->context, (GSourceFunc) arm_tracks, sequencer);
+}
+
+/* Fill attempts with the number of handshakes sent for each BrilliantStartTrack so far. Returns
+ * the number of values written. */
+gint
+brilliant_start_sequencer_get_attempts (BrilliantStartSequencer *sequencer, gint *attempts,
+    gint count)
+{
+  count = MIN (count, BRILLIANT_START_TRACK_COUNT);
+  g_mutex_lock (&sequencer->lock);
+  for (gint i = 0; i < count; i++)
+    attempts[i] = sequencer->tracks[i] ? sequencer->tracks[i]->attempts : 0;
+  g_mutex_unlock (&sequencer->lock);
+  return count;
+}
@@ -0,0 +1,61 @@
+/*****************************************************************************
+ * GStreamerBrilliant: Android Library built with system's GStreamer Implementation. Intended for use in Brilliant Mobile App.
+ *****************************************************************************
+ * Copyright (C) 2022 Brilliant Home Technologies
+ *
+ * Authors: Brilliant iOS Team <android_developer # brilliant.tech>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+
+#ifndef GSTREAMERBRILLIANT_BRILLIANT_START_SEQUENCER_H
+#define GSTREAMERBRILLIANT_BRILLIANT_START_SEQUENCER_H
+#include <gst/gst.h>
+#include <gio/gio.h>
+#include "brilliant_startup_timings.h"
+
+/* Sends the custom RTP "Start Data" handshake of each track once the receive path is live, and
+ * keeps sending it until media arrives.
+ *
+ * Tracks are registered with the socket the handshake goes out from (the one the track's udpsrc
+ * receives on, since the device sends to the port it sees the handshake come from) and the
+ * udpsrc pad their RTP leaves from. brilliant_start_sequencer_arm, which the session calls as
+ * elements reach PLAYING, only sends for tracks whose udpsrc is PLAYING, so the first packets and
+ * the IDR they usually carry are not dropped by a udpsrc that is not running yet. The sinks do not
+ * have to preroll first, the video sink may well be waiting for a surface. The handshake is then
+ * retransmitted with exponential backoff until the first packet of the track is seen, and the
+ * number of attempts it took is kept.
+ *
+ * All sending happens on the main context the sequencer was created with.
+ * */
+typedef enum
+{
+  BRILLIANT_START_TRACK_VIDEO = 0,
+  BRILLIANT_START_TRACK_AUDIO,
+  BRILLIANT_START_TRACK_COUNT
+} BrilliantStartTrack;
+
+typedef struct _BrilliantStartSequencer BrilliantStartSequencer;
+
+BrilliantStartSequencer *brilliant_start_sequencer_new (GMainContext *context,
+    BrilliantStartupTimings *timings);
+void brilliant_start_sequencer_free (BrilliantStartSequencer *sequencer);
+void brilliant_start_sequencer_add_track (BrilliantStartSequencer *sequencer,
+    BrilliantStartTrack track, GSocket *socket, const gchar *server, int port, GstPad *rtp_pad);
+void brilliant_start_sequencer_arm (BrilliantStartSequencer *sequencer);
+gint brilliant_start_sequencer_get_attempts (BrilliantStartSequencer *sequencer,
+    gint *attempts, gint count);
+#endif //GSTREAMERBRILLIANT_BRILLIANT_START_SEQUENCER_H
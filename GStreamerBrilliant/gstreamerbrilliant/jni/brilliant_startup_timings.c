@@ -0,0 +1,213 @@
+/*****************************************************************************
+ * GStreamerBrilliant: Android Library built with system's GStreamer Implementation. Intended for use in Brilliant Mobile App.
+ *****************************************************************************
+ * Copyright (C) 2022 Brilliant Home Technologies
+ *
+ * Authors: Brilliant iOS Team <android_developer # brilliant.tech>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+
+#include <string.h>
+#include "brilliant_startup_timings.h"
+
+static const gchar *milestone_names[BRILLIANT_STARTUP_MILESTONE_COUNT] = {
+  "session_created",
+  "pipeline_built",
+  "sockets_bound",
+  "video_start_data_sent",
+  "audio_start_data_sent",
+  "first_video_rtp",
+  "first_audio_rtp",
+  "first_srtp_decrypted",
+  "first_idr",
+  "first_decoded_frame",
+  "first_frame_rendered",
+  "preview_rendered",
+};
+
+typedef struct _PadWatch
+{
+  BrilliantStartupTimings *timings;
+  BrilliantStartupMilestone milestone;
+} PadWatch;
+
+void
+brilliant_startup_timings_init (BrilliantStartupTimings *timings,
+    void (*on_complete) (gpointer user_data), gpointer user_data)
+{
+  g_mutex_init (&timings->lock);
+  memset (timings->timestamps, 0, sizeof (timings->timestamps));
+  timings->on_complete = on_complete;
+  timings->user_data = user_data;
+  timings->timestamps[BRILLIANT_STARTUP_SESSION_CREATED] = g_get_monotonic_time ();
+}
+
+void
+brilliant_startup_timings_clear (BrilliantStartupTimings *timings)
+{
+  g_mutex_clear (&timings->lock);
+}
+
+/* Forget the milestones reached so far and count from now, for sessions built ahead of use */
+void
+brilliant_startup_timings_restart (BrilliantStartupTimings *timings)
+{
+  g_mutex_lock (&timings->lock);
+  memset (timings->timestamps, 0, sizeof (timings->timestamps));
+  timings->timestamps[BRILLIANT_STARTUP_SESSION_CREATED] = g_get_monotonic_time ();
+  g_mutex_unlock (&timings->lock);
+}
+
+/* Record a milestone. Only the first occurrence counts, except for the socket milestone which
+ * tracks the last socket bound before media could flow. */
+void
+brilliant_startup_timings_mark (BrilliantStartupTimings *timings,
+    BrilliantStartupMilestone milestone)
+{
+  gint64 now = g_get_monotonic_time ();
+  gboolean complete = FALSE;
+
+  g_mutex_lock (&timings->lock);
+  if (!timings->timestamps[milestone] || milestone == BRILLIANT_STARTUP_SOCKETS_BOUND) {
+    timings->timestamps[milestone] = now;
+    complete = milestone == BRILLIANT_STARTUP_FIRST_FRAME_RENDERED;
+    GST_DEBUG ("Startup milestone %s after %" G_GINT64_FORMAT " us",
+        milestone_names[milestone],
+        now - timings->timestamps[BRILLIANT_STARTUP_SESSION_CREATED]);
+  }
+  g_mutex_unlock (&timings->lock);
+
+  if (complete && timings->on_complete)
+    timings->on_complete (timings->user_data);
+}
+
+/* The push that delivered the first frame to the sink has returned, so it has been rendered.
+ * Idle probes on a src pad fire once no push is in progress, they only wait for the current one
+ * when added while it is past the src pad's own probes: from a probe on the peer sink pad. */
+static GstPadProbeReturn
+rendered_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  PadWatch *watch = user_data;
+  brilliant_startup_timings_mark (watch->timings, watch->milestone);
+  return GST_PAD_PROBE_REMOVE;
+}
+
+static gboolean
+milestone_reached (BrilliantStartupTimings *timings, BrilliantStartupMilestone milestone)
+{
+  g_mutex_lock (&timings->lock);
+  gboolean reached = timings->timestamps[milestone] != 0;
+  g_mutex_unlock (&timings->lock);
+  return reached;
+}
+
+static GstPadProbeReturn
+first_buffer_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  PadWatch *watch = user_data;
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+
+  if (watch->milestone == BRILLIANT_STARTUP_FIRST_IDR &&
+      GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT))
+    return GST_PAD_PROBE_OK;
+
+  /* Frames decoded before the first live keyframe are the cached preview */
+  gboolean live = milestone_reached (watch->timings, BRILLIANT_STARTUP_FIRST_IDR);
+  if (watch->milestone == BRILLIANT_STARTUP_PREVIEW_RENDERED && live)
+    return GST_PAD_PROBE_REMOVE;
+  if ((watch->milestone == BRILLIANT_STARTUP_FIRST_DECODED_FRAME ||
+          watch->milestone == BRILLIANT_STARTUP_FIRST_FRAME_RENDERED) && !live)
+    return GST_PAD_PROBE_OK;
+
+  if (watch->milestone == BRILLIANT_STARTUP_FIRST_FRAME_RENDERED ||
+      watch->milestone == BRILLIANT_STARTUP_PREVIEW_RENDERED) {
+    /* pad is the sink's, the sink renders inside the push of its peer */
+    GstPad *src_pad = gst_pad_get_peer (pad);
+    if (src_pad) {
+      PadWatch *idle_watch = g_memdup (watch, sizeof (PadWatch));
+      gst_pad_add_probe (src_pad, GST_PAD_PROBE_TYPE_IDLE, rendered_probe, idle_watch, g_free);
+      gst_object_unref (src_pad);
+    }
+  } else {
+    brilliant_startup_timings_mark (watch->timings, watch->milestone);
+  }
+  return GST_PAD_PROBE_REMOVE;
+}
+
+/* Mark the milestone when the first buffer goes through the pad. FIRST_IDR waits for a buffer
+ * that is not a delta unit. FIRST_FRAME_RENDERED expects the linked src pad pushing to the video
+ * sink, watches the sink pad it is linked to and waits until the push returns. FIRST_DECODED_FRAME
+ * and FIRST_FRAME_RENDERED only count frames after FIRST_IDR, PREVIEW_RENDERED (a render milestone
+ * too) only frames before it. */
+void
+brilliant_startup_timings_watch_pad (BrilliantStartupTimings *timings, GstPad *pad,
+    BrilliantStartupMilestone milestone)
+{
+  GstPad *sink_pad = NULL;
+  if (milestone == BRILLIANT_STARTUP_FIRST_FRAME_RENDERED ||
+      milestone == BRILLIANT_STARTUP_PREVIEW_RENDERED) {
+    sink_pad = gst_pad_get_peer (pad);
+    if (!sink_pad) {
+      GST_WARNING ("%s:%s is not linked, cannot watch for startup milestone %s",
+          GST_DEBUG_PAD_NAME (pad), milestone_names[milestone]);
+      return;
+    }
+    pad = sink_pad;
+  }
+  PadWatch *watch = g_new0 (PadWatch, 1);
+  watch->timings = timings;
+  watch->milestone = milestone;
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, first_buffer_probe, watch, g_free);
+  if (sink_pad)
+    gst_object_unref (sink_pad);
+}
+
+void
+brilliant_startup_timings_watch_element (BrilliantStartupTimings *timings,
+    GstElement *element, const gchar *pad_name, BrilliantStartupMilestone milestone)
+{
+  GstPad *pad = element ? gst_element_get_static_pad (element, pad_name) : NULL;
+  if (!pad) {
+    GST_WARNING ("No %s pad to watch for startup milestone %s", pad_name,
+        milestone_names[milestone]);
+    return;
+  }
+  brilliant_startup_timings_watch_pad (timings, pad, milestone);
+  gst_object_unref (pad);
+}
+
+/* Fill offsets_us with the time of each milestone since the session was created, or -1 for
+ * milestones not reached (yet). Returns the number of entries written. */
+gint
+brilliant_startup_timings_get (BrilliantStartupTimings *timings, gint64 *offsets_us,
+    gint count)
+{
+  count = MIN (count, BRILLIANT_STARTUP_MILESTONE_COUNT);
+  g_mutex_lock (&timings->lock);
+  gint64 created = timings->timestamps[BRILLIANT_STARTUP_SESSION_CREATED];
+  for (gint i = 0; i < count; i++) {
+    offsets_us[i] = timings->timestamps[i] ? timings->timestamps[i] - created : -1;
+  }
+  g_mutex_unlock (&timings->lock);
+  return count;
+}
+
+const gchar *
+brilliant_startup_milestone_get_name (BrilliantStartupMilestone milestone)
+{
+  return milestone < BRILLIANT_STARTUP_MILESTONE_COUNT ? milestone_names[milestone] : NULL;
+}
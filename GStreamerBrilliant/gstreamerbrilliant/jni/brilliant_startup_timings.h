@@ -0,0 +1,71 @@
+/*****************************************************************************
+ * GStreamerBrilliant: Android Library built with system's GStreamer Implementation. Intended for use in Brilliant Mobile App.
+ *****************************************************************************
+ * Copyright (C) 2022 Brilliant Home Technologies
+ *
+ * Authors: Brilliant iOS Team <android_developer # brilliant.tech>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+
+#ifndef GSTREAMERBRILLIANT_BRILLIANT_STARTUP_TIMINGS_H
+#define GSTREAMERBRILLIANT_BRILLIANT_STARTUP_TIMINGS_H
+#include <gst/gst.h>
+
+/* Startup milestones of a session, in the order they normally happen. The order and values are
+ * part of the Java interface: nativeGetStartupTimings and onStartupTimings deliver one entry per
+ * milestone, indexed by these values.
+ * */
+typedef enum
+{
+  BRILLIANT_STARTUP_SESSION_CREATED = 0,    /* nativeInit, the reference for all other entries */
+  BRILLIANT_STARTUP_PIPELINE_BUILT,         /* Backend pipeline constructed on the session thread */
+  BRILLIANT_STARTUP_SOCKETS_BOUND,          /* Last local UDP socket bound */
+  BRILLIANT_STARTUP_VIDEO_START_DATA_SENT,  /* "Start Data" sent for the video track */
+  BRILLIANT_STARTUP_AUDIO_START_DATA_SENT,  /* "Start Data" sent for the audio track */
+  BRILLIANT_STARTUP_FIRST_VIDEO_RTP,        /* First packet out of the video udpsrc */
+  BRILLIANT_STARTUP_FIRST_AUDIO_RTP,        /* First packet out of the audio udpsrc */
+  BRILLIANT_STARTUP_FIRST_SRTP_DECRYPTED,   /* First packet out of any srtpdec */
+  BRILLIANT_STARTUP_FIRST_IDR,              /* First keyframe out of rtph264depay */
+  BRILLIANT_STARTUP_FIRST_DECODED_FRAME,    /* First live raw frame out of the decoder */
+  BRILLIANT_STARTUP_FIRST_FRAME_RENDERED,   /* First live frame handled by the video sink */
+  BRILLIANT_STARTUP_PREVIEW_RENDERED,       /* Cached keyframe handled by the video sink */
+  BRILLIANT_STARTUP_MILESTONE_COUNT
+} BrilliantStartupMilestone;
+
+/* Monotonic timestamps of each milestone, filled from whichever thread reaches it */
+typedef struct _BrilliantStartupTimings
+{
+  GMutex lock;
+  gint64 timestamps[BRILLIANT_STARTUP_MILESTONE_COUNT];  /* Monotonic time in us, 0 if not reached */
+  void (*on_complete) (gpointer user_data);  /* Called once, when the first frame was rendered */
+  gpointer user_data;
+} BrilliantStartupTimings;
+
+void brilliant_startup_timings_init (BrilliantStartupTimings *timings,
+    void (*on_complete) (gpointer user_data), gpointer user_data);
+void brilliant_startup_timings_clear (BrilliantStartupTimings *timings);
+void brilliant_startup_timings_restart (BrilliantStartupTimings *timings);
+void brilliant_startup_timings_mark (BrilliantStartupTimings *timings,
+    BrilliantStartupMilestone milestone);
+void brilliant_startup_timings_watch_pad (BrilliantStartupTimings *timings, GstPad *pad,
+    BrilliantStartupMilestone milestone);
+void brilliant_startup_timings_watch_element (BrilliantStartupTimings *timings,
+    GstElement *element, const gchar *pad_name, BrilliantStartupMilestone milestone);
+gint brilliant_startup_timings_get (BrilliantStartupTimings *timings, gint64 *offsets_us,
+    gint count);
+const gchar *brilliant_startup_milestone_get_name (BrilliantStartupMilestone milestone);
+#endif //GSTREAMERBRILLIANT_BRILLIANT_STARTUP_TIMINGS_H
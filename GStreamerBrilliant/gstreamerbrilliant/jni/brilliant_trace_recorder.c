@@ -0,0 +1,345 @@
+/*****************************************************************************
+ * GStreamerBrilliant: Android Library built with system's GStreamer Implementation. Intended for use in Brilliant Mobile App.
+ *****************************************************************************
+ * Copyright (C) 2022 Brilliant Home Technologies
+ *
+ * Authors: Brilliant iOS Team <android_developer # brilliant.tech>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "brilliant_trace_recorder.h"
+
+#define DEFAULT_TRACE_CAPACITY (64 * 1024)
+#define MIN_TRACE_CAPACITY 1024
+#define MAX_TRACE_CAPACITY (4 * 1024 * 1024)
+#define TRACE_NAME_SIZE 48
+
+GST_DEBUG_CATEGORY_STATIC (trace_recorder_debug);
+#define GST_CAT_DEFAULT trace_recorder_debug
+
+typedef struct _TraceEvent
+{
+  guint sequence;               /* Index of the event + 1 once written, 0 while being written */
+  gchar phase;                  /* Chrome phase: B(egin), E(nd), X (complete) or i(nstant) */
+  guint8 category;
+  guint32 tid;
+  GstClockTime ts;
+  GstClockTime duration;        /* X events only */
+  gchar name[TRACE_NAME_SIZE];
+} TraceEvent;
+
+/* Capacity is a power of two, so indices keep mapping to the same slots when head wraps */
+typedef struct _TraceRing
+{
+  TraceEvent *events;
+  guint capacity;
+  guint head;                   /* Index of the next event */
+} TraceRing;
+
+typedef struct _BrilliantTraceRecorderTracer
+{
+  GstTracer parent;
+} BrilliantTraceRecorderTracer;
+
+typedef struct _BrilliantTraceRecorderTracerClass
+{
+  GstTracerClass parent_class;
+} BrilliantTraceRecorderTracerClass;
+
+#define BRILLIANT_TYPE_TRACE_RECORDER_TRACER (brilliant_trace_recorder_tracer_get_type ())
+G_DEFINE_TYPE (BrilliantTraceRecorderTracer, brilliant_trace_recorder_tracer, GST_TYPE_TRACER);
+
+static const gchar *category_names[BRILLIANT_TRACE_CATEGORY_COUNT] = {
+  "buffer", "state", "message", "jni", "mainloop"
+};
+
+/* GStreamer cannot remove tracer hooks, so the tracer lives for the whole process once created */
+static BrilliantTraceRecorderTracer *tracer_instance;
+static GMutex control_lock;     /* Serializes start and stop, never taken by writers */
+static TraceRing *ring;         /* Non NULL while recording */
+static gint writers;            /* Threads currently writing into ring */
+static GPrivate thread_id = G_PRIVATE_INIT (NULL);
+static GPrivate dispatch_start = G_PRIVATE_INIT (g_free);
+
+static guint32
+current_tid (void)
+{
+  gpointer tid = g_private_get (&thread_id);
+  if (!tid) {
+    tid = GUINT_TO_POINTER ((guint) syscall (SYS_gettid));
+    g_private_set (&thread_id, tid);
+  }
+  return GPOINTER_TO_UINT (tid);
+}
+
+/* Writers announce themselves before reading ring, so that stop can wait for them to leave it */
+static void
+record (BrilliantTraceCategory category, gchar phase, const gchar *name, GstClockTime ts,
+    GstClockTime duration)
+{
+  if (!g_atomic_pointer_get (&ring))
+    return;
+  g_atomic_int_inc (&writers);
+  TraceRing *current = g_atomic_pointer_get (&ring);
+  if (current) {
+    guint index = (guint) g_atomic_int_add ((gint *) &current->head, 1);
+    TraceEvent *event = &current->events[index & (current->capacity - 1)];
+    g_atomic_int_set ((gint *) &event->sequence, 0);
+    event->phase = phase;
+    event->category = category;
+    event->tid = current_tid ();
+    event->ts = ts;
+    event->duration = duration;
+    g_strlcpy (event->name, name ? name : "", sizeof (event->name));
+    g_atomic_int_set ((gint *) &event->sequence, index + 1);
+  }
+  g_atomic_int_add (&writers, -1);
+}
+
+/* Name of the element a push on pad runs into, the bin for pushes into ghost pads */
+static const gchar *
+push_target_name (GstPad * pad)
+{
+  GstPad *peer = GST_PAD_PEER (pad);
+  GstObject *parent = peer ? GST_OBJECT_PARENT (peer) : NULL;
+  if (parent && GST_IS_PAD (parent))
+    parent = GST_OBJECT_PARENT (parent);
+  return parent ? GST_OBJECT_NAME (parent) : "unlinked";
+}
+
+/* pad-push-pre and pad-push-list-pre */
+static void
+push_pre (GstTracer * self, GstClockTime ts, GstPad * pad, gpointer buffer)
+{
+  if (g_atomic_pointer_get (&ring))
+    record (BRILLIANT_TRACE_BUFFER, 'B', push_target_name (pad), ts, 0);
+}
+
+/* pad-push-post and pad-push-list-post */
+static void
+push_post (GstTracer * self, GstClockTime ts, GstPad * pad, GstFlowReturn result)
+{
+  record (BRILLIANT_TRACE_BUFFER, 'E', NULL, ts, 0);
+}
+
+static void
+change_state_pre (GstTracer * self, GstClockTime ts, GstElement * element,
+    GstStateChange transition)
+{
+  if (!g_atomic_pointer_get (&ring))
+    return;
+  gchar name[TRACE_NAME_SIZE];
+  g_snprintf (name, sizeof (name), "%s %s", GST_OBJECT_NAME (element),
+      gst_state_change_get_name (transition));
+  record (BRILLIANT_TRACE_STATE, 'B', name, ts, 0);
+}
+
+static void
+change_state_post (GstTracer * self, GstClockTime ts, GstElement * element,
+    GstStateChange transition, GstStateChangeReturn result)
+{
+  record (BRILLIANT_TRACE_STATE, 'E', NULL, ts, 0);
+}
+
+static void
+post_message_pre (GstTracer * self, GstClockTime ts, GstElement * element, GstMessage * message)
+{
+  if (!g_atomic_pointer_get (&ring))
+    return;
+  gchar name[TRACE_NAME_SIZE];
+  g_snprintf (name, sizeof (name), "%s %s", GST_MESSAGE_TYPE_NAME (message),
+      GST_OBJECT_NAME (element));
+  record (BRILLIANT_TRACE_MESSAGE, 'i', name, ts, 0);
+}
+
+static void
+brilliant_trace_recorder_tracer_class_init (BrilliantTraceRecorderTracerClass * klass)
+{
+}
+
+static void
+brilliant_trace_recorder_tracer_init (BrilliantTraceRecorderTracer * self)
+{
+  GstTracer *tracer = GST_TRACER (self);
+  gst_tracing_register_hook (tracer, "pad-push-pre", G_CALLBACK (push_pre));
+  gst_tracing_register_hook (tracer, "pad-push-post", G_CALLBACK (push_post));
+  gst_tracing_register_hook (tracer, "pad-push-list-pre", G_CALLBACK (push_pre));
+  gst_tracing_register_hook (tracer, "pad-push-list-post", G_CALLBACK (push_post));
+  gst_tracing_register_hook (tracer, "element-change-state-pre", G_CALLBACK (change_state_pre));
+  gst_tracing_register_hook (tracer, "element-change-state-post", G_CALLBACK (change_state_post));
+  gst_tracing_register_hook (tracer, "element-post-message-pre", G_CALLBACK (post_message_pre));
+}
+
+/* Main loop poll function: everything between two polls is one dispatch */
+static gint
+trace_poll (GPollFD * fds, guint nfds, gint timeout)
+{
+  GstClockTime *woken = g_private_get (&dispatch_start);
+  if (!woken) {
+    woken = g_new (GstClockTime, 1);
+    *woken = GST_CLOCK_TIME_NONE;
+    g_private_set (&dispatch_start, woken);
+  }
+  if (!g_atomic_pointer_get (&ring)) {
+    *woken = GST_CLOCK_TIME_NONE;
+    return g_poll (fds, nfds, timeout);
+  }
+
+  GstClockTime now = gst_util_get_timestamp ();
+  if (GST_CLOCK_TIME_IS_VALID (*woken))
+    record (BRILLIANT_TRACE_MAIN_LOOP, 'X', "dispatch", *woken, now - *woken);
+  gint result = g_poll (fds, nfds, timeout);
+  *woken = gst_util_get_timestamp ();
+  return result;
+}
+
+static void
+write_json_string (FILE *file, const gchar *string)
+{
+  fputc ('"', file);
+  for (const gchar *c = string; *c; c++)
+    fputc (*c == '"' || *c == '\\' || (guchar) *c < 0x20 ? '_' : *c, file);
+  fputc ('"', file);
+}
+
+/* Microseconds with the nanoseconds as fraction, the unit of trace event timestamps */
+static void
+write_json_time (FILE *file, const gchar *key, GstClockTime time)
+{
+  fprintf (file, ",\"%s\":%" G_GUINT64_FORMAT ".%03u", key, time / 1000, (guint) (time % 1000));
+}
+
+static gboolean
+write_json (TraceRing *current, const gchar *path, GError **error)
+{
+  FILE *file = fopen (path, "w");
+  if (!file) {
+    int saved_errno = errno;
+    g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (saved_errno),
+        "Cannot open %s: %s", path, g_strerror (saved_errno));
+    return FALSE;
+  }
+
+  guint written = 0;
+  guint head = current->head;
+  guint first = head > current->capacity ? head - current->capacity : 0;
+  fputs ("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", file);
+  for (guint index = first; index != head; index++) {
+    TraceEvent *event = &current->events[index & (current->capacity - 1)];
+    if (event->sequence != index + 1)
+      continue;
+    fputs (written++ ? ",\n{\"name\":" : "\n{\"name\":", file);
+    write_json_string (file, event->name);
+    fprintf (file, ",\"cat\":\"%s\",\"ph\":\"%c\",\"pid\":%d,\"tid\":%u",
+        category_names[event->category], event->phase, (int) getpid (), event->tid);
+    write_json_time (file, "ts", event->ts);
+    if (event->phase == 'X')
+      write_json_time (file, "dur", event->duration);
+    if (event->phase == 'i')
+      fputs (",\"s\":\"t\"", file);
+    fputc ('}', file);
+  }
+  fputs ("\n]}\n", file);
+
+  if (fclose (file) != 0) {
+    int saved_errno = errno;
+    g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (saved_errno),
+        "Cannot write %s: %s", path, g_strerror (saved_errno));
+    return FALSE;
+  }
+  GST_INFO ("Wrote %u trace events to %s", written, path);
+  return TRUE;
+}
+
+/* Start recording into a ring of capacity events (0 for the default), rounded up to a power of
+ * two. Returns FALSE if a recording is already in progress. */
+gboolean
+brilliant_trace_recorder_start (guint capacity)
+{
+  g_mutex_lock (&control_lock);
+  if (!tracer_instance) {
+    GST_DEBUG_CATEGORY_INIT (trace_recorder_debug, "brilliant-trace-recorder", 0,
+        "Chrome trace recorder");
+    tracer_instance = g_object_new (BRILLIANT_TYPE_TRACE_RECORDER_TRACER, NULL);
+  }
+  if (ring) {
+    g_mutex_unlock (&control_lock);
+    GST_WARNING ("Trace recording already in progress");
+    return FALSE;
+  }
+
+  capacity = CLAMP (capacity ? capacity : DEFAULT_TRACE_CAPACITY, MIN_TRACE_CAPACITY,
+      MAX_TRACE_CAPACITY);
+  TraceRing *new_ring = g_new0 (TraceRing, 1);
+  new_ring->capacity = 1u << g_bit_storage (capacity - 1);
+  /* Touch every page now rather than faulting them in while recording */
+  new_ring->events = g_malloc (new_ring->capacity * sizeof (TraceEvent));
+  memset (new_ring->events, 0, new_ring->capacity * sizeof (TraceEvent));
+  g_atomic_pointer_set (&ring, new_ring);
+  g_mutex_unlock (&control_lock);
+  GST_INFO ("Recording up to %u trace events", new_ring->capacity);
+  return TRUE;
+}
+
+/* Stop recording and write the events still in the ring to path */
+gboolean
+brilliant_trace_recorder_stop (const gchar *path, GError **error)
+{
+  g_mutex_lock (&control_lock);
+  TraceRing *current = ring;
+  if (!current) {
+    g_mutex_unlock (&control_lock);
+    g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED, "No trace recording in progress");
+    return FALSE;
+  }
+  g_atomic_pointer_set (&ring, NULL);
+  while (g_atomic_int_get (&writers) > 0)
+    g_thread_yield ();
+  g_mutex_unlock (&control_lock);
+
+  gboolean result = write_json (current, path, error);
+  g_free (current->events);
+  g_free (current);
+  return result;
+}
+
+/* Open and close a span on the calling thread, for activity GStreamer does not see */
+void
+brilliant_trace_recorder_begin (BrilliantTraceCategory category, const gchar *name)
+{
+  if (g_atomic_pointer_get (&ring))
+    record (category, 'B', name, gst_util_get_timestamp (), 0);
+}
+
+void
+brilliant_trace_recorder_end (BrilliantTraceCategory category, const gchar *name)
+{
+  if (g_atomic_pointer_get (&ring))
+    record (category, 'E', name, gst_util_get_timestamp (), 0);
+}
+
+/* Record the dispatches of a main loop running context */
+void
+brilliant_trace_recorder_watch_context (GMainContext *context)
+{
+  g_main_context_set_poll_func (context, trace_poll);
+}
@@ -0,0 +1,53 @@
+/*****************************************************************************
+ * GStreamerBrilliant: Android Library built with system's GStreamer Implementation. Intended for use in Brilliant Mobile App.
+ *****************************************************************************
+ * Copyright (C) 2022 Brilliant Home Technologies
+ *
+ * Authors: Brilliant iOS Team <android_developer # brilliant.tech>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+
+#ifndef GSTREAMERBRILLIANT_BRILLIANT_TRACE_RECORDER_H
+#define GSTREAMERBRILLIANT_BRILLIANT_TRACE_RECORDER_H
+#include <gst/gst.h>
+
+/* On demand recorder of pipeline activity, written out in the Chrome trace event JSON format that
+ * chrome://tracing and ui.perfetto.dev open.
+ *
+ * Records, per thread: buffers being processed by each element, element state changes, bus
+ * messages being posted, JNI calls and main loop dispatches. Events go into a ring preallocated
+ * by brilliant_trace_recorder_start; recording one is a couple of atomic operations and a copy,
+ * and the oldest events are overwritten once the ring is full. Like GStreamer tracers, recording
+ * covers every pipeline in the process. Thread ids are kernel tids, so traces line up with
+ * systrace and simpleperf captures.
+ * */
+typedef enum
+{
+  BRILLIANT_TRACE_BUFFER = 0,
+  BRILLIANT_TRACE_STATE,
+  BRILLIANT_TRACE_MESSAGE,
+  BRILLIANT_TRACE_JNI,
+  BRILLIANT_TRACE_MAIN_LOOP,
+  BRILLIANT_TRACE_CATEGORY_COUNT
+} BrilliantTraceCategory;
+
+gboolean brilliant_trace_recorder_start (guint capacity);
+gboolean brilliant_trace_recorder_stop (const gchar *path, GError **error);
+void brilliant_trace_recorder_begin (BrilliantTraceCategory category, const gchar *name);
+void brilliant_trace_recorder_end (BrilliantTraceCategory category, const gchar *name);
+void brilliant_trace_recorder_watch_context (GMainContext *context);
+#endif //GSTREAMERBRILLIANT_BRILLIANT_TRACE_RECORDER_H
@@ -21,14 +21,9 @@
  *****************************************************************************/
 #include <android/log.h>
 #include <android/native_window_jni.h>
-#include <gst/video/video.h>
-#include <gst/video/videooverlay.h>
+#include <jni.h>
 #include <pthread.h>
-#include "gstreamer_brilliant_android.h"
-#include "brilliant_rtsp_backend.h"
-#include "brilliant_custom_rtp_backend.h"
-#include "inttypes.h"
-#include <gio/gio.h>
+#include "brilliant_session.h"
 
 GST_DEBUG_CATEGORY_STATIC (debug_category);
 #define GST_CAT_DEFAULT debug_category
@@ -45,14 +40,7 @@ GST_DEBUG_CATEGORY_STATIC (debug_category);
 # define SET_CUSTOM_DATA(env, thiz, fieldID, data) (*env)->SetLongField (env, thiz, fieldID, (jlong)(jint)data)
 #endif
 
-/* Do not allow seeks to be performed closer than this distance. It is visually useless, and will probably
- * confuse some demuxers. */
-#define SEEK_MIN_DELAY (500 * GST_MSECOND)
-
-
-
 /* These global variables cache values which are not changing during execution */
-static pthread_t gst_app_thread;
 static pthread_key_t current_jni_env;
 static JavaVM *java_vm;
 static jfieldID custom_data_field_id;
@@ -60,20 +48,12 @@ static jmethodID set_message_method_id;
 static jmethodID set_current_position_method_id;
 static jmethodID on_gstreamer_initialized_method_id;
 static jmethodID on_media_size_changed_method_id;
-
-/* These global constants are used to evaluate against backend_type strings */
-static const char backend_type_rtsp[] = "rtsp";
-static const char backend_type_custom_rtp[] = "custom_rtp";
+static jmethodID on_startup_timings_method_id;     /* Optional, may be NULL */
+static jmethodID on_rtp_stats_method_id;           /* Optional, may be NULL */
 
 /*
  * Private methods
  */
-static GstBuffer * byte_array_to_buffer(jbyte *data, int data_len) {
-  gpointer buffer_data = g_memdup(data, data_len);
-  // Takes ownership of allocated memory
-  GstBuffer *buffer = gst_buffer_new_wrapped(buffer_data, data_len);
-  return buffer;
-}
 
 /* Register this thread with the VM */
 static JNIEnv *
@@ -117,13 +97,17 @@ get_jni_env (void)
   return env;
 }
 
+/*
+ * Session callbacks, forwarded to the Java application object kept in user_data
+ */
+
 /* Change the content of the UI's TextView */
-void set_ui_message (const gchar * message, CustomData * data)
+static void
+android_set_message (const gchar * message, gpointer user_data)
 {
   JNIEnv *env = get_jni_env ();
-  GST_DEBUG ("Setting message to: %s", message);
   jstring jmessage = (*env)->NewStringUTF (env, message);
-  (*env)->CallVoidMethod (env, data->app, set_message_method_id, jmessage);
+  (*env)->CallVoidMethod (env, (jobject) user_data, set_message_method_id, jmessage);
   if ((*env)->ExceptionCheck (env)) {
     GST_ERROR ("Failed to call Java method");
     (*env)->ExceptionClear (env);
@@ -133,10 +117,10 @@ void set_ui_message (const gchar * message, CustomData * data)
 
 /* Tell the application what is the current position and clip duration */
 static void
-set_current_ui_position (gint position, gint duration, CustomData * data)
+android_set_current_position (gint position, gint duration, gpointer user_data)
 {
   JNIEnv *env = get_jni_env ();
-  (*env)->CallVoidMethod (env, data->app, set_current_position_method_id,
+  (*env)->CallVoidMethod (env, (jobject) user_data, set_current_position_method_id,
       position, duration);
   if ((*env)->ExceptionCheck (env)) {
     GST_ERROR ("Failed to call Java method");
@@ -144,394 +128,124 @@ set_current_ui_position (gint position, gint duration, CustomData * data)
   }
 }
 
-/* If we have pipeline and it is running, query the current position and clip duration and inform
- * the application */
-static gboolean
-refresh_ui (CustomData * data)
-{
-  gint64 position;
-
-  /* We do not want to update anything unless we have a working pipeline in the PAUSED or PLAYING state */
-  if (!data || !data->pipeline || data->state < GST_STATE_PAUSED)
-    return TRUE;
-
-  /* If we didn't know it yet, query the stream duration */
-  if (!GST_CLOCK_TIME_IS_VALID (data->duration)) {
-    if (!gst_element_query_duration (data->pipeline, GST_FORMAT_TIME,
-            &data->duration)) {
-//      GST_WARNING
-//          ("Could not query current duration (normal for still pictures)");
-      data->duration = 0;
-    }
-  }
-
-  if (!gst_element_query_position (data->pipeline, GST_FORMAT_TIME, &position)) {
-    GST_WARNING
-        ("Could not query current position (normal for still pictures)");
-    position = 0;
-  }
-
-  /* Java expects these values in milliseconds, and GStreamer provides nanoseconds */
-  set_current_ui_position (position / GST_MSECOND, data->duration / GST_MSECOND,
-      data);
-  return TRUE;
-}
-
-/* Forward declaration for the delayed seek callback */
-static gboolean delayed_seek_cb (CustomData * data);
-
-/* Perform seek, if we are not too close to the previous seek. Otherwise, schedule the seek for
- * some time in the future. */
+/* Tell the application the pipeline is ready to be played */
 static void
-execute_seek (gint64 desired_position, CustomData * data)
+android_on_initialized (const gchar * backend_type, gpointer user_data)
 {
-  gint64 diff;
-
-  if (desired_position == GST_CLOCK_TIME_NONE)
-    return;
-
-  diff = gst_util_get_timestamp () - data->last_seek_time;
-
-  if (GST_CLOCK_TIME_IS_VALID (data->last_seek_time) && diff < SEEK_MIN_DELAY) {
-    /* The previous seek was too close, delay this one */
-    GSource *timeout_source;
-
-    if (data->desired_position == GST_CLOCK_TIME_NONE) {
-      /* There was no previous seek scheduled. Setup a timer for some time in the future */
-      timeout_source =
-          g_timeout_source_new ((SEEK_MIN_DELAY - diff) / GST_MSECOND);
-      g_source_set_callback (timeout_source, (GSourceFunc) delayed_seek_cb,
-          data, NULL);
-      g_source_attach (timeout_source, data->context);
-      g_source_unref (timeout_source);
-    }
-    /* Update the desired seek position. If multiple petitions are received before it is time
-     * to perform a seek, only the last one is remembered. */
-    data->desired_position = desired_position;
-    GST_DEBUG ("Throttling seek to %" GST_TIME_FORMAT ", will be in %"
-        GST_TIME_FORMAT, GST_TIME_ARGS (desired_position),
-        GST_TIME_ARGS (SEEK_MIN_DELAY - diff));
-  } else {
-    /* Perform the seek now */
-    GST_DEBUG ("Seeking to %" GST_TIME_FORMAT,
-        GST_TIME_ARGS (desired_position));
-    data->last_seek_time = gst_util_get_timestamp ();
-    gst_element_seek_simple (data->pipeline, GST_FORMAT_TIME,
-        GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT, desired_position);
-    data->desired_position = GST_CLOCK_TIME_NONE;
+  JNIEnv *env = get_jni_env ();
+  jstring jbackend_type = (*env)->NewStringUTF (env, backend_type);
+  (*env)->CallVoidMethod (env, (jobject) user_data, on_gstreamer_initialized_method_id, jbackend_type);
+  if ((*env)->ExceptionCheck (env)) {
+    GST_ERROR ("Failed to call Java method");
+    (*env)->ExceptionClear (env);
   }
+  (*env)->DeleteLocalRef (env, jbackend_type);
 }
 
-/* Delayed seek callback. This gets called by the timer setup in the above function. */
-static gboolean
-delayed_seek_cb (CustomData * data)
-{
-  GST_DEBUG ("Doing delayed seek to %" GST_TIME_FORMAT,
-      GST_TIME_ARGS (data->desired_position));
-  execute_seek (data->desired_position, data);
-  return FALSE;
-}
-
-/* Retrieve errors from the bus and show them on the UI */
+/* Tell the application about the media size */
 static void
-error_cb (GstBus * bus, GstMessage * msg, CustomData * data)
+android_on_media_size_changed (gint width, gint height, gpointer user_data)
 {
-  GError *err;
-  gchar *debug_info;
-  gchar *message_string;
-
-  gst_message_parse_error (msg, &err, &debug_info);
-  message_string =
-      g_strdup_printf ("Error received from element %s: %s",
-      GST_OBJECT_NAME (msg->src), err->message);
-  g_clear_error (&err);
-  g_free (debug_info);
-  set_ui_message (message_string, data);
-  g_free (message_string);
-  data->target_state = GST_STATE_NULL;
-  gst_element_set_state (data->pipeline, GST_STATE_NULL);
-}
-
-/* Called when the End Of the Stream is reached. Just move to the beginning of the media and pause. */
-static void
-eos_cb (GstBus * bus, GstMessage * msg, CustomData * data)
-{
-  data->target_state = GST_STATE_PAUSED;
-  data->is_live |=
-      (gst_element_set_state (data->pipeline,
-          GST_STATE_PAUSED) == GST_STATE_CHANGE_NO_PREROLL);
-  execute_seek (0, data);
-}
-
-/* Called when the duration of the media changes. Just mark it as unknown, so we re-query it in the next UI refresh. */
-static void
-duration_cb (GstBus * bus, GstMessage * msg, CustomData * data)
-{
-  data->duration = GST_CLOCK_TIME_NONE;
-}
-
-/* Called when buffering messages are received. We inform the UI about the current buffering level and
- * keep the pipeline paused until 100% buffering is reached. At that point, set the desired state. */
-static void
-buffering_cb (GstBus * bus, GstMessage * msg, CustomData * data)
-{
-  gint percent;
-
-  if (data->is_live)
-    return;
-
-  gst_message_parse_buffering (msg, &percent);
-  if (percent < 100 && data->target_state >= GST_STATE_PAUSED) {
-    gchar *message_string = g_strdup_printf ("Buffering %d%%", percent);
-    gst_element_set_state (data->pipeline, GST_STATE_PAUSED);
-    set_ui_message (message_string, data);
-    g_free (message_string);
-  } else if (data->target_state >= GST_STATE_PLAYING) {
-    gst_element_set_state (data->pipeline, GST_STATE_PLAYING);
-  } else if (data->target_state >= GST_STATE_PAUSED) {
-    set_ui_message ("Buffering complete", data);
+  JNIEnv *env = get_jni_env ();
+  (*env)->CallVoidMethod (env, (jobject) user_data, on_media_size_changed_method_id,
+      (jint) width, (jint) height);
+  if ((*env)->ExceptionCheck (env)) {
+    GST_ERROR ("Failed to call Java method");
+    (*env)->ExceptionClear (env);
   }
 }
 
-/* Called when the clock is lost */
-static void
-clock_lost_cb (GstBus * bus, GstMessage * msg, CustomData * data)
+/* Copy startup timings into a new Java long[] */
+static jlongArray
+startup_timings_to_java (JNIEnv *env, const gint64 *timings_us, gint count)
 {
-  if (data->target_state >= GST_STATE_PLAYING) {
-    gst_element_set_state (data->pipeline, GST_STATE_PAUSED);
-    gst_element_set_state (data->pipeline, GST_STATE_PLAYING);
-  }
+  jlongArray jtimings = (*env)->NewLongArray (env, count);
+  if (!jtimings)
+    return NULL;
+  jlong values[BRILLIANT_STARTUP_MILESTONE_COUNT];
+  for (gint i = 0; i < count && i < BRILLIANT_STARTUP_MILESTONE_COUNT; i++)
+    values[i] = timings_us[i];
+  (*env)->SetLongArrayRegion (env, jtimings, 0, count, values);
+  return jtimings;
 }
 
-/* Retrieve the video sink's Caps and tell the application about the media size */
+/* Tell the application how long each startup stage took */
 static void
-check_media_size (CustomData * data)
+android_on_startup_timings (const gint64 *timings_us, gint count, gpointer user_data)
 {
+  if (!on_startup_timings_method_id)
+    return;
   JNIEnv *env = get_jni_env ();
-  GstPad *video_sink_pad;
-  GstCaps *caps;
-  GstVideoInfo info;
-
-  /* Retrieve the Caps at the entrance of the video sink */
-  video_sink_pad = gst_element_get_static_pad (data->video_sink, "sink");
-  caps = gst_pad_get_current_caps (video_sink_pad);
-
-  if (gst_video_info_from_caps (&info, caps)) {
-    info.width = info.width * info.par_n / info.par_d;
-    GST_DEBUG ("Media size is %dx%d, notifying application", info.width,
-        info.height);
-
-    (*env)->CallVoidMethod (env, data->app, on_media_size_changed_method_id,
-        (jint) info.width, (jint) info.height);
-    if ((*env)->ExceptionCheck (env)) {
-      GST_ERROR ("Failed to call Java method");
-      (*env)->ExceptionClear (env);
-    }
+  jlongArray jtimings = startup_timings_to_java (env, timings_us, count);
+  (*env)->CallVoidMethod (env, (jobject) user_data, on_startup_timings_method_id, jtimings);
+  if ((*env)->ExceptionCheck (env)) {
+    GST_ERROR ("Failed to call Java method");
+    (*env)->ExceptionClear (env);
   }
-
-  gst_caps_unref (caps);
-  gst_object_unref (video_sink_pad);
+  (*env)->DeleteLocalRef (env, jtimings);
 }
 
-/* Notify UI about pipeline state changes */
-static void
-state_changed_cb (GstBus * bus, GstMessage * msg, CustomData * data)
-{
-  GstState old_state, new_state, pending_state;
-  gst_message_parse_state_changed (msg, &old_state, &new_state, &pending_state);
-  /* Only pay attention to messages coming from the pipeline, not its children */
-  if (GST_MESSAGE_SRC (msg) == GST_OBJECT (data->pipeline)) {
-    data->state = new_state;
-    gchar *message = g_strdup_printf ("State changed to %s",
-        gst_element_state_get_name (new_state));
-    set_ui_message (message, data);
-    g_free (message);
-
-    if (new_state == GST_STATE_NULL || new_state == GST_STATE_READY)
-      data->is_live = FALSE;
-
-    /* The Ready to Paused state change is particularly interesting: */
-    if (old_state == GST_STATE_READY && new_state == GST_STATE_PAUSED) {
-      /* By now the sink already knows the media size */
-      check_media_size (data);
-
-      /* If there was a scheduled seek, perform it now that we have moved to the Paused state */
-      if (GST_CLOCK_TIME_IS_VALID (data->desired_position))
-        execute_seek (data->desired_position, data);
-    }
-  }
+/* Copy an RTP statistics snapshot into a new Java long[] */
+static jlongArray
+rtp_stats_to_java (JNIEnv *env, const gint64 *stats, gint source_count)
+{
+  jsize length = source_count * BRILLIANT_RTP_STATS_FIELD_COUNT;
+  jlongArray jstats = (*env)->NewLongArray (env, length);
+  if (!jstats)
+    return NULL;
+  /* jlong and gint64 are both 64 bit signed integers */
+  (*env)->SetLongArrayRegion (env, jstats, 0, length, (const jlong *) stats);
+  return jstats;
 }
 
-/* Check if all conditions are met to report GStreamer as initialized.
- * These conditions will change depending on the application */
+/* Hand the periodic RTP statistics to the application */
 static void
-check_initialization_complete (CustomData * data)
+android_on_rtp_stats (const gint64 *stats, gint source_count, gpointer user_data)
 {
+  if (!on_rtp_stats_method_id)
+    return;
   JNIEnv *env = get_jni_env ();
-  if (!data->initialized && data->native_window && data->main_loop) {
-    GST_DEBUG
-        ("Initialization complete, notifying application. native_window:%p main_loop:%p",
-        data->native_window, data->main_loop);
-    data->video_sink = gst_bin_get_by_interface(GST_BIN(data->pipeline), GST_TYPE_VIDEO_OVERLAY);
-    if (!data->video_sink) {
-      GST_ERROR("Could not retrieve video sink");
-    } else {
-      GST_DEBUG("RETRIEVED VIDEO SINK");
-    }
-
-    /* The main loop is running and we received a native window, inform the sink about it */
-    gst_video_overlay_set_window_handle (GST_VIDEO_OVERLAY (data->video_sink),
-        (guintptr) data->native_window);
-    jstring jbackend_type = (*env)->NewStringUTF (env, data->backend_type);
-    (*env)->CallVoidMethod (env, data->app, on_gstreamer_initialized_method_id, jbackend_type);
-    if ((*env)->ExceptionCheck (env)) {
-      GST_ERROR ("Failed to call Java method");
-      (*env)->ExceptionClear (env);
-    }
-    (*env)->DeleteLocalRef (env, jbackend_type);
-    data->initialized = TRUE;
+  jlongArray jstats = rtp_stats_to_java (env, stats, source_count);
+  (*env)->CallVoidMethod (env, (jobject) user_data, on_rtp_stats_method_id, jstats);
+  if ((*env)->ExceptionCheck (env)) {
+    GST_ERROR ("Failed to call Java method");
+    (*env)->ExceptionClear (env);
   }
+  (*env)->DeleteLocalRef (env, jstats);
 }
 
-/* Main method for the native code. This is executed on its own thread. */
-static void *
-app_function (void *userdata)
-{
-  JavaVMAttachArgs args;
-  GstBus *bus;
-  CustomData *data = (CustomData *) userdata;
-  GSource *timeout_source;
-  GSource *bus_source;
-
-  GST_DEBUG ("Creating pipeline in CustomData at %p", data);
-
-  /* Create our own GLib Main Context and make it the default one */
-  data->context = g_main_context_new ();
-  g_main_context_push_thread_default (data->context);
-
-  int result = FALSE;
-  if (strcmp(data->backend_type, backend_type_rtsp) == 0) {
-    result = build_rtsp_pipeline(data);
-  } else if (strcmp(data->backend_type, backend_type_custom_rtp) == 0) {
-    result = build_custom_rtp_pipeline(data);
-  } else {
-    GST_ERROR("Unrecognized backend type %s, aborting pipeline creation.", data->backend_type);
-  }
-  if (!result) {
-    return NULL;
-  }
-
-  /* Set the pipeline to READY, so it can already accept a window handle, if we have one */
-  data->target_state = GST_STATE_READY;
-  gst_element_set_state (data->pipeline, GST_STATE_READY);
-
-  /* Instruct the bus to emit signals for each received message, and connect to the interesting signals */
-  bus = gst_element_get_bus (data->pipeline);
-  bus_source = gst_bus_create_watch (bus);
-  g_source_set_callback (bus_source, (GSourceFunc) gst_bus_async_signal_func,
-      NULL, NULL);
-  g_source_attach (bus_source, data->context);
-  g_source_unref (bus_source);
-  g_signal_connect (G_OBJECT (bus), "message::error", (GCallback) error_cb,
-      data);
-  g_signal_connect (G_OBJECT (bus), "message::eos", (GCallback) eos_cb, data);
-  g_signal_connect (G_OBJECT (bus), "message::state-changed",
-      (GCallback) state_changed_cb, data);
-  g_signal_connect (G_OBJECT (bus), "message::duration",
-      (GCallback) duration_cb, data);
-  g_signal_connect (G_OBJECT (bus), "message::buffering",
-      (GCallback) buffering_cb, data);
-  g_signal_connect (G_OBJECT (bus), "message::clock-lost",
-      (GCallback) clock_lost_cb, data);
-  gst_object_unref (bus);
-
-  /* Register a function that GLib will call 4 times per second */
-  timeout_source = g_timeout_source_new (250);
-  g_source_set_callback (timeout_source, (GSourceFunc) refresh_ui, data, NULL);
-  g_source_attach (timeout_source, data->context);
-  g_source_unref (timeout_source);
-
-  /* Create a GLib Main Loop and set it to run */
-  GST_DEBUG ("Entering main loop... (CustomData:%p)", data);
-  data->main_loop = g_main_loop_new (data->context, FALSE);
-  check_initialization_complete (data);
-  g_main_loop_run (data->main_loop);
-  GST_DEBUG ("Exited main loop");
-  g_main_loop_unref (data->main_loop);
-  data->main_loop = NULL;
-
-  /* Free resources */
-  g_main_context_pop_thread_default (data->context);
-  g_main_context_unref (data->context);
-  data->target_state = GST_STATE_NULL;
-  gst_element_set_state (data->pipeline, GST_STATE_NULL);
-  gst_object_unref (data->pipeline);
-  free(data->backend_type);
-
-  if (data->rtsp_data) {
-    data->rtsp_data->rtsp_src = NULL;
-    GST_DEBUG ("Cleaned up rtsp_data pipeline elements");
-  }
-  data->video_sink = NULL;
-  data->volume = NULL;
-  if (data->rtp_custom_data) {
-    if (data->rtp_custom_data->audio_rtp_socket) {
-      GError *error = NULL;
-      GST_DEBUG("Closing socket 0.0.0.0:%d", data->rtp_custom_data->local_rtp_audio_udp_port);
-      g_socket_close(data->rtp_custom_data->audio_rtp_socket, &error);
-      if (error) {
-        gchar *message =
-            g_strdup_printf ("Failed to close socket on cleanup: %s", error->message);
-        g_clear_error (&error);
-        set_ui_message (message, data);
-        g_free (message);
-      }
-      gst_object_unref(data->rtp_custom_data->audio_rtp_socket);
-      data->rtp_custom_data->audio_rtp_socket = NULL;
-      GST_DEBUG ("Cleaned up rtp_custom_data audio_rtp_socket.");
-    }
-    data->rtp_custom_data->out_audio_data_pipe = NULL;
-    data->rtp_custom_data->rtp_bin = NULL;
-    data->rtp_custom_data->video_depay = NULL;
-    data->rtp_custom_data->video_data_pipe = NULL;
-    data->rtp_custom_data->audio_depay = NULL;
-    data->rtp_custom_data->mic_volume = NULL;
-    GST_DEBUG ("Cleaned up rtp_custom_data pipeline elements");
-  }
-  GST_DEBUG("Exiting gstreamer pipeline app_function.");
-  return NULL;
-}
+static const BrilliantSessionCallbacks android_callbacks = {
+  android_set_message,
+  android_set_current_position,
+  android_on_initialized,
+  android_on_media_size_changed,
+  NULL,
+  android_on_startup_timings,
+  android_on_rtp_stats,
+};
 
 /*
  * Java Bindings
  */
 
+/* Spans around the JNI calls that do real work, for trace recordings */
+#define TRACE_JNI_BEGIN() brilliant_trace_recorder_begin (BRILLIANT_TRACE_JNI, __func__)
+#define TRACE_JNI_END() brilliant_trace_recorder_end (BRILLIANT_TRACE_JNI, __func__)
+
 /* Instruct the native code to create its internal data structure, pipeline and thread */
 static void
 gst_native_init (JNIEnv *env, jobject thiz, jstring backend_type)
 {
-  CustomData *data = g_new0 (CustomData, 1);
-  data->rtp_custom_data = NULL;
-  data->desired_position = GST_CLOCK_TIME_NONE;
-  data->last_seek_time = GST_CLOCK_TIME_NONE;
-  SET_CUSTOM_DATA (env, thiz, custom_data_field_id, data);
-  GST_DEBUG_CATEGORY_INIT (debug_category, "gstreamer-brilliant", 0,
-      "GStreamer Brilliant");
+  GST_DEBUG_CATEGORY_INIT (debug_category, "gstreamer-brilliant-jni", 0,
+      "GStreamer Brilliant JNI");
+  jobject app = (*env)->NewGlobalRef (env, thiz);
+  GST_DEBUG ("Created GlobalRef for app object at %p", app);
   const gchar *backend_string = (*env)->GetStringUTFChars (env, backend_type, NULL);
-  data->backend_type = malloc(strlen(backend_string));
-  strcpy(data->backend_type, backend_string);
-  GST_DEBUG ("Created CustomData for backendType %s at %p", data->backend_type, data);
+  TRACE_JNI_BEGIN ();
+  CustomData *data = brilliant_session_new (backend_string, &android_callbacks, app);
+  TRACE_JNI_END ();
   (*env)->ReleaseStringUTFChars (env, backend_type, backend_string);
-  if (strcmp(data->backend_type, backend_type_custom_rtp) == 0) {
-    data->rtp_custom_data = g_new0 (RTPCustomData, 1);
-    data->rtsp_data = NULL;
-  } else if (strcmp(data->backend_type, backend_type_rtsp) == 0) {
-    data->rtsp_data = g_new0 (RTSPData, 1);
-    data->rtp_custom_data = NULL;
-  }
-  data->app = (*env)->NewGlobalRef (env, thiz);
-  GST_DEBUG ("Created GlobalRef for app object at %p", data->app);
-  pthread_create (&gst_app_thread, NULL, &app_function, data);
+  SET_CUSTOM_DATA (env, thiz, custom_data_field_id, data);
 }
 
 /* Quit the main loop, remove the native thread and free resources */
@@ -541,27 +255,35 @@ gst_native_finalize (JNIEnv *env, jobject thiz)
   CustomData *data = GET_CUSTOM_DATA (env, thiz, custom_data_field_id);
   if (!data)
     return;
-  GST_DEBUG ("Quitting main loop...");
-  g_main_loop_quit (data->main_loop);
-  GST_DEBUG ("Waiting for thread to finish...");
-  pthread_join (gst_app_thread, NULL);
-  GST_DEBUG ("Deleting GlobalRef for app object at %p", data->app);
-  (*env)->DeleteGlobalRef (env, data->app);
-  if (data->rtp_custom_data) {
-    GST_DEBUG ("Freeing RtpCustomData at %p", data->rtp_custom_data);
-    cleanup_custom_rtp_data(data->rtp_custom_data);
-    g_free(data->rtp_custom_data);
-    data->rtp_custom_data = NULL;
-  }
-  if (data->rtsp_data) {
-    GST_DEBUG ("Freeing RtspData at %p", data->rtsp_data);
-    g_free(data->rtsp_data);
-    data->rtsp_data = NULL;
-  }
-  GST_DEBUG ("Freeing CustomData at %p", data);
-  g_free (data);
+  jobject app = (jobject) data->user_data;
+  TRACE_JNI_BEGIN ();
+  brilliant_session_free (data);
+  TRACE_JNI_END ();
+  GST_DEBUG ("Deleting GlobalRef for app object at %p", app);
+  (*env)->DeleteGlobalRef (env, app);
   SET_CUSTOM_DATA (env, thiz, custom_data_field_id, NULL);
-  GST_DEBUG ("Done finalizing");
+}
+
+/* Build a session of backendType up to READY in the background, so that the next nativeInit of
+ * that type only has to apply the track properties. Returns false if the pool is full. */
+static jboolean
+gst_native_prewarm (JNIEnv *env, jobject thiz, jstring backend_type)
+{
+  GST_DEBUG_CATEGORY_INIT (debug_category, "gstreamer-brilliant-jni", 0,
+      "GStreamer Brilliant JNI");
+  const gchar *backend_string = (*env)->GetStringUTFChars (env, backend_type, NULL);
+  TRACE_JNI_BEGIN ();
+  gboolean result = brilliant_session_prewarm (backend_string);
+  TRACE_JNI_END ();
+  (*env)->ReleaseStringUTFChars (env, backend_type, backend_string);
+  return result ? JNI_TRUE : JNI_FALSE;
+}
+
+/* Free the prewarmed sessions that were not used */
+static void
+gst_native_drain_pool (JNIEnv *env, jobject thiz)
+{
+  brilliant_session_drain_pool ();
 }
 
 /* Set rtspsrc's URI */
@@ -569,126 +291,74 @@ void
 gst_native_set_uri (JNIEnv *env, jobject thiz, jstring uri)
 {
   CustomData *data = GET_CUSTOM_DATA (env, thiz, custom_data_field_id);
-  if (!data || !data->pipeline) {
-    GST_DEBUG ("Missing Pipeline or data, aborting set URI");
-    return;
-  }
-  if (strcmp(data->backend_type, backend_type_rtsp) != 0) {
-    GST_ERROR("Set URI called on backend type %s", data->backend_type);
+  if (!data) {
+    GST_DEBUG ("Missing data, aborting set URI");
     return;
   }
   const gchar *char_uri = (*env)->GetStringUTFChars (env, uri, NULL);
-  GST_DEBUG ("Setting rtspsrc URI to %s", char_uri);
-  if (data->target_state >= GST_STATE_READY)
-    gst_element_set_state (data->pipeline, GST_STATE_READY);
-  g_object_set (data->rtsp_data->rtsp_src, "location", char_uri, NULL);
+  TRACE_JNI_BEGIN ();
+  brilliant_session_set_uri (data, char_uri);
+  TRACE_JNI_END ();
   (*env)->ReleaseStringUTFChars (env, uri, char_uri);
-  data->duration = GST_CLOCK_TIME_NONE;
-  data->is_live |=
-      (gst_element_set_state (data->pipeline,
-          data->target_state) == GST_STATE_CHANGE_NO_PREROLL);
 }
 
 void
 gst_native_set_rtp_track_properties(JNIEnv *env, jobject thiz, jstring track_name,
                                     jstring server, int track_port,
-                                    jbyteArray track_key, long track_ssrc,
+                                    jbyteArray track_key, jlong track_ssrc,
                                     int sample_rate, int payload_type, int channels)
 {
   CustomData *data = GET_CUSTOM_DATA (env, thiz, custom_data_field_id);
-  if (strcmp(data->backend_type, backend_type_custom_rtp) != 0) {
-    GST_ERROR("Native set rtp track properties called on pipeline with type %s.",
-              data->backend_type);
+  if (!data)
     return;
-  }
   const char *_trackName = (*env)->GetStringUTFChars(env, track_name, 0);
   const char *_server = (*env)->GetStringUTFChars(env, server, 0);
   jbyte* key_bytes = (*env)->GetByteArrayElements(env, track_key, NULL);
   jsize track_key_len = (*env)->GetArrayLength(env, track_key);
 
-  if (strncmp(_trackName, "incoming_video", strlen(_trackName)) == 0) {
-    // Copy allocated types
-    data->rtp_custom_data->incoming_video_server = malloc(strlen(_server));
-    strcpy(data->rtp_custom_data->incoming_video_server, _server);
-    data->rtp_custom_data->incoming_video_key = byte_array_to_buffer(key_bytes, track_key_len);
-    GST_DEBUG ("Incoming Video Track uri to %s", data->rtp_custom_data->incoming_video_server);
-
-    // Assign primitive types
-    // Convert signed 64bit int to unsigned 32bit
-    data->rtp_custom_data->incoming_video_ssrc = track_ssrc & 0xffffffff;
-    data->rtp_custom_data->incoming_video_port = track_port;
-    data->rtp_custom_data->incoming_video_sample_rate = sample_rate;
-    data->rtp_custom_data->incoming_video_payload_type = payload_type;
-    GST_DEBUG ("Incoming Video Track ssrc %" PRIu32 " port %d sample rate %d payload type %d",
-               data->rtp_custom_data->incoming_video_ssrc,
-               track_port,
-               sample_rate,
-               payload_type
-    );
-
-  } else if (strncmp(_trackName, "incoming_audio", strlen(_trackName)) == 0) {
-    // Copy allocated types
-    data->rtp_custom_data->incoming_audio_server = malloc(strlen(_server));
-    strcpy(data->rtp_custom_data->incoming_audio_server, _server);
-    data->rtp_custom_data->incoming_audio_key = byte_array_to_buffer(key_bytes, track_key_len);
-    GST_DEBUG ("Incoming Audio Track uri to %s", data->rtp_custom_data->incoming_audio_server);
-
-    // Assign primitive types
-    // Convert signed 64bit int to unsigned 32bit
-    data->rtp_custom_data->incoming_audio_ssrc = track_ssrc & 0xffffffff;
-    data->rtp_custom_data->incoming_audio_port = track_port;
-    data->rtp_custom_data->incoming_audio_sample_rate = sample_rate;
-    data->rtp_custom_data->incoming_audio_payload_type = payload_type;
-    data->rtp_custom_data->incoming_audio_channels = channels;
-    GST_DEBUG ("Incoming Audio Track ssrc %" PRIu32 " port %d sample rate %d payload type %d channels %d",
-               data->rtp_custom_data->incoming_audio_ssrc,
-               track_port,
-               sample_rate,
-               payload_type,
-               channels
-    );
-  } else if (strncmp(_trackName, "outgoing_audio", strlen(_trackName)) == 0) {
-    // Copy allocated types
-
-    data->rtp_custom_data->outgoing_audio_server = malloc(strlen(_server));
-    strcpy(data->rtp_custom_data->outgoing_audio_server, _server);
-    data->rtp_custom_data->outgoing_audio_key = byte_array_to_buffer(key_bytes, track_key_len);
-    GST_DEBUG ("Outgoing Audio Track uri to %s", data->rtp_custom_data->outgoing_audio_server);
-    // Assign primitive types
-    // Convert signed 64bit int to unsigned 32bit
-    data->rtp_custom_data->outgoing_audio_ssrc = track_ssrc & 0xffffffff;
-    data->rtp_custom_data->outgoing_audio_port = track_port;
-    data->rtp_custom_data->outgoing_audio_sample_rate = sample_rate;
-    data->rtp_custom_data->outgoing_audio_payload_type = payload_type;
-    data->rtp_custom_data->audio_channels = channels;
-    GST_DEBUG ("Outgoing Audio Track ssrc %" PRIu32 " port %d sample rate %d payload type %d channels %d",
-               data->rtp_custom_data->outgoing_audio_ssrc,
-               track_port,
-               sample_rate,
-               payload_type,
-               channels
-    );
-  }
+  // Convert signed 64bit int to unsigned 32bit
+  TRACE_JNI_BEGIN ();
+  brilliant_session_set_rtp_track_properties(data, _trackName, _server, track_port,
+                                             (const guint8 *) key_bytes, track_key_len,
+                                             track_ssrc & 0xffffffff,
+                                             sample_rate, payload_type, channels);
+  TRACE_JNI_END ();
+
   (*env)->ReleaseByteArrayElements(env, track_key, key_bytes, JNI_ABORT);
   (*env)->ReleaseStringUTFChars(env, track_name, _trackName);
   (*env)->ReleaseStringUTFChars(env, server, _server);
 }
 
+/* H.264 parameter sets of the incoming video track, as the sprop-parameter-sets of its SDP.
+ * Returns false if they do not parse. */
+static jboolean
+gst_native_set_rtp_video_parameter_sets (JNIEnv *env, jobject thiz, jstring sprop_parameter_sets)
+{
+  CustomData *data = GET_CUSTOM_DATA (env, thiz, custom_data_field_id);
+  if (!data)
+    return JNI_FALSE;
+  const gchar *char_sprop = sprop_parameter_sets ?
+      (*env)->GetStringUTFChars (env, sprop_parameter_sets, NULL) : NULL;
+  TRACE_JNI_BEGIN ();
+  gboolean result = brilliant_session_set_rtp_video_parameter_sets (data, char_sprop);
+  TRACE_JNI_END ();
+  if (char_sprop)
+    (*env)->ReleaseStringUTFChars (env, sprop_parameter_sets, char_sprop);
+  return result;
+}
+
 void gst_native_set_rtp_local_ports(JNIEnv *env, jobject thiz,
                                     int local_rtp_video_udp_port, int local_rtcp_video_udp_port,
                                     int local_rtp_audio_udp_port, int local_rtcp_audio_udp_port)
 {
   CustomData *data = GET_CUSTOM_DATA (env, thiz, custom_data_field_id);
-  if (strcmp(data->backend_type, backend_type_custom_rtp) != 0) {
-    GST_ERROR("Native set rtp local ports called on pipeline with type %s.",
-              data->backend_type);
+  if (!data)
     return;
-  }
-  data->rtp_custom_data->local_rtp_video_udp_port = local_rtp_video_udp_port;
-  data->rtp_custom_data->local_rtcp_video_udp_port = local_rtcp_video_udp_port;
-  data->rtp_custom_data->local_rtp_audio_udp_port = local_rtp_audio_udp_port;
-  data->rtp_custom_data->local_rtcp_audio_udp_port = local_rtcp_audio_udp_port;
-
+  TRACE_JNI_BEGIN ();
+  brilliant_session_set_rtp_local_ports(data,
+                                        local_rtp_video_udp_port, local_rtcp_video_udp_port,
+                                        local_rtp_audio_udp_port, local_rtcp_audio_udp_port);
+  TRACE_JNI_END ();
 }
 
 /* Set volume's mute property */
@@ -696,15 +366,7 @@ void
 gst_native_set_mute (JNIEnv *env, jobject thiz, jboolean mute)
 {
   CustomData *data = GET_CUSTOM_DATA (env, thiz, custom_data_field_id);
-  if (!data || !data->pipeline) {
-    GST_DEBUG ("Missing Pipeline or data, aborting set URI");
-    return;
-  }
-  if (data->volume == NULL) {
-    GST_ERROR("Missing volume when setting mute");
-  } else {
-    g_object_set(data->volume, "mute", !(mute == JNI_FALSE), NULL);
-  }
+  brilliant_session_set_mute (data, !(mute == JNI_FALSE));
 }
 
 /* Set mic volume's mute property */
@@ -712,19 +374,7 @@ void
 gst_native_set_mic_mute (JNIEnv *env, jobject thiz, jboolean mute)
 {
   CustomData *data = GET_CUSTOM_DATA (env, thiz, custom_data_field_id);
-  if (!data || !data->pipeline) {
-    GST_DEBUG ("Missing Pipeline or data, aborting set mic mute");
-    return;
-  }
-  if (strcmp(data->backend_type, backend_type_custom_rtp) != 0 || data->rtp_custom_data == NULL) {
-    GST_ERROR("Called mic mute on inapplicable backend type %s", data->backend_type);
-    return;
-  }
-  if (data->rtp_custom_data->mic_volume == NULL) {
-    GST_ERROR("Missing mic volume when setting mute");
-  } else {
-    g_object_set(data->rtp_custom_data->mic_volume, "mute", !(mute == JNI_FALSE), NULL);
-  }
+  brilliant_session_set_mic_mute (data, !(mute == JNI_FALSE));
 }
 
 /* Set mic volume's volume property */
@@ -732,19 +382,7 @@ void
 gst_native_set_mic_volume (JNIEnv *env, jobject thiz, jfloat volume)
 {
   CustomData *data = GET_CUSTOM_DATA (env, thiz, custom_data_field_id);
-  if (!data || !data->pipeline) {
-    GST_DEBUG ("Missing Pipeline or data, aborting set mic volume");
-    return;
-  }
-  if (strcmp(data->backend_type, backend_type_custom_rtp) != 0 || data->rtp_custom_data == NULL) {
-    GST_ERROR("Called mic volume on inapplicable backend type %s", data->backend_type);
-    return;
-  }
-  if (data->rtp_custom_data->mic_volume == NULL) {
-    GST_ERROR("Missing mic volume when setting volume");
-  } else {
-    g_object_set(data->rtp_custom_data->mic_volume, "volume", volume, NULL);
-  }
+  brilliant_session_set_mic_volume (data, volume);
 }
 
 /* Enable GST_DEBUG Logging
@@ -754,35 +392,132 @@ gst_native_set_mic_volume (JNIEnv *env, jobject thiz, jfloat volume)
 void
 gst_native_set_debug_logging (JNIEnv *env, jobject thiz, jstring gst_debug_string)
 {
-    // Note: When using this make sure to adjust the default level in
-    // <GstreamerAndroidRoot>/<platform>/share/gst-android/ndk-build/gstreamer_android-1.0.c.in
-    // and recompile first.
-    const gchar *char_gstdebug = (*env)->GetStringUTFChars (env, gst_debug_string, NULL);
-    setenv("GST_DEBUG", char_gstdebug, 1);
-    gst_debug_set_default_threshold(GST_LEVEL_DEBUG);
+  const gchar *char_gstdebug = (*env)->GetStringUTFChars (env, gst_debug_string, NULL);
+  brilliant_session_set_debug_logging (char_gstdebug);
+  (*env)->ReleaseStringUTFChars (env, gst_debug_string, char_gstdebug);
 }
 
-/* Set pipeline to PLAYING state */
+/* Record the GStreamer debug log of all sessions in memory instead of logcat. thresholds is a
+ * GST_DEBUG string, null keeps the current ones. Logs are written to dumpDir when a pipeline
+ * fails, unless it is null. */
 static void
-gst_native_play (JNIEnv *env, jobject thiz)
+gst_native_set_log_ring (JNIEnv *env, jobject thiz, jstring thresholds, jstring dump_dir)
+{
+  const gchar *char_thresholds =
+      thresholds ? (*env)->GetStringUTFChars (env, thresholds, NULL) : NULL;
+  const gchar *char_dump_dir = dump_dir ? (*env)->GetStringUTFChars (env, dump_dir, NULL) : NULL;
+  brilliant_session_set_log_ring (char_thresholds, char_dump_dir);
+  if (char_thresholds)
+    (*env)->ReleaseStringUTFChars (env, thresholds, char_thresholds);
+  if (char_dump_dir)
+    (*env)->ReleaseStringUTFChars (env, dump_dir, char_dump_dir);
+}
+
+/* Write the recent debug log of this session to path */
+static jboolean
+gst_native_dump_log (JNIEnv *env, jobject thiz, jstring path)
+{
+  CustomData *data = GET_CUSTOM_DATA (env, thiz, custom_data_field_id);
+  const gchar *char_path = (*env)->GetStringUTFChars (env, path, NULL);
+  gboolean result = brilliant_session_dump_log (data, char_path);
+  (*env)->ReleaseStringUTFChars (env, path, char_path);
+  return result ? JNI_TRUE : JNI_FALSE;
+}
+
+/* Load the element factories of backendType in the background, ahead of its first session */
+static void
+gst_native_warm_up (JNIEnv *env, jobject thiz, jstring backend_type)
+{
+  const gchar *char_backend_type = (*env)->GetStringUTFChars (env, backend_type, NULL);
+  brilliant_session_warm_up (char_backend_type);
+  (*env)->ReleaseStringUTFChars (env, backend_type, char_backend_type);
+}
+
+/* Remember decoder choices in path, so later sessions skip decodebin autoplugging */
+static void
+gst_native_set_decoder_cache (JNIEnv *env, jclass klass, jstring path)
+{
+  const gchar *char_path = (*env)->GetStringUTFChars (env, path, NULL);
+  brilliant_session_set_decoder_cache (char_path);
+  (*env)->ReleaseStringUTFChars (env, path, char_path);
+}
+
+/* Keep the last keyframe of each camera in directory too, so previews survive the process */
+static void
+gst_native_set_keyframe_cache (JNIEnv *env, jclass klass, jstring directory)
+{
+  const gchar *char_directory = (*env)->GetStringUTFChars (env, directory, NULL);
+  brilliant_session_set_keyframe_cache (char_directory);
+  (*env)->ReleaseStringUTFChars (env, directory, char_directory);
+}
+
+/* Name the camera of this session, to show its last keyframe while the stream connects */
+static void
+gst_native_set_camera_id (JNIEnv *env, jobject thiz, jstring camera_id)
 {
   CustomData *data = GET_CUSTOM_DATA (env, thiz, custom_data_field_id);
   if (!data)
     return;
+  const gchar *char_camera_id = (*env)->GetStringUTFChars (env, camera_id, NULL);
+  TRACE_JNI_BEGIN ();
+  brilliant_session_set_camera_id (data, char_camera_id);
+  TRACE_JNI_END ();
+  (*env)->ReleaseStringUTFChars (env, camera_id, char_camera_id);
+}
 
-  if (strcmp(data->backend_type, backend_type_custom_rtp) == 0) {
-    // Custom RTP Backend type expects track info to be set at this point.
-    if (!complete_custom_rtp_track_pipeline_setup(data)) {
-      GST_ERROR("Custom RTP Track pipeline setup failed (likely due to missing track info). Aborting pipeline play.");
-      return;
-    }
+/* Measure the processing time of every element, for all sessions */
+static void
+gst_native_set_element_tracing (JNIEnv *env, jobject thiz, jboolean enabled)
+{
+  brilliant_session_set_element_tracing (enabled);
+}
+
+/* Return the element processing times measured since tracing was enabled, one line per element:
+ * "name count p50 p95 p99 max", times in nanoseconds. */
+static jstring
+gst_native_get_element_latencies (JNIEnv *env, jobject thiz)
+{
+  BrilliantElementLatency latencies[BRILLIANT_ELEMENT_TRACER_MAX_ELEMENTS];
+  gint count = brilliant_session_get_element_latencies (latencies,
+      BRILLIANT_ELEMENT_TRACER_MAX_ELEMENTS);
+  GString *report = g_string_new (NULL);
+  for (gint i = 0; i < count; i++) {
+    g_string_append_printf (report, "%s %" G_GINT64_FORMAT " %" G_GINT64_FORMAT " %"
+        G_GINT64_FORMAT " %" G_GINT64_FORMAT " %" G_GINT64_FORMAT "\n", latencies[i].name,
+        latencies[i].count, latencies[i].p50_ns, latencies[i].p95_ns, latencies[i].p99_ns,
+        latencies[i].max_ns);
   }
+  jstring jreport = (*env)->NewStringUTF (env, report->str);
+  g_string_free (report, TRUE);
+  return jreport;
+}
 
-  GST_DEBUG ("Setting state to PLAYING");
-  data->target_state = GST_STATE_PLAYING;
-  data->is_live |=
-      (gst_element_set_state (data->pipeline,
-          GST_STATE_PLAYING) == GST_STATE_CHANGE_NO_PREROLL);
+/* Start recording pipeline activity of all sessions, into a ring of capacity events (0 for the
+ * default). Returns false if a recording is already in progress. */
+static jboolean
+gst_native_start_trace (JNIEnv *env, jobject thiz, jint capacity)
+{
+  return brilliant_session_start_trace (capacity > 0 ? (guint) capacity : 0) ? JNI_TRUE : JNI_FALSE;
+}
+
+/* Stop recording and write a Chrome trace event JSON file to path */
+static jboolean
+gst_native_stop_trace (JNIEnv *env, jobject thiz, jstring path)
+{
+  const gchar *char_path = (*env)->GetStringUTFChars (env, path, NULL);
+  gboolean result = brilliant_session_stop_trace (char_path);
+  (*env)->ReleaseStringUTFChars (env, path, char_path);
+  return result ? JNI_TRUE : JNI_FALSE;
+}
+
+/* Set pipeline to PLAYING state */
+static void
+gst_native_play (JNIEnv *env, jobject thiz)
+{
+  CustomData *data = GET_CUSTOM_DATA (env, thiz, custom_data_field_id);
+  TRACE_JNI_BEGIN ();
+  brilliant_session_play (data);
+  TRACE_JNI_END ();
 }
 
 /* Set pipeline to PAUSED state */
@@ -790,13 +525,9 @@ static void
 gst_native_pause (JNIEnv *env, jobject thiz)
 {
   CustomData *data = GET_CUSTOM_DATA (env, thiz, custom_data_field_id);
-  if (!data)
-    return;
-  GST_DEBUG ("Setting state to PAUSED");
-  data->target_state = GST_STATE_PAUSED;
-  data->is_live |=
-      (gst_element_set_state (data->pipeline,
-          GST_STATE_PAUSED) == GST_STATE_CHANGE_NO_PREROLL);
+  TRACE_JNI_BEGIN ();
+  brilliant_session_pause (data);
+  TRACE_JNI_END ();
 }
 
 /* Instruct the pipeline to seek to a different position */
@@ -804,16 +535,245 @@ void
 gst_native_set_position (JNIEnv *env, jobject thiz, int milliseconds)
 {
   CustomData *data = GET_CUSTOM_DATA (env, thiz, custom_data_field_id);
-  if (!data)
-    return;
-  gint64 desired_position = (gint64) (milliseconds * GST_MSECOND);
-  if (data->state >= GST_STATE_PAUSED) {
-    execute_seek (desired_position, data);
-  } else {
-    GST_DEBUG ("Scheduling seek to %" GST_TIME_FORMAT " for later",
-        GST_TIME_ARGS (desired_position));
-    data->desired_position = desired_position;
-  }
+  brilliant_session_set_position (data, milliseconds);
+}
+
+/* Return the startup milestones reached so far, microseconds since nativeInit, -1 if not reached.
+ * Indexed by BrilliantStartupMilestone. */
+static jlongArray
+gst_native_get_startup_timings (JNIEnv *env, jobject thiz)
+{
+  CustomData *data = GET_CUSTOM_DATA (env, thiz, custom_data_field_id);
+  gint64 timings_us[BRILLIANT_STARTUP_MILESTONE_COUNT];
+  gint count = brilliant_session_get_startup_timings (data, timings_us,
+      BRILLIANT_STARTUP_MILESTONE_COUNT);
+  return startup_timings_to_java (env, timings_us, count);
+}
+
+/* Return the Start Data handshakes sent so far for {video, audio}, custom RTP backend only */
+static jlongArray
+gst_native_get_start_attempts (JNIEnv *env, jobject thiz)
+{
+  CustomData *data = GET_CUSTOM_DATA (env, thiz, custom_data_field_id);
+  gint attempts[BRILLIANT_START_TRACK_COUNT];
+  gint count = brilliant_session_get_start_attempts (data, attempts, BRILLIANT_START_TRACK_COUNT);
+  jlong values[BRILLIANT_START_TRACK_COUNT];
+  for (gint i = 0; i < count; i++)
+    values[i] = attempts[i];
+  jlongArray jattempts = (*env)->NewLongArray (env, count);
+  if (jattempts)
+    (*env)->SetLongArrayRegion (env, jattempts, 0, count, values);
+  return jattempts;
+}
+
+/* Id of the absolute capture time RTP header extension sent by the device, 0 for none */
+static void
+gst_native_set_capture_time_extension_id (JNIEnv *env, jobject thiz, jint id)
+{
+  CustomData *data = GET_CUSTOM_DATA (env, thiz, custom_data_field_id);
+  brilliant_session_set_capture_time_extension_id (data, (guint) id);
+}
+
+/* Return the glass to glass latency of a track (0 video, 1 audio) over the last 30 seconds as
+ * {count, p50, p90, p99, max}, in microseconds. Returns null if the backend does not measure it. */
+static jlongArray
+gst_native_get_latency_stats (JNIEnv *env, jobject thiz, jint track)
+{
+  CustomData *data = GET_CUSTOM_DATA (env, thiz, custom_data_field_id);
+  BrilliantHistogramSnapshot snapshot;
+  if (!brilliant_session_get_latency_stats (data, (BrilliantLatencyTrack) track, &snapshot))
+    return NULL;
+  jlong values[BRILLIANT_HISTOGRAM_SNAPSHOT_FIELDS] = {
+    snapshot.count, snapshot.p50, snapshot.p90, snapshot.p99, snapshot.max
+  };
+  jlongArray jstats = (*env)->NewLongArray (env, BRILLIANT_HISTOGRAM_SNAPSHOT_FIELDS);
+  if (jstats)
+    (*env)->SetLongArrayRegion (env, jstats, 0, BRILLIANT_HISTOGRAM_SNAPSHOT_FIELDS, values);
+  return jstats;
+}
+
+/* Report RTP statistics through onRtpStats every intervalMs milliseconds, 0 to stop */
+static void
+gst_native_set_rtp_stats_interval (JNIEnv *env, jobject thiz, jint interval_ms)
+{
+  CustomData *data = GET_CUSTOM_DATA (env, thiz, custom_data_field_id);
+  brilliant_session_set_rtp_stats_interval (data, interval_ms > 0 ? (guint) interval_ms : 0);
+}
+
+/* Keep the jitterbuffer latency of a custom RTP track (0 video, 1 audio) within [minMs, maxMs],
+ * equal bounds fix it */
+static void
+gst_native_set_jitter_latency_bounds (JNIEnv *env, jobject thiz, jint track, jint min_ms,
+    jint max_ms)
+{
+  CustomData *data = GET_CUSTOM_DATA (env, thiz, custom_data_field_id);
+  brilliant_session_set_jitter_latency_bounds (data, (BrilliantLatencyTrack) track,
+      MAX (min_ms, 0), MAX (max_ms, 0));
+}
+
+/* Return the current jitterbuffer latency of a track in milliseconds, 0 if the backend does not
+ * adapt it */
+static jint
+gst_native_get_jitter_latency (JNIEnv *env, jobject thiz, jint track)
+{
+  CustomData *data = GET_CUSTOM_DATA (env, thiz, custom_data_field_id);
+  return (jint) brilliant_session_get_jitter_latency (data, (BrilliantLatencyTrack) track);
+}
+
+/* 0 lip sync, 1 audio priority, 2 unsynchronized, see BrilliantSyncPolicy */
+static void
+gst_native_set_sync_policy (JNIEnv *env, jobject thiz, jint policy)
+{
+  CustomData *data = GET_CUSTOM_DATA (env, thiz, custom_data_field_id);
+  brilliant_session_set_sync_policy (data, (BrilliantSyncPolicy) policy);
+}
+
+/* Time the queue in front of the decoder (track 0, video) or the audio sink (track 1) may hold
+ * before dropping, 0 for the default */
+static void
+gst_native_set_queue_limit (JNIEnv *env, jobject thiz, jint track, jint limit_ms)
+{
+  CustomData *data = GET_CUSTOM_DATA (env, thiz, custom_data_field_id);
+  brilliant_session_set_queue_limit (data, (BrilliantLatencyTrack) track, MAX (limit_ms, 0));
+}
+
+/* Return what the bounded queues dropped, indexed by BrilliantQueueStatsField: {video frames,
+ * video GOPs, audio buffers, max video level us, max audio level us} */
+static jlongArray
+gst_native_get_queue_drops (JNIEnv *env, jobject thiz)
+{
+  CustomData *data = GET_CUSTOM_DATA (env, thiz, custom_data_field_id);
+  gint64 values[BRILLIANT_QUEUE_STATS_FIELD_COUNT];
+  gint count = brilliant_session_get_queue_drops (data, values, BRILLIANT_QUEUE_STATS_FIELD_COUNT);
+  jlongArray jstats = (*env)->NewLongArray (env, count);
+  if (jstats)
+    (*env)->SetLongArrayRegion (env, jstats, 0, count, (const jlong *) values);
+  return jstats;
+}
+
+/* Buffered duration catch-up playback drains video (track 0) or audio (track 1) back to, 0 for
+ * the default */
+static void
+gst_native_set_catch_up_target (JNIEnv *env, jobject thiz, jint track, jint target_ms)
+{
+  CustomData *data = GET_CUSTOM_DATA (env, thiz, custom_data_field_id);
+  brilliant_session_set_catch_up_target (data, (BrilliantLatencyTrack) track, MAX (target_ms, 0));
+}
+
+/* Return how much catching up took place, indexed by BrilliantCatchUpStatsField: {video
+ * episodes, video frames dropped, audio episodes, audio time saved us} */
+static jlongArray
+gst_native_get_catch_up_stats (JNIEnv *env, jobject thiz)
+{
+  CustomData *data = GET_CUSTOM_DATA (env, thiz, custom_data_field_id);
+  gint64 values[BRILLIANT_CATCH_UP_STATS_FIELD_COUNT];
+  gint count = brilliant_session_get_catch_up_stats (data, values,
+      BRILLIANT_CATCH_UP_STATS_FIELD_COUNT);
+  jlongArray jstats = (*env)->NewLongArray (env, count);
+  if (jstats)
+    (*env)->SetLongArrayRegion (env, jstats, 0, count, (const jlong *) values);
+  return jstats;
+}
+
+/* Select how the video sink presents frames: 0 paced on the clock, 1 as soon as decoded */
+static void
+gst_native_set_render_mode (JNIEnv *env, jobject thiz, jint mode)
+{
+  CustomData *data = GET_CUSTOM_DATA (env, thiz, custom_data_field_id);
+  brilliant_session_set_render_mode (data, (BrilliantRenderMode) mode);
+}
+
+/* Return what immediate rendering did, indexed by BrilliantRenderStatsField: {frames early,
+ * frames superseded, delay removed us, max delay removed us} */
+static jlongArray
+gst_native_get_render_stats (JNIEnv *env, jobject thiz)
+{
+  CustomData *data = GET_CUSTOM_DATA (env, thiz, custom_data_field_id);
+  gint64 values[BRILLIANT_RENDER_STATS_FIELD_COUNT];
+  gint count = brilliant_session_get_render_stats (data, values,
+      BRILLIANT_RENDER_STATS_FIELD_COUNT);
+  jlongArray jstats = (*env)->NewLongArray (env, count);
+  if (jstats)
+    (*env)->SetLongArrayRegion (env, jstats, 0, count, (const jlong *) values);
+  return jstats;
+}
+
+/* Return the RTCP and jitterbuffer statistics of every remote SSRC, BRILLIANT_RTP_STATS_FIELD_COUNT
+ * values per SSRC indexed by BrilliantRtpStatsField. Returns null if the backend has no rtpbin. */
+static jlongArray
+gst_native_get_rtp_stats (JNIEnv *env, jobject thiz)
+{
+  CustomData *data = GET_CUSTOM_DATA (env, thiz, custom_data_field_id);
+  GArray *stats = brilliant_session_get_rtp_stats (data);
+  if (!stats)
+    return NULL;
+  jlongArray jstats = rtp_stats_to_java (env, (const gint64 *) stats->data,
+      stats->len / BRILLIANT_RTP_STATS_FIELD_COUNT);
+  g_array_free (stats, TRUE);
+  return jstats;
+}
+
+/* Return the decode and render statistics of the video path: the BrilliantFrameCounter values,
+ * then {count, p50, p90, p99, max} for each BrilliantFrameHistogram. */
+static jlongArray
+gst_native_get_frame_stats (JNIEnv *env, jobject thiz)
+{
+  CustomData *data = GET_CUSTOM_DATA (env, thiz, custom_data_field_id);
+  gint64 values[BRILLIANT_FRAME_STATS_FIELDS];
+  gint count = brilliant_session_get_frame_stats (data, values, BRILLIANT_FRAME_STATS_FIELDS);
+  jlongArray jstats = (*env)->NewLongArray (env, count);
+  if (jstats)
+    (*env)->SetLongArrayRegion (env, jstats, 0, count, (const jlong *) values);
+  return jstats;
+}
+
+/* Return the RTCP keyframe requests of the video path, indexed by BrilliantKeyframeRequestField:
+ * {sent, suppressed, recoveries, last recovery us, max recovery us} */
+static jlongArray
+gst_native_get_keyframe_requests (JNIEnv *env, jobject thiz)
+{
+  CustomData *data = GET_CUSTOM_DATA (env, thiz, custom_data_field_id);
+  gint64 values[BRILLIANT_KEYFRAME_REQUEST_FIELD_COUNT];
+  gint count = brilliant_session_get_keyframe_requests (data, values,
+      BRILLIANT_KEYFRAME_REQUEST_FIELD_COUNT);
+  jlongArray jstats = (*env)->NewLongArray (env, count);
+  if (jstats)
+    (*env)->SetLongArrayRegion (env, jstats, 0, count, (const jlong *) values);
+  return jstats;
+}
+
+/* Count the GStreamer objects and memory of all sessions, to find leaks in the field */
+static void
+gst_native_set_allocation_accounting (JNIEnv *env, jobject thiz, jboolean enabled)
+{
+  brilliant_session_set_allocation_accounting (enabled);
+}
+
+/* Return {objects, mini objects, bytes} still alive among those created since this session was,
+ * null if allocation accounting is disabled. */
+static jlongArray
+gst_native_get_allocation_counts (JNIEnv *env, jobject thiz)
+{
+  CustomData *data = GET_CUSTOM_DATA (env, thiz, custom_data_field_id);
+  BrilliantAllocCounts counts;
+  if (!brilliant_session_get_allocation_counts (data, &counts))
+    return NULL;
+  jlong values[] = { counts.objects, counts.mini_objects, counts.bytes };
+  jlongArray jcounts = (*env)->NewLongArray (env, G_N_ELEMENTS (values));
+  if (jcounts)
+    (*env)->SetLongArrayRegion (env, jcounts, 0, G_N_ELEMENTS (values), values);
+  return jcounts;
+}
+
+/* Return what the last finalized session left behind, one line per type: "type count bytes".
+ * Empty if it left nothing. */
+static jstring
+gst_native_get_allocation_report (JNIEnv *env, jobject thiz)
+{
+  gchar *report = brilliant_session_get_allocation_report ();
+  jstring jreport = (*env)->NewStringUTF (env, report ? report : "");
+  g_free (report);
+  return jreport;
 }
 
 /* Static class initializer: retrieve method and field IDs */
@@ -830,6 +790,14 @@ gst_native_class_init (JNIEnv *env, jclass klass)
       (*env)->GetMethodID (env, klass, "onGStreamerInitialized", "(Ljava/lang/String;)V");
   on_media_size_changed_method_id =
       (*env)->GetMethodID (env, klass, "onMediaSizeChanged", "(II)V");
+  /* Optional: older apps do not implement it, GetMethodID throws NoSuchMethodError then */
+  on_startup_timings_method_id =
+      (*env)->GetMethodID (env, klass, "onStartupTimings", "([J)V");
+  if (!on_startup_timings_method_id)
+    (*env)->ExceptionClear (env);
+  on_rtp_stats_method_id = (*env)->GetMethodID (env, klass, "onRtpStats", "([J)V");
+  if (!on_rtp_stats_method_id)
+    (*env)->ExceptionClear (env);
 
   if (!custom_data_field_id || !set_message_method_id
       || !on_gstreamer_initialized_method_id || !on_media_size_changed_method_id
@@ -854,23 +822,14 @@ gst_native_surface_init (JNIEnv *env, jobject thiz, jobject surface)
   GST_DEBUG ("Received surface %p (native window %p)", surface,
       new_native_window);
 
-  if (data->native_window) {
-    ANativeWindow_release (data->native_window);
-    if (data->native_window == new_native_window) {
-      GST_DEBUG ("New native window is the same as the previous one %p",
-          data->native_window);
-      if (data->video_sink) {
-        gst_video_overlay_expose (GST_VIDEO_OVERLAY (data->video_sink));
-      }
-      return;
-    } else {
-      GST_DEBUG ("Released previous native window %p", data->native_window);
-      data->initialized = FALSE;
-    }
+  /* ANativeWindow_fromSurface always acquires a new reference, drop the one we held so far.
+   * The session keeps using the same handle if the window did not change. */
+  if (data->window_handle) {
+    ANativeWindow_release ((ANativeWindow *) data->window_handle);
   }
-  data->native_window = new_native_window;
-
-  check_initialization_complete (data);
+  TRACE_JNI_BEGIN ();
+  brilliant_session_set_window_handle (data, (guintptr) new_native_window);
+  TRACE_JNI_END ();
 }
 
 static void
@@ -879,22 +838,18 @@ gst_native_surface_finalize (JNIEnv *env, jobject thiz)
   CustomData *data = GET_CUSTOM_DATA (env, thiz, custom_data_field_id);
   if (!data)
     return;
-  GST_DEBUG ("Releasing Native Window %p", data->native_window);
-
-  if (data->video_sink) {
-    gst_video_overlay_set_window_handle (GST_VIDEO_OVERLAY (data->video_sink),
-        (guintptr) NULL);
-    gst_element_set_state (data->pipeline, GST_STATE_READY);
-  }
+  ANativeWindow *native_window = (ANativeWindow *) data->window_handle;
+  GST_DEBUG ("Releasing Native Window %p", native_window);
+  TRACE_JNI_BEGIN ();
+  brilliant_session_release_window (data);
+  TRACE_JNI_END ();
 
-  if (data->native_window) {
-    ANativeWindow_release(data->native_window);
-    data->native_window = NULL;
+  if (native_window) {
+    ANativeWindow_release(native_window);
   }
-  data->initialized = FALSE;
 }
 
-/* List of implemented native methods */
+/* List of implemented native methods, every application declares these */
 static JNINativeMethod native_methods[] = {
   {"nativeInit", "(Ljava/lang/String;)V", (void *) gst_native_init},
   {"nativeFinalize", "()V", (void *) gst_native_finalize},
@@ -915,6 +870,59 @@ static JNINativeMethod native_methods[] = {
   {"nativeClassInit", "()Z", (void *) gst_native_class_init}
 };
 
+/* Natives added since, registered one by one: an application that does not declare some of
+ * them keeps the others, see register_optional_natives */
+static JNINativeMethod optional_native_methods[] = {
+  {"nativePrewarm", "(Ljava/lang/String;)Z", (void *) gst_native_prewarm},
+  {"nativeDrainPool", "()V", (void *) gst_native_drain_pool},
+  {"nativeSetRTPVideoParameterSets", "(Ljava/lang/String;)Z",
+      (void *) gst_native_set_rtp_video_parameter_sets},
+  {"nativeSetLogRing", "(Ljava/lang/String;Ljava/lang/String;)V", (void *) gst_native_set_log_ring},
+  {"nativeDumpLog", "(Ljava/lang/String;)Z", (void *) gst_native_dump_log},
+  {"nativeWarmUp", "(Ljava/lang/String;)V", (void *) gst_native_warm_up},
+  {"nativeSetDecoderCache", "(Ljava/lang/String;)V", (void *) gst_native_set_decoder_cache},
+  {"nativeSetKeyframeCache", "(Ljava/lang/String;)V", (void *) gst_native_set_keyframe_cache},
+  {"nativeSetCameraId", "(Ljava/lang/String;)V", (void *) gst_native_set_camera_id},
+  {"nativeSetElementTracing", "(Z)V", (void *) gst_native_set_element_tracing},
+  {"nativeGetElementLatencies", "()Ljava/lang/String;", (void *) gst_native_get_element_latencies},
+  {"nativeStartTrace", "(I)Z", (void *) gst_native_start_trace},
+  {"nativeStopTrace", "(Ljava/lang/String;)Z", (void *) gst_native_stop_trace},
+  {"nativeGetStartupTimings", "()[J", (void *) gst_native_get_startup_timings},
+  {"nativeGetStartAttempts", "()[J", (void *) gst_native_get_start_attempts},
+  {"nativeSetCaptureTimeExtensionId", "(I)V", (void *) gst_native_set_capture_time_extension_id},
+  {"nativeGetLatencyStats", "(I)[J", (void *) gst_native_get_latency_stats},
+  {"nativeSetRtpStatsInterval", "(I)V", (void *) gst_native_set_rtp_stats_interval},
+  {"nativeSetJitterLatencyBounds", "(III)V", (void *) gst_native_set_jitter_latency_bounds},
+  {"nativeGetJitterLatency", "(I)I", (void *) gst_native_get_jitter_latency},
+  {"nativeSetSyncPolicy", "(I)V", (void *) gst_native_set_sync_policy},
+  {"nativeSetQueueLimit", "(II)V", (void *) gst_native_set_queue_limit},
+  {"nativeGetQueueDrops", "()[J", (void *) gst_native_get_queue_drops},
+  {"nativeSetCatchUpTarget", "(II)V", (void *) gst_native_set_catch_up_target},
+  {"nativeGetCatchUpStats", "()[J", (void *) gst_native_get_catch_up_stats},
+  {"nativeSetRenderMode", "(I)V", (void *) gst_native_set_render_mode},
+  {"nativeGetRenderStats", "()[J", (void *) gst_native_get_render_stats},
+  {"nativeGetRtpStats", "()[J", (void *) gst_native_get_rtp_stats},
+  {"nativeGetFrameStats", "()[J", (void *) gst_native_get_frame_stats},
+  {"nativeGetKeyframeRequests", "()[J", (void *) gst_native_get_keyframe_requests},
+  {"nativeSetAllocationAccounting", "(Z)V", (void *) gst_native_set_allocation_accounting},
+  {"nativeGetAllocationCounts", "()[J", (void *) gst_native_get_allocation_counts},
+  {"nativeGetAllocationReport", "()Ljava/lang/String;", (void *) gst_native_get_allocation_report}
+};
+
+/* Register optional_native_methods, skipping those klass does not declare. A failed
+ * RegisterNatives leaves a NoSuchMethodError pending, which is cleared. */
+static void
+register_optional_natives (JNIEnv * env, jclass klass)
+{
+  for (guint i = 0; i < G_N_ELEMENTS (optional_native_methods); i++) {
+    if ((*env)->RegisterNatives (env, klass, &optional_native_methods[i], 1) != JNI_OK) {
+      (*env)->ExceptionClear (env);
+      __android_log_print (ANDROID_LOG_INFO, "gstreamer-brilliant",
+          "%s is not declared by the application, skipped", optional_native_methods[i].name);
+    }
+  }
+}
+
 /* Library initializer */
 jint
 JNI_OnLoad (JavaVM * vm, void *reserved)
@@ -930,8 +938,20 @@ JNI_OnLoad (JavaVM * vm, void *reserved)
   }
   jclass klass = (*env)->FindClass (env,
       "tech/brilliant/brilliant/device/control/liveview/LiveViewActivity");
-  (*env)->RegisterNatives (env, klass, native_methods,
-      G_N_ELEMENTS (native_methods));
+  if (!klass) {
+    (*env)->ExceptionClear (env);
+    __android_log_print (ANDROID_LOG_ERROR, "gstreamer-brilliant",
+        "Could not find LiveViewActivity");
+    return 0;
+  }
+  if ((*env)->RegisterNatives (env, klass, native_methods,
+          G_N_ELEMENTS (native_methods)) != JNI_OK) {
+    (*env)->ExceptionClear (env);
+    __android_log_print (ANDROID_LOG_ERROR, "gstreamer-brilliant",
+        "Could not register the native methods");
+    return 0;
+  }
+  register_optional_natives (env, klass);
 
   pthread_key_create (&current_jni_env, detach_current_thread);
   return JNI_VERSION_1_4;
@@ -0,0 +1,4 @@
+# Platform independent session core, shared by the Android (ndk-build) and desktop Linux builds.
+# Paths are relative to this directory.
+BRILLIANT_CORE_SRC_FILES := brilliant_session.c brilliant_rtsp_backend.c brilliant_custom_rtp_backend.c brilliant_startup_timings.c brilliant_histogram.c brilliant_latency_monitor.c brilliant_rtp_stats.c brilliant_frame_stats.c brilliant_element_tracer.c brilliant_trace_recorder.c brilliant_alloc_tracker.c brilliant_log_ring.c brilliant_plugins.c brilliant_decoder_cache.c brilliant_start_sequencer.c brilliant_keyframe_cache.c brilliant_keyframe_requester.c brilliant_jitter_controller.c brilliant_queue_guard.c brilliant_catch_up.c brilliant_render_pacer.c
+BRILLIANT_CORE_HEADERS := brilliant_session.h brilliant_rtsp_backend.h brilliant_custom_rtp_backend.h brilliant_startup_timings.h brilliant_histogram.h brilliant_latency_monitor.h brilliant_rtp_stats.h brilliant_frame_stats.h brilliant_element_tracer.h brilliant_trace_recorder.h brilliant_alloc_tracker.h brilliant_log_ring.h brilliant_plugins.h brilliant_decoder_cache.h brilliant_start_sequencer.h brilliant_keyframe_cache.h brilliant_keyframe_requester.h brilliant_jitter_controller.h brilliant_queue_guard.h brilliant_catch_up.h brilliant_render_pacer.h
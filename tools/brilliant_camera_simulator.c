@@ -0,0 +1,422 @@
+/*****************************************************************************
+ * GStreamerBrilliant: Android Library built with system's GStreamer Implementation. Intended for use in Brilliant Mobile App.
+ *****************************************************************************
+ * Copyright (C) 2022 Brilliant Home Technologies
+ *
+ * Authors: Brilliant iOS Team <android_developer # brilliant.tech>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/*
+ * Stand-in for a Brilliant device talking to the custom RTP backend.
+ *
+ * For each of the video and audio device ports the simulator waits for the "Start Data"
+ * datagram sent by notify_custom_rtp_start_sending, then streams SRTP to the address the
+ * datagram came from: H.264 for video, L16 for audio, using the keys and SSRCs the app passes to
+ * nativeSetRTPTrackProperties. Talkback audio arriving on the audio port is decrypted with the
+ * talkback key and counted. All outgoing media goes through the brilliant_netsim impairment model.
+ *
+ *   [videotestsrc]-->[x264enc]-->[rtph264pay]-->[srtpenc]-->[appsink]--+
+ *                                                                       +-->(netsim)-->phone
+ *   [audiotestsrc]-->[rtpL16pay]-->[srtpenc]-->[appsink]---------------+
+ *
+ *   phone-->[appsrc]-->[srtpdec]-->[rtpL16depay]-->[fakesink]
+ */
+
+#include <gst/gst.h>
+#include <gst/app/app.h>
+#include <gio/gio.h>
+#include <glib-unix.h>
+#include <signal.h>
+#include "brilliant_netsim.h"
+
+#define START_DATA_MESSAGE "Start Data"
+#define STATS_INTERVAL_SECONDS 5
+
+typedef struct _SimulatedTrack
+{
+  const gchar *name;
+  int port;
+  GSocket *socket;              /* Bound on the device port, media is sent from here */
+  GSocket *rtcp_socket;         /* Bound on the device port + 1 */
+  GSocketAddress *peer;         /* Learned from the last "Start Data" datagram */
+  GstElement *pipeline;
+  guint64 handshakes;
+  guint64 rtcp_packets;
+} SimulatedTrack;
+
+typedef struct _Simulator
+{
+  BrilliantNetsim *netsim;
+  GMutex peer_lock;
+  SimulatedTrack video;
+  SimulatedTrack audio;
+  GstElement *talkback_pipeline;
+  GstElement *talkback_src;
+  guint64 talkback_packets;
+  guint64 talkback_decrypted;
+  GMainLoop *loop;
+} Simulator;
+
+/* Command line options */
+static gchar *bind_address = "0.0.0.0";
+static gint video_port = 5000;
+static gint audio_port = 5002;
+static gchar *video_key_hex;
+static gchar *audio_key_hex;
+static gchar *talkback_key_hex;
+static gint64 video_ssrc = 1111;
+static gint64 audio_ssrc = 2222;
+static gint64 talkback_ssrc = 3333;
+static gint video_payload_type = 96;
+static gint audio_payload_type = 97;
+static gint talkback_payload_type = 97;
+static gint audio_rate = 16000;
+static gint audio_channels = 1;
+static gint video_width = 1280;
+static gint video_height = 720;
+static gint video_fps = 15;
+static gint keyframe_interval = 30;
+static gint video_bitrate_kbps = 1500;
+static BrilliantNetsimConfig netsim_config = { 0, 0, 0, 0, 0, 0, 0, 0, 1 };
+
+static GOptionEntry entries[] = {
+  {"bind-address", 0, 0, G_OPTION_ARG_STRING, &bind_address, "Local address to listen on", "ADDR"},
+  {"video-port", 0, 0, G_OPTION_ARG_INT, &video_port, "Device video port (incoming_video_port)", "PORT"},
+  {"audio-port", 0, 0, G_OPTION_ARG_INT, &audio_port, "Device audio port (incoming/outgoing_audio_port)", "PORT"},
+  {"video-key", 0, 0, G_OPTION_ARG_STRING, &video_key_hex, "Incoming video SRTP key, hex", "HEX"},
+  {"audio-key", 0, 0, G_OPTION_ARG_STRING, &audio_key_hex, "Incoming audio SRTP key, hex", "HEX"},
+  {"talkback-key", 0, 0, G_OPTION_ARG_STRING, &talkback_key_hex, "Outgoing (talkback) audio SRTP key, hex", "HEX"},
+  {"video-ssrc", 0, 0, G_OPTION_ARG_INT64, &video_ssrc, "Incoming video SSRC", "SSRC"},
+  {"audio-ssrc", 0, 0, G_OPTION_ARG_INT64, &audio_ssrc, "Incoming audio SSRC", "SSRC"},
+  {"talkback-ssrc", 0, 0, G_OPTION_ARG_INT64, &talkback_ssrc, "Outgoing (talkback) audio SSRC", "SSRC"},
+  {"video-pt", 0, 0, G_OPTION_ARG_INT, &video_payload_type, "Video payload type", "PT"},
+  {"audio-pt", 0, 0, G_OPTION_ARG_INT, &audio_payload_type, "Audio payload type", "PT"},
+  {"talkback-pt", 0, 0, G_OPTION_ARG_INT, &talkback_payload_type, "Talkback payload type", "PT"},
+  {"audio-rate", 0, 0, G_OPTION_ARG_INT, &audio_rate, "Audio sample rate", "HZ"},
+  {"audio-channels", 0, 0, G_OPTION_ARG_INT, &audio_channels, "Audio channels", "N"},
+  {"width", 0, 0, G_OPTION_ARG_INT, &video_width, "Video width", "PX"},
+  {"height", 0, 0, G_OPTION_ARG_INT, &video_height, "Video height", "PX"},
+  {"fps", 0, 0, G_OPTION_ARG_INT, &video_fps, "Video frame rate", "FPS"},
+  {"keyframe-interval", 0, 0, G_OPTION_ARG_INT, &keyframe_interval, "Frames between IDRs", "N"},
+  {"video-bitrate", 0, 0, G_OPTION_ARG_INT, &video_bitrate_kbps, "Video bitrate", "KBPS"},
+  {"loss", 0, 0, G_OPTION_ARG_DOUBLE, &netsim_config.loss_percent, "Random loss", "PERCENT"},
+  {"burst-enter", 0, 0, G_OPTION_ARG_DOUBLE, &netsim_config.burst_enter_percent, "Chance per packet to enter a loss burst", "PERCENT"},
+  {"burst-exit", 0, 0, G_OPTION_ARG_DOUBLE, &netsim_config.burst_exit_percent, "Chance per packet to leave a loss burst", "PERCENT"},
+  {"burst-loss", 0, 0, G_OPTION_ARG_DOUBLE, &netsim_config.burst_loss_percent, "Loss while in a burst", "PERCENT"},
+  {"delay", 0, 0, G_OPTION_ARG_INT, &netsim_config.delay_ms, "Constant delay", "MS"},
+  {"jitter", 0, 0, G_OPTION_ARG_INT, &netsim_config.jitter_ms, "Maximum random extra delay", "MS"},
+  {"reorder", 0, 0, G_OPTION_ARG_DOUBLE, &netsim_config.reorder_percent, "Reordered packets", "PERCENT"},
+  {"bandwidth", 0, 0, G_OPTION_ARG_INT, &netsim_config.bandwidth_kbps, "Link capacity, 0 for unlimited", "KBPS"},
+  {"seed", 0, 0, G_OPTION_ARG_INT, &netsim_config.seed, "Impairment random seed", "N"},
+  {NULL}
+};
+
+static GstBuffer * hex_to_buffer(const gchar *hex) {
+  gsize length = hex ? strlen(hex) / 2 : 0;
+  guint8 *bytes = g_malloc0(MAX(length, 1));
+  for (gsize i = 0; i < length; i++) {
+    gint high = g_ascii_xdigit_value(hex[2 * i]);
+    gint low = g_ascii_xdigit_value(hex[2 * i + 1]);
+    if (high < 0 || low < 0) {
+      g_printerr("Invalid hex key %s\n", hex);
+      g_free(bytes);
+      return NULL;
+    }
+    bytes[i] = (guint8) (high << 4 | low);
+  }
+  return gst_buffer_new_wrapped(bytes, length);
+}
+
+static GSocket * bind_udp_socket(int port) {
+  GError *error = NULL;
+  GSocket *socket = g_socket_new(G_SOCKET_FAMILY_IPV4, G_SOCKET_TYPE_DATAGRAM,
+                                 G_SOCKET_PROTOCOL_UDP, &error);
+  if (!socket) {
+    g_printerr("Failed to create socket: %s\n", error->message);
+    g_clear_error(&error);
+    return NULL;
+  }
+  GInetAddress *address = g_inet_address_new_from_string(bind_address);
+  GSocketAddress *socket_address = g_inet_socket_address_new(address, port);
+  gboolean bound = g_socket_bind(socket, socket_address, TRUE, &error);
+  g_object_unref(address);
+  g_object_unref(socket_address);
+  if (!bound) {
+    g_printerr("Failed to bind %s:%d: %s\n", bind_address, port, error->message);
+    g_clear_error(&error);
+    g_object_unref(socket);
+    return NULL;
+  }
+  return socket;
+}
+
+/* Streaming thread: forward each SRTP packet to the phone through the impairment model */
+static GstFlowReturn on_new_sample(GstAppSink *appsink, gpointer user_data) {
+  SimulatedTrack *track = user_data;
+  Simulator *simulator = g_object_get_data(G_OBJECT(appsink), "simulator");
+  GstSample *sample = gst_app_sink_pull_sample(appsink);
+  if (!sample)
+    return GST_FLOW_EOS;
+
+  g_mutex_lock(&simulator->peer_lock);
+  GSocketAddress *peer = track->peer ? g_object_ref(track->peer) : NULL;
+  g_mutex_unlock(&simulator->peer_lock);
+
+  if (peer) {
+    GstBuffer *buffer = gst_sample_get_buffer(sample);
+    GstMapInfo map;
+    if (gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+      brilliant_netsim_send(simulator->netsim, track->socket, peer, map.data, map.size);
+      gst_buffer_unmap(buffer, &map);
+    }
+    g_object_unref(peer);
+  }
+  gst_sample_unref(sample);
+  return GST_FLOW_OK;
+}
+
+static GstElement * build_media_pipeline(Simulator *simulator, SimulatedTrack *track,
+                                         const gchar *description, GstBuffer *key) {
+  GError *error = NULL;
+  GstElement *pipeline = gst_parse_launch(description, &error);
+  if (error) {
+    g_printerr("Unable to build %s pipeline: %s\n", track->name, error->message);
+    g_clear_error(&error);
+    return NULL;
+  }
+  GstElement *srtp_enc = gst_bin_get_by_name(GST_BIN(pipeline), "enc");
+  g_object_set(srtp_enc, "key", key, NULL);
+  gst_object_unref(srtp_enc);
+
+  GstElement *appsink = gst_bin_get_by_name(GST_BIN(pipeline), "out");
+  GstAppSinkCallbacks callbacks = { NULL, NULL, on_new_sample };
+  g_object_set_data(G_OBJECT(appsink), "simulator", simulator);
+  gst_app_sink_set_callbacks(GST_APP_SINK(appsink), &callbacks, track, NULL);
+  gst_object_unref(appsink);
+  return pipeline;
+}
+
+static GstCaps * request_talkback_key(GstElement *element, guint ssrc, GstBuffer *key) {
+  return gst_caps_new_simple("application/x-srtp",
+                             "srtp-key", GST_TYPE_BUFFER, key,
+                             "srtp-cipher", G_TYPE_STRING, "aes-128-icm",
+                             "srtp-auth", G_TYPE_STRING, "hmac-sha1-80",
+                             "srtcp-cipher", G_TYPE_STRING, "aes-128-icm",
+                             "srtcp-auth", G_TYPE_STRING, "hmac-sha1-80",
+                             NULL);
+}
+
+static GstPadProbeReturn count_talkback_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+  Simulator *simulator = user_data;
+  simulator->talkback_decrypted++;
+  return GST_PAD_PROBE_OK;
+}
+
+static GstElement * build_talkback_pipeline(Simulator *simulator, GstBuffer *key) {
+  GError *error = NULL;
+  GstElement *pipeline = gst_parse_launch(
+      "appsrc name=src is-live=true format=time do-timestamp=true ! srtpdec name=dec ! "
+      "rtpL16depay ! fakesink sync=false", &error);
+  if (error) {
+    g_printerr("Unable to build talkback pipeline: %s\n", error->message);
+    g_clear_error(&error);
+    return NULL;
+  }
+  simulator->talkback_src = gst_bin_get_by_name(GST_BIN(pipeline), "src");
+  GstCaps *caps = gst_caps_new_simple("application/x-srtp",
+                                      "media", G_TYPE_STRING, "audio",
+                                      "clock-rate", G_TYPE_INT, audio_rate,
+                                      "encoding-name", G_TYPE_STRING, "L16",
+                                      "payload", G_TYPE_INT, talkback_payload_type,
+                                      "channels", G_TYPE_INT, audio_channels,
+                                      "ssrc", G_TYPE_UINT, (guint) talkback_ssrc,
+                                      NULL);
+  g_object_set(simulator->talkback_src, "caps", caps, NULL);
+  gst_caps_unref(caps);
+
+  GstElement *srtp_dec = gst_bin_get_by_name(GST_BIN(pipeline), "dec");
+  g_signal_connect(srtp_dec, "request-key", G_CALLBACK(request_talkback_key), key);
+  GstPad *rtp_src = gst_element_get_static_pad(srtp_dec, "rtp_src");
+  gst_pad_add_probe(rtp_src, GST_PAD_PROBE_TYPE_BUFFER, count_talkback_probe, simulator, NULL);
+  gst_object_unref(rtp_src);
+  gst_object_unref(srtp_dec);
+  return pipeline;
+}
+
+/* Main loop: a datagram arrived on a device port */
+static gboolean on_socket_readable(GSocket *socket, GIOCondition condition, gpointer user_data) {
+  SimulatedTrack *track = user_data;
+  Simulator *simulator = g_object_get_data(G_OBJECT(socket), "simulator");
+  guint8 datagram[2048];
+  GSocketAddress *sender = NULL;
+  GError *error = NULL;
+  gssize size = g_socket_receive_from(socket, &sender, (gchar *) datagram, sizeof(datagram), NULL, &error);
+  if (size < 0) {
+    g_printerr("%s: receive failed: %s\n", track->name, error->message);
+    g_clear_error(&error);
+    return G_SOURCE_CONTINUE;
+  }
+
+  if (socket == track->rtcp_socket) {
+    track->rtcp_packets++;
+  } else if (size == strlen(START_DATA_MESSAGE) &&
+             memcmp(datagram, START_DATA_MESSAGE, size) == 0) {
+    gchar *sender_string = g_socket_connectable_to_string(G_SOCKET_CONNECTABLE(sender));
+    track->handshakes++;
+    g_print("%s: \"Start Data\" #%" G_GUINT64_FORMAT " from %s\n", track->name, track->handshakes, sender_string);
+    g_free(sender_string);
+    g_mutex_lock(&simulator->peer_lock);
+    g_clear_object(&track->peer);
+    track->peer = g_object_ref(sender);
+    g_mutex_unlock(&simulator->peer_lock);
+    gst_element_set_state(track->pipeline, GST_STATE_PLAYING);
+  } else if (track == &simulator->audio && simulator->talkback_src) {
+    // Anything else arriving on the audio port is the phone's SRTP talkback stream
+    simulator->talkback_packets++;
+    GstBuffer *buffer = gst_buffer_new_memdup(datagram, size);
+    gst_app_src_push_buffer(GST_APP_SRC(simulator->talkback_src), buffer);
+  }
+  g_object_unref(sender);
+  return G_SOURCE_CONTINUE;
+}
+
+static void watch_socket(Simulator *simulator, SimulatedTrack *track, GSocket *socket) {
+  g_object_set_data(G_OBJECT(socket), "simulator", simulator);
+  GSource *source = g_socket_create_source(socket, G_IO_IN, NULL);
+  g_source_set_callback(source, (GSourceFunc) on_socket_readable, track, NULL);
+  g_source_attach(source, NULL);
+  g_source_unref(source);
+}
+
+static gboolean print_stats(Simulator *simulator) {
+  BrilliantNetsimStats stats;
+  brilliant_netsim_get_stats(simulator->netsim, &stats);
+  g_print("{\"packets_in\": %" G_GUINT64_FORMAT ", \"packets_sent\": %" G_GUINT64_FORMAT
+          ", \"packets_lost\": %" G_GUINT64_FORMAT ", \"packets_reordered\": %" G_GUINT64_FORMAT
+          ", \"bytes_sent\": %" G_GUINT64_FORMAT ", \"max_queue_delay_us\": %" G_GINT64_FORMAT
+          ", \"video_handshakes\": %" G_GUINT64_FORMAT ", \"audio_handshakes\": %" G_GUINT64_FORMAT
+          ", \"video_rtcp_in\": %" G_GUINT64_FORMAT ", \"audio_rtcp_in\": %" G_GUINT64_FORMAT
+          ", \"talkback_in\": %" G_GUINT64_FORMAT ", \"talkback_decrypted\": %" G_GUINT64_FORMAT "}\n",
+          stats.packets_in, stats.packets_sent, stats.packets_lost, stats.packets_reordered,
+          stats.bytes_sent, stats.max_queue_delay_us,
+          simulator->video.handshakes, simulator->audio.handshakes,
+          simulator->video.rtcp_packets, simulator->audio.rtcp_packets,
+          simulator->talkback_packets, simulator->talkback_decrypted);
+  return G_SOURCE_CONTINUE;
+}
+
+static gboolean on_sigint(Simulator *simulator) {
+  g_main_loop_quit(simulator->loop);
+  return G_SOURCE_REMOVE;
+}
+
+static void cleanup_track(SimulatedTrack *track) {
+  if (track->pipeline) {
+    gst_element_set_state(track->pipeline, GST_STATE_NULL);
+    gst_object_unref(track->pipeline);
+  }
+  g_clear_object(&track->peer);
+  g_clear_object(&track->socket);
+  g_clear_object(&track->rtcp_socket);
+}
+
+int main(int argc, char *argv[]) {
+  GError *error = NULL;
+  GOptionContext *context = g_option_context_new("- simulated Brilliant camera for the custom RTP backend");
+  g_option_context_add_main_entries(context, entries, NULL);
+  g_option_context_add_group(context, gst_init_get_option_group());
+  if (!g_option_context_parse(context, &argc, &argv, &error)) {
+    g_printerr("%s\n", error->message);
+    g_clear_error(&error);
+    g_option_context_free(context);
+    return 1;
+  }
+  g_option_context_free(context);
+
+  GstBuffer *video_key = hex_to_buffer(video_key_hex);
+  GstBuffer *audio_key = hex_to_buffer(audio_key_hex);
+  GstBuffer *talkback_key = hex_to_buffer(talkback_key_hex);
+  if (!video_key || !audio_key || !talkback_key)
+    return 1;
+
+  Simulator simulator = { 0 };
+  g_mutex_init(&simulator.peer_lock);
+  simulator.netsim = brilliant_netsim_new(&netsim_config);
+  simulator.video.name = "video";
+  simulator.video.port = video_port;
+  simulator.audio.name = "audio";
+  simulator.audio.port = audio_port;
+
+  gchar *video_description = g_strdup_printf(
+      "videotestsrc is-live=true pattern=ball ! video/x-raw,width=%d,height=%d,framerate=%d/1 ! "
+      "x264enc tune=zerolatency speed-preset=ultrafast key-int-max=%d bitrate=%d ! "
+      "rtph264pay config-interval=-1 mtu=1200 pt=%d ssrc=%u ! "
+      "srtpenc name=enc rtp-cipher=aes-128-icm rtp-auth=hmac-sha1-80 "
+      "rtcp-cipher=aes-128-icm rtcp-auth=hmac-sha1-80 ! appsink name=out sync=false",
+      video_width, video_height, video_fps, keyframe_interval, video_bitrate_kbps,
+      video_payload_type, (guint) video_ssrc);
+  gchar *audio_description = g_strdup_printf(
+      "audiotestsrc is-live=true wave=sine samplesperbuffer=%d ! "
+      "audio/x-raw,format=S16BE,layout=interleaved,rate=%d,channels=%d ! "
+      "rtpL16pay pt=%d ssrc=%u min-ptime=20000000 ! "
+      "srtpenc name=enc rtp-cipher=aes-128-icm rtp-auth=hmac-sha1-80 "
+      "rtcp-cipher=aes-128-icm rtcp-auth=hmac-sha1-80 ! appsink name=out sync=false",
+      audio_rate / 50, audio_rate, audio_channels, audio_payload_type, (guint) audio_ssrc);
+  simulator.video.pipeline = build_media_pipeline(&simulator, &simulator.video, video_description, video_key);
+  simulator.audio.pipeline = build_media_pipeline(&simulator, &simulator.audio, audio_description, audio_key);
+  simulator.talkback_pipeline = build_talkback_pipeline(&simulator, talkback_key);
+  g_free(video_description);
+  g_free(audio_description);
+
+  simulator.video.socket = bind_udp_socket(video_port);
+  simulator.video.rtcp_socket = bind_udp_socket(video_port + 1);
+  simulator.audio.socket = bind_udp_socket(audio_port);
+  simulator.audio.rtcp_socket = bind_udp_socket(audio_port + 1);
+  int result = 1;
+  if (simulator.video.pipeline && simulator.audio.pipeline && simulator.talkback_pipeline &&
+      simulator.video.socket && simulator.video.rtcp_socket &&
+      simulator.audio.socket && simulator.audio.rtcp_socket) {
+    watch_socket(&simulator, &simulator.video, simulator.video.socket);
+    watch_socket(&simulator, &simulator.video, simulator.video.rtcp_socket);
+    watch_socket(&simulator, &simulator.audio, simulator.audio.socket);
+    watch_socket(&simulator, &simulator.audio, simulator.audio.rtcp_socket);
+    gst_element_set_state(simulator.talkback_pipeline, GST_STATE_PLAYING);
+
+    g_print("Waiting for \"Start Data\" on %s video:%d audio:%d\n", bind_address, video_port, audio_port);
+    simulator.loop = g_main_loop_new(NULL, FALSE);
+    g_timeout_add_seconds(STATS_INTERVAL_SECONDS, (GSourceFunc) print_stats, &simulator);
+    g_unix_signal_add(SIGINT, (GSourceFunc) on_sigint, &simulator);
+    g_main_loop_run(simulator.loop);
+    g_main_loop_unref(simulator.loop);
+    print_stats(&simulator);
+    result = 0;
+  }
+
+  cleanup_track(&simulator.video);
+  cleanup_track(&simulator.audio);
+  if (simulator.talkback_pipeline) {
+    gst_element_set_state(simulator.talkback_pipeline, GST_STATE_NULL);
+    gst_object_unref(simulator.talkback_src);
+    gst_object_unref(simulator.talkback_pipeline);
+  }
+  brilliant_netsim_free(simulator.netsim);
+  g_mutex_clear(&simulator.peer_lock);
+  gst_buffer_unref(video_key);
+  gst_buffer_unref(audio_key);
+  gst_buffer_unref(talkback_key);
+  return result;
+}
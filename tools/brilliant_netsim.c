@@ -0,0 +1,198 @@
+/*****************************************************************************
+ * GStreamerBrilliant: Android Library built with system's GStreamer Implementation. Intended for use in Brilliant Mobile App.
+ *****************************************************************************
+ * Copyright (C) 2022 Brilliant Home Technologies
+ *
+ * Authors: Brilliant iOS Team <android_developer # brilliant.tech>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "brilliant_netsim.h"
+
+/* A bandwidth limited link drops packets that would wait longer than this in the
+ * bottleneck queue, like the tail drop of a Wi-Fi access point buffer. */
+#define NETSIM_MAX_BOTTLENECK_DELAY_US (1 * G_USEC_PER_SEC)
+/* Extra hold applied to a reordered packet when there is no delay line to skip */
+#define NETSIM_REORDER_HOLD_US (10 * 1000)
+
+typedef struct _NetsimPacket
+{
+  gint64 due_time;              /* Monotonic time the packet leaves the simulator */
+  GSocket *socket;
+  GSocketAddress *destination;
+  gsize size;
+  guint8 data[];
+} NetsimPacket;
+
+struct _BrilliantNetsim
+{
+  BrilliantNetsimConfig config;
+  GRand *rand;
+  gboolean in_burst;            /* Gilbert-Elliott state */
+  gint64 last_due_time;         /* Keeps in order packets in order despite jitter */
+  gint64 link_free_time;        /* When the bottleneck link finishes the packets queued so far */
+
+  GMutex lock;
+  GCond cond;
+  GQueue queue;                 /* NetsimPacket, sorted by due_time */
+  gboolean running;
+  GThread *thread;
+  BrilliantNetsimStats stats;
+};
+
+static gint compare_due_time(gconstpointer a, gconstpointer b, gpointer user_data) {
+  const NetsimPacket *packet_a = a;
+  const NetsimPacket *packet_b = b;
+  if (packet_a->due_time < packet_b->due_time)
+    return -1;
+  return packet_a->due_time > packet_b->due_time ? 1 : 0;
+}
+
+static void free_packet(NetsimPacket *packet) {
+  g_object_unref(packet->socket);
+  g_object_unref(packet->destination);
+  g_free(packet);
+}
+
+static gboolean chance(BrilliantNetsim *netsim, gdouble percent) {
+  return percent > 0 && g_rand_double(netsim->rand) * 100.0 < percent;
+}
+
+/* Decide whether the next packet is lost, advancing the burst state machine */
+static gboolean next_packet_lost(BrilliantNetsim *netsim) {
+  if (netsim->in_burst) {
+    if (chance(netsim, netsim->config.burst_exit_percent))
+      netsim->in_burst = FALSE;
+  } else if (chance(netsim, netsim->config.burst_enter_percent)) {
+    netsim->in_burst = TRUE;
+  }
+  return chance(netsim, netsim->in_burst ? netsim->config.burst_loss_percent
+                                         : netsim->config.loss_percent);
+}
+
+static gpointer sender_thread(gpointer user_data) {
+  BrilliantNetsim *netsim = user_data;
+  g_mutex_lock(&netsim->lock);
+  while (netsim->running) {
+    NetsimPacket *packet = g_queue_peek_head(&netsim->queue);
+    if (!packet) {
+      g_cond_wait(&netsim->cond, &netsim->lock);
+      continue;
+    }
+    if (packet->due_time > g_get_monotonic_time()) {
+      g_cond_wait_until(&netsim->cond, &netsim->lock, packet->due_time);
+      continue;
+    }
+    g_queue_pop_head(&netsim->queue);
+    g_mutex_unlock(&netsim->lock);
+
+    GError *error = NULL;
+    gssize sent = g_socket_send_to(packet->socket, packet->destination,
+                                   (const gchar *) packet->data, packet->size, NULL, &error);
+    if (error) {
+      g_warning("netsim: failed to send datagram: %s", error->message);
+      g_clear_error(&error);
+    }
+
+    g_mutex_lock(&netsim->lock);
+    if (sent > 0) {
+      netsim->stats.packets_sent++;
+      netsim->stats.bytes_sent += sent;
+    }
+    free_packet(packet);
+  }
+  g_mutex_unlock(&netsim->lock);
+  return NULL;
+}
+
+BrilliantNetsim *brilliant_netsim_new(const BrilliantNetsimConfig *config) {
+  BrilliantNetsim *netsim = g_new0(BrilliantNetsim, 1);
+  netsim->config = *config;
+  netsim->rand = g_rand_new_with_seed(config->seed);
+  g_mutex_init(&netsim->lock);
+  g_cond_init(&netsim->cond);
+  g_queue_init(&netsim->queue);
+  netsim->running = TRUE;
+  netsim->thread = g_thread_new("netsim-sender", sender_thread, netsim);
+  return netsim;
+}
+
+void brilliant_netsim_free(BrilliantNetsim *netsim) {
+  if (!netsim)
+    return;
+  g_mutex_lock(&netsim->lock);
+  netsim->running = FALSE;
+  g_cond_signal(&netsim->cond);
+  g_mutex_unlock(&netsim->lock);
+  g_thread_join(netsim->thread);
+  g_queue_clear_full(&netsim->queue, (GDestroyNotify) free_packet);
+  g_mutex_clear(&netsim->lock);
+  g_cond_clear(&netsim->cond);
+  g_rand_free(netsim->rand);
+  g_free(netsim);
+}
+
+void brilliant_netsim_send(BrilliantNetsim *netsim, GSocket *socket, GSocketAddress *destination,
+                           const guint8 *data, gsize size) {
+  gint64 now = g_get_monotonic_time();
+  g_mutex_lock(&netsim->lock);
+  netsim->stats.packets_in++;
+  if (next_packet_lost(netsim)) {
+    netsim->stats.packets_lost++;
+    g_mutex_unlock(&netsim->lock);
+    return;
+  }
+
+  gint64 due_time = now + (gint64) netsim->config.delay_ms * 1000;
+  if (netsim->config.jitter_ms > 0)
+    due_time += g_rand_int_range(netsim->rand, 0, netsim->config.jitter_ms * 1000 + 1);
+
+  if (chance(netsim, netsim->config.reorder_percent)) {
+    // Overtake whatever is sitting in the delay line
+    due_time = netsim->config.delay_ms > 0 ? now : now + NETSIM_REORDER_HOLD_US;
+    netsim->stats.packets_reordered++;
+  } else {
+    due_time = MAX(due_time, netsim->last_due_time);
+    netsim->last_due_time = due_time;
+  }
+
+  if (netsim->config.bandwidth_kbps > 0) {
+    due_time = MAX(due_time, netsim->link_free_time);
+    if (due_time - now > NETSIM_MAX_BOTTLENECK_DELAY_US) {
+      netsim->stats.packets_lost++;
+      g_mutex_unlock(&netsim->lock);
+      return;
+    }
+    netsim->link_free_time = due_time + (gint64) size * 8000 / netsim->config.bandwidth_kbps;
+  }
+  netsim->stats.max_queue_delay_us = MAX(netsim->stats.max_queue_delay_us, due_time - now);
+
+  NetsimPacket *packet = g_malloc(sizeof(NetsimPacket) + size);
+  packet->due_time = due_time;
+  packet->socket = g_object_ref(socket);
+  packet->destination = g_object_ref(destination);
+  packet->size = size;
+  memcpy(packet->data, data, size);
+  g_queue_insert_sorted(&netsim->queue, packet, compare_due_time, NULL);
+  g_cond_signal(&netsim->cond);
+  g_mutex_unlock(&netsim->lock);
+}
+
+void brilliant_netsim_get_stats(BrilliantNetsim *netsim, BrilliantNetsimStats *stats) {
+  g_mutex_lock(&netsim->lock);
+  *stats = netsim->stats;
+  g_mutex_unlock(&netsim->lock);
+}
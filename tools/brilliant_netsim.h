@@ -0,0 +1,66 @@
+/*****************************************************************************
+ * GStreamerBrilliant: Android Library built with system's GStreamer Implementation. Intended for use in Brilliant Mobile App.
+ *****************************************************************************
+ * Copyright (C) 2022 Brilliant Home Technologies
+ *
+ * Authors: Brilliant iOS Team <android_developer # brilliant.tech>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef GSTREAMERBRILLIANT_BRILLIANT_NETSIM_H
+#define GSTREAMERBRILLIANT_BRILLIANT_NETSIM_H
+#include <gio/gio.h>
+
+/* Network impairment model used by the desktop test tools.
+ *
+ * Every datagram handed to brilliant_netsim_send goes through, in order:
+ *   - random loss, optionally in bursts (two state Gilbert-Elliott model),
+ *   - a fixed delay plus uniformly distributed jitter,
+ *   - optional reordering (the packet skips the delay line),
+ *   - a shared token bucket limiting the link bandwidth.
+ * Packets are then sent from a dedicated thread at their due time.
+ * */
+typedef struct _BrilliantNetsimConfig
+{
+  gdouble loss_percent;         /* Loss probability while in the "good" state */
+  gdouble burst_enter_percent;  /* Probability to move from the good to the bad (burst) state */
+  gdouble burst_exit_percent;   /* Probability to move from the bad back to the good state */
+  gdouble burst_loss_percent;   /* Loss probability while in the bad state */
+  gint delay_ms;                /* Constant one way delay */
+  gint jitter_ms;               /* Maximum additional random delay */
+  gdouble reorder_percent;      /* Probability a packet overtakes the ones queued before it */
+  gint bandwidth_kbps;          /* Link capacity, 0 for unlimited */
+  guint32 seed;                 /* Random seed, so impairment runs are repeatable */
+} BrilliantNetsimConfig;
+
+typedef struct _BrilliantNetsimStats
+{
+  guint64 packets_in;
+  guint64 packets_sent;
+  guint64 packets_lost;
+  guint64 packets_reordered;
+  guint64 bytes_sent;
+  gint64 max_queue_delay_us;
+} BrilliantNetsimStats;
+
+typedef struct _BrilliantNetsim BrilliantNetsim;
+
+BrilliantNetsim *brilliant_netsim_new (const BrilliantNetsimConfig *config);
+void brilliant_netsim_free (BrilliantNetsim *netsim);
+void brilliant_netsim_send (BrilliantNetsim *netsim, GSocket *socket, GSocketAddress *destination,
+    const guint8 *data, gsize size);
+void brilliant_netsim_get_stats (BrilliantNetsim *netsim, BrilliantNetsimStats *stats);
+#endif //GSTREAMERBRILLIANT_BRILLIANT_NETSIM_H
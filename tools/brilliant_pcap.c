@@ -0,0 +1,167 @@
+/*****************************************************************************
+ * GStreamerBrilliant: Android Library built with system's GStreamer Implementation. Intended for use in Brilliant Mobile App.
+ *****************************************************************************
+ * Copyright (C) 2022 Brilliant Home Technologies
+ *
+ * Authors: Brilliant iOS Team <android_developer # brilliant.tech>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include "brilliant_pcap.h"
+
+#define PCAP_MAGIC_MICROSECONDS 0xa1b2c3d4
+#define PCAP_MAGIC_NANOSECONDS 0xa1b23c4d
+#define PCAP_MAX_RECORD_SIZE (256 * 1024)
+
+#define LINKTYPE_NULL 0
+#define LINKTYPE_ETHERNET 1
+#define LINKTYPE_RAW 101
+#define LINKTYPE_LINUX_SLL 113
+
+#define ETHERTYPE_IPV4 0x0800
+#define ETHERTYPE_VLAN 0x8100
+#define IP_PROTOCOL_UDP 17
+
+struct _BrilliantPcap
+{
+  FILE *file;
+  gboolean swapped;             /* File was written with the other byte order */
+  gboolean nanoseconds;
+  guint32 link_type;
+  guint8 *record;
+};
+
+static guint32 read_u32(BrilliantPcap *pcap, const guint8 *bytes) {
+  guint32 value;
+  memcpy(&value, bytes, sizeof(value));
+  return pcap->swapped ? GUINT32_SWAP_LE_BE(value) : value;
+}
+
+static guint16 read_be16(const guint8 *bytes) {
+  return (guint16) (bytes[0] << 8 | bytes[1]);
+}
+
+BrilliantPcap *brilliant_pcap_open(const gchar *path, GError **error) {
+  FILE *file = fopen(path, "rb");
+  if (!file) {
+    g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno), "Cannot open %s: %s",
+                path, g_strerror(errno));
+    return NULL;
+  }
+  guint8 header[24];
+  if (fread(header, 1, sizeof(header), file) != sizeof(header)) {
+    g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "%s is too short to be a capture", path);
+    fclose(file);
+    return NULL;
+  }
+
+  BrilliantPcap *pcap = g_new0(BrilliantPcap, 1);
+  pcap->file = file;
+  guint32 magic;
+  memcpy(&magic, header, sizeof(magic));
+  if (magic == GUINT32_SWAP_LE_BE(PCAP_MAGIC_MICROSECONDS) ||
+      magic == GUINT32_SWAP_LE_BE(PCAP_MAGIC_NANOSECONDS)) {
+    pcap->swapped = TRUE;
+    magic = GUINT32_SWAP_LE_BE(magic);
+  }
+  if (magic != PCAP_MAGIC_MICROSECONDS && magic != PCAP_MAGIC_NANOSECONDS) {
+    g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                "%s is not a pcap file (pcapng captures must be converted with editcap -F pcap)", path);
+    brilliant_pcap_close(pcap);
+    return NULL;
+  }
+  pcap->nanoseconds = magic == PCAP_MAGIC_NANOSECONDS;
+  pcap->link_type = read_u32(pcap, header + 20) & 0xffff;
+  if (pcap->link_type != LINKTYPE_NULL && pcap->link_type != LINKTYPE_ETHERNET &&
+      pcap->link_type != LINKTYPE_RAW && pcap->link_type != LINKTYPE_LINUX_SLL) {
+    g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "%s uses unsupported link type %u",
+                path, pcap->link_type);
+    brilliant_pcap_close(pcap);
+    return NULL;
+  }
+  pcap->record = g_malloc(PCAP_MAX_RECORD_SIZE);
+  return pcap;
+}
+
+void brilliant_pcap_close(BrilliantPcap *pcap) {
+  if (!pcap)
+    return;
+  fclose(pcap->file);
+  g_free(pcap->record);
+  g_free(pcap);
+}
+
+/* Returns the offset of the IPv4 header in a link layer frame, or -1 if it does not carry IPv4 */
+static gssize ip_header_offset(BrilliantPcap *pcap, const guint8 *frame, gsize size) {
+  switch (pcap->link_type) {
+    case LINKTYPE_NULL:
+      // Address family in host byte order of the capturing machine, 2 is AF_INET everywhere
+      return size >= 4 && (frame[0] == 2 || frame[3] == 2) ? 4 : -1;
+    case LINKTYPE_ETHERNET: {
+      gsize offset = 12;
+      if (size >= offset + 2 && read_be16(frame + offset) == ETHERTYPE_VLAN)
+        offset += 4;
+      return size >= offset + 2 && read_be16(frame + offset) == ETHERTYPE_IPV4 ? (gssize) offset + 2 : -1;
+    }
+    case LINKTYPE_RAW:
+      return 0;
+    case LINKTYPE_LINUX_SLL:
+      return size >= 16 && read_be16(frame + 14) == ETHERTYPE_IPV4 ? 16 : -1;
+    default:
+      return -1;
+  }
+}
+
+gboolean brilliant_pcap_next(BrilliantPcap *pcap, BrilliantPcapPacket *packet) {
+  guint8 header[16];
+  while (fread(header, 1, sizeof(header), pcap->file) == sizeof(header)) {
+    guint32 seconds = read_u32(pcap, header);
+    guint32 fraction = read_u32(pcap, header + 4);
+    guint32 captured_size = read_u32(pcap, header + 8);
+    if (captured_size > PCAP_MAX_RECORD_SIZE ||
+        fread(pcap->record, 1, captured_size, pcap->file) != captured_size) {
+      return FALSE;
+    }
+
+    gssize ip_offset = ip_header_offset(pcap, pcap->record, captured_size);
+    if (ip_offset < 0 || (gsize) ip_offset + 20 > captured_size)
+      continue;
+    const guint8 *ip = pcap->record + ip_offset;
+    gsize ip_header_size = (ip[0] & 0x0f) * 4;
+    // Skip anything that is not a complete, unfragmented IPv4 UDP datagram
+    if ((ip[0] >> 4) != 4 || ip[9] != IP_PROTOCOL_UDP || (read_be16(ip + 6) & 0x3fff) != 0)
+      continue;
+    if ((gsize) ip_offset + ip_header_size + 8 > captured_size)
+      continue;
+    const guint8 *udp = ip + ip_header_size;
+    gsize udp_size = read_be16(udp + 4);
+    if (udp_size < 8 || (gsize) (udp - pcap->record) + udp_size > captured_size)
+      continue;
+
+    packet->timestamp_us = (gint64) seconds * G_USEC_PER_SEC +
+        (pcap->nanoseconds ? fraction / 1000 : fraction);
+    packet->source_port = read_be16(udp);
+    packet->destination_port = read_be16(udp + 2);
+    packet->payload = udp + 8;
+    packet->payload_size = udp_size - 8;
+    return TRUE;
+  }
+  return FALSE;
+}
@@ -0,0 +1,45 @@
+/*****************************************************************************
+ * GStreamerBrilliant: Android Library built with system's GStreamer Implementation. Intended for use in Brilliant Mobile App.
+ *****************************************************************************
+ * Copyright (C) 2022 Brilliant Home Technologies
+ *
+ * Authors: Brilliant iOS Team <android_developer # brilliant.tech>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef GSTREAMERBRILLIANT_BRILLIANT_PCAP_H
+#define GSTREAMERBRILLIANT_BRILLIANT_PCAP_H
+#include <glib.h>
+
+/* Minimal reader for classic libpcap capture files, as written by tcpdump or Wireshark
+ * ("pcap", not "pcapng"). Only IPv4 UDP datagrams are returned, everything else in the capture
+ * is skipped. Supported link types: Ethernet, Linux cooked (SLL), raw IP and BSD loopback.
+ * */
+typedef struct _BrilliantPcapPacket
+{
+  gint64 timestamp_us;          /* Capture time, microseconds since the epoch */
+  guint16 source_port;
+  guint16 destination_port;
+  const guint8 *payload;        /* UDP payload, valid until the next call to brilliant_pcap_next */
+  gsize payload_size;
+} BrilliantPcapPacket;
+
+typedef struct _BrilliantPcap BrilliantPcap;
+
+BrilliantPcap *brilliant_pcap_open (const gchar *path, GError **error);
+void brilliant_pcap_close (BrilliantPcap *pcap);
+gboolean brilliant_pcap_next (BrilliantPcap *pcap, BrilliantPcapPacket *packet);
+#endif //GSTREAMERBRILLIANT_BRILLIANT_PCAP_H
@@ -0,0 +1,702 @@
+/*****************************************************************************
+ * GStreamerBrilliant: Android Library built with system's GStreamer Implementation. Intended for use in Brilliant Mobile App.
+ *****************************************************************************
+ * Copyright (C) 2022 Brilliant Home Technologies
+ *
+ * Authors: Brilliant iOS Team <android_developer # brilliant.tech>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+
+/*
+ * Replay benchmark for the receive pipelines.
+ *
+ * custom_rtp: plays the device side of the custom RTP backend from a capture. The benchmark
+ * answers the session's "Start Data" datagrams on --video-port/--audio-port, then replays the
+ * capture's UDP datagrams to the session's local ports with the original timing (scaled by
+ * --speed). Datagrams sent to --capture-video-port/--capture-audio-port in the capture are RTP,
+ * the ones sent to the port above each are RTCP. Captures of plain RTP are SRTP protected on the
+ * fly with --plain-rtp.
+ *
+ * rtsp: plays --uri (typically a local gst-rtsp-server) for --duration seconds.
+ *
+ * Results are printed as a single JSON object so runs can be compared across commits with
+ * tools/compare_bench.py. End-to-end latency is measured per video frame, from the arrival of its
+ * first packet at the video udpsrc (custom_rtp) or at the depayloader (rtsp, where rtspsrc owns the
+ * sockets) to the decoded frame entering the video converter.
+ */
+
+#include <gst/gst.h>
+#include <gst/app/app.h>
+#include <gio/gio.h>
+#include <glib-unix.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include "brilliant_session.h"
+#include "brilliant_pcap.h"
+
+#define START_DATA_MESSAGE "Start Data"
+#define START_DATA_TIMEOUT_SECONDS 10
+#define PIPELINE_READY_TIMEOUT_SECONDS 10
+#define RTP_HEADER_SIZE 12
+#define LOCALHOST "127.0.0.1"
+
+typedef struct _ReplayTrack
+{
+  const gchar *name;
+  int capture_port;             /* Destination port of the track's RTP in the capture */
+  int device_port;              /* Where the session sends "Start Data", replay is sent from here */
+  int local_rtp_port;           /* Session side ports the replay is sent to */
+  int local_rtcp_port;
+  GstBuffer *key;
+  GSocket *socket;
+  GSocketAddress *rtp_destination;
+  GSocketAddress *rtcp_destination;
+  GstElement *encryptor;        /* --plain-rtp only: appsrc ! srtpenc ! appsink */
+  GstElement *encryptor_src;
+  GstElement *encryptor_sink;
+  guint64 sent;
+  guint64 received;
+} ReplayTrack;
+
+typedef struct _Bench
+{
+  CustomData *session;
+  GMainLoop *loop;
+  GMutex lock;
+  GCond cond;
+  GstElement *pipeline;         /* Set once the session reports its pipeline ready */
+  ReplayTrack video;
+  ReplayTrack audio;
+  BrilliantPcap *pcap;
+  GThread *replay_thread;
+  gboolean replay_failed;
+  GPtrArray *jitterbuffers;
+  GHashTable *arrivals;         /* RTP timestamp -> first arrival of a packet of that frame, us */
+  GHashTable *frame_timestamps; /* Depayloaded PTS -> RTP timestamp */
+  GArray *latencies_us;
+  guint64 frames_decoded;
+} Bench;
+
+/* Command line options */
+static gchar *backend = "custom_rtp";
+static gchar *capture_path;
+static gchar *uri;
+static gint duration_seconds = 30;
+static gdouble speed = 1.0;
+static gint drain_ms = 2000;
+static gboolean plain_rtp;
+static gboolean display;
+static gchar *label = "";
+static gchar *output_path;
+static gchar *trace_path;
+static gint capture_video_port = 5000;
+static gint capture_audio_port = 5002;
+static gint video_port = 15000;
+static gint audio_port = 15002;
+static gint local_video_port = 16000;
+static gint local_audio_port = 16002;
+static gchar *video_key_hex;
+static gchar *audio_key_hex;
+static gchar *talkback_key_hex;
+static gint64 video_ssrc = 1111;
+static gint64 audio_ssrc = 2222;
+static gint64 talkback_ssrc = 3333;
+static gint video_payload_type = 96;
+static gint audio_payload_type = 97;
+static gint audio_rate = 16000;
+static gint audio_channels = 1;
+
+static GOptionEntry entries[] = {
+  {"backend", 0, 0, G_OPTION_ARG_STRING, &backend, "Backend to benchmark: custom_rtp or rtsp", "TYPE"},
+  {"capture", 0, 0, G_OPTION_ARG_FILENAME, &capture_path, "pcap capture to replay (custom_rtp)", "FILE"},
+  {"uri", 0, 0, G_OPTION_ARG_STRING, &uri, "RTSP URI to play (rtsp)", "URI"},
+  {"duration", 0, 0, G_OPTION_ARG_INT, &duration_seconds, "How long to play the RTSP URI", "SECONDS"},
+  {"speed", 0, 0, G_OPTION_ARG_DOUBLE, &speed, "Replay speed, 0 sends as fast as possible", "FACTOR"},
+  {"drain", 0, 0, G_OPTION_ARG_INT, &drain_ms, "Time to keep running after the replay ends", "MS"},
+  {"plain-rtp", 0, 0, G_OPTION_ARG_NONE, &plain_rtp, "The capture holds unencrypted RTP, protect it before sending", NULL},
+  {"display", 0, 0, G_OPTION_ARG_NONE, &display, "Render to real sinks instead of fakevideosink/fakeaudiosink", NULL},
+  {"label", 0, 0, G_OPTION_ARG_STRING, &label, "Free form label stored in the results, e.g. a commit", "TEXT"},
+  {"output", 0, 0, G_OPTION_ARG_FILENAME, &output_path, "Write results here instead of stdout", "FILE"},
+  {"trace", 0, 0, G_OPTION_ARG_FILENAME, &trace_path, "Record a Chrome trace of the run into this file", "FILE"},
+  {"capture-video-port", 0, 0, G_OPTION_ARG_INT, &capture_video_port, "Video RTP destination port in the capture", "PORT"},
+  {"capture-audio-port", 0, 0, G_OPTION_ARG_INT, &capture_audio_port, "Audio RTP destination port in the capture", "PORT"},
+  {"video-port", 0, 0, G_OPTION_ARG_INT, &video_port, "Simulated device video port", "PORT"},
+  {"audio-port", 0, 0, G_OPTION_ARG_INT, &audio_port, "Simulated device audio port", "PORT"},
+  {"local-video-port", 0, 0, G_OPTION_ARG_INT, &local_video_port, "Session video RTP port, RTCP is the next one", "PORT"},
+  {"local-audio-port", 0, 0, G_OPTION_ARG_INT, &local_audio_port, "Session audio RTP port, RTCP is the next one", "PORT"},
+  {"video-key", 0, 0, G_OPTION_ARG_STRING, &video_key_hex, "Incoming video SRTP key, hex", "HEX"},
+  {"audio-key", 0, 0, G_OPTION_ARG_STRING, &audio_key_hex, "Incoming audio SRTP key, hex", "HEX"},
+  {"talkback-key", 0, 0, G_OPTION_ARG_STRING, &talkback_key_hex, "Outgoing audio SRTP key, hex (defaults to the audio key)", "HEX"},
+  {"video-ssrc", 0, 0, G_OPTION_ARG_INT64, &video_ssrc, "Incoming video SSRC", "SSRC"},
+  {"audio-ssrc", 0, 0, G_OPTION_ARG_INT64, &audio_ssrc, "Incoming audio SSRC", "SSRC"},
+  {"talkback-ssrc", 0, 0, G_OPTION_ARG_INT64, &talkback_ssrc, "Outgoing audio SSRC", "SSRC"},
+  {"video-pt", 0, 0, G_OPTION_ARG_INT, &video_payload_type, "Video payload type", "PT"},
+  {"audio-pt", 0, 0, G_OPTION_ARG_INT, &audio_payload_type, "Audio payload type", "PT"},
+  {"audio-rate", 0, 0, G_OPTION_ARG_INT, &audio_rate, "Audio sample rate", "HZ"},
+  {"audio-channels", 0, 0, G_OPTION_ARG_INT, &audio_channels, "Audio channels", "N"},
+  {NULL}
+};
+
+static GstBuffer * hex_to_buffer(const gchar *hex) {
+  gsize length = hex ? strlen(hex) / 2 : 0;
+  guint8 *bytes = g_malloc0(MAX(length, 1));
+  for (gsize i = 0; i < length; i++) {
+    gint high = g_ascii_xdigit_value(hex[2 * i]);
+    gint low = g_ascii_xdigit_value(hex[2 * i + 1]);
+    if (high < 0 || low < 0) {
+      g_printerr("Invalid hex key %s\n", hex);
+      g_free(bytes);
+      return NULL;
+    }
+    bytes[i] = (guint8) (high << 4 | low);
+  }
+  return gst_buffer_new_wrapped(bytes, length);
+}
+
+static gboolean read_rtp_timestamp(GstBuffer *buffer, guint32 *timestamp) {
+  guint8 header[RTP_HEADER_SIZE];
+  if (gst_buffer_extract(buffer, 0, header, sizeof(header)) != sizeof(header) || (header[0] >> 6) != 2)
+    return FALSE;
+  *timestamp = (guint32) header[4] << 24 | header[5] << 16 | header[6] << 8 | header[7];
+  return TRUE;
+}
+
+/*
+ * Session callbacks
+ */
+static void bench_set_message(const gchar *message, gpointer user_data) {
+  g_printerr("session: %s\n", message);
+}
+
+static void bench_on_pipeline_ready(GstElement *pipeline, gpointer user_data) {
+  Bench *bench = user_data;
+  g_mutex_lock(&bench->lock);
+  bench->pipeline = pipeline;
+  g_cond_broadcast(&bench->cond);
+  g_mutex_unlock(&bench->lock);
+}
+
+static const BrilliantSessionCallbacks bench_callbacks = {
+  bench_set_message,
+  NULL,
+  NULL,
+  NULL,
+  bench_on_pipeline_ready,
+};
+
+/*
+ * Pipeline instrumentation, probes run on the streaming threads
+ */
+static void record_arrival(Bench *bench, GstBuffer *buffer) {
+  guint32 rtp_timestamp;
+  if (!read_rtp_timestamp(buffer, &rtp_timestamp))
+    return;
+  gpointer key = GUINT_TO_POINTER(rtp_timestamp);
+  if (!g_hash_table_contains(bench->arrivals, key)) {
+    gint64 now = g_get_monotonic_time();
+    g_hash_table_insert(bench->arrivals, key, g_memdup(&now, sizeof(now)));
+  }
+}
+
+static GstPadProbeReturn video_udp_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+  Bench *bench = user_data;
+  g_mutex_lock(&bench->lock);
+  bench->video.received++;
+  record_arrival(bench, GST_PAD_PROBE_INFO_BUFFER(info));
+  g_mutex_unlock(&bench->lock);
+  return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn audio_udp_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+  Bench *bench = user_data;
+  g_mutex_lock(&bench->lock);
+  bench->audio.received++;
+  g_mutex_unlock(&bench->lock);
+  return GST_PAD_PROBE_OK;
+}
+
+/* Depayloader input: RTP packets carrying the PTS the jitterbuffer assigned to their frame */
+static GstPadProbeReturn video_depay_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+  Bench *bench = user_data;
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+  guint32 rtp_timestamp;
+  gint64 pts = (gint64) GST_BUFFER_PTS(buffer);
+  if (!GST_BUFFER_PTS_IS_VALID(buffer) || !read_rtp_timestamp(buffer, &rtp_timestamp))
+    return GST_PAD_PROBE_OK;
+
+  g_mutex_lock(&bench->lock);
+  if (strcmp(backend, backend_type_rtsp) == 0)
+    record_arrival(bench, buffer);
+  if (!g_hash_table_contains(bench->frame_timestamps, &pts)) {
+    g_hash_table_insert(bench->frame_timestamps, g_memdup(&pts, sizeof(pts)),
+                        g_memdup(&rtp_timestamp, sizeof(rtp_timestamp)));
+  }
+  g_mutex_unlock(&bench->lock);
+  return GST_PAD_PROBE_OK;
+}
+
+/* Video converter input: one decoded frame */
+static GstPadProbeReturn decoded_frame_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+  Bench *bench = user_data;
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+  gint64 pts = (gint64) GST_BUFFER_PTS(buffer);
+  gint64 now = g_get_monotonic_time();
+
+  g_mutex_lock(&bench->lock);
+  bench->frames_decoded++;
+  guint32 *rtp_timestamp = GST_BUFFER_PTS_IS_VALID(buffer) ?
+      g_hash_table_lookup(bench->frame_timestamps, &pts) : NULL;
+  if (rtp_timestamp) {
+    gpointer key = GUINT_TO_POINTER(*rtp_timestamp);
+    gint64 *arrival = g_hash_table_lookup(bench->arrivals, key);
+    if (arrival) {
+      gint64 latency = now - *arrival;
+      g_array_append_val(bench->latencies_us, latency);
+      g_hash_table_remove(bench->arrivals, key);
+    }
+    g_hash_table_remove(bench->frame_timestamps, &pts);
+  }
+  g_mutex_unlock(&bench->lock);
+  return GST_PAD_PROBE_OK;
+}
+
+static void on_new_jitterbuffer(GstElement *rtp_bin, GstElement *jitterbuffer, guint session,
+                                guint ssrc, gpointer user_data) {
+  Bench *bench = user_data;
+  g_mutex_lock(&bench->lock);
+  g_ptr_array_add(bench->jitterbuffers, gst_object_ref(jitterbuffer));
+  g_mutex_unlock(&bench->lock);
+}
+
+static void on_new_manager(GstElement *rtsp_src, GstElement *manager, gpointer user_data) {
+  g_signal_connect(manager, "new-jitterbuffer", G_CALLBACK(on_new_jitterbuffer), user_data);
+}
+
+static void probe_element(Bench *bench, const gchar *element_name, const gchar *pad_name,
+                          GstPadProbeCallback callback) {
+  GstElement *element = gst_bin_get_by_name(GST_BIN(bench->pipeline), element_name);
+  if (!element) {
+    g_printerr("Element %s not found, its counters will stay at zero\n", element_name);
+    return;
+  }
+  GstPad *pad = gst_element_get_static_pad(element, pad_name);
+  gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, callback, bench, NULL);
+  gst_object_unref(pad);
+  gst_object_unref(element);
+}
+
+/* The custom RTP receive elements only exist once play has completed the track setup */
+static void instrument_pipeline(Bench *bench) {
+  if (strcmp(backend, backend_type_custom_rtp) == 0) {
+    GstElement *rtp_bin = gst_bin_get_by_name(GST_BIN(bench->pipeline), "incoming_video_manager");
+    g_signal_connect(rtp_bin, "new-jitterbuffer", G_CALLBACK(on_new_jitterbuffer), bench);
+    gst_object_unref(rtp_bin);
+    probe_element(bench, "rtp_video_udp_src", "src", video_udp_probe);
+    probe_element(bench, "rtp_audio_udp_src", "src", audio_udp_probe);
+  } else {
+    GstElement *rtsp_src = gst_bin_get_by_name(GST_BIN(bench->pipeline), "rtspsrc");
+    g_signal_connect(rtsp_src, "new-manager", G_CALLBACK(on_new_manager), bench);
+    gst_object_unref(rtsp_src);
+  }
+  probe_element(bench, "video_depay", "sink", video_depay_probe);
+  probe_element(bench, "video_convert", "sink", decoded_frame_probe);
+}
+
+/*
+ * Replay, runs on its own thread
+ */
+static gboolean wait_for_start_data(ReplayTrack *track) {
+  guint8 datagram[2048];
+  g_socket_set_timeout(track->socket, START_DATA_TIMEOUT_SECONDS);
+  while (TRUE) {
+    GError *error = NULL;
+    gssize size = g_socket_receive(track->socket, (gchar *) datagram, sizeof(datagram), NULL, &error);
+    if (size < 0) {
+      g_printerr("%s: no \"Start Data\" from the session: %s\n", track->name, error->message);
+      g_clear_error(&error);
+      return FALSE;
+    }
+    if (size == strlen(START_DATA_MESSAGE) && memcmp(datagram, START_DATA_MESSAGE, size) == 0)
+      return TRUE;
+  }
+}
+
+static GstElement * build_encryptor(ReplayTrack *track) {
+  GError *error = NULL;
+  GstElement *pipeline = gst_parse_launch(
+      "appsrc name=src format=time caps=application/x-rtp ! "
+      "srtpenc name=enc rtp-cipher=aes-128-icm rtp-auth=hmac-sha1-80 ! "
+      "appsink name=out sync=false", &error);
+  if (error) {
+    g_printerr("Unable to build %s encryptor: %s\n", track->name, error->message);
+    g_clear_error(&error);
+    return NULL;
+  }
+  GstElement *srtp_enc = gst_bin_get_by_name(GST_BIN(pipeline), "enc");
+  g_object_set(srtp_enc, "key", track->key, NULL);
+  gst_object_unref(srtp_enc);
+  track->encryptor_src = gst_bin_get_by_name(GST_BIN(pipeline), "src");
+  track->encryptor_sink = gst_bin_get_by_name(GST_BIN(pipeline), "out");
+  gst_element_set_state(pipeline, GST_STATE_PLAYING);
+  return pipeline;
+}
+
+static void send_datagram(ReplayTrack *track, GSocketAddress *destination, const guint8 *data, gsize size) {
+  GError *error = NULL;
+  if (g_socket_send_to(track->socket, destination, (const gchar *) data, size, NULL, &error) < 0) {
+    g_printerr("%s: send failed: %s\n", track->name, error->message);
+    g_clear_error(&error);
+  }
+}
+
+static void replay_rtp(Bench *bench, ReplayTrack *track, const guint8 *data, gsize size) {
+  if (!track->encryptor) {
+    send_datagram(track, track->rtp_destination, data, size);
+  } else {
+    // srtpenc works on one packet at a time, so the next sample is always this packet
+    gst_app_src_push_buffer(GST_APP_SRC(track->encryptor_src),
+                            gst_buffer_new_wrapped(g_memdup(data, size), size));
+    GstSample *sample = gst_app_sink_try_pull_sample(GST_APP_SINK(track->encryptor_sink), GST_SECOND);
+    if (!sample)
+      return;
+    GstBuffer *buffer = gst_sample_get_buffer(sample);
+    GstMapInfo map;
+    if (gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+      send_datagram(track, track->rtp_destination, map.data, map.size);
+      gst_buffer_unmap(buffer, &map);
+    }
+    gst_sample_unref(sample);
+  }
+  g_mutex_lock(&bench->lock);
+  track->sent++;
+  g_mutex_unlock(&bench->lock);
+}
+
+static gboolean quit_loop(Bench *bench) {
+  g_main_loop_quit(bench->loop);
+  return G_SOURCE_REMOVE;
+}
+
+static gpointer replay_thread(gpointer user_data) {
+  Bench *bench = user_data;
+  // Both tracks send "Start Data" once the session pipeline is PLAYING, and repeat it until
+  // media arrives; the repeats are left unread
+  if (!wait_for_start_data(&bench->video) || !wait_for_start_data(&bench->audio)) {
+    bench->replay_failed = TRUE;
+    g_idle_add((GSourceFunc) quit_loop, bench);
+    return NULL;
+  }
+
+  BrilliantPcapPacket packet;
+  gint64 first_capture_time = -1;
+  gint64 start_time = g_get_monotonic_time();
+  while (g_main_loop_is_running(bench->loop) && brilliant_pcap_next(bench->pcap, &packet)) {
+    if (first_capture_time < 0)
+      first_capture_time = packet.timestamp_us;
+    if (speed > 0) {
+      gint64 due_time = start_time + (gint64) ((packet.timestamp_us - first_capture_time) / speed);
+      gint64 wait = due_time - g_get_monotonic_time();
+      if (wait > 0)
+        g_usleep(wait);
+    }
+
+    if (packet.destination_port == bench->video.capture_port) {
+      replay_rtp(bench, &bench->video, packet.payload, packet.payload_size);
+    } else if (packet.destination_port == bench->audio.capture_port) {
+      replay_rtp(bench, &bench->audio, packet.payload, packet.payload_size);
+    } else if (packet.destination_port == bench->video.capture_port + 1) {
+      send_datagram(&bench->video, bench->video.rtcp_destination, packet.payload, packet.payload_size);
+    } else if (packet.destination_port == bench->audio.capture_port + 1) {
+      send_datagram(&bench->audio, bench->audio.rtcp_destination, packet.payload, packet.payload_size);
+    }
+  }
+  g_timeout_add(drain_ms, (GSourceFunc) quit_loop, bench);
+  return NULL;
+}
+
+static gboolean set_up_track(ReplayTrack *track, const gchar *name, int capture_port, int device_port,
+                             int local_rtp_port, GstBuffer *key) {
+  track->name = name;
+  track->capture_port = capture_port;
+  track->device_port = device_port;
+  track->local_rtp_port = local_rtp_port;
+  track->local_rtcp_port = local_rtp_port + 1;
+  track->key = key;
+
+  GError *error = NULL;
+  track->socket = g_socket_new(G_SOCKET_FAMILY_IPV4, G_SOCKET_TYPE_DATAGRAM, G_SOCKET_PROTOCOL_UDP, &error);
+  if (!track->socket) {
+    g_printerr("Failed to create %s socket: %s\n", name, error->message);
+    g_clear_error(&error);
+    return FALSE;
+  }
+  GInetAddress *localhost = g_inet_address_new_from_string(LOCALHOST);
+  GSocketAddress *bind_address = g_inet_socket_address_new(localhost, device_port);
+  gboolean bound = g_socket_bind(track->socket, bind_address, TRUE, &error);
+  track->rtp_destination = g_inet_socket_address_new(localhost, track->local_rtp_port);
+  track->rtcp_destination = g_inet_socket_address_new(localhost, track->local_rtcp_port);
+  g_object_unref(bind_address);
+  g_object_unref(localhost);
+  if (!bound) {
+    g_printerr("Failed to bind %s:%d: %s\n", LOCALHOST, device_port, error->message);
+    g_clear_error(&error);
+    return FALSE;
+  }
+  if (plain_rtp && !(track->encryptor = build_encryptor(track)))
+    return FALSE;
+  return TRUE;
+}
+
+static void cleanup_track(ReplayTrack *track) {
+  if (track->encryptor) {
+    gst_element_set_state(track->encryptor, GST_STATE_NULL);
+    gst_object_unref(track->encryptor_src);
+    gst_object_unref(track->encryptor_sink);
+    gst_object_unref(track->encryptor);
+  }
+  g_clear_object(&track->socket);
+  g_clear_object(&track->rtp_destination);
+  g_clear_object(&track->rtcp_destination);
+}
+
+static void configure_custom_rtp_session(Bench *bench, GstBuffer *talkback_key) {
+  GstMapInfo map;
+  gst_buffer_map(bench->video.key, &map, GST_MAP_READ);
+  brilliant_session_set_rtp_track_properties(bench->session, "incoming_video", LOCALHOST,
+      video_port, map.data, map.size, (uint32_t) video_ssrc, 90000, video_payload_type, 1);
+  gst_buffer_unmap(bench->video.key, &map);
+  gst_buffer_map(bench->audio.key, &map, GST_MAP_READ);
+  brilliant_session_set_rtp_track_properties(bench->session, "incoming_audio", LOCALHOST,
+      audio_port, map.data, map.size, (uint32_t) audio_ssrc, audio_rate, audio_payload_type,
+      audio_channels);
+  gst_buffer_unmap(bench->audio.key, &map);
+  gst_buffer_map(talkback_key, &map, GST_MAP_READ);
+  brilliant_session_set_rtp_track_properties(bench->session, "outgoing_audio", LOCALHOST,
+      audio_port, map.data, map.size, (uint32_t) talkback_ssrc, audio_rate, audio_payload_type,
+      audio_channels);
+  gst_buffer_unmap(talkback_key, &map);
+  brilliant_session_set_rtp_local_ports(bench->session, local_video_port, local_video_port + 1,
+                                        local_audio_port, local_audio_port + 1);
+}
+
+static gint compare_int64(gconstpointer a, gconstpointer b) {
+  gint64 value_a = *(const gint64 *) a;
+  gint64 value_b = *(const gint64 *) b;
+  return value_a < value_b ? -1 : value_a > value_b;
+}
+
+static gdouble latency_percentile_ms(GArray *sorted, gdouble percentile) {
+  if (sorted->len == 0)
+    return 0;
+  guint index = MIN(sorted->len - 1, (guint) (percentile / 100.0 * sorted->len));
+  return g_array_index(sorted, gint64, index) / 1000.0;
+}
+
+static gint64 cpu_time_us(const struct rusage *usage) {
+  return (gint64) (usage->ru_utime.tv_sec + usage->ru_stime.tv_sec) * G_USEC_PER_SEC +
+      usage->ru_utime.tv_usec + usage->ru_stime.tv_usec;
+}
+
+static gchar * build_results(Bench *bench, gint64 wall_time_us, gint64 cpu_us, glong peak_rss_kb) {
+  guint64 pushed = 0, lost = 0, late = 0, duplicates = 0;
+  for (guint i = 0; i < bench->jitterbuffers->len; i++) {
+    GstStructure *stats = NULL;
+    guint64 value;
+    g_object_get(g_ptr_array_index(bench->jitterbuffers, i), "stats", &stats, NULL);
+    if (!stats)
+      continue;
+    if (gst_structure_get_uint64(stats, "num-pushed", &value))
+      pushed += value;
+    if (gst_structure_get_uint64(stats, "num-lost", &value))
+      lost += value;
+    if (gst_structure_get_uint64(stats, "num-late", &value))
+      late += value;
+    if (gst_structure_get_uint64(stats, "num-duplicates", &value))
+      duplicates += value;
+    gst_structure_free(stats);
+  }
+
+  g_array_sort(bench->latencies_us, compare_int64);
+  guint64 sent = bench->video.sent + bench->audio.sent;
+  guint64 received = bench->video.received + bench->audio.received;
+  gchar *escaped_label = g_strescape(label, NULL);
+  gchar *results = g_strdup_printf(
+      "{\"label\": \"%s\", \"backend\": \"%s\", \"speed\": %.2f, \"wall_time_s\": %.3f, "
+      "\"cpu_time_s\": %.3f, \"frames_decoded\": %" G_GUINT64_FORMAT ", \"cpu_us_per_frame\": %.1f, "
+      "\"peak_rss_kb\": %ld, "
+      "\"packets\": {\"video_sent\": %" G_GUINT64_FORMAT ", \"video_received\": %" G_GUINT64_FORMAT
+      ", \"audio_sent\": %" G_GUINT64_FORMAT ", \"audio_received\": %" G_GUINT64_FORMAT
+      ", \"dropped\": %" G_GUINT64_FORMAT "}, "
+      "\"jitterbuffer\": {\"pushed\": %" G_GUINT64_FORMAT ", \"lost\": %" G_GUINT64_FORMAT
+      ", \"late\": %" G_GUINT64_FORMAT ", \"duplicates\": %" G_GUINT64_FORMAT "}, "
+      "\"latency_ms\": {\"samples\": %u, \"p50\": %.1f, \"p95\": %.1f, \"p99\": %.1f, \"max\": %.1f}}\n",
+      escaped_label, backend, speed, wall_time_us / 1e6, cpu_us / 1e6, bench->frames_decoded,
+      bench->frames_decoded ? (gdouble) cpu_us / bench->frames_decoded : 0.0, peak_rss_kb,
+      bench->video.sent, bench->video.received, bench->audio.sent, bench->audio.received,
+      sent > received ? sent - received : 0,
+      pushed, lost, late, duplicates,
+      bench->latencies_us->len,
+      latency_percentile_ms(bench->latencies_us, 50), latency_percentile_ms(bench->latencies_us, 95),
+      latency_percentile_ms(bench->latencies_us, 99), latency_percentile_ms(bench->latencies_us, 100));
+  g_free(escaped_label);
+  return results;
+}
+
+static gboolean on_sigint(Bench *bench) {
+  g_main_loop_quit(bench->loop);
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean check_options(void) {
+  if (strcmp(backend, backend_type_custom_rtp) == 0) {
+    if (!capture_path || !video_key_hex || !audio_key_hex) {
+      g_printerr("custom_rtp needs --capture, --video-key and --audio-key\n");
+      return FALSE;
+    }
+  } else if (strcmp(backend, backend_type_rtsp) == 0) {
+    if (!uri) {
+      g_printerr("rtsp needs --uri\n");
+      return FALSE;
+    }
+  } else {
+    g_printerr("Unknown backend %s\n", backend);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+int main(int argc, char *argv[]) {
+  GError *error = NULL;
+  GOptionContext *context = g_option_context_new("- replay benchmark for the receive pipelines");
+  g_option_context_add_main_entries(context, entries, NULL);
+  g_option_context_add_group(context, gst_init_get_option_group());
+  if (!g_option_context_parse(context, &argc, &argv, &error)) {
+    g_printerr("%s\n", error->message);
+    g_clear_error(&error);
+    g_option_context_free(context);
+    return 1;
+  }
+  g_option_context_free(context);
+  if (!check_options())
+    return 1;
+  // autovideosink/autoaudiosink pick the highest ranked sink, so this keeps rendering out of
+  // the measurement (and lets the benchmark run headless)
+  if (!display)
+    g_setenv("GST_PLUGIN_FEATURE_RANK", "fakevideosink:MAX,fakeaudiosink:MAX", FALSE);
+
+  Bench bench = { 0 };
+  g_mutex_init(&bench.lock);
+  g_cond_init(&bench.cond);
+  bench.loop = g_main_loop_new(NULL, FALSE);
+  bench.jitterbuffers = g_ptr_array_new_with_free_func(gst_object_unref);
+  bench.arrivals = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+  bench.frame_timestamps = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, g_free);
+  bench.latencies_us = g_array_new(FALSE, FALSE, sizeof(gint64));
+
+  int result = 1;
+  GstBuffer *talkback_key = NULL;
+  if (strcmp(backend, backend_type_custom_rtp) == 0) {
+    bench.pcap = brilliant_pcap_open(capture_path, &error);
+    if (!bench.pcap) {
+      g_printerr("%s\n", error->message);
+      g_clear_error(&error);
+      goto done;
+    }
+    GstBuffer *video_key = hex_to_buffer(video_key_hex);
+    GstBuffer *audio_key = hex_to_buffer(audio_key_hex);
+    talkback_key = hex_to_buffer(talkback_key_hex ? talkback_key_hex : audio_key_hex);
+    if (!set_up_track(&bench.video, "video", capture_video_port, video_port, local_video_port, video_key) ||
+        !set_up_track(&bench.audio, "audio", capture_audio_port, audio_port, local_audio_port, audio_key) ||
+        !talkback_key) {
+      goto done;
+    }
+  }
+
+  struct rusage start_usage, end_usage;
+  getrusage(RUSAGE_SELF, &start_usage);
+  gint64 start_time = g_get_monotonic_time();
+  if (trace_path)
+    brilliant_session_start_trace(0);
+  bench.session = brilliant_session_new(backend, &bench_callbacks, &bench);
+  // Without --display the fake sinks need no window; real ones open their own, no surface comes
+  if (display)
+    brilliant_session_use_own_window(bench.session);
+
+  // Track properties and play must wait until the session thread has built the pipeline
+  gint64 ready_deadline = g_get_monotonic_time() + PIPELINE_READY_TIMEOUT_SECONDS * G_TIME_SPAN_SECOND;
+  g_mutex_lock(&bench.lock);
+  while (!bench.pipeline && g_cond_wait_until(&bench.cond, &bench.lock, ready_deadline));
+  g_mutex_unlock(&bench.lock);
+  if (!bench.pipeline) {
+    g_printerr("The session did not build its pipeline\n");
+    goto done;
+  }
+
+  if (strcmp(backend, backend_type_custom_rtp) == 0) {
+    configure_custom_rtp_session(&bench, talkback_key);
+  } else {
+    brilliant_session_set_uri(bench.session, uri);
+    g_timeout_add_seconds(duration_seconds, (GSourceFunc) quit_loop, &bench);
+  }
+  brilliant_session_play(bench.session);
+  instrument_pipeline(&bench);
+  if (bench.pcap)
+    bench.replay_thread = g_thread_new("replay", replay_thread, &bench);
+
+  g_unix_signal_add(SIGINT, (GSourceFunc) on_sigint, &bench);
+  g_main_loop_run(bench.loop);
+  if (bench.replay_thread)
+    g_thread_join(bench.replay_thread);
+
+  getrusage(RUSAGE_SELF, &end_usage);
+  gint64 wall_time_us = g_get_monotonic_time() - start_time;
+  if (trace_path)
+    brilliant_session_stop_trace(trace_path);
+  g_mutex_lock(&bench.lock);
+  gchar *results = build_results(&bench, wall_time_us,
+                                 cpu_time_us(&end_usage) - cpu_time_us(&start_usage),
+                                 end_usage.ru_maxrss);
+  g_mutex_unlock(&bench.lock);
+  if (!output_path) {
+    g_print("%s", results);
+  } else if (!g_file_set_contents(output_path, results, -1, &error)) {
+    g_printerr("%s\n", error->message);
+    g_clear_error(&error);
+  }
+  g_free(results);
+  result = bench.replay_failed ? 1 : 0;
+
+done:
+  brilliant_session_free(bench.session);
+  cleanup_track(&bench.video);
+  cleanup_track(&bench.audio);
+  brilliant_pcap_close(bench.pcap);
+  if (bench.video.key)
+    gst_buffer_unref(bench.video.key);
+  if (bench.audio.key)
+    gst_buffer_unref(bench.audio.key);
+  if (talkback_key)
+    gst_buffer_unref(talkback_key);
+  g_ptr_array_free(bench.jitterbuffers, TRUE);
+  g_hash_table_destroy(bench.arrivals);
+  g_hash_table_destroy(bench.frame_timestamps);
+  g_array_free(bench.latencies_us, TRUE);
+  g_main_loop_unref(bench.loop);
+  g_mutex_clear(&bench.lock);
+  g_cond_clear(&bench.cond);
+  return result;
+}
@@ -0,0 +1,333 @@
+/*****************************************************************************
+ * GStreamerBrilliant: Android Library built with system's GStreamer Implementation. Intended for use in Brilliant Mobile App.
+ *****************************************************************************
+ * Copyright (C) 2022 Brilliant Home Technologies
+ *
+ * Authors: Brilliant iOS Team <android_developer # brilliant.tech>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+
+/*
+ * Soak test for session setup and teardown.
+ *
+ * Opens a session, plays it for --play-ms and frees it, --iterations times, with allocation
+ * accounting enabled. The first --warmup iterations let GStreamer create its lazily allocated
+ * singletons and let the allocator settle; after that, every GstObject, GstMiniObject and byte of
+ * GstMemory still alive at the end was left behind by a session. Exits non-zero if any are, or if
+ * the resident set grew by more than --max-rss-growth kilobytes after the warm-up.
+ *
+ * custom_rtp sessions send their "Start Data" datagrams to --server, so pointing the test at a
+ * running brilliant-camera-simulator also exercises the streaming paths; without one, only setup
+ * and teardown are covered. rtsp sessions play --uri.
+ *
+ * With --pooled, each session is prewarmed first and taken from the pool, and the test fails if
+ * a session does not come from the pool or never reports itself initialized to its owner.
+ */
+
+#include <gst/gst.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "brilliant_session.h"
+
+#define PIPELINE_READY_TIMEOUT_SECONDS 10
+#define INITIALIZED_TIMEOUT_SECONDS 5
+/* 30 bytes, an AES-128 key and salt */
+#define DEFAULT_KEY_HEX "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d"
+
+typedef struct _Soak
+{
+  GMutex lock;
+  GCond cond;
+  GstElement *pipeline;         /* Set once the current session reports its pipeline ready */
+  gboolean initialized;         /* Set once the current session reports it is initialized */
+} Soak;
+
+/* Command line options */
+static gchar *backend = "custom_rtp";
+static gchar *uri;
+static gint iterations = 200;
+static gint warmup = 10;
+static gint play_ms = 2000;
+static gint max_rss_growth_kb = 2048;
+static gboolean verbose;
+static gboolean pooled;
+static gint pool_settle_ms = 1000;
+static gchar *server = "127.0.0.1";
+static gint video_port = 5000;
+static gint audio_port = 5002;
+static gint local_video_port = 16000;
+static gint local_audio_port = 16002;
+static gchar *video_key_hex = DEFAULT_KEY_HEX;
+static gchar *audio_key_hex = DEFAULT_KEY_HEX;
+static gchar *talkback_key_hex = DEFAULT_KEY_HEX;
+static gint64 video_ssrc = 1111;
+static gint64 audio_ssrc = 2222;
+static gint64 talkback_ssrc = 3333;
+static gint video_payload_type = 96;
+static gint audio_payload_type = 97;
+static gint audio_rate = 16000;
+static gint audio_channels = 1;
+
+static GOptionEntry entries[] = {
+  {"backend", 0, 0, G_OPTION_ARG_STRING, &backend, "Backend to soak: custom_rtp or rtsp", "TYPE"},
+  {"uri", 0, 0, G_OPTION_ARG_STRING, &uri, "RTSP URI to play (rtsp)", "URI"},
+  {"iterations", 0, 0, G_OPTION_ARG_INT, &iterations, "Sessions to open and close, warm-up included", "N"},
+  {"warmup", 0, 0, G_OPTION_ARG_INT, &warmup, "Sessions before the baseline is taken", "N"},
+  {"play-ms", 0, 0, G_OPTION_ARG_INT, &play_ms, "How long each session plays", "MS"},
+  {"max-rss-growth", 0, 0, G_OPTION_ARG_INT, &max_rss_growth_kb, "Allowed resident set growth after the warm-up", "KB"},
+  {"verbose", 0, 0, G_OPTION_ARG_NONE, &verbose, "Print the objects each session left behind", NULL},
+  {"pooled", 0, 0, G_OPTION_ARG_NONE, &pooled, "Take every session from the pool of prewarmed sessions", NULL},
+  {"pool-settle-ms", 0, 0, G_OPTION_ARG_INT, &pool_settle_ms, "How long a prewarmed session gets to reach READY", "MS"},
+  {"server", 0, 0, G_OPTION_ARG_STRING, &server, "Device address custom_rtp sessions connect to", "ADDRESS"},
+  {"video-port", 0, 0, G_OPTION_ARG_INT, &video_port, "Device video port", "PORT"},
+  {"audio-port", 0, 0, G_OPTION_ARG_INT, &audio_port, "Device audio port", "PORT"},
+  {"local-video-port", 0, 0, G_OPTION_ARG_INT, &local_video_port, "Session video RTP port, RTCP is the next one", "PORT"},
+  {"local-audio-port", 0, 0, G_OPTION_ARG_INT, &local_audio_port, "Session audio RTP port, RTCP is the next one", "PORT"},
+  {"video-key", 0, 0, G_OPTION_ARG_STRING, &video_key_hex, "Incoming video SRTP key, hex", "HEX"},
+  {"audio-key", 0, 0, G_OPTION_ARG_STRING, &audio_key_hex, "Incoming audio SRTP key, hex", "HEX"},
+  {"talkback-key", 0, 0, G_OPTION_ARG_STRING, &talkback_key_hex, "Outgoing audio SRTP key, hex", "HEX"},
+  {"video-ssrc", 0, 0, G_OPTION_ARG_INT64, &video_ssrc, "Incoming video SSRC", "SSRC"},
+  {"audio-ssrc", 0, 0, G_OPTION_ARG_INT64, &audio_ssrc, "Incoming audio SSRC", "SSRC"},
+  {"talkback-ssrc", 0, 0, G_OPTION_ARG_INT64, &talkback_ssrc, "Outgoing audio SSRC", "SSRC"},
+  {"video-pt", 0, 0, G_OPTION_ARG_INT, &video_payload_type, "Video payload type", "PT"},
+  {"audio-pt", 0, 0, G_OPTION_ARG_INT, &audio_payload_type, "Audio payload type", "PT"},
+  {"audio-rate", 0, 0, G_OPTION_ARG_INT, &audio_rate, "Audio sample rate", "HZ"},
+  {"audio-channels", 0, 0, G_OPTION_ARG_INT, &audio_channels, "Audio channels", "N"},
+  {NULL}
+};
+
+static GBytes * hex_to_bytes(const gchar *hex) {
+  gsize length = strlen(hex) / 2;
+  guint8 *bytes = g_malloc0(MAX(length, 1));
+  for (gsize i = 0; i < length; i++) {
+    gint high = g_ascii_xdigit_value(hex[2 * i]);
+    gint low = g_ascii_xdigit_value(hex[2 * i + 1]);
+    if (high < 0 || low < 0) {
+      g_printerr("Invalid hex key %s\n", hex);
+      g_free(bytes);
+      return NULL;
+    }
+    bytes[i] = (guint8) (high << 4 | low);
+  }
+  return g_bytes_new_take(bytes, length);
+}
+
+static glong resident_set_kb(void) {
+  gchar *statm = NULL;
+  glong size_pages = 0, resident_pages = 0;
+  if (g_file_get_contents("/proc/self/statm", &statm, NULL, NULL))
+    sscanf(statm, "%ld %ld", &size_pages, &resident_pages);
+  g_free(statm);
+  return resident_pages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/*
+ * Session callbacks
+ */
+static void soak_set_message(const gchar *message, gpointer user_data) {
+  if (verbose)
+    g_printerr("session: %s\n", message);
+}
+
+static void soak_on_initialized(const gchar *backend_type, gpointer user_data) {
+  Soak *soak = user_data;
+  g_mutex_lock(&soak->lock);
+  soak->initialized = TRUE;
+  g_cond_broadcast(&soak->cond);
+  g_mutex_unlock(&soak->lock);
+}
+
+static void soak_on_pipeline_ready(GstElement *pipeline, gpointer user_data) {
+  Soak *soak = user_data;
+  g_mutex_lock(&soak->lock);
+  soak->pipeline = pipeline;
+  g_cond_broadcast(&soak->cond);
+  g_mutex_unlock(&soak->lock);
+}
+
+static const BrilliantSessionCallbacks soak_callbacks = {
+  soak_set_message,
+  NULL,
+  soak_on_initialized,
+  NULL,
+  soak_on_pipeline_ready,
+};
+
+static void set_track(CustomData *session, const gchar *track_name, int port, GBytes *key,
+                      gint64 ssrc, int sample_rate, int payload_type, int channels) {
+  gsize key_len;
+  const guint8 *key_data = g_bytes_get_data(key, &key_len);
+  brilliant_session_set_rtp_track_properties(session, track_name, server, port, key_data, key_len,
+                                             (uint32_t) ssrc, sample_rate, payload_type, channels);
+}
+
+/* Open a session, play it for play_ms and free it. FALSE if the pipeline never got built, or with
+ * --pooled if the session did not come from the pool or was never reported initialized. */
+static gboolean run_session(Soak *soak, GBytes *video_key, GBytes *audio_key, GBytes *talkback_key) {
+  g_mutex_lock(&soak->lock);
+  soak->pipeline = NULL;
+  soak->initialized = FALSE;
+  g_mutex_unlock(&soak->lock);
+  if (pooled) {
+    if (!brilliant_session_prewarm(backend)) {
+      g_printerr("Could not prewarm a session\n");
+      return FALSE;
+    }
+    g_usleep((gulong) pool_settle_ms * 1000);
+  }
+  CustomData *session = brilliant_session_new(backend, &soak_callbacks, soak);
+  // A pooled session is adopted, and reports its pipeline ready, before brilliant_session_new returns
+  g_mutex_lock(&soak->lock);
+  gboolean from_pool = soak->pipeline != NULL;
+  g_mutex_unlock(&soak->lock);
+  if (pooled && !from_pool) {
+    g_printerr("The session was not taken from the pool, try a longer --pool-settle-ms\n");
+    brilliant_session_free(session);
+    return FALSE;
+  }
+
+  // Track properties and play must wait until the session thread has built the pipeline
+  gint64 ready_deadline = g_get_monotonic_time() + PIPELINE_READY_TIMEOUT_SECONDS * G_TIME_SPAN_SECOND;
+  g_mutex_lock(&soak->lock);
+  while (!soak->pipeline && g_cond_wait_until(&soak->cond, &soak->lock, ready_deadline));
+  gboolean ready = soak->pipeline != NULL;
+  gint64 initialized_deadline = g_get_monotonic_time() + INITIALIZED_TIMEOUT_SECONDS * G_TIME_SPAN_SECOND;
+  while (ready && !soak->initialized &&
+         g_cond_wait_until(&soak->cond, &soak->lock, initialized_deadline));
+  gboolean initialized = soak->initialized;
+  g_mutex_unlock(&soak->lock);
+  if (ready && !initialized) {
+    g_printerr("The session never reported itself initialized\n");
+    brilliant_session_free(session);
+    return FALSE;
+  }
+
+  if (ready) {
+    if (strcmp(backend, backend_type_custom_rtp) == 0) {
+      set_track(session, "incoming_video", video_port, video_key, video_ssrc, 90000,
+                video_payload_type, 1);
+      set_track(session, "incoming_audio", audio_port, audio_key, audio_ssrc, audio_rate,
+                audio_payload_type, audio_channels);
+      set_track(session, "outgoing_audio", audio_port, talkback_key, talkback_ssrc, audio_rate,
+                audio_payload_type, audio_channels);
+      brilliant_session_set_rtp_local_ports(session, local_video_port, local_video_port + 1,
+                                            local_audio_port, local_audio_port + 1);
+    } else {
+      brilliant_session_set_uri(session, uri);
+    }
+    brilliant_session_play(session);
+    g_usleep((gulong) play_ms * 1000);
+  } else {
+    g_printerr("The session did not build its pipeline\n");
+  }
+  brilliant_session_free(session);
+  return ready;
+}
+
+static gboolean check_options(void) {
+  if (strcmp(backend, backend_type_rtsp) == 0) {
+    if (!uri) {
+      g_printerr("rtsp needs --uri\n");
+      return FALSE;
+    }
+  } else if (strcmp(backend, backend_type_custom_rtp) != 0) {
+    g_printerr("Unknown backend %s\n", backend);
+    return FALSE;
+  }
+  if (warmup < 0 || iterations <= warmup) {
+    g_printerr("--iterations must be larger than --warmup\n");
+    return FALSE;
+  }
+  return TRUE;
+}
+
+int main(int argc, char *argv[]) {
+  GError *error = NULL;
+  GOptionContext *context = g_option_context_new("- open and close sessions, checking for leaks");
+  g_option_context_add_main_entries(context, entries, NULL);
+  g_option_context_add_group(context, gst_init_get_option_group());
+  if (!g_option_context_parse(context, &argc, &argv, &error)) {
+    g_printerr("%s\n", error->message);
+    g_clear_error(&error);
+    g_option_context_free(context);
+    return 1;
+  }
+  g_option_context_free(context);
+  if (!check_options())
+    return 1;
+  // Keep rendering out of the way, the test runs headless
+  g_setenv("GST_PLUGIN_FEATURE_RANK", "fakevideosink:MAX,fakeaudiosink:MAX", FALSE);
+
+  GBytes *video_key = hex_to_bytes(video_key_hex);
+  GBytes *audio_key = hex_to_bytes(audio_key_hex);
+  GBytes *talkback_key = hex_to_bytes(talkback_key_hex);
+  if (!video_key || !audio_key || !talkback_key)
+    return 1;
+
+  Soak soak = { 0 };
+  g_mutex_init(&soak.lock);
+  g_cond_init(&soak.cond);
+  brilliant_session_set_allocation_accounting(TRUE);
+
+  gboolean failed = FALSE;
+  guint64 baseline = 0;
+  glong baseline_rss_kb = 0;
+  gint leaking_sessions = 0;
+  for (gint i = 0; i < iterations && !failed; i++) {
+    if (i == warmup) {
+      baseline = brilliant_alloc_tracker_checkpoint();
+      baseline_rss_kb = resident_set_kb();
+    }
+    failed = !run_session(&soak, video_key, audio_key, talkback_key);
+    gchar *report = brilliant_session_get_allocation_report();
+    if (report && i >= warmup) {
+      leaking_sessions++;
+      if (verbose)
+        g_printerr("Session %d left behind (type count bytes):\n%s", i, report);
+    }
+    g_free(report);
+    if (verbose)
+      g_printerr("Session %d done, rss %ld kB\n", i, resident_set_kb());
+  }
+
+  BrilliantAllocCounts leftover;
+  brilliant_alloc_tracker_get_counts(baseline, &leftover);
+  gchar *leftover_types = brilliant_alloc_tracker_describe(baseline);
+  glong rss_growth_kb = resident_set_kb() - baseline_rss_kb;
+  g_print("{\"backend\": \"%s\", \"iterations\": %d, \"warmup\": %d, \"leaking_sessions\": %d, "
+          "\"leftover_objects\": %" G_GINT64_FORMAT ", \"leftover_mini_objects\": %" G_GINT64_FORMAT
+          ", \"leftover_bytes\": %" G_GINT64_FORMAT ", \"rss_growth_kb\": %ld}\n",
+          backend, iterations, warmup, leaking_sessions, leftover.objects, leftover.mini_objects,
+          leftover.bytes, rss_growth_kb);
+  if (leftover_types) {
+    g_printerr("Left behind after the warm-up (type count bytes):\n%s", leftover_types);
+    failed = TRUE;
+  }
+  if (rss_growth_kb > max_rss_growth_kb) {
+    g_printerr("Resident set grew by %ld kB, more than %d kB\n", rss_growth_kb, max_rss_growth_kb);
+    failed = TRUE;
+  }
+  g_free(leftover_types);
+
+  brilliant_session_set_allocation_accounting(FALSE);
+  g_bytes_unref(video_key);
+  g_bytes_unref(audio_key);
+  g_bytes_unref(talkback_key);
+  g_mutex_clear(&soak.lock);
+  g_cond_clear(&soak.cond);
+  return failed ? 1 : 0;
+}
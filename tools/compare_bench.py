@@ -0,0 +1,70 @@
+#!/usr/bin/env python3
+"""Compare two brilliant-replay-bench result files.
+
+Usage: compare_bench.py BASELINE.json CANDIDATE.json [--threshold PERCENT]
+
+Prints every metric side by side and exits with status 1 when a metric where lower is better
+regressed by more than the threshold (10% by default).
+"""
+import argparse
+import json
+import sys
+
+# Metrics where a higher value is a regression
+LOWER_IS_BETTER = [
+    "cpu_us_per_frame",
+    "peak_rss_kb",
+    "packets.dropped",
+    "jitterbuffer.lost",
+    "jitterbuffer.late",
+    "latency_ms.p50",
+    "latency_ms.p95",
+    "latency_ms.p99",
+]
+INFORMATIONAL = [
+    "frames_decoded",
+    "cpu_time_s",
+    "wall_time_s",
+    "latency_ms.samples",
+    "latency_ms.max",
+]
+
+
+def lookup(results, path):
+    value = results
+    for key in path.split("."):
+        value = value.get(key, 0) if isinstance(value, dict) else 0
+    return value
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("baseline")
+    parser.add_argument("candidate")
+    parser.add_argument("--threshold", type=float, default=10.0,
+                        help="allowed regression in percent")
+    args = parser.parse_args()
+    with open(args.baseline) as f:
+        baseline = json.load(f)
+    with open(args.candidate) as f:
+        candidate = json.load(f)
+
+    print("%-22s %14s %14s %9s" % ("metric", baseline.get("label") or "baseline",
+                                   candidate.get("label") or "candidate", "change"))
+    regressions = []
+    for metric in LOWER_IS_BETTER + INFORMATIONAL:
+        before = lookup(baseline, metric)
+        after = lookup(candidate, metric)
+        change = (after - before) * 100.0 / before if before else 0.0
+        print("%-22s %14.1f %14.1f %8.1f%%" % (metric, before, after, change))
+        if metric in LOWER_IS_BETTER and change > args.threshold:
+            regressions.append(metric)
+
+    if regressions:
+        print("Regressed: " + ", ".join(regressions))
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())